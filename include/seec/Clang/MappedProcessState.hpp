@@ -85,6 +85,10 @@ class ProcessState {
   /// Currently open DIRs.
   llvm::DenseMap<stateptr_ty, DIRState> Dirs;
   
+  /// \brief Regenerate the stream and DIR information.
+  ///
+  void cacheStreamsAndDirs();
+  
 public:
   /// \brief Constructor.
   ///
@@ -116,6 +120,16 @@ public:
   ///
   void cacheClear();
   
+  /// \brief Update cached information to reflect the changes made to the
+  ///        underlying state since the last update.
+  ///
+  /// Only the \c Value objects and mapped functions that may have changed are
+  /// discarded, so this is cheaper than cacheClear() when a movement changes
+  /// a small part of the state. Must be called following movements of the
+  /// underlying state.
+  ///
+  void cacheUpdate();
+  
   /// \brief Print a textual description of the state.
   ///
   void print(llvm::raw_ostream &Out,
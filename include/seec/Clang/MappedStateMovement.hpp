@@ -106,6 +106,11 @@ MovementResult moveForward(ProcessState &Process);
 ///
 MovementResult moveBackward(ProcessState &Process);
 
+/// \brief Move to the given (raw) process time.
+///
+MovementResult moveToProcessTime(ProcessState &Process,
+                                 uint64_t const ProcessTime);
+
 /// @} (Process-level movement.)
 //===----------------------------------------------------------------------===//
 
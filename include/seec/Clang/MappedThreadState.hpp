@@ -91,6 +91,14 @@ public:
   ///
   void cacheClear();
   
+  /// \brief Update cached information to reflect the changes made to the
+  ///        underlying state since the last update.
+  ///
+  /// Mapped functions are only regenerated if their underlying state may have
+  /// changed.
+  ///
+  void cacheUpdate();
+  
   /// \brief Print a textual description of the state.
   ///
   void print(llvm::raw_ostream &Out,
@@ -153,8 +161,10 @@ public:
   
 private:
   /// \brief Generate the mapped call stack.
+  /// \param From the number of existing mapped functions to keep (from the
+  ///        bottom of the stack).
   ///
-  void generateCallStack();
+  void generateCallStack(std::size_t From);
 
 public:
   /// \brief Get the function state of all functions on the call stack.
@@ -359,6 +359,13 @@ public:
   ///
   std::shared_ptr<Value const>
   findFromAddressAndType(stateptr_ty Address, llvm::StringRef TypeString) const;
+
+  /// \brief Remove all \c Value objects that overlap any of the given areas.
+  ///
+  /// Subsequent requests for these \c Value objects will create new objects.
+  /// Existing references to the removed objects remain valid.
+  ///
+  void invalidate(llvm::ArrayRef<MemoryArea> Areas) const;
 };
 
 
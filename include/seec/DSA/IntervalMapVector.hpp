@@ -504,7 +504,7 @@ public:
 
   /// Copy constructor.
   IntervalMapVector(IntervalMapVector const & Other)
-  : KeyComparator(Other.Comparator),
+  : KeyComparator(Other.KeyComparator),
     ValueComparator(KeyComparator),
     Allocator(Other.Allocator),
     Items(Other.Items, Other.Allocator)
@@ -512,7 +512,7 @@ public:
 
   /// Move constructor.
   IntervalMapVector(IntervalMapVector && Other)
-  : KeyComparator(Other.Comparator),
+  : KeyComparator(Other.KeyComparator),
     ValueComparator(KeyComparator),
     Allocator(Other.Allocator),
     Items()
@@ -0,0 +1,259 @@
+//===- include/seec/Trace/AllocationLifetimeTable.hpp --------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// A table of the lifetimes of all memory allocations in a process trace, used
+/// to find when an area was allocated or deallocated, and which areas are
+/// allocated at a given process time, without replaying the trace.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_ALLOCATIONLIFETIMETABLE_HPP
+#define SEEC_TRACE_ALLOCATIONLIFETIMETABLE_HPP
+
+#include "seec/DSA/MemoryArea.hpp"
+#include "seec/Trace/MemoryChangeIndex.hpp"
+#include "seec/Trace/StateCommon.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace seec {
+
+namespace trace {
+
+class EventRecordBase;
+class ProcessTrace;
+
+
+/// \brief The lifetime of a single memory allocation.
+///
+/// The birth and death of the allocation are described by MemoryChange
+/// objects, so allocations made by events that don't set a process time (such
+/// as allocas) are placed between the neighbouring process times in their
+/// thread.
+///
+/// A Realloc ends the lifetime of the allocation that it resizes and starts a
+/// new lifetime for the resized allocation. The two lifetimes are linked, so
+/// that the original allocation can be found (see
+/// AllocationLifetimeTable::getPrevious()).
+///
+class AllocationLifetime {
+public:
+  /// \brief The kinds of allocation.
+  ///
+  enum class KindTy {
+    Malloc,
+    Realloc,
+    Alloca,
+    ByVal,
+    KnownRegion
+  };
+
+private:
+  friend class AllocationLifetimeTable;
+  
+  static constexpr uint32_t noLifetime() {
+    return std::numeric_limits<uint32_t>::max();
+  }
+  
+  /// The allocated area.
+  MemoryArea Area;
+  
+  /// The kind of allocation.
+  KindTy Kind;
+  
+  /// The thread that made the allocation.
+  uint32_t ThreadID;
+  
+  /// The event that made the allocation.
+  EventRecordBase const *BirthEvent;
+  
+  /// When the allocation was made.
+  MemoryChange Birth;
+  
+  /// The event that ended the allocation, or nullptr if it was never ended.
+  EventRecordBase const *DeathEvent;
+  
+  /// When the allocation was ended (only valid if DeathEvent is set).
+  MemoryChange Death;
+  
+  /// Index of the lifetime that this one resized.
+  uint32_t Previous;
+  
+  /// Index of the lifetime that resized this one.
+  uint32_t Next;
+
+public:
+  AllocationLifetime(MemoryArea const &WithArea,
+                     KindTy const WithKind,
+                     uint32_t const WithThreadID,
+                     EventRecordBase const &WithBirthEvent,
+                     MemoryChange const &WithBirth)
+  : Area(WithArea),
+    Kind(WithKind),
+    ThreadID(WithThreadID),
+    BirthEvent(&WithBirthEvent),
+    Birth(WithBirth),
+    DeathEvent(nullptr),
+    Death(WithBirth),
+    Previous(noLifetime()),
+    Next(noLifetime())
+  {}
+  
+  /// \brief Get the allocated area.
+  ///
+  MemoryArea const &getArea() const { return Area; }
+  
+  /// \brief Get the kind of allocation.
+  ///
+  KindTy getKind() const { return Kind; }
+  
+  /// \brief Get the ID of the thread that made the allocation.
+  ///
+  uint32_t getThreadID() const { return ThreadID; }
+  
+  /// \brief Get the event that made the allocation.
+  ///
+  EventRecordBase const &getBirthEvent() const { return *BirthEvent; }
+  
+  /// \brief Get the process times at which the allocation was made.
+  ///
+  MemoryChange const &getBirth() const { return Birth; }
+  
+  /// \brief Check if the allocation was ended before the trace finished.
+  ///
+  bool hasDeath() const { return DeathEvent != nullptr; }
+  
+  /// \brief Get the event that ended the allocation.
+  /// \pre hasDeath()
+  ///
+  EventRecordBase const &getDeathEvent() const { return *DeathEvent; }
+  
+  /// \brief Get the process times at which the allocation was ended.
+  /// \pre hasDeath()
+  ///
+  MemoryChange const &getDeath() const { return Death; }
+  
+  /// \brief Get the earliest process time at which the allocation may exist.
+  ///
+  /// An allocation made by an event that doesn't set a process time may
+  /// already exist in the last state at the process time before the earliest
+  /// time of its birth.
+  ///
+  uint64_t getEarliestLive() const;
+  
+  /// \brief Check if the allocation may exist at ProcessTime.
+  ///
+  bool mayBeLiveAt(uint64_t const ProcessTime) const {
+    return getEarliestLive() <= ProcessTime
+           && (!DeathEvent || ProcessTime < Death.getLatest());
+  }
+};
+
+
+/// \brief The lifetimes of all memory allocations in a process trace.
+///
+/// The table includes dynamic memory allocations (Malloc, Realloc and
+/// CheckpointMalloc events), allocas, byval arguments, and known regions.
+/// Global variables are not included, because they exist for the entire
+/// trace.
+///
+class AllocationLifetimeTable {
+  /// \brief A dynamic memory allocation event, with its thread's context.
+  ///
+  struct DynamicEvent;
+  
+  std::vector<AllocationLifetime> Lifetimes;
+  
+  /// Indices of Lifetimes sorted by area start, then by getEarliestLive().
+  std::vector<uint32_t> ByStart;
+  
+  /// Indices of Lifetimes sorted by getEarliestLive().
+  std::vector<uint32_t> ByBirth;
+  
+  /// \brief Add the lifetimes of allocations made on the stack and of known
+  ///        regions, and collect the dynamic memory allocation events.
+  ///
+  void addThread(ProcessTrace const &Trace,
+                 uint32_t const ThreadID,
+                 std::map<stateptr_ty, uint32_t> &KnownRegions,
+                 std::vector<DynamicEvent> &Dynamic);
+  
+  /// \brief Add the lifetimes of dynamic memory allocations.
+  ///
+  void addDynamic(std::vector<DynamicEvent> &Dynamic);
+  
+  /// \brief Build the table from all events in Trace.
+  ///
+  void build(ProcessTrace const &Trace);
+  
+  AllocationLifetime const *get(uint32_t const Index) const {
+    return Index != AllocationLifetime::noLifetime() ? &Lifetimes[Index]
+                                                      : nullptr;
+  }
+
+public:
+  /// \brief Build the table for Trace.
+  ///
+  /// This reads every event in the trace.
+  ///
+  AllocationLifetimeTable(ProcessTrace const &Trace);
+  
+  ~AllocationLifetimeTable();
+  
+  AllocationLifetimeTable(AllocationLifetimeTable const &) = delete;
+  AllocationLifetimeTable &operator=(AllocationLifetimeTable const &) = delete;
+  
+  /// \brief Get all lifetimes, in no particular order.
+  ///
+  std::vector<AllocationLifetime> const &getLifetimes() const {
+    return Lifetimes;
+  }
+  
+  /// \brief Find the lifetime of the allocation that starts at Start and may
+  ///        exist at ProcessTime.
+  ///
+  /// If several such lifetimes exist (e.g. a function that was called several
+  /// times between two process times), then this gets the latest.
+  ///
+  /// \return the lifetime, or nullptr if there is no such allocation.
+  ///
+  AllocationLifetime const *find(stateptr_ty const Start,
+                                 uint64_t const ProcessTime) const;
+  
+  /// \brief Get the lifetime that Lifetime resized, if any.
+  ///
+  AllocationLifetime const *getPrevious(AllocationLifetime const &Lifetime)
+  const {
+    return get(Lifetime.Previous);
+  }
+  
+  /// \brief Get the lifetime that resized Lifetime, if any.
+  ///
+  AllocationLifetime const *getNext(AllocationLifetime const &Lifetime) const {
+    return get(Lifetime.Next);
+  }
+  
+  /// \brief Get all allocations that may exist at ProcessTime.
+  ///
+  /// The result is sorted by getEarliestLive().
+  ///
+  std::vector<AllocationLifetime const *>
+  getLiveAt(uint64_t const ProcessTime) const;
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_ALLOCATIONLIFETIMETABLE_HPP
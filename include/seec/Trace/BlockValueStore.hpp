@@ -23,6 +23,7 @@
 #include <type_safe/types.hpp>
 
 #include <memory>
+#include <vector>
 
 namespace llvm {
   class BasicBlock;
@@ -193,6 +194,15 @@ public:
   ///
   BasicBlockStore(BasicBlockInfo const &Info);
 
+  /// \brief Copy another store for the same \c BasicBlock.
+  ///
+  BasicBlockStore(BasicBlockInfo const &Info, BasicBlockStore const &Other);
+  
+  /// \brief Mark every \c Instruction as having no runtime value, so that
+  ///        this store can be reused.
+  ///
+  void clear();
+  
   /// \brief Check if the given \c Instruction has a runtime value.
   /// \param Info the \c BasicBlockInfo for this \c BasicBlock.
   /// \param InstrIndex the function-level-index of the \c Instruction.
@@ -280,6 +290,45 @@ public:
                                            InstrIndexInFn const Instr) const;
 };
 
+/// \brief Holds unused \c BasicBlockStore s so that they can be reused.
+///
+/// Loops and repeated calls would otherwise allocate a new store every time a
+/// \c BasicBlock becomes active. Stores are kept separately for each
+/// \c BasicBlock, because their size depends on the \c BasicBlock.
+///
+class BasicBlockStorePool {
+  /// Unused stores for each \c BasicBlock.
+  llvm::DenseMap<llvm::BasicBlock const *,
+                 std::vector<std::unique_ptr<BasicBlockStore>>> m_Unused;
+  
+  /// \brief Get the maximum number of unused stores kept for a single
+  ///        \c BasicBlock.
+  ///
+  static constexpr std::size_t getMaxUnusedPerBlock() { return 4; }
+  
+public:
+  /// \brief Constructor.
+  ///
+  BasicBlockStorePool();
+  
+  BasicBlockStorePool(BasicBlockStorePool const &) = delete;
+  BasicBlockStorePool &operator=(BasicBlockStorePool const &) = delete;
+  
+  /// \brief Get an empty store for a \c BasicBlock.
+  /// \param BB the \c BasicBlock.
+  /// \param Info the \c BasicBlockInfo for BB.
+  ///
+  std::unique_ptr<BasicBlockStore> acquire(llvm::BasicBlock const *BB,
+                                           BasicBlockInfo const &Info);
+  
+  /// \brief Return a store that is no longer used.
+  /// \param BB the \c BasicBlock that Store was acquired for.
+  /// \param Store the store.
+  ///
+  void release(llvm::BasicBlock const *BB,
+               std::unique_ptr<BasicBlockStore> Store);
+};
+
 } // value_store
 
 } // namespace trace (in seec)
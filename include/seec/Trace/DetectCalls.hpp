@@ -334,16 +334,16 @@ public:
   : CallLookup(WithLookup)
   {}
   
+  /// \brief Notify the listener of a call to a known function.
+  ///
+  /// This is used directly when the instrumentation identified the callee.
+  ///
   bool detectPreCall(llvm::CallInst const *Instruction,
                      InstrIndexInFn Index,
-                     void const *Address) {
+                     seec::trace::detect_calls::Call C) {
     using namespace seec::trace::detect_calls;
     
-    auto MaybeCall = CallLookup.Check(Address);
-    if (!MaybeCall.assigned())
-      return false;
-    
-    switch (MaybeCall.template get<0>()) {
+    switch (C) {
 #define DETECT_CALL(PREFIX, NAME, ARGTYPES)                                    \
       case Call::PREFIX##NAME:                                                 \
         return ExtractAndNotify<true, Call::PREFIX##NAME>                      \
@@ -358,16 +358,30 @@ public:
     return false;
   }
   
-  bool detectPostCall(llvm::CallInst const *Instruction,
-                      InstrIndexInFn Index,
-                      void const *Address) {
-    using namespace seec::trace::detect_calls;
-    
+  /// \brief Notify the listener if a call is to a known function.
+  ///
+  /// This is used for indirect calls, which require the callee's address to
+  /// be looked up.
+  ///
+  bool detectPreCall(llvm::CallInst const *Instruction,
+                     InstrIndexInFn Index,
+                     void const *Address) {
     auto MaybeCall = CallLookup.Check(Address);
     if (!MaybeCall.assigned())
       return false;
     
-    switch (MaybeCall.template get<0>()) {
+    return detectPreCall(Instruction, Index, MaybeCall.template get<0>());
+  }
+  
+  /// \brief Notify the listener of the completion of a call to a known
+  ///        function.
+  ///
+  bool detectPostCall(llvm::CallInst const *Instruction,
+                      InstrIndexInFn Index,
+                      seec::trace::detect_calls::Call C) {
+    using namespace seec::trace::detect_calls;
+    
+    switch (C) {
 #define DETECT_CALL(PREFIX, NAME, ARGTYPES)                                    \
       case Call::PREFIX##NAME:                                                 \
         return ExtractAndNotify<false, Call::PREFIX##NAME>                     \
@@ -382,6 +396,18 @@ public:
     return false;
   }
   
+  /// \brief Notify the listener if a completed call was to a known function.
+  ///
+  bool detectPostCall(llvm::CallInst const *Instruction,
+                      InstrIndexInFn Index,
+                      void const *Address) {
+    auto MaybeCall = CallLookup.Check(Address);
+    if (!MaybeCall.assigned())
+      return false;
+    
+    return detectPostCall(Instruction, Index, MaybeCall.template get<0>());
+  }
+  
   // Define empty notification functions that will be called if SubclassT does
   // not implement a notification function.
 #define DETECT_CALL(PREFIX, NAME, ARGTYPES)                                    \
@@ -56,6 +56,21 @@ constexpr bool isKnownToDetectCall(seec::const_strings::StringRef const Fn) {
 }
 
 
+/// \brief Get the detectable Call for a function name, if there is one.
+///
+/// This allows the instrumentation to identify direct calls to detectable
+/// functions, so that the runtime doesn't need to look up their addresses.
+///
+inline seec::Maybe<Call> getCallForName(llvm::StringRef const Name) {
+#define DETECT_CALL(PREFIX, NAME, ARGTYPES)                                    \
+  if (Name.equals(#NAME))                                                      \
+    return Call::PREFIX ## NAME;
+#include "DetectCallsAll.def"
+
+  return seec::Maybe<Call>();
+}
+
+
 /// \brief Store the run-time locations of functions known to DetectCall.
 ///
 /// It is not thread-safe to call Set() while other threads may be calling
@@ -27,6 +27,7 @@
 #include "llvm/IR/Instructions.h"
 
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <vector>
 
@@ -46,12 +47,15 @@ class FunctionIndex;
 
 namespace trace {
 
+class EventReference;
 class FunctionState;
 class FunctionTrace;
 class ThreadState;
 
 namespace value_store {
+  class BasicBlockInfo;
   class BasicBlockStore;
+  class BasicBlockStorePool;
   class FunctionInfo;
   class ModuleInfo;
 }
@@ -287,13 +291,53 @@ class FunctionState {
                  std::unique_ptr<value_store::BasicBlockStore>>
     ActiveBlocks;
   
-  /// History of backwards BasicBlock jumps.
-  std::vector<BasicBlockBackwardsJumpRecord> BackwardsJumps;
+  /// History of the most recent backwards BasicBlock jumps. Older jumps are
+  /// forgotten, and the BasicBlocks that they cleared are recreated from the
+  /// trace if we rewind over them (see restoreClearedBlocks()).
+  std::deque<BasicBlockBackwardsJumpRecord> BackwardsJumps;
   
-  /// Information about BasicBlocks cleared by backwards jumps.
-  std::vector<std::pair<llvm::BasicBlock const *,
-                        std::unique_ptr<value_store::BasicBlockStore>>>
+  /// Information about BasicBlocks cleared by the jumps in BackwardsJumps.
+  std::deque<std::pair<llvm::BasicBlock const *,
+                       std::unique_ptr<value_store::BasicBlockStore>>>
     ClearedBlocks;
+  
+  /// \brief Get the maximum number of backwards jumps kept in BackwardsJumps.
+  ///
+  static constexpr std::size_t getMaxRetainedBackwardsJumps() { return 64; }
+  
+  /// \brief Get the pool used to allocate BasicBlock stores.
+  ///
+  value_store::BasicBlockStorePool &getStorePool();
+  
+  /// \brief Make a new, empty store active for a BasicBlock.
+  ///
+  /// Any store that was already active for BB is returned to the pool.
+  ///
+  void activateEmptyStore(llvm::BasicBlock const *BB);
+  
+  /// \brief Recreate the BasicBlocks cleared by a forgotten backwards jump.
+  /// \param FromEvent the instruction event that the jump was made from.
+  ///
+  /// This reads the instruction events that precede the jump, until it finds
+  /// the point at which each of the cleared BasicBlocks was last cleared.
+  ///
+  void restoreClearedBlocks(EventReference const &FromEvent);
+  
+  /// \brief Recompute the value of an Instruction that was not recorded.
+  ///
+  /// If the value of the Instruction at Index is recomputed during replay
+  /// (see seec/Util/RecomputedValues.hpp) and Store doesn't hold it yet, then
+  /// evaluate it from its operands' values and add it to Store. Store thereby
+  /// caches recomputed values until its BasicBlock is cleared.
+  ///
+  void recomputeValue(value_store::BasicBlockStore &Store,
+                      value_store::BasicBlockInfo const &Info,
+                      InstrIndexInFn const Index,
+                      llvm::Instruction const *I) const;
+
+  /// \brief Copy Other, but belong to WithParent.
+  ///
+  FunctionState(ThreadState &WithParent, FunctionState const &Other);
 
 public:
   /// \brief Constructor.
@@ -312,6 +356,16 @@ public:
   ///
   ~FunctionState();
 
+  /// \brief Create a copy of this state that belongs to \c WithParent.
+  ///
+  /// This is used to take and restore snapshots of a \c ThreadState.
+  ///
+  std::unique_ptr<FunctionState> clone(ThreadState &WithParent) const;
+  
+  /// \brief Get the approximate number of bytes used by this state.
+  ///
+  std::size_t getApproximateSize() const;
+  
   /// \name Accessors.
   /// @{
 
@@ -369,8 +423,17 @@ public:
   
   /// \brief Notify that we are moving backward to the given Instruction index.
   /// \param Index index of the \c llvm::Instruction we are moving to.
+  /// \param Event the instruction event that we are moving to.
+  ///
+  void rewindingToInstruction(InstrIndexInFn const Index,
+                              EventReference const &Event);
+  
+  /// \brief Return all BasicBlock stores to the thread's pool.
+  ///
+  /// This should be used when the function is removed from the call stack.
+  /// No runtime values will be available afterwards.
   ///
-  void rewindingToInstruction(InstrIndexInFn const Index);
+  void releaseBasicBlockStores();
   
   /// \brief Set the index of the active \c llvm::Instruction and mark it as
   ///        having completed execution.
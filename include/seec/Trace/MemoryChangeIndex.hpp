@@ -0,0 +1,146 @@
+//===- include/seec/Trace/MemoryChangeIndex.hpp --------------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// An index of the changes made to memory by a process trace, used to find
+/// when an area of memory changes without replaying the whole trace (see
+/// moveForwardUntilMemoryChanges()).
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_MEMORYCHANGEINDEX_HPP
+#define SEEC_TRACE_MEMORYCHANGEINDEX_HPP
+
+#include "seec/DSA/MemoryArea.hpp"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace seec {
+
+namespace trace {
+
+class ProcessTrace;
+
+
+/// \brief A change that may have been made to an area of memory.
+///
+/// The change is not visible before process time getEarliest(), and is
+/// always visible from process time getLatest(). For events that set a
+/// process time these are both the event's process time. Changes made by
+/// events that don't set a process time (such as stack allocations) are
+/// placed between the neighbouring process times in their thread.
+///
+class MemoryChange {
+  uint64_t Earliest;
+  
+  uint64_t Latest;
+
+public:
+  MemoryChange(uint64_t const WithEarliest, uint64_t const WithLatest)
+  : Earliest(WithEarliest),
+    Latest(WithLatest)
+  {}
+  
+  uint64_t getEarliest() const { return Earliest; }
+  
+  uint64_t getLatest() const { return Latest; }
+};
+
+
+/// \brief Indexes the process times at which each area of memory may change.
+///
+/// Changes are indexed by page, and each page's changes are sorted by process
+/// time, so a query takes time logarithmic in the number of changes to the
+/// pages that it covers (plus a scan over changes to other parts of those
+/// pages). The index includes writes (StateUntyped, StateUntypedSmall,
+/// StateMemmove and StateClear events), dynamic memory allocation (Malloc,
+/// Free and Realloc events), and the allocation and deallocation of allocas
+/// and byval arguments.
+///
+/// The index may include changes that don't modify the memory's value (e.g.
+/// writing the value that was already held), so callers should check each
+/// result.
+///
+class MemoryChangeIndex {
+  /// Each page covers (1 << getPageShift()) bytes of memory.
+  static constexpr unsigned getPageShift() { return 12; }
+  
+  /// \brief A change to a part of a single page.
+  ///
+  struct Entry {
+    uint64_t Earliest;
+    
+    uint64_t Latest;
+    
+    /// Offset of the first byte changed, from the start of the page.
+    uint16_t Begin;
+    
+    /// Offset of the byte following the last byte changed.
+    uint16_t End;
+  };
+  
+  /// \brief All changes to a single page.
+  ///
+  struct Page {
+    /// Changes sorted by their latest process time.
+    std::vector<Entry> ByLatest;
+    
+    /// Indices into ByLatest, sorted by the changes' earliest process time.
+    std::vector<uint32_t> ByEarliest;
+  };
+  
+  /// Map from page numbers to pages.
+  llvm::DenseMap<uint64_t, Page> Pages;
+  
+  /// \brief Add a change to the index.
+  ///
+  void add(MemoryArea const &Area, uint64_t const Earliest,
+           uint64_t const Latest);
+  
+  /// \brief Build the index from all events in Trace.
+  ///
+  void build(ProcessTrace const &Trace);
+
+public:
+  /// \brief Build the index for Trace.
+  ///
+  /// This reads every event in the trace.
+  ///
+  MemoryChangeIndex(ProcessTrace const &Trace);
+  
+  MemoryChangeIndex(MemoryChangeIndex const &) = delete;
+  MemoryChangeIndex &operator=(MemoryChangeIndex const &) = delete;
+  
+  /// \brief Find the change to Area with the lowest latest process time
+  ///        after ProcessTime.
+  ///
+  /// This is the next change that may not be visible at ProcessTime.
+  ///
+  llvm::Optional<MemoryChange> findNext(MemoryArea const &Area,
+                                        uint64_t const ProcessTime) const;
+  
+  /// \brief Find the change to Area with the highest earliest process time
+  ///        at or before ProcessTime.
+  ///
+  /// This is the previous change that may be visible at ProcessTime.
+  ///
+  llvm::Optional<MemoryChange> findPrevious(MemoryArea const &Area,
+                                            uint64_t const ProcessTime) const;
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_MEMORYCHANGEINDEX_HPP
@@ -20,9 +20,10 @@
 
 #include "llvm/ADT/ArrayRef.h"
 
-#include <stack>
-#include <thread>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <thread>
 #include <vector>
 
 namespace llvm {
@@ -36,19 +37,60 @@ namespace trace {
 
 /// \brief A single recreated memory allocation.
 ///
+/// The allocation's value and initialization are stored in fixed-size pages,
+/// with one initialization bit per byte. Pages are shared between copies of
+/// an allocation (e.g. in snapshots of a \c MemoryState), and are copied
+/// before they are modified. Pages that have never been initialized are not
+/// allocated.
+///
 class MemoryAllocation {
+  /// The log2 of the number of bytes in a page.
+  static constexpr std::size_t PageShift = 12;
+
+  /// The number of bytes in a page.
+  static constexpr std::size_t PageSize = std::size_t(1) << PageShift;
+
+  /// \brief Get the log2 of the number of bytes in a page.
+  ///
+  static constexpr std::size_t getPageShift() { return PageShift; }
+
+  /// \brief Get the number of bytes in a page.
+  ///
+  static constexpr std::size_t getPageSize() { return PageSize; }
+
+  /// \brief The value and initialization of a single page.
+  ///
+  struct Page {
+    /// The value of each \c char in the page.
+    char Data[PageSize];
+
+    /// The initialization of each \c char in the page, one bit per \c char
+    /// (a 1 bit is initialized and a 0 is uninitialized).
+    uint64_t Init[PageSize / 64];
+  };
+
+  /// \brief The part of a single page that is covered by an area.
+  ///
+  struct PagePart {
+    /// The index of the page.
+    std::size_t Index;
+
+    /// Offset of the first covered byte in the page.
+    std::size_t Begin;
+
+    /// Offset of the byte following the last covered byte in the page.
+    std::size_t End;
+  };
+
   /// The address that this allocation starts at.
   stateptr_ty Address;
 
   /// The size of this allocation (in \c char units).
   std::size_t Size;
 
-  /// The value of each \c char in this allocation.
-  std::vector<char> Data;
-
-  /// The initialization of each \c char in this allocation (truth indicates
-  /// initialization, i.e. a 1 bit is initialized and a 0 is uninitialized).
-  std::vector<unsigned char> Init;
+  /// The pages of this allocation (nullptr for uninitialized pages). Pages
+  /// are shared with copies of this allocation.
+  std::vector<std::shared_ptr<Page>> Pages;
 
   /// Determines the initialization of a "saved" area (overwritten or cleared).
   enum class EPreviousAreaType : uint8_t {
@@ -57,25 +99,55 @@ class MemoryAllocation {
     Complete
   };
 
-  /// Determines the initialization of all "saved" areas, in order from oldest
-  /// to most recent (i.e. the most recent is at the end of the vector).
+  /// Determines the initialization of the edges of all "saved" areas, in order
+  /// from oldest to most recent (i.e. the most recent is at the end of the
+  /// vector).
   std::vector<EPreviousAreaType> PreviousType;
 
-  /// Holds the value of "saved" areas, in order from oldest to most recent.
-  /// For example, if the most recently saved area was 4 chars, then the final
-  /// 4 chars of this vector will hold the saved chars (if the type is either
-  /// \c EPreviousAreaType::Partial or \c EPreviousAreaType::Complete.
+  /// Holds the value of the edges of "saved" areas, in order from oldest to
+  /// most recent. For example, if the most recently saved area had 4 chars in
+  /// its edges, then the final 4 chars of this vector will hold the saved
+  /// chars (if the type is either \c EPreviousAreaType::Partial or
+  /// \c EPreviousAreaType::Complete.
   std::vector<char> PreviousData;
 
-  /// Holds the initialization of "saved" areas, in order from oldest to most
-  /// recent. For example, if the most recently saved area was 4 chars, then
-  /// the final 4 chars of this vector will hold its initialization (if the
-  /// type is \c EPreviousAreaType::Partial.
+  /// Holds the initialization of the edges of "saved" areas, packed eight
+  /// chars to a byte, in order from oldest to most recent (only if the type is
+  /// \c EPreviousAreaType::Partial).
   std::vector<unsigned char> PreviousInit;
 
-  MemoryAllocation(MemoryAllocation const &) = delete;
+  /// Holds the pages that were completely covered by "saved" areas, in order
+  /// from oldest to most recent. These are the retired pages themselves, so
+  /// saving them doesn't copy any bytes.
+  std::vector<std::shared_ptr<Page>> PreviousPages;
+
   MemoryAllocation &operator=(MemoryAllocation const &) = delete;
 
+  /// \brief Call Fn(PagePart const &) for each page covered by the Length
+  ///        chars starting at Offset, in order, until Fn returns false.
+  ///
+  /// \return true iff Fn returned true for every page.
+  ///
+  template<typename FnT>
+  static bool forEachPagePart(std::size_t const Offset,
+                              std::size_t const Length,
+                              FnT &&Fn);
+
+  /// \brief Get a page, which may be shared with other allocations.
+  ///
+  Page const *getPage(std::size_t const Index) const {
+    return Pages[Index].get();
+  }
+
+  /// \brief Get a page that is owned by this allocation alone, copying or
+  ///        creating it if necessary.
+  ///
+  Page &getWritablePage(std::size_t const Index);
+
+  /// \brief Set the initialization of part of a page.
+  ///
+  void setInitialization(PagePart const &Part, bool const Initialized);
+
 public:
   /// \brief Construct a new \c MemoryAllocation.
   ///
@@ -83,13 +155,21 @@ public:
                             std::size_t const WithSize)
   : Address(WithAddress),
     Size(WithSize),
-    Data(Size),
-    Init(Size),
+    Pages((WithSize + getPageSize() - 1) >> getPageShift()),
     PreviousType(),
     PreviousData(),
-    PreviousInit()
+    PreviousInit(),
+    PreviousPages()
   {}
 
+  /// \brief Copy a \c MemoryAllocation (including its history).
+  ///
+  /// The pages are shared with the copy, but the history of partially
+  /// overwritten pages is copied. This is explicit because it is only used to
+  /// take snapshots of a \c MemoryState.
+  ///
+  explicit MemoryAllocation(MemoryAllocation const &Other) = default;
+  
   MemoryAllocation(MemoryAllocation &&Other) = default;
   MemoryAllocation &operator=(MemoryAllocation &&RHS) = default;
 
@@ -103,27 +183,45 @@ public:
 
   /// \brief Get the raw values of the allocated \c chars.
   ///
-  llvm::ArrayRef<char>
-  getAreaData(MemoryArea const &Area) const;
+  std::vector<char> getAreaData(MemoryArea const &Area) const;
 
-  /// \brief Get the initialization of the allocated \c chars.
+  /// \brief Get the initialization of the allocated \c chars (one \c char
+  ///        per byte, which is zero if the byte is uninitialized).
   ///
-  llvm::ArrayRef<unsigned char>
+  std::vector<unsigned char>
   getAreaInitialization(MemoryArea const &Area) const;
 
+  /// \brief Find out if the bytes in Area are initialized.
+  ///
+  bool isAreaCompletelyInitialized(MemoryArea const &Area) const;
+
+  /// \brief Find out if any byte in Area is initialized.
+  ///
+  bool isAreaPartiallyInitialized(MemoryArea const &Area) const;
+
+  /// \brief Find out if all bytes in Area are uninitialized.
+  ///
+  bool isAreaUninitialized(MemoryArea const &Area) const;
+
   /// \brief Find out if the contained bytes are initialized.
   ///
-  bool isCompletelyInitialized() const;
+  bool isCompletelyInitialized() const {
+    return isAreaCompletelyInitialized(MemoryArea(Address, Size));
+  }
 
   /// \brief Find out if any contained byte is initialized.
   /// If the region is completely initialized, this method will also return
   /// true.
   ///
-  bool isPartiallyInitialized() const;
+  bool isPartiallyInitialized() const {
+    return isAreaPartiallyInitialized(MemoryArea(Address, Size));
+  }
 
   /// \brief Find out if all contained bytes are uninitialized.
   ///
-  bool isUninitialized() const;
+  bool isUninitialized() const {
+    return isAreaUninitialized(MemoryArea(Address, Size));
+  }
 
   /// \brief Add a new \c MappedMemoryBlock, updating the value and
   ///        initialization of the contained memory.
@@ -153,6 +251,13 @@ public:
   ///        will be uninitialized.
   ///
   void resize(std::size_t const NewSize);
+  
+  /// \brief Get the approximate number of bytes used by this allocation and
+  ///        its history.
+  ///
+  /// Pages that are shared with other allocations are divided between them.
+  ///
+  std::size_t getApproximateSize() const;
 };
 
 
@@ -215,13 +320,13 @@ public:
 
   /// \brief Find out whether each contained byte is initialized.
   ///
-  llvm::ArrayRef<unsigned char> getByteInitialization() const;
+  std::vector<unsigned char> getByteInitialization() const;
 
   /// \brief Find out the value of each contained byte.
   ///
   /// Uninitialized bytes will have a value of zero.
   ///
-  llvm::ArrayRef<char> getByteValues() const;
+  std::vector<char> getByteValues() const;
 
   /// @}
 };
@@ -237,11 +342,24 @@ class MemoryState {
   /// Map allocation start addresses to the allocations themselves.
   std::map<stateptr_ty, MemoryAllocation> Allocations;
 
-  /// Historical allocations (that were deallocated).
-  std::stack<MemoryAllocation> PreviousAllocations;
+  /// Historical allocations (that were deallocated), from oldest to youngest.
+  std::vector<MemoryAllocation> PreviousAllocations;
+
+  /// Areas changed since the last call to clearChanges().
+  std::vector<MemoryArea> ChangedAreas;
 
-  // Don't allow copying
-  MemoryState(MemoryState const &) = delete;
+  /// true iff too many areas have changed to record them all.
+  bool ChangesOverflowed;
+
+  /// \brief Get the maximum number of areas recorded in ChangedAreas.
+  ///
+  static constexpr std::size_t getMaxChangedAreas() { return 1u << 16; }
+
+  /// \brief Record that an area's allocation, value or initialization changed.
+  ///
+  void addChangedArea(MemoryArea const &Area);
+
+  // Don't allow copy assignment
   MemoryState &operator=(MemoryState const &) = delete;
 
 public:
@@ -249,9 +367,29 @@ public:
   ///
   MemoryState()
   : Allocations(),
-    PreviousAllocations()
+    PreviousAllocations(),
+    ChangedAreas(),
+    ChangesOverflowed(false)
   {}
 
+  /// \brief Copy a MemoryState (including its history).
+  ///
+  /// The allocations' pages are shared with the copy. This is explicit
+  /// because it is only used to take snapshots of a \c ProcessState.
+  ///
+  /// The copy doesn't know which areas have changed, so it reports that all
+  /// areas have changed (see haveChangesOverflowed()).
+  ///
+  explicit MemoryState(MemoryState const &Other)
+  : Allocations(Other.Allocations),
+    PreviousAllocations(Other.PreviousAllocations),
+    ChangedAreas(),
+    ChangesOverflowed(true)
+  {}
+  
+  MemoryState(MemoryState &&) = default;
+  MemoryState &operator=(MemoryState &&) = default;
+  
 
   /// \name Accessors
   /// @{
@@ -358,6 +496,40 @@ public:
   }
 
   /// @} (Regions)
+
+
+  /// \name Change tracking
+  /// @{
+
+  /// \brief Check if all areas must be treated as changed since the last call
+  ///        to clearChanges().
+  ///
+  /// This is the case when too many areas changed to record them, or when this
+  /// state was copied from another state.
+  ///
+  bool haveChangesOverflowed() const { return ChangesOverflowed; }
+
+  /// \brief Get the areas whose allocation, value or initialization changed
+  ///        since the last call to clearChanges().
+  ///
+  /// An area may be listed more than once. This is empty if
+  /// haveChangesOverflowed() is true.
+  ///
+  std::vector<MemoryArea> const &getChangedAreas() const {
+    return ChangedAreas;
+  }
+
+  /// \brief Forget all recorded changes.
+  ///
+  void clearChanges();
+
+  /// @} (Change tracking)
+  
+  
+  /// \brief Get the approximate number of bytes used by this state and its
+  ///        history.
+  ///
+  std::size_t getApproximateSize() const;
 };
 
 /// \brief Print a textual description of a MemoryState.
@@ -17,6 +17,7 @@
 #include "seec/DSA/IntervalMapVector.hpp"
 #include "seec/Trace/MemoryState.hpp"
 #include "seec/Trace/StateCommon.hpp"
+#include "seec/Trace/StateSnapshot.hpp"
 #include "seec/Trace/StreamState.hpp"
 #include "seec/Trace/ThreadState.hpp"
 
@@ -38,9 +39,12 @@ namespace llvm {
 namespace seec {
 
 class ModuleIndex;
+class WorkerPool;
 
 namespace trace {
 
+class AllocationLifetimeTable;
+class MemoryChangeIndex;
 class ProcessTrace;
 
 namespace value_store {
@@ -110,6 +114,7 @@ public:
 ///
 class ProcessState {
   friend class ThreadState; // Allow child threads to update the shared state.
+  friend class ProcessStateSnapshot; // Allow snapshots to copy the state.
 
   /// \name Constants
   /// @{
@@ -136,6 +141,10 @@ private:
   /// The synthetic process time that this state represents.
   std::atomic<uint64_t> ProcessTime;
 
+  /// The earliest process time that this state can represent. This is only
+  /// non-zero if the oldest events were dropped by the flight recorder.
+  uint64_t StartProcessTime;
+  
   /// Thread states, indexed by (ThreadID - 1).
   std::vector<std::unique_ptr<ThreadState>> ThreadStates;
 
@@ -163,6 +172,19 @@ private:
   /// @} (Variable data.)
 
 
+  /// Snapshots of this state, used to move to arbitrary process times.
+  std::unique_ptr<ProcessStateSnapshotIndex> Snapshots;
+  
+  /// Worker threads used to move the thread states concurrently.
+  std::unique_ptr<WorkerPool> MovementWorkers;
+  
+  /// Index of changes to memory (created when first required).
+  std::unique_ptr<MemoryChangeIndex> MemoryChanges;
+  
+  /// Table of allocation lifetimes (created when first required).
+  std::unique_ptr<AllocationLifetimeTable> AllocationLifetimes;
+  
+  
   // Don't allow copying.
   ProcessState(ProcessState const &Other) = delete;
   ProcessState &operator=(ProcessState const &RHS) = delete;
@@ -202,6 +224,10 @@ public:
   ///
   uint64_t getProcessTime() const { return ProcessTime; }
   
+  /// \brief Get the earliest process time that this state can represent.
+  ///
+  uint64_t getStartProcessTime() const { return StartProcessTime; }
+  
   /// \brief Get the vector of thread states.
   ///
   decltype(ThreadStates) const &getThreadStates() const { return ThreadStates; }
@@ -224,6 +250,30 @@ public:
     return *(ThreadStates[ThreadID - 1]);
   }
 
+  /// \brief Get the snapshots of this state.
+  ///
+  ProcessStateSnapshotIndex &getSnapshots() { return *Snapshots; }
+  
+  /// \brief Get the snapshots of this state.
+  ///
+  ProcessStateSnapshotIndex const &getSnapshots() const { return *Snapshots; }
+  
+  /// \brief Get the worker threads used to move the thread states.
+  ///
+  WorkerPool &getMovementWorkers() { return *MovementWorkers; }
+  
+  /// \brief Get the index of changes to memory in the trace.
+  ///
+  /// The index is built when this is first called.
+  ///
+  MemoryChangeIndex const &getMemoryChangeIndex();
+  
+  /// \brief Get the lifetimes of all memory allocations in the trace.
+  ///
+  /// The table is built when this is first called.
+  ///
+  AllocationLifetimeTable const &getAllocationLifetimes();
+  
   /// @} (Accessors.)
   
   
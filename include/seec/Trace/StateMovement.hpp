@@ -73,6 +73,19 @@ MovementResult moveForward(ProcessState &State);
 ///
 MovementResult moveBackward(ProcessState &State);
 
+/// \brief Move State to the given process time.
+///
+/// State is restored from the nearest snapshot (see \c StateSnapshot.hpp),
+/// if that is closer than its current time, and the remaining events are
+/// replayed. Snapshots are taken as State moves forward, so later movements
+/// to nearby process times are fast.
+///
+/// \param ProcessTime the target process time, which is clamped to the
+///        process times that the trace covers.
+///
+MovementResult moveToProcessTime(ProcessState &State,
+                                 uint64_t const ProcessTime);
+
 /// \brief Move State forward until the memory state in Area changes.
 ///
 MovementResult moveForwardUntilMemoryChanges(ProcessState &State,
@@ -83,6 +96,40 @@ MovementResult moveForwardUntilMemoryChanges(ProcessState &State,
 MovementResult moveBackwardUntilMemoryChanges(ProcessState &State,
                                               MemoryArea const &Area);
 
+/// \brief Move State to the allocation of the area that contains Address.
+///
+/// State is moved to the earliest process time at which the area is
+/// allocated, using the process's AllocationLifetimeTable.
+///
+MovementResult moveToAllocation(ProcessState &State,
+                                stateptr_ty const Address);
+
+/// \brief Move State to the deallocation of the area that contains Address.
+///
+/// State is moved to the latest process time at which the area is allocated,
+/// using the process's AllocationLifetimeTable.
+///
+MovementResult moveToDeallocation(ProcessState &State,
+                                  stateptr_ty const Address);
+
+/// \brief Move State to the allocation of the area that contains Address, by
+///        searching backward until the area is not allocated.
+///
+/// This doesn't use the AllocationLifetimeTable. It is the fallback for
+/// moveToAllocation().
+///
+MovementResult searchForAllocation(ProcessState &State,
+                                   stateptr_ty const Address);
+
+/// \brief Move State to the deallocation of the area that contains Address,
+///        by searching forward until the area is not allocated.
+///
+/// This doesn't use the AllocationLifetimeTable. It is the fallback for
+/// moveToDeallocation().
+///
+MovementResult searchForDeallocation(ProcessState &State,
+                                     stateptr_ty const Address);
+
 /// \brief Move \c State to the write to \c Stream that produced the character
 ///        at \c Position.
 ///
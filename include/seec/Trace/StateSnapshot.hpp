@@ -0,0 +1,157 @@
+//===- include/seec/Trace/StateSnapshot.hpp ------------------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Snapshots of a ProcessState, used to move quickly to arbitrary process
+/// times (see moveToProcessTime()).
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_STATESNAPSHOT_HPP
+#define SEEC_TRACE_STATESNAPSHOT_HPP
+
+#include "llvm/ADT/Optional.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+namespace seec {
+
+namespace trace {
+
+class ProcessState;
+class ProcessStateSnapshot;
+
+
+/// \brief Holds snapshots of a single \c ProcessState, indexed by process
+///        time.
+///
+/// A snapshot is due when no snapshot exists within getInterval() process
+/// times before the current time. When the snapshots exceed the memory budget,
+/// the interval is doubled and the snapshots are thinned to match it, so the
+/// snapshots remain evenly spread over the trace.
+///
+class ProcessStateSnapshotIndex {
+  /// The minimum number of process times between snapshots.
+  uint64_t m_Interval;
+  
+  /// The maximum number of bytes that the snapshots may use.
+  std::size_t m_MemoryBudget;
+  
+  /// The approximate number of bytes used by the snapshots.
+  std::size_t m_MemoryUsed;
+  
+  /// The snapshots, indexed by process time.
+  std::map<uint64_t, std::unique_ptr<ProcessStateSnapshot>> m_Snapshots;
+  
+  /// \brief Remove snapshots until the memory budget is satisfied.
+  ///
+  void enforceMemoryBudget();
+
+public:
+  /// \brief Get the default interval between snapshots.
+  ///
+  static constexpr uint64_t getDefaultInterval() { return 1u << 14; }
+  
+  /// \brief Get the default memory budget (256 MiB).
+  ///
+  static constexpr std::size_t getDefaultMemoryBudget() { return 256u << 20; }
+  
+  /// \brief Construct an empty index with the default settings.
+  ///
+  ProcessStateSnapshotIndex();
+  
+  ProcessStateSnapshotIndex(ProcessStateSnapshotIndex const &) = delete;
+  ProcessStateSnapshotIndex &
+  operator=(ProcessStateSnapshotIndex const &) = delete;
+  
+  /// \brief Destructor.
+  ///
+  ~ProcessStateSnapshotIndex();
+  
+  
+  /// \name Settings
+  /// @{
+  
+  /// \brief Get the minimum number of process times between snapshots.
+  ///
+  uint64_t getInterval() const { return m_Interval; }
+  
+  /// \brief Set the minimum number of process times between snapshots.
+  ///
+  /// Existing snapshots are kept.
+  ///
+  void setInterval(uint64_t const Interval);
+  
+  /// \brief Get the maximum number of bytes that the snapshots may use.
+  ///
+  std::size_t getMemoryBudget() const { return m_MemoryBudget; }
+  
+  /// \brief Set the maximum number of bytes that the snapshots may use.
+  ///
+  /// Existing snapshots are thinned if they exceed the new budget. A budget
+  /// of zero disables snapshots.
+  ///
+  void setMemoryBudget(std::size_t const Bytes);
+  
+  /// @} (Settings)
+  
+  
+  /// \name Queries
+  /// @{
+  
+  /// \brief Get the approximate number of bytes used by the snapshots.
+  ///
+  std::size_t getMemoryUsed() const { return m_MemoryUsed; }
+  
+  /// \brief Get the number of snapshots.
+  ///
+  std::size_t size() const { return m_Snapshots.size(); }
+  
+  /// \brief Check if a snapshot should be taken at the given process time.
+  ///
+  bool isSnapshotDue(uint64_t const ProcessTime) const;
+  
+  /// \brief Get the time of the latest snapshot at or before ProcessTime.
+  ///
+  llvm::Optional<uint64_t> getLatestAtOrBefore(uint64_t const ProcessTime)
+  const;
+  
+  /// @} (Queries)
+  
+  
+  /// \name Mutators
+  /// @{
+  
+  /// \brief Take a snapshot of State at its current process time.
+  ///
+  /// Any existing snapshot at the same time is replaced.
+  ///
+  void add(ProcessState const &State);
+  
+  /// \brief Restore State from the snapshot taken at ProcessTime.
+  ///
+  /// \return true iff the snapshot existed and was restored.
+  ///
+  bool restore(ProcessState &State, uint64_t const ProcessTime) const;
+  
+  /// \brief Remove all snapshots.
+  ///
+  void clear();
+  
+  /// @} (Mutators)
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_STATESNAPSHOT_HPP
@@ -82,8 +82,8 @@ public:
     Writes()
   {}
 
-  // Copying denied.
-  StreamState(StreamState const &) = delete;
+  // Copying must be explicit (it is only used to take snapshots).
+  explicit StreamState(StreamState const &) = default;
   StreamState &operator=(StreamState const &) = delete;
 
   // Movement OK.
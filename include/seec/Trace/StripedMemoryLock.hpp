@@ -0,0 +1,178 @@
+//===- include/seec/Trace/StripedMemoryLock.hpp --------------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Striped locking of the traced process' memory.
+///
+/// The global memory lock is split into stripes, each of which covers an
+/// interleaved set of pages. Loads and stores lock only the stripes that cover
+/// the memory they access, so threads that access different memory do not
+/// wait for each other. Everything else that reads or modifies the memory
+/// state (allocations, known regions, library functions, etc.) locks every
+/// stripe, so it is ordered with respect to all other memory accesses.
+///
+/// Stripes are always locked in order of increasing index, so that locks of
+/// different ranges cannot deadlock.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_STRIPEDMEMORYLOCK_HPP
+#define SEEC_TRACE_STRIPEDMEMORYLOCK_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+
+namespace seec {
+
+namespace trace {
+
+
+class StripedMemoryLock;
+
+
+/// \brief The striped mutex that controls access to traced memory.
+///
+class StripedMemoryMutex {
+  friend class StripedMemoryLock;
+  
+  static constexpr unsigned StripeCount = 16;
+
+public:
+  /// Number of stripes.
+  static constexpr unsigned getStripeCount() { return StripeCount; }
+  
+  /// Each stripe covers pages of (1 << getPageShift()) bytes.
+  static constexpr unsigned getPageShift() { return 12; }
+  
+  /// Mask with one bit set for each stripe.
+  static constexpr uint32_t getAllStripes() {
+    return (uint32_t(1) << getStripeCount()) - 1;
+  }
+  
+  /// \brief Get the mask of stripes covering the given range of memory.
+  ///
+  static uint32_t getStripesFor(uintptr_t const Address,
+                                std::size_t const Length)
+  {
+    auto const First = Address >> getPageShift();
+    auto const Last  = (Address + (Length ? Length - 1 : 0)) >> getPageShift();
+    
+    if (Last < First || Last - First + 1 >= getStripeCount())
+      return getAllStripes();
+    
+    uint32_t Stripes = 0;
+    for (auto Page = First; Page <= Last; ++Page)
+      Stripes |= uint32_t(1) << (Page % getStripeCount());
+    
+    return Stripes;
+  }
+
+private:
+  std::mutex m_Stripes[StripeCount];
+};
+
+
+/// \brief Holds some or all of the stripes of a StripedMemoryMutex.
+///
+/// This supports the subset of std::unique_lock's interface that is used for
+/// the global memory lock.
+///
+class StripedMemoryLock {
+  StripedMemoryMutex *m_Mutex;
+  
+  uint32_t m_Stripes;
+  
+  void lock() {
+    for (unsigned i = 0; i < StripedMemoryMutex::getStripeCount(); ++i)
+      if (m_Stripes & (uint32_t(1) << i))
+        m_Mutex->m_Stripes[i].lock();
+  }
+
+public:
+  /// \brief Construct a lock that holds nothing.
+  ///
+  StripedMemoryLock()
+  : m_Mutex(nullptr),
+    m_Stripes(0)
+  {}
+  
+  /// \brief Lock the given stripes of Mutex.
+  ///
+  StripedMemoryLock(StripedMemoryMutex &Mutex, uint32_t const Stripes)
+  : m_Mutex(&Mutex),
+    m_Stripes(Stripes)
+  {
+    lock();
+  }
+  
+  StripedMemoryLock(StripedMemoryLock &&Other)
+  : m_Mutex(Other.m_Mutex),
+    m_Stripes(Other.m_Stripes)
+  {
+    Other.m_Stripes = 0;
+  }
+  
+  StripedMemoryLock &operator=(StripedMemoryLock &&Other) {
+    if (this != &Other) {
+      unlock();
+      m_Mutex = Other.m_Mutex;
+      m_Stripes = Other.m_Stripes;
+      Other.m_Stripes = 0;
+    }
+    
+    return *this;
+  }
+  
+  StripedMemoryLock(StripedMemoryLock const &) = delete;
+  StripedMemoryLock &operator=(StripedMemoryLock const &) = delete;
+  
+  ~StripedMemoryLock() { unlock(); }
+  
+  /// \brief Check if any stripe is held.
+  ///
+  bool owns_lock() const { return m_Stripes != 0; }
+  
+  explicit operator bool() const { return owns_lock(); }
+  
+  /// \brief Check if every stripe is held.
+  ///
+  bool owns_all() const {
+    return m_Stripes == StripedMemoryMutex::getAllStripes();
+  }
+  
+  /// \brief Check if the stripes covering the given memory are held.
+  ///
+  bool covers(uintptr_t const Address, std::size_t const Length) const {
+    auto const Needed = StripedMemoryMutex::getStripesFor(Address, Length);
+    return (m_Stripes & Needed) == Needed;
+  }
+  
+  /// \brief Release all held stripes.
+  ///
+  void unlock() {
+    if (!m_Stripes)
+      return;
+    
+    for (unsigned i = StripedMemoryMutex::getStripeCount(); i-- > 0; )
+      if (m_Stripes & (uint32_t(1) << i))
+        m_Mutex->m_Stripes[i].unlock();
+    
+    m_Stripes = 0;
+  }
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_STRIPEDMEMORYLOCK_HPP
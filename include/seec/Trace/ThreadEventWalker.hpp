@@ -0,0 +1,165 @@
+//===- include/seec/Trace/ThreadEventWalker.hpp --------------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// A walk over the events of a single thread that tracks the stack areas of
+/// each function invocation, used to build indexes of a process trace (see
+/// AllocationLifetimeTable and MemoryChangeIndex).
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_THREADEVENTWALKER_HPP
+#define SEEC_TRACE_THREADEVENTWALKER_HPP
+
+#include "seec/DSA/MemoryArea.hpp"
+#include "seec/Trace/StateCommon.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace seec {
+
+namespace trace {
+
+class EventRecordBase;
+class ProcessTrace;
+
+
+/// \brief Walks the events of a single thread.
+///
+/// The walker tracks the stack areas (allocas and byval arguments) allocated
+/// by each active function invocation, and reports when they are allocated
+/// and deallocated. Events that don't set a process time become visible
+/// somewhere between the thread's surrounding process times, so the walker
+/// reports each process time that the thread reaches, along with the earliest
+/// time at which the preceding untimed events could be visible.
+///
+/// Dynamic memory allocation events are reported rather than handled, because
+/// the allocation that a Free or Realloc ends may have been made by another
+/// thread.
+///
+class ThreadEventWalker {
+public:
+  /// \brief A stack area allocated by an active function invocation.
+  ///
+  struct StackArea {
+    /// The allocated area.
+    MemoryArea Area;
+    
+    /// The Alloca or ByValRegionAdd event that allocated the area.
+    EventRecordBase const *Event;
+    
+    /// The value returned by stackAreaAdded() for this area.
+    uint32_t Handle;
+  };
+
+private:
+  /// The trace that contains the thread.
+  ProcessTrace const &Trace;
+  
+  /// The thread to walk.
+  uint32_t const ThreadID;
+  
+  /// The most recent process time set by this thread.
+  uint64_t LastProcessTime;
+  
+  /// The value of the most recent InstructionWithPtr event. Malloc and Alloca
+  /// events take their address from this.
+  stateptr_ty LastPointer;
+  
+  /// Stack areas allocated by each active function invocation.
+  std::vector<std::vector<StackArea>> Frames;
+  
+  /// The StackRestore being handled.
+  EventRecordBase const *Restore;
+  
+  /// The allocas kept by Restore (from the StackRestoreAlloca events that
+  /// follow it).
+  std::vector<EventRecordBase const *> Restored;
+  
+  /// \brief Add a stack area to the current function invocation.
+  ///
+  void addStackArea(MemoryArea const &Area, EventRecordBase const &Ev);
+  
+  /// \brief Remove the allocas that the current StackRestore didn't keep.
+  ///
+  void finishRestore();
+  
+  /// \brief Remove all stack areas of the current function invocation.
+  ///
+  void finishFrame(EventRecordBase const &Ev);
+  
+  /// \brief Report that the thread reached ProcessTime.
+  ///
+  void reachProcessTime(uint64_t const ProcessTime);
+
+protected:
+  /// \brief A stack area was allocated by Ev.
+  ///
+  /// \return a handle that is stored with the area, and passed back when the
+  ///         area is deallocated.
+  ///
+  virtual uint32_t stackAreaAdded(MemoryArea const &Area,
+                                  EventRecordBase const &Ev) = 0;
+  
+  /// \brief A stack area was deallocated by Ev (a FunctionEnd or a
+  ///        StackRestore).
+  ///
+  virtual void stackAreaRemoved(StackArea const &Area,
+                                EventRecordBase const &Ev) = 0;
+  
+  /// \brief A dynamic memory allocation event (Malloc, Free, Realloc or
+  ///        CheckpointMalloc) affected the allocation at Address.
+  ///
+  virtual void dynamicEvent(EventRecordBase const &Ev,
+                            uint64_t const ProcessTime,
+                            stateptr_ty const Address) = 0;
+  
+  /// \brief Called for every event, after the walker has handled it.
+  ///
+  virtual void event(EventRecordBase const &Ev) {}
+  
+  /// \brief The thread reached process time Latest. The untimed events since
+  ///        the previous process time became visible between Earliest and
+  ///        Latest.
+  ///
+  /// This is called after event() for each event that sets a process time,
+  /// and once more for the final process time of the trace.
+  ///
+  virtual void processTimeReached(uint64_t const Earliest,
+                                  uint64_t const Latest) = 0;
+  
+  ThreadEventWalker(ProcessTrace const &WithTrace,
+                    uint32_t const WithThreadID);
+  
+  /// \brief Get the trace that contains the thread.
+  ///
+  ProcessTrace const &getTrace() const { return Trace; }
+  
+  /// \brief Get the ID of the thread being walked.
+  ///
+  uint32_t getThreadID() const { return ThreadID; }
+
+public:
+  virtual ~ThreadEventWalker();
+  
+  ThreadEventWalker(ThreadEventWalker const &) = delete;
+  ThreadEventWalker &operator=(ThreadEventWalker const &) = delete;
+  
+  /// \brief Walk all events of the thread.
+  ///
+  void walk();
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_THREADEVENTWALKER_HPP
@@ -20,9 +20,12 @@
 #include "seec/Trace/TraceFormat.hpp"
 #include "seec/Util/Maybe.hpp"
 
+#include "llvm/ADT/Optional.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <map>
 #include <memory>
 #include <type_traits>
 #include <vector>
@@ -41,6 +44,7 @@ class ThreadTrace;
 class ThreadState {
   friend class ProcessState; // Allow ProcessStates to construct ThreadStates.
   friend class ThreadMovementDispatcher;
+  friend class ProcessStateSnapshot; // Allow snapshots to copy the state.
 
 
   /// \name Constants
@@ -61,15 +65,63 @@ class ThreadState {
   /// The next event to process when moving forward through the trace.
   std::unique_ptr<EventReference> m_NextEvent;
 
+  /// The first event that may be removed when moving backward through the
+  /// trace (following the thread's checkpoint, if it has one).
+  std::unique_ptr<EventReference> m_StartEvent;
+  
   /// The synthetic process time that this ThreadState represents.
   uint64_t ProcessTime;
 
   /// The synthetic thread time that this ThreadState represents.
   uint64_t ThreadTime;
 
+  /// Unused BasicBlock stores, shared by this thread's FunctionStates.
+  std::unique_ptr<value_store::BasicBlockStorePool> BlockStorePool;
+
   /// The stack of FunctionState objects.
   std::vector<std::unique_ptr<FunctionState>> CallStack;
 
+  /// The number of FunctionStates at the bottom of CallStack that have not
+  /// been modified since the last call to clearCallStackChanges().
+  std::size_t UnchangedCallStackDepth;
+
+  /// \brief Record that the active FunctionState may be modified.
+  ///
+  void noteCallStackChange() {
+    auto const Active = CallStack.empty() ? 0 : CallStack.size() - 1;
+    UnchangedCallStackDepth = std::min(UnchangedCallStackDepth, Active);
+  }
+
+  /// @}
+
+
+  /// \name Function exit summaries
+  /// @{
+
+  /// Copies of the final state of long-running functions, indexed by the
+  /// offset of their FunctionStart event. When moving backward over a
+  /// FunctionEnd, these are used instead of re-adding all of the function's
+  /// events.
+  std::map<offset_uint, std::unique_ptr<FunctionState>> ExitSummaries;
+
+  /// The approximate number of bytes used by ExitSummaries.
+  std::size_t ExitSummariesSize;
+
+  /// \brief Get the minimum size (in bytes) of a function's events for the
+  ///        function to be summarized at exit.
+  ///
+  static constexpr offset_uint getMinimumSummarizedEventSize() {
+    return 4096;
+  }
+
+  /// \brief Get the maximum number of bytes that ExitSummaries may use.
+  ///
+  static constexpr std::size_t getExitSummariesBudget() { return 64u << 20; }
+
+  /// \brief Keep a copy of State's final state, if it is worth summarizing.
+  ///
+  void addExitSummary(FunctionState const &State);
+
   /// @}
 
 
@@ -121,6 +173,9 @@ class ThreadState {
   void addEvent(EventRecord<EventType::DirOpen> const &);
   void addEvent(EventRecord<EventType::DirClose> const &);
   void addEvent(EventRecord<EventType::RuntimeError> const &);
+  void addEvent(EventRecord<EventType::Checkpoint> const &);
+  void addEvent(EventRecord<EventType::CheckpointMalloc> const &);
+  void addEvent(EventRecord<EventType::CheckpointEnd> const &);
 
 
   /// Special handling when re-adding the following, so that they do not set
@@ -148,12 +203,48 @@ public:
   /// NextEvent.
   void addNextEvent();
 
+private:
+  /// \brief Get the process time of the flight-recorder checkpoint that
+  ///        begins this thread's events, if there is one.
+  ///
+  llvm::Optional<uint64_t> getCheckpointProcessTime() const;
+  
+  /// \brief Add the flight-recorder checkpoint that begins this thread's
+  ///        events, if there is one.
+  ///
+  /// The checkpoint's events become the start of the thread, so they will not
+  /// be removed when moving backward.
+  ///
+  /// \param WithSharedState if false, then the checkpoint's events that
+  ///        modify the shared process state are skipped (because the state has
+  ///        been recreated from another thread's checkpoint).
+  ///
+  void addCheckpoint(bool WithSharedState);
+  
+  /// \brief Add the events that this thread made before another thread's
+  ///        flight-recorder checkpoint, for a thread that has no checkpoint.
+  ///
+  /// A thread whose events were never dropped keeps the events that it made
+  /// before the checkpoint that the shared state was recreated from. Events
+  /// up to the first event with a process time later than CheckpointTime are
+  /// added, except for those that modify the shared process state (because
+  /// their effects are already part of the checkpoint). These events become
+  /// the start of the thread, so they will not be removed when moving
+  /// backward.
+  ///
+  void addEventsBeforeCheckpoint(uint64_t CheckpointTime);
+
 private:
   void makePreviousInstructionActive(EventReference PriorTo);
   void makePreviousInstructionActive(EventRecordBase const &PriorTo);
   void setPreviousViewOfProcessTime(EventReference PriorTo);
   void setPreviousViewOfProcessTime(EventRecordBase const &PriorTo);
 
+  /// \brief Restore the allocas and byval areas of a FunctionState that is
+  ///        being returned to the CallStack by removing its FunctionEnd.
+  ///
+  void restoreFunctionAllocations(FunctionState const &State);
+
   void removeEvent(EventRecord<EventType::None> const &);
   void removeEvent(EventRecord<EventType::TraceEnd> const &);
   void removeEvent(EventRecord<EventType::FunctionStart> const &);
@@ -190,6 +281,9 @@ private:
   void removeEvent(EventRecord<EventType::DirOpen> const &);
   void removeEvent(EventRecord<EventType::DirClose> const &);
   void removeEvent(EventRecord<EventType::RuntimeError> const &);
+  void removeEvent(EventRecord<EventType::Checkpoint> const &);
+  void removeEvent(EventRecord<EventType::CheckpointMalloc> const &);
+  void removeEvent(EventRecord<EventType::CheckpointEnd> const &);
 
 public:
   /// Decrement NextEvent, and then remove the event it references from the
@@ -198,6 +292,9 @@ public:
 
   /// @} (Movement)
 
+  /// \brief Destructor.
+  ~ThreadState();
+
 
   /// \name Accessors
   /// @{
@@ -214,6 +311,10 @@ public:
   /// \brief Get the next event to process when moving forward through the
   /// trace.
   EventReference const &getNextEvent() const { return *m_NextEvent; }
+  
+  /// \brief Get the first event that may be removed when moving backward
+  /// through the trace.
+  EventReference const &getStartEvent() const { return *m_StartEvent; }
 
   /// \brief Get the synthetic thread time that this ThreadState represents.
   uint64_t getThreadTime() const { return ThreadTime; }
@@ -221,6 +322,21 @@ public:
   /// \brief Get the current stack of FunctionStates.
   decltype(CallStack) const &getCallStack() const { return CallStack; }
 
+  /// \brief Get the number of FunctionStates at the bottom of the call stack
+  ///        that have not been modified (or replaced) since the last call to
+  ///        clearCallStackChanges().
+  std::size_t getUnchangedCallStackDepth() const {
+    return UnchangedCallStackDepth;
+  }
+
+  /// \brief Forget all recorded changes to the call stack.
+  void clearCallStackChanges() { UnchangedCallStackDepth = CallStack.size(); }
+
+  /// \brief Get the pool of unused BasicBlock stores for this thread.
+  value_store::BasicBlockStorePool &getBasicBlockStorePool() {
+    return *BlockStorePool;
+  }
+
   /// @} (Accessors)
   
   
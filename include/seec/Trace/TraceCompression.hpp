@@ -0,0 +1,172 @@
+//===- include/seec/Trace/TraceCompression.hpp ---------------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Compression of thread event blocks.
+///
+/// Consecutive event records usually differ in only a few bytes (the low bytes
+/// of their instruction index, process time, and value), so each record is
+/// XORed with the record that precedes it, and the resulting runs of zero bytes
+/// are run-length encoded.
+///
+/// A compressed block has the following layout (following the usual block
+/// header of BlockType and NextBlock):
+///
+///   uint32_t ThreadID
+///   uint64_t BlockOffset  (offset of the uncompressed block)
+///   uint64_t BlockSize    (used size of the uncompressed block)
+///   uint64_t PatchSize    (size of the patch records)
+///   patch records         (uint64_t Offset, uint32_t Length, data)
+///   encoded events        (to the end of the block)
+///
+/// Uncompressed blocks are allocated in a separate offset space, beginning at
+/// compressedEventOffsetBase(), so the offsets of events (and of rewrites to
+/// events in blocks that have already been written) are unaffected by the
+/// compression. The patch records hold rewrites of events in earlier blocks.
+///
+/// Blocks of type BlockType::ThreadCheckpointData use the same layout, but
+/// hold the raw memory contents recorded by a flight-recorder checkpoint
+/// (following a zero word, so that no events are delta encoded).
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_TRACECOMPRESSION_HPP
+#define SEEC_TRACE_TRACECOMPRESSION_HPP
+
+#include "seec/Trace/TraceFormat.hpp"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+namespace seec {
+
+namespace trace {
+
+
+/// \brief Append a patch record that rewrites Size bytes at Offset.
+///
+void appendThreadEventPatch(std::vector<char> &Patches,
+                            offset_uint Offset,
+                            void const *Data,
+                            size_t Size);
+
+
+/// \brief Compress the used portion of a thread event block.
+///
+/// \param Image the used portion of the uncompressed block, including its
+///              block header and thread ID. If the block's type is
+///              BlockType::ThreadCheckpointData then the compressed block
+///              keeps that type, otherwise it is ThreadEventsCompressed.
+/// \param BlockOffset the offset of the uncompressed block.
+/// \param Patches patch records for earlier blocks.
+/// \return the complete compressed block, including its block header. The
+///         NextBlock field is zero, and must be set by the caller when the
+///         block's position in the trace file is known.
+///
+std::vector<char> compressThreadEventBlock(llvm::ArrayRef<char> Image,
+                                           offset_uint BlockOffset,
+                                           llvm::ArrayRef<char> Patches);
+
+
+/// \brief Add patch records to a complete compressed block.
+///
+/// \param Block the complete compressed block, including its block header.
+/// \param Patches patch records that will precede the block's own patch
+///                records (so they are applied first).
+/// \return the rebuilt block. The NextBlock field is zero.
+///
+std::vector<char> prependThreadEventPatches(llvm::ArrayRef<char> Block,
+                                            llvm::ArrayRef<char> Patches);
+
+
+/// \brief A compressed thread event block read from a trace file.
+///
+class CompressedThreadEventBlock {
+  uint32_t m_ThreadID;
+  
+  offset_uint m_BlockOffset;
+  
+  uint64_t m_BlockSize;
+  
+  llvm::ArrayRef<char> m_Patches;
+  
+  llvm::ArrayRef<char> m_Encoded;
+  
+  CompressedThreadEventBlock(uint32_t ThreadID,
+                             offset_uint BlockOffset,
+                             uint64_t BlockSize,
+                             llvm::ArrayRef<char> Patches,
+                             llvm::ArrayRef<char> Encoded)
+  : m_ThreadID(ThreadID),
+    m_BlockOffset(BlockOffset),
+    m_BlockSize(BlockSize),
+    m_Patches(Patches),
+    m_Encoded(Encoded)
+  {}
+
+public:
+  /// \brief Read a compressed block.
+  ///
+  /// \param Data the block's contents (following the block header).
+  /// \return the block, or an empty Optional if it is malformed.
+  ///
+  static llvm::Optional<CompressedThreadEventBlock>
+  read(llvm::ArrayRef<char> Data);
+  
+  uint32_t getThreadID() const { return m_ThreadID; }
+  
+  offset_uint getBlockOffset() const { return m_BlockOffset; }
+  
+  uint64_t getBlockSize() const { return m_BlockSize; }
+  
+  /// \brief Get this block's patch records.
+  ///
+  llvm::ArrayRef<char> getPatches() const { return m_Patches; }
+  
+  /// \brief Recreate the used portion of the uncompressed block.
+  ///
+  /// \param Out receives getBlockSize() bytes.
+  /// \return true iff the block was decompressed successfully.
+  ///
+  bool decompress(char *Out) const;
+  
+  /// \brief Call Fn(Offset, Data) for each of this block's patch records.
+  ///
+  template<typename FnT>
+  void forEachPatch(FnT Fn) const {
+    auto Data = m_Patches;
+    auto const RecordHeaderSize = sizeof(uint64_t) + sizeof(uint32_t);
+    
+    while (Data.size() >= RecordHeaderSize) {
+      offset_uint Offset;
+      uint32_t Length;
+      std::memcpy(&Offset, Data.data(), sizeof(Offset));
+      std::memcpy(&Length, Data.data() + sizeof(Offset), sizeof(Length));
+      Data = Data.drop_front(RecordHeaderSize);
+      
+      if (Data.size() < Length)
+        return;
+      
+      Fn(Offset, Data.take_front(Length));
+      Data = Data.drop_front(Length);
+    }
+  }
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_TRACECOMPRESSION_HPP
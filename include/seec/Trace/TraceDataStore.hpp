@@ -0,0 +1,146 @@
+//===- include/seec/Trace/TraceDataStore.hpp ------------------------ C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Content-deduplicating storage for process data.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_TRACEDATASTORE_HPP
+#define SEEC_TRACE_TRACEDATASTORE_HPP
+
+#include "seec/Trace/TraceFormat.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace seec {
+
+namespace trace {
+
+
+class OutputBlockProcessDataStream;
+class OutputStreamAllocator;
+
+
+/// \brief Writes process data to the trace, writing identical data only once.
+///
+/// Each payload is hashed, and if identical bytes have already been written
+/// then the offset of the existing copy is returned. The index of written
+/// payloads is split into shards by hash, each with its own lock, so threads
+/// recording different data do not wait for each other to search the index.
+/// Only writes of new small payloads share a single lock (for the buffered
+/// process data block); large payloads are written in their own blocks.
+///
+/// To confirm that a match is genuine, a copy of each indexed payload is kept
+/// in memory. Payloads are no longer indexed once a shard has used its share
+/// of getRetainedBytesLimit(), so memory use is bounded.
+///
+/// This class is thread-safe.
+///
+class ProcessDataStore {
+public:
+  /// \brief Counters describing the store's activity.
+  ///
+  struct Statistics {
+    /// Number of payloads recorded.
+    uint64_t Records;
+    
+    /// Total size of the payloads recorded.
+    uint64_t RecordBytes;
+    
+    /// Number of payloads that matched data already in the trace.
+    uint64_t Duplicates;
+    
+    /// Total size of the payloads that matched data already in the trace.
+    uint64_t DuplicateBytes;
+  };
+  
+  /// \brief Create a store that writes to the given allocator.
+  ///
+  ProcessDataStore(OutputStreamAllocator &Allocator);
+  
+  ~ProcessDataStore();
+  
+  // Don't allow copying.
+  ProcessDataStore(ProcessDataStore const &) = delete;
+  ProcessDataStore &operator=(ProcessDataStore const &) = delete;
+  
+  /// \brief Record a payload and get the offset of its data in the trace.
+  ///
+  /// \return the offset of the data, or 0 if it could not be written.
+  ///
+  offset_uint write(char const *Data, size_t Size);
+  
+  /// \brief Write any buffered data to the trace file.
+  ///
+  void flush();
+  
+  /// \brief Drop any buffered data and stop writing new data.
+  ///
+  void abandon();
+  
+  /// \brief Get the store's counters.
+  ///
+  Statistics getStatistics() const;
+
+private:
+  /// Number of independently locked index shards.
+  static constexpr unsigned getShardCount() { return 16; }
+  
+  /// Maximum size of all payload copies kept for comparison.
+  static constexpr size_t getRetainedBytesLimit() { return 32 * 1024 * 1024; }
+  
+  struct Entry {
+    std::unique_ptr<char[]> Data;
+    
+    size_t Size;
+    
+    offset_uint Offset;
+  };
+  
+  struct Shard {
+    std::mutex Mutex;
+    
+    std::unordered_multimap<size_t, Entry> Entries;
+    
+    size_t RetainedBytes = 0;
+    
+    Statistics Stats = Statistics();
+  };
+  
+  /// \brief Write a payload that is not already in the trace.
+  ///
+  offset_uint writeNew(char const *Data, size_t Size);
+  
+  OutputStreamAllocator &m_Allocator;
+  
+  /// The stream for small payloads.
+  std::unique_ptr<OutputBlockProcessDataStream> m_Stream;
+  
+  /// Controls access to m_Stream.
+  std::mutex m_StreamMutex;
+  
+  /// Set when the output has been abandoned.
+  std::atomic<bool> m_Abandoned;
+  
+  std::unique_ptr<Shard[]> m_Shards;
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_TRACEDATASTORE_HPP
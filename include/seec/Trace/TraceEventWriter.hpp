@@ -20,6 +20,7 @@
 #include "llvm/ADT/ArrayRef.h"
 
 #include <memory>
+#include <mutex>
 
 
 namespace seec {
@@ -29,9 +30,16 @@ namespace trace {
 
 /// \brief Handled writing trace events to an output stream.
 ///
+/// Events are only written by the owning thread, but another thread may flush
+/// the stream when the process is about to terminate (see flush()), so access
+/// to the stream is serialized by OutMutex.
+///
 class EventWriter {
   /// The output stream to write to.
   std::unique_ptr<OutputBlockThreadEventStream> Out;
+  
+  /// Controls access to Out.
+  mutable std::mutex OutMutex;
 
   /// Size of the last-written event (in bytes).
   uint8_t PreviousEventSize;
@@ -50,6 +58,8 @@ class EventWriter {
   llvm::Optional<OutputBlock::WriteRecord> write(llvm::ArrayRef<char> Bytes) {
     llvm::Optional<OutputBlock::WriteRecord> Ret;
     
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    
     // If the stream doesn't exist, silently ignore the write request.
     if (Out) {
       if (auto Result = Out->rewritableWrite(Bytes.data(), Bytes.size())) {
@@ -65,6 +75,7 @@ public:
   ///
   EventWriter()
   : Out(),
+    OutMutex(),
     PreviousEventSize(0),
     PreviousOffsets()
   {
@@ -96,15 +107,72 @@ public:
   /// \brief Open this EventWriter's output stream.
   ///
   void open(std::unique_ptr<OutputBlockThreadEventStream> Stream) {
+    std::lock_guard<std::mutex> Lock{OutMutex};
     Out = std::move(Stream);
   }
   
   /// \brief Close this EventWriter's output stream.
   ///
   void close() {
+    std::lock_guard<std::mutex> Lock{OutMutex};
     Out.reset(nullptr);
   }
   
+  /// \brief Write any buffered events to the output stream.
+  ///
+  /// This may be called by any thread.
+  ///
+  void flush() {
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    if (Out)
+      Out->flush();
+  }
+  
+  /// \brief Close this EventWriter's output stream without writing any
+  ///        buffered events.
+  ///
+  void abandon() {
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    if (Out) {
+      Out->discard();
+      Out.reset(nullptr);
+    }
+  }
+  
+  /// \brief Check if a flight-recorder checkpoint should be written.
+  ///
+  bool isCheckpointDue() const {
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    return Out && Out->isCheckpointDue();
+  }
+  
+  /// \brief Begin writing a flight-recorder checkpoint.
+  ///
+  void beginCheckpoint() {
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    if (Out)
+      Out->beginCheckpoint();
+  }
+  
+  /// \brief Finish writing a flight-recorder checkpoint.
+  ///
+  void endCheckpoint() {
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    if (Out)
+      Out->endCheckpoint();
+  }
+  
+  /// \brief Write memory contents for the current flight-recorder checkpoint.
+  ///
+  /// \return the offset of the data, if it was written.
+  ///
+  llvm::Optional<off_t> writeCheckpointData(llvm::ArrayRef<char> Data) {
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    if (Out)
+      return Out->writeCheckpointData(Data);
+    return llvm::Optional<off_t>();
+  }
+  
   /// @} (Writing control)
   
   
@@ -167,6 +235,8 @@ public:
   {
     llvm::Optional<EventWriteRecord<ET>> Ret;
     
+    std::lock_guard<std::mutex> Lock{OutMutex};
+    
     if (Out) {
       // Construct the event record.
       EventRecord<ET> Record(PreviousWrite.PrecedingEventSize,
@@ -46,7 +46,18 @@ inline offset_uint noOffset() {
 }
 
 /// Version of the trace storage format.
-constexpr inline uint64_t formatVersion() { return 8; }
+constexpr inline uint64_t formatVersion() { return 10; }
+
+/// Oldest version of the trace storage format that can still be read.
+/// Version 9 added compressed thread event blocks, and version 10 added the
+/// checkpoint events, but the formats are otherwise unchanged.
+constexpr inline uint64_t minimumFormatVersion() { return 8; }
+
+/// Offsets at or above this value refer to events in compressed thread event
+/// blocks, rather than to positions in the trace file.
+constexpr inline offset_uint compressedEventOffsetBase() {
+  return offset_uint(1) << 48;
+}
 
 /// ThreadID used to indicate that an event location refers to the initial
 /// state of the process.
@@ -62,7 +73,9 @@ enum class BlockType : uint8_t {
   ModuleBitcode = 1,
   ProcessTrace = 2,
   ProcessData = 3,
-  ThreadEvents = 4
+  ThreadEvents = 4,
+  ThreadEventsCompressed = 5,
+  ThreadCheckpointData = 6 ///< Compressed, holds a checkpoint's memory data.
 };
 
 
@@ -16,7 +16,10 @@
 
 #include "seec/DSA/MemoryArea.hpp"
 
+#include "llvm/ADT/DenseMap.h"
+
 #include <cassert>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <vector>
@@ -26,52 +29,74 @@ namespace seec {
 namespace trace {
 
 
-static constexpr char getUninitializedByte() { return ~0; }
-static constexpr char getInitializedByte() { return 0; }
+/// Each shadow page covers (1 << getShadowPageShift()) bytes of memory.
+static constexpr unsigned getShadowPageShift() { return 12; }
+
+static constexpr std::size_t getShadowPageSize() {
+  return std::size_t(1) << getShadowPageShift();
+}
+
+/// Number of 64-bit shadow words in each shadow page.
+static constexpr std::size_t getShadowPageWords() {
+  return getShadowPageSize() / 64;
+}
 
-/// \brief Holds the shadow state for a memory allocation.
+
+/// \brief Holds the extent of a memory allocation.
 ///
 class TraceMemoryAllocation {
   uintptr_t m_Address;
   
-  std::vector<char> m_Shadow;
+  std::size_t m_Length;
   
 public:
   /// \brief Construct a new MemoryAllocation.
   TraceMemoryAllocation(uintptr_t const Address,
                         std::size_t const Length)
   : m_Address(Address),
-    m_Shadow(/* count */ Length, /* value */ getUninitializedByte())
+    m_Length(Length)
   {}
   
-  MemoryArea getArea() const { return MemoryArea(m_Address, getLength()); }
+  MemoryArea getArea() const { return MemoryArea(m_Address, m_Length); }
   
   uintptr_t getAddress() const { return m_Address; }
   
-  std::size_t getLength() const { return m_Shadow.size(); }
+  std::size_t getLength() const { return m_Length; }
   
-  char *getShadow() { return m_Shadow.data(); }
+  void resize(std::size_t const NewLength) { m_Length = NewLength; }
+};
+
+
+/// \brief Shadow state for one page of memory.
+///
+/// Each byte of memory has one bit of shadow, which is set iff the byte is
+/// completely initialized.
+///
+struct TraceMemoryShadowPage {
+  uint64_t Bits[getShadowPageWords()];
   
-  char *getShadowAt(uintptr_t const Address) {
-    assert(Address >= m_Address);
-    assert((Address - m_Address) < m_Shadow.size());
-    return m_Shadow.data() + (Address - m_Address);
-  }
+  /// The allocation that covers this entire page, if there is one.
+  TraceMemoryAllocation const *Owner;
   
-  char const *getShadowAt(uintptr_t const Address) const {
-    assert(Address >= m_Address);
-    assert((Address - m_Address) < m_Shadow.size());
-    return m_Shadow.data() + (Address - m_Address);
-  }
+  /// Number of allocations that overlap this page.
+  unsigned Users;
   
-  void resize(std::size_t const NewLength) {
-    m_Shadow.resize(NewLength, getUninitializedByte());
-  }
+  TraceMemoryShadowPage()
+  : Bits(),
+    Owner(nullptr),
+    Users(0)
+  {}
 };
 
 
 /// \brief Holds information about traced memory states.
 ///
+/// The initialization state of memory is kept in a two-level table: a hash
+/// table of pages, each of which holds one bit per byte. Shadow operations
+/// work on whole 64-bit words where possible. If an allocation covers an
+/// entire page, the page also records the allocation, so that finding the
+/// allocation containing an address does not need to search the allocations.
+///
 class TraceMemoryState {
   // don't allow copying
   TraceMemoryState(TraceMemoryState const &) = delete;
@@ -79,24 +104,61 @@ class TraceMemoryState {
   
   /// Map from start addresses to allocations.
   std::map<uintptr_t, TraceMemoryAllocation> m_Allocations;
-
-  TraceMemoryAllocation *
-  getAllocationAtOrPreceding(uintptr_t const Address);
+  
+  /// Map from page numbers to the shadow pages of allocated memory.
+  llvm::DenseMap<uintptr_t, std::unique_ptr<TraceMemoryShadowPage>> m_Pages;
   
   TraceMemoryAllocation const *
   getAllocationAtOrPreceding(uintptr_t const Address) const;
   
-  TraceMemoryAllocation &getAllocationContaining(uintptr_t const Address,
-                                                 std::size_t const Length);
-
-  TraceMemoryAllocation const &
-  getAllocationContaining(uintptr_t const Address,
-                          std::size_t const Length) const;
+  /// \brief Check if the given range is contained in one allocation.
+  ///
+  bool isAllocated(uintptr_t const Address, std::size_t const Length) const;
+  
+  /// \brief Get the shadow page for an allocated address.
+  ///
+  TraceMemoryShadowPage &getPage(uintptr_t const Address);
+  
+  TraceMemoryShadowPage const &getPage(uintptr_t const Address) const;
+  
+  /// \brief Add a use of the shadow pages overlapping Area, creating them if
+  ///        necessary.
+  ///
+  void attachPages(MemoryArea const Area);
+  
+  /// \brief Remove a use of the shadow pages overlapping Area, deleting any
+  ///        that are no longer used, and remove Alloc as their owner.
+  ///
+  void detachPages(MemoryArea const Area, TraceMemoryAllocation const &Alloc);
+  
+  /// \brief Set Alloc as the owner of the shadow pages that it covers.
+  ///
+  void setPageOwner(TraceMemoryAllocation const &Alloc);
+  
+  /// \brief Set the shadow of all bytes in the given range.
+  ///
+  void setState(uintptr_t Address, std::size_t Length, bool Initialized);
+  
+  /// \brief Read the shadow of up to 64 bytes, starting at Address.
+  ///
+  uint64_t readBits(uintptr_t Address, unsigned Count) const;
+  
+  /// \brief Write the shadow of up to 64 bytes, starting at Address.
+  ///
+  void writeBits(uintptr_t Address, unsigned Count, uint64_t Bits);
+  
+  /// \brief Find the number of bytes, starting at Address and to a maximum of
+  ///        MaxLength, whose initialization matches Initialized.
+  ///
+  std::size_t getLengthOfState(uintptr_t Address,
+                               std::size_t MaxLength,
+                               bool Initialized) const;
 
 public:
   /// Construct a new, empty TraceMemoryState.
   TraceMemoryState()
-  : m_Allocations()
+  : m_Allocations(),
+    m_Pages()
   {}
 
   /// \brief Set all bytes in the given range to completely initialized.
@@ -135,6 +197,28 @@ public:
   void removeAllocation(uintptr_t const Address);
   
   void resizeAllocation(uintptr_t const Address, std::size_t const NewSize);
+  
+  /// \brief Call Fn(Address, Length) for each maximal range of completely
+  ///        initialized bytes, in order of address.
+  ///
+  template<typename FnT>
+  void forEachInitializedRange(FnT Fn) const {
+    for (auto const &Pair : m_Allocations) {
+      auto const &Alloc = Pair.second;
+      auto Address = Alloc.getAddress();
+      auto const End = Alloc.getArea().end();
+      
+      while (Address < End) {
+        auto const Known = getLengthOfState(Address, End - Address, true);
+        if (Known) {
+          Fn(Address, Known);
+          Address += Known;
+        }
+        
+        Address += getLengthOfState(Address, End - Address, false);
+      }
+    }
+  }
 };
 
 
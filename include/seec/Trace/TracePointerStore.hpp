@@ -0,0 +1,109 @@
+//===- include/seec/Trace/TracePointerStore.hpp --------------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Storage for the targets of pointers held in memory.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRACE_TRACEPOINTERSTORE_HPP
+#define SEEC_TRACE_TRACEPOINTERSTORE_HPP
+
+#include "seec/DSA/MemoryArea.hpp"
+#include "seec/Trace/TracePointer.hpp"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+
+namespace seec {
+
+namespace trace {
+
+
+/// \brief Holds the PointerTarget of each pointer stored in memory.
+///
+/// Almost all pointers are stored at pointer-aligned addresses, so targets
+/// are kept in a radix table: a hash table of pages, each of which holds an
+/// array with one slot per pointer-aligned address. Clearing and copying
+/// ranges work on contiguous slots, rather than on individual tree nodes.
+/// Pointers stored at unaligned addresses are kept in a separate map.
+///
+/// A target with a null base is treated as an empty slot.
+///
+/// This class is not thread-safe.
+///
+class PointerTargetStore {
+  /// Each page covers (1 << getPageShift()) bytes of memory.
+  static constexpr unsigned getPageShift() { return 12; }
+  
+  static constexpr std::size_t getPageSize() {
+    return std::size_t(1) << getPageShift();
+  }
+  
+  /// Each slot holds the target of the pointer at one aligned address.
+  static constexpr std::size_t getSlotSize() { return sizeof(void *); }
+  
+  struct Page;
+  
+  /// Map from page numbers to pages.
+  llvm::DenseMap<uintptr_t, std::unique_ptr<Page>> m_Pages;
+  
+  /// Targets of pointers at unaligned addresses.
+  std::map<uintptr_t, PointerTarget> m_Unaligned;
+  
+  /// \brief Call Fn(Page, Index, Address) for each slot whose address is in
+  ///        Area, skipping pages that do not exist.
+  ///
+  template<typename FnT>
+  void forEachSlotIn(MemoryArea const Area, FnT Fn);
+  
+  void put(uintptr_t const Address, PointerTarget const &Target);
+
+public:
+  PointerTargetStore();
+  
+  ~PointerTargetStore();
+  
+  PointerTargetStore(PointerTargetStore const &) = delete;
+  PointerTargetStore &operator=(PointerTargetStore const &) = delete;
+  
+  /// \brief Get the target of the pointer stored at Address.
+  ///
+  /// \return the target, or a null PointerTarget if there is none.
+  ///
+  PointerTarget get(uintptr_t const Address) const;
+  
+  /// \brief Set the target of the pointer stored at Address, removing any
+  ///        targets of pointers that it overwrites.
+  ///
+  void set(uintptr_t const Address, PointerTarget const &Target);
+  
+  /// \brief Remove the targets of all pointers stored in Area.
+  ///
+  void clear(MemoryArea const Area);
+  
+  /// \brief Copy the targets of pointers stored in [From, From + Length) to
+  ///        the corresponding locations in [To, To + Length).
+  ///
+  /// The two ranges may overlap. Targets previously stored in the destination
+  /// range are removed.
+  ///
+  void copy(uintptr_t const From, uintptr_t const To, std::size_t const Length);
+};
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
+
+#endif // SEEC_TRACE_TRACEPOINTERSTORE_HPP
@@ -17,9 +17,12 @@
 #include "seec/DSA/IntervalMapVector.hpp"
 #include "seec/DSA/MemoryArea.hpp"
 #include "seec/Trace/DetectCallsLookup.hpp"
+#include "seec/Trace/StripedMemoryLock.hpp"
+#include "seec/Trace/TraceDataStore.hpp"
 #include "seec/Trace/TraceFormat.hpp"
 #include "seec/Trace/TraceMemory.hpp"
 #include "seec/Trace/TracePointer.hpp"
+#include "seec/Trace/TracePointerStore.hpp"
 #include "seec/Trace/TraceStorage.hpp"
 #include "seec/Trace/TraceStreams.hpp"
 #include "seec/Util/LockedObjectAccessor.hpp"
@@ -42,6 +45,7 @@ namespace llvm {
   class Module;
   class GlobalVariable;
   class Function;
+  class Instruction;
 } // namespace llvm
 
 namespace seec {
@@ -68,16 +72,21 @@ class DynamicAllocation {
 
   /// Size of the allocation.
   std::size_t Size;
+  
+  /// The instruction that caused this allocation (or nullptr if unknown).
+  llvm::Instruction const *Allocator;
 
 public:
   DynamicAllocation(uint32_t Thread,
                     offset_uint Offset,
                     uintptr_t Address,
-                    std::size_t Size)
+                    std::size_t Size,
+                    llvm::Instruction const *Allocator)
   : Thread(Thread),
     Offset(Offset),
     Address(Address),
-    Size(Size)
+    Size(Size),
+    Allocator(Allocator)
   {}
 
   DynamicAllocation(DynamicAllocation const &) = default;
@@ -96,6 +105,8 @@ public:
 
   std::size_t size() const { return Size; }
   
+  llvm::Instruction const *allocator() const { return Allocator; }
+  
   MemoryArea area() const { return MemoryArea(Address, Size); }
   
   /// @} (Accessors)
@@ -104,10 +115,15 @@ public:
   /// \name Mutators
   /// @{
   
-  void update(uint32_t NewThread, offset_uint NewOffset, std::size_t NewSize) {
+  void update(uint32_t NewThread,
+              offset_uint NewOffset,
+              std::size_t NewSize,
+              llvm::Instruction const *NewAllocator)
+  {
     Thread = NewThread;
     Offset = NewOffset;
     Size = NewSize;
+    Allocator = NewAllocator;
   }
   
   /// @} (Mutators)
@@ -163,15 +179,12 @@ class TraceProcessListener {
   llvm::DenseMap<uintptr_t, llvm::Function const *> FunctionLookup;
 
 
-  /// Output stream for this process' data.
-  std::unique_ptr<OutputBlockProcessDataStream> DataOut;
-
-  /// Controls access to the DataOut stream.
-  std::mutex DataOutMutex;
+  /// Output for this process' data.
+  ProcessDataStore DataOut;
 
 
   /// Synthetic ``process time'' for this process.
-  uint64_t Time;
+  std::atomic<uint64_t> Time;
 
 
   /// Integer ID given to the next requesting thread.
@@ -185,8 +198,8 @@ class TraceProcessListener {
   std::once_flag EnvironSetupOnceFlag;
 
 
-  /// Global memory mutex.
-  std::mutex GlobalMemoryMutex;
+  /// Global memory mutex, striped by address.
+  StripedMemoryMutex GlobalMemoryMutex;
 
   /// Controls access to TraceMemory.
   mutable std::mutex TraceMemoryMutex;
@@ -205,8 +218,11 @@ class TraceProcessListener {
   mutable std::mutex RegionTemporalIDsMutex;
 
   /// Pointer objects.
-  std::map<uintptr_t, PointerTarget> InMemoryPointerObjects;
+  PointerTargetStore InMemoryPointerObjects;
 
+  /// Control access to \c InMemoryPointerObjects.
+  mutable std::mutex InMemoryPointerObjectsMutex;
+  
 
   /// Dynamic memory mutex.
   std::mutex DynamicMemoryMutex;
@@ -259,8 +275,20 @@ public:
   
   /// \brief Close all open trace streams and disable future writes.
   ///
+  /// Waits until all buffered output has been written to the trace file.
+  ///
   void traceClose();
   
+  /// \brief Write buffered process data to the trace file.
+  ///
+  void traceFlush();
+  
+  /// \brief Drop buffered process data and disable future writes.
+  ///
+  /// Used by a forked child, which must not write to its parent's trace.
+  ///
+  void traceAbandon();
+  
   /// @}
 
 
@@ -419,11 +447,34 @@ public:
   /// @{
 
   /// \brief Record a block of data, and return the offset of the record.
+  ///
+  /// If identical data has already been recorded, then the offset of the
+  /// existing record is returned.
+  ///
   offset_uint recordData(char const *Data, size_t Size);
 
-  /// \brief Lock a region of memory.
-  std::unique_lock<std::mutex> lockMemory() {
-    return std::unique_lock<std::mutex>(GlobalMemoryMutex);
+  /// \brief Get counters describing the recorded data.
+  ProcessDataStore::Statistics getDataStatistics() const {
+    return DataOut.getStatistics();
+  }
+  
+  /// \brief Lock all of memory.
+  StripedMemoryLock lockMemory() {
+    return StripedMemoryLock(GlobalMemoryMutex,
+                             StripedMemoryMutex::getAllStripes());
+  }
+  
+  /// \brief Lock the memory used by a load or store.
+  ///
+  /// This only excludes other accesses to the same stripes of memory, so it
+  /// must not be used to change the memory state's allocations or known
+  /// regions.
+  ///
+  StripedMemoryLock lockMemory(uintptr_t const Address,
+                               std::size_t const Length) {
+    return StripedMemoryLock(GlobalMemoryMutex,
+                             StripedMemoryMutex::getStripesFor(Address,
+                                                               Length));
   }
   
   /// \brief Get access to this ProcessListener's TraceMemoryState.
@@ -478,13 +529,26 @@ public:
   /// \param Address
   /// \param Thread
   /// \param Offset
+  /// \param Allocator the instruction that (re)allocated the address.
   void setCurrentDynamicMemoryAllocation(uintptr_t Address,
                                          uint32_t Thread,
                                          offset_uint Offset,
-                                         std::size_t Size);
+                                         std::size_t Size,
+                                         llvm::Instruction const *Allocator);
 
   /// Remove the dynamic memory allocation for an address.
   bool removeCurrentDynamicMemoryAllocation(uintptr_t Address);
+  
+  /// \brief Call Fn(Allocation) for each current dynamic memory allocation,
+  ///        in order of address.
+  ///
+  template<typename FnT>
+  void forEachCurrentDynamicMemoryAllocation(FnT Fn) const {
+    std::lock_guard<std::mutex> Lock(DynamicMemoryAllocationsMutex);
+    
+    for (auto const &Pair : DynamicMemoryAllocations)
+      Fn(Pair.second);
+  }
 
   /// @} (Dynamic memory allocation tracking)
   
@@ -21,13 +21,16 @@
 
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/PointerIntPair.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MemoryBuffer.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 
@@ -52,6 +55,7 @@ namespace trace {
 
 class EventReference;
 class ProcessTrace;
+class ThreadEventIndex;
 class ThreadTrace;
 
 
@@ -179,7 +183,37 @@ type_safe::boolean doesLookLikeTraceFile(char const *Path);
 
 /// \brief Gets MemoryBuffers for the various sections of a trace.
 ///
+/// Compressed thread event blocks are decompressed into a cache when their
+/// thread's \c ThreadEventBlockSequence is first requested (or when data in
+/// them is first requested by offset). The decompressed blocks for a thread
+/// are held contiguously and in order, so that the sequence can be navigated
+/// with pointers, exactly as for uncompressed blocks.
+///
 class InputBufferAllocator {
+public:
+  /// \brief Location of a compressed thread event block.
+  ///
+  struct CompressedBlockEntry {
+    /// Offset of the uncompressed block.
+    offset_uint Offset;
+    
+    /// Used size of the uncompressed block.
+    uint64_t Size;
+    
+    /// Index of the thread that the block belongs to.
+    uint32_t ThreadIndex;
+    
+    /// Does the block hold checkpoint data, rather than events?
+    bool IsData;
+    
+    /// The compressed block's contents.
+    llvm::ArrayRef<char> Data;
+    
+    /// The decompressed block, or nullptr if it has not been decompressed.
+    std::atomic<char const *> Image;
+  };
+
+private:
   /// Path to the directory containing the individual execution trace files.
   std::unique_ptr<llvm::MemoryBuffer> m_TraceBuffer;
 
@@ -190,24 +224,60 @@ class InputBufferAllocator {
   
   InputBlock m_BlockForProcessTrace;
   
-  std::vector<ThreadEventBlockSequence> m_BlockSequencesForThreads;
+  /// Thread event blocks for each thread, in the order they appear in the
+  /// trace file.
+  std::vector<std::vector<InputBlock>> m_BlocksForThreads;
+  
+  /// Sequences for each thread (created when first requested).
+  mutable std::vector<std::unique_ptr<ThreadEventBlockSequence>>
+    m_BlockSequencesForThreads;
+  
+  /// Compressed blocks, sorted by Offset (the latest copy of each block).
+  std::unique_ptr<CompressedBlockEntry[]> m_CompressedBlocks;
+  
+  /// Number of entries in m_CompressedBlocks.
+  size_t m_CompressedBlockCount;
+  
+  /// Storage for decompressed blocks (one allocation per thread).
+  mutable std::vector<std::unique_ptr<char[]>> m_DecompressedStorage;
+  
+  /// Controls creation of sequences and decompression of blocks.
+  std::unique_ptr<std::mutex> m_CacheMutex;
 
   /// \brief Constructor (no temporaries).
   ///
   InputBufferAllocator(std::unique_ptr<llvm::MemoryBuffer> TraceBuffer,
                        InputBlock BlockForModule,
                        InputBlock BlockForProcessTrace,
-                       std::vector<ThreadEventBlockSequence> BlockSequences,
+                       std::vector<std::vector<InputBlock>> BlocksForThreads,
+                       std::unique_ptr<CompressedBlockEntry[]> Compressed,
+                       size_t CompressedCount,
                        std::vector<std::string> TempFiles)
   : m_TraceBuffer(std::move(TraceBuffer)),
     m_TempFiles(std::move(TempFiles)),
     m_BlockForModule(BlockForModule),
     m_BlockForProcessTrace(BlockForProcessTrace),
-    m_BlockSequencesForThreads(std::move(BlockSequences))
+    m_BlocksForThreads(std::move(BlocksForThreads)),
+    m_BlockSequencesForThreads(m_BlocksForThreads.size()),
+    m_CompressedBlocks(std::move(Compressed)),
+    m_CompressedBlockCount(CompressedCount),
+    m_DecompressedStorage(),
+    m_CacheMutex(new std::mutex())
   {
     assert(m_BlockForModule.getType() == BlockType::ModuleBitcode);
     assert(m_BlockForProcessTrace.getType() == BlockType::ProcessTrace);
   }
+  
+  /// \brief Create the sequence for a thread, decompressing its blocks if
+  ///        necessary.
+  ///
+  /// pre: m_CacheMutex is held.
+  ///
+  void createThreadSequence(uint32_t Index) const;
+  
+  /// \brief Get a pointer to data in a compressed thread event block.
+  ///
+  char const *getCompressedDataRaw(offset_uint Offset) const;
 
 public:
   /// \brief Destructor. Deletes temporary files and directories.
@@ -271,7 +341,7 @@ public:
   ///
   ///
   size_t getNumberOfThreadSequences() const {
-    return m_BlockSequencesForThreads.size();
+    return m_BlocksForThreads.size();
   }
   
   /// \brief
@@ -279,11 +349,17 @@ public:
   ThreadEventBlockSequence const *getThreadSequence(ThreadIDTy ID) const {
     auto const Index = uint32_t(ID);
     
-    if (Index < m_BlockSequencesForThreads.size()) {
-      return &(m_BlockSequencesForThreads[Index]);
+    if (Index >= m_BlocksForThreads.size()) {
+      return nullptr;
+    }
+    
+    std::lock_guard<std::mutex> Lock(*m_CacheMutex);
+    
+    if (!m_BlockSequencesForThreads[Index]) {
+      createThreadSequence(Index);
     }
     
-    return nullptr;
+    return m_BlockSequencesForThreads[Index].get();
   }
   
   llvm::MemoryBuffer const &getRawTraceBuffer() const {
@@ -295,6 +371,10 @@ public:
   }
   
   char const *getDataRaw(offset_uint Offset) {
+    if (Offset >= compressedEventOffsetBase()) {
+      return getCompressedDataRaw(Offset);
+    }
+    
     assert(Offset < m_TraceBuffer->getBufferSize());
     return m_TraceBuffer->getBufferStart() + Offset;
   }
@@ -304,6 +384,8 @@ public:
 /// \brief A reference to a single event record in a thread trace.
 ///
 class EventReference {
+  friend class ThreadEventIndex;
+  
   enum class EState : unsigned {
     Valid   = 0,
     PastEnd = 1
@@ -460,6 +542,31 @@ public:
   }
 
   /// @} (Movement operators)
+
+
+  /// \name Indexed queries
+  /// @{
+
+  /// \brief Find the previous instruction event that is part of the same
+  ///        function invocation as this event, using Trace's event index.
+  ///
+  /// This is equivalent to calling rfindInFunction() with an instruction
+  /// predicate on the range preceding this event, but takes constant time if
+  /// this event is an instruction.
+  ///
+  llvm::Optional<EventReference>
+  getPreviousInstructionInFunction(ThreadTrace const &Trace) const;
+
+  /// \brief Get the process time set by the latest event prior to this event,
+  ///        using Trace's event index.
+  ///
+  /// This takes constant time if this event sets a process time.
+  ///
+  /// \return the process time, or zero if no prior event set a process time.
+  ///
+  uint64_t getPreviousProcessTime(ThreadTrace const &Trace) const;
+
+  /// @} (Indexed queries)
 };
 
 
@@ -534,6 +641,50 @@ getRange(ThreadEventBlockSequence const &Sequence) {
 }
 
 
+/// \brief An index of a single thread's events, used to quickly find earlier
+///        events when moving backward through the thread.
+///
+/// For each instruction event the index holds the previous instruction event
+/// in the same function invocation, and for each event that sets a process
+/// time it holds the process time set by the previous such event. Each thread
+/// trace builds its index in a single pass, when it is first required.
+///
+class ThreadEventIndex {
+  /// \brief A compact form of \c EventReference.
+  ///
+  struct Position {
+    EventRecordBase const *Record;
+    
+    ThreadEventBlockSequence::ThreadEventBlock const *Block;
+  };
+  
+  /// Previous instruction in the same function invocation, for each
+  /// instruction event that has one.
+  llvm::DenseMap<EventRecordBase const *, Position> PreviousInstruction;
+  
+  /// Previous process time, for each event that sets a process time.
+  llvm::DenseMap<EventRecordBase const *, uint64_t> PreviousProcessTime;
+
+public:
+  /// \brief Build the index for all events in Events.
+  ///
+  ThreadEventIndex(EventRange Events);
+  
+  ThreadEventIndex(ThreadEventIndex const &) = delete;
+  ThreadEventIndex &operator=(ThreadEventIndex const &) = delete;
+  
+  /// \brief Find the previous instruction in the same function invocation as
+  ///        the event at Ev.
+  ///
+  llvm::Optional<EventReference>
+  getPreviousInstructionInFunction(EventReference const &Ev) const;
+  
+  /// \brief Get the process time set by the latest event prior to Ev.
+  ///
+  uint64_t getPreviousProcessTime(EventReference const &Ev) const;
+};
+
+
 /// \brief Deserialize a \c RunError from a \c RuntimeError event record.
 /// \param Records a range of events that starts with the
 ///                \c EventRecord<EventType::RuntimeError> and should contain
@@ -612,6 +763,12 @@ class ThreadTrace {
 
   /// Information about the thread's serialized events.
   ThreadEventBlockSequence const &m_EventSequence;
+  
+  /// Controls creation of the event index.
+  mutable std::once_flag m_EventIndexFlag;
+  
+  /// Index of the thread's events (created when first required).
+  mutable std::unique_ptr<ThreadEventIndex> m_EventIndex;
  
   /// \brief Constructor
   ///
@@ -620,7 +777,9 @@ class ThreadTrace {
               ThreadEventBlockSequence const &EventBlockSequence)
   : m_ProcessTrace(Parent),
     m_ID(ID),
-    m_EventSequence(EventBlockSequence)
+    m_EventSequence(EventBlockSequence),
+    m_EventIndexFlag(),
+    m_EventIndex()
   {}
 
 public:
@@ -653,6 +812,12 @@ public:
   ///
   EventReference getReferenceToOffset(offset_uint Offset) const;
   
+  /// \brief Get the index of this thread's events.
+  ///
+  /// The index is built when this is first called. This is thread-safe.
+  ///
+  ThreadEventIndex const &getEventIndex() const;
+  
   /// @} (Accessors)
 
   /// \brief Get a \c FunctionTrace from a given offset.
@@ -18,6 +18,7 @@
 #include "seec/Util/Error.hpp"
 #include "seec/Util/Maybe.hpp"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/FileSystem.h"
@@ -25,11 +26,17 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <set>
 #include <system_error>
+#include <thread>
+#include <vector>
 
 #include <type_safe/flag.hpp>
 #include <type_safe/strong_typedef.hpp>
@@ -47,7 +54,10 @@ namespace trace {
 
 
 class OutputBlock;
+class OutputBlockBuffer;
+class OutputMappedChunks;
 class OutputStreamAllocator;
+class ThreadEventRing;
 
 
 /// \brief Offset of some data in the trace.
@@ -70,9 +80,19 @@ public:
   
   /// \brief Writes to a set position in the trace.
   ///
+  /// If the original write was made to an \c OutputBlockBuffer, and the block
+  /// is still held in that buffer, then the rewrite modifies the buffer.
+  ///
+  /// If the original write was made to a memory-mapped block, then the rewrite
+  /// modifies the mapped memory directly.
+  ///
   class WriteRecord {
     int const m_TraceFD;
     
+    OutputBlockBuffer * const m_Buffer;
+    
+    char * const m_Mapped;
+    
     off_t const m_Offset;
     
     size_t const m_Length;
@@ -80,26 +100,55 @@ public:
   public:
     WriteRecord(int TraceFD, off_t Offset, size_t Length)
     : m_TraceFD(TraceFD),
+      m_Buffer(nullptr),
+      m_Mapped(nullptr),
+      m_Offset(Offset),
+      m_Length(Length)
+    {}
+    
+    WriteRecord(int TraceFD,
+                OutputBlockBuffer &Buffer,
+                off_t Offset,
+                size_t Length)
+    : m_TraceFD(TraceFD),
+      m_Buffer(&Buffer),
+      m_Mapped(nullptr),
+      m_Offset(Offset),
+      m_Length(Length)
+    {}
+    
+    WriteRecord(int TraceFD,
+                char * const Mapped,
+                off_t Offset,
+                size_t Length)
+    : m_TraceFD(TraceFD),
+      m_Buffer(nullptr),
+      m_Mapped(Mapped),
       m_Offset(Offset),
       m_Length(Length)
     {}
     
     off_t const getOffset() const { return m_Offset; }
     
-    type_safe::boolean rewrite(const void * const buf, size_t const nbyte) {
-      assert(nbyte == m_Length);
-      return OutputBlock::writeat(m_TraceFD, buf, nbyte, m_Offset);
-    }
+    type_safe::boolean rewrite(const void * const buf, size_t const nbyte);
   };
   
+  /// \brief Create a block occupying [Offset, BlockEnd) in the trace file.
+  ///
+  /// If Mapped is not null, then it points to the memory-mapped trace file at
+  /// Offset, and all writes to the block will be made through it.
+  ///
   OutputBlock(int TraceFD,
               BlockType Type,
               off_t BlockEnd,
-              off_t Offset);
+              off_t Offset,
+              char *Mapped = nullptr);
   
   OutputBlock(OutputBlock &&Other)
   : m_TraceFD(Other.m_TraceFD),
+    m_BlockStart(Other.m_BlockStart),
     m_BlockEnd(Other.m_BlockEnd),
+    m_Mapped(Other.m_Mapped),
     m_Offset(Other.m_Offset.exchange(std::numeric_limits<off_t>::max()))
   {}
   
@@ -115,12 +164,356 @@ private:
 
   int const m_TraceFD;
   
+  off_t const m_BlockStart;
+  
   off_t const m_BlockEnd;
   
+  char * const m_Mapped;
+  
   std::atomic<off_t> m_Offset;
 };
 
 
+/// \brief The memory-mapped chunks of a trace file.
+///
+/// Blocks and write records refer to the mapped memory directly, so ownership
+/// of the chunks is shared by the \c OutputStreamAllocator and every stream
+/// that has created a mapped block. The chunks are unmapped when the last
+/// owner is destroyed, so a stream that outlives the allocator (for example,
+/// the stream of a thread that is still running during static destruction)
+/// never writes to memory that has been unmapped.
+///
+class OutputMappedChunks {
+public:
+  /// \brief Create an empty table of Count chunks, each of ChunkSize bytes.
+  ///
+  OutputMappedChunks(size_t Count, off_t ChunkSize);
+  
+  /// \brief Unmap all chunks.
+  ///
+  ~OutputMappedChunks();
+  
+  // Don't allow copying.
+  OutputMappedChunks(OutputMappedChunks const &) = delete;
+  OutputMappedChunks &operator=(OutputMappedChunks const &) = delete;
+  
+  /// \brief Get the number of chunks in the table.
+  ///
+  size_t size() const { return m_Count; }
+  
+  /// \brief Get the chunk at Index, or nullptr if it is not mapped.
+  ///
+  char *get(size_t const Index) const {
+    return m_Chunks[Index].load(std::memory_order_relaxed);
+  }
+  
+  /// \brief Set the chunk at Index (which must not already be mapped).
+  ///
+  void set(size_t const Index, char * const Chunk) {
+    m_Chunks[Index].store(Chunk, std::memory_order_relaxed);
+  }
+
+private:
+  size_t const m_Count;
+  
+  off_t const m_ChunkSize;
+  
+  std::unique_ptr<std::atomic<char *>[]> m_Chunks;
+};
+
+
+/// \brief Writes buffered output to the trace file on a background thread.
+///
+/// Producers hand over complete images of output regions, which are held in a
+/// bounded lock-free queue until the writer thread writes them with pwrite().
+/// There is a single writer thread, so regions are written in the order that
+/// they were queued, and a later image of a region always replaces an earlier
+/// one. If the queue is full then the producer waits for the writer thread to
+/// make room (this is recorded as stall time).
+///
+/// This class is thread-safe.
+///
+class OutputFlusher {
+public:
+  /// \brief A region of the trace file to be written.
+  ///
+  struct Request {
+    int FD;
+    
+    off_t Offset;
+    
+    std::vector<char> Data;
+  };
+  
+  /// \brief Counters describing the flusher's activity.
+  ///
+  struct Statistics {
+    /// Number of requests written.
+    uint64_t Writes;
+    
+    /// Number of bytes written.
+    uint64_t Bytes;
+    
+    /// The largest number of requests that were waiting at one time.
+    uint64_t MaximumDepth;
+    
+    /// Number of times that a producer found the queue full.
+    uint64_t Stalls;
+    
+    /// Total time that producers spent waiting for room in the queue.
+    std::chrono::nanoseconds StallTime;
+  };
+  
+  /// \brief Start the writer thread.
+  ///
+  /// \param Capacity the number of requests that may be queued (this will be
+  ///                 rounded up to a power of two).
+  ///
+  OutputFlusher(size_t Capacity);
+  
+  /// \brief Write all queued requests and stop the writer thread.
+  ///
+  ~OutputFlusher();
+  
+  // Don't allow copying.
+  OutputFlusher(OutputFlusher const &) = delete;
+  OutputFlusher &operator=(OutputFlusher const &) = delete;
+  
+  /// \brief Queue Data to be written at Offset in the file FD.
+  ///
+  void write(int FD, off_t Offset, std::vector<char> Data);
+  
+  /// \brief Wait until all requests queued so far have been written.
+  ///
+  void drain();
+  
+  /// \brief Get the current number of requests that are waiting.
+  ///
+  uint64_t getDepth() const;
+  
+  /// \brief Get the flusher's counters.
+  ///
+  Statistics getStatistics() const;
+  
+private:
+  struct Cell {
+    std::atomic<size_t> Sequence;
+    
+    Request Value;
+  };
+  
+  /// \brief Attempt to add a request to the queue.
+  ///
+  bool tryPush(Request &Value);
+  
+  /// \brief Attempt to take a request from the queue (writer thread only).
+  ///
+  bool tryPop(Request &Value);
+  
+  /// \brief Wake the writer thread if it is waiting.
+  ///
+  void notifyWriter();
+  
+  /// \brief The writer thread's main loop.
+  ///
+  void run();
+  
+  /// \brief Check if this is the process that started the writer thread.
+  ///
+  /// A forked child has no writer thread, so it must not wait for one.
+  ///
+  bool isOwner() const;
+  
+  /// \name Queue.
+  /// @{
+  
+  std::unique_ptr<Cell[]> m_Cells;
+  
+  size_t const m_Mask;
+  
+  std::atomic<size_t> m_EnqueuePos;
+  
+  std::atomic<size_t> m_DequeuePos;
+  
+  /// @} (Queue.)
+  
+  /// \name Writer thread control.
+  /// @{
+  
+  int const m_OwnerPID;
+  
+  std::atomic<bool> m_Stop;
+  
+  std::atomic<bool> m_WriterWaiting;
+  
+  std::mutex m_WakeMutex;
+  
+  std::condition_variable m_WakeCV;
+  
+  std::thread m_Thread;
+  
+  /// @} (Writer thread control.)
+  
+  /// \name Counters.
+  /// @{
+  
+  std::atomic<uint64_t> m_Completed;
+  
+  std::atomic<uint64_t> m_Bytes;
+  
+  std::atomic<uint64_t> m_MaximumDepth;
+  
+  std::atomic<uint64_t> m_Stalls;
+  
+  std::atomic<uint64_t> m_StallNanoseconds;
+  
+  /// @} (Counters.)
+};
+
+
+/// \brief An in-memory image of a single output block.
+///
+/// Writes are copied into the image, which is written to its reserved region
+/// of the trace file with a single pwrite() when it is flushed. The same buffer
+/// is reused for each new block, so a \c OutputBlock::WriteRecord may refer to
+/// it for as long as the owning stream exists.
+///
+/// If the buffer has an \c OutputFlusher, then flushed blocks (and rewrites of
+/// flushed records) are queued for the flusher's writer thread instead.
+///
+/// A compressing buffer holds thread event blocks that are allocated in the
+/// compressed event offset space (see TraceCompression.hpp). Each block is
+/// compressed when it is flushed, and written to space allocated for it in
+/// the trace file at that time. Rewrites of flushed records are held as patch
+/// records, which are written with the next flushed block.
+///
+/// This class is not internally thread-safe.
+///
+class OutputBlockBuffer {
+public:
+  OutputBlockBuffer(int TraceFD, OutputFlusher *Flusher = nullptr)
+  : m_TraceFD(TraceFD),
+    m_Flusher(Flusher),
+    m_CompressTo(nullptr),
+    m_Ring(nullptr),
+    m_Data(),
+    m_BlockStart(0),
+    m_BlockEnd(0),
+    m_Used(0),
+    m_Dirty(false),
+    m_Patches()
+  {}
+  
+  /// \brief Create a compressing buffer, whose blocks will be written by
+  ///        CompressTo (or retained by Ring, if it is not null).
+  ///
+  OutputBlockBuffer(int TraceFD,
+                    OutputStreamAllocator &CompressTo,
+                    ThreadEventRing *Ring = nullptr)
+  : m_TraceFD(TraceFD),
+    m_Flusher(nullptr),
+    m_CompressTo(&CompressTo),
+    m_Ring(Ring),
+    m_Data(),
+    m_BlockStart(0),
+    m_BlockEnd(0),
+    m_Used(0),
+    m_Dirty(false),
+    m_Patches()
+  {}
+  
+  /// \brief Flushes the current block.
+  ///
+  ~OutputBlockBuffer() {
+    flush();
+  }
+  
+  /// \brief Flush the current block and begin buffering a new block.
+  ///
+  /// The new block occupies [BlockStart, BlockEnd) in the trace file. Its
+  /// header is written into the buffer immediately.
+  ///
+  void reset(BlockType Type, off_t BlockStart, off_t BlockEnd);
+  
+  /// If the write was successful, returns the offset at which the data will
+  /// be written in the trace file.
+  llvm::Optional<off_t> write(const void *buf, size_t nbyte);
+  
+  llvm::Optional<OutputBlock::WriteRecord>
+  rewritableWrite(const void *buf, size_t nbyte);
+  
+  /// \brief Check if [Offset, Offset + nbyte) is held in the current block.
+  ///
+  bool holds(off_t const Offset, size_t const nbyte) const {
+    return m_BlockStart <= Offset
+        && Offset + off_t(nbyte) <= m_BlockStart + m_Used;
+  }
+  
+  /// \brief Overwrite data that is held in the current block.
+  ///
+  /// pre: holds(Offset, nbyte)
+  ///
+  void overwrite(off_t Offset, const void *buf, size_t nbyte);
+  
+  /// \brief Write data to a region of the trace file that is no longer held
+  ///        in the buffer.
+  ///
+  /// If there is a flusher then the write is queued behind the earlier images
+  /// of the region, otherwise it is written immediately.
+  ///
+  type_safe::boolean writeThrough(off_t Offset, const void *buf, size_t nbyte);
+  
+  /// \brief Write the current block to the trace file, if it has changed.
+  ///
+  /// The block remains buffered, so later writes will extend it and cause it
+  /// to be written again by the next flush.
+  ///
+  type_safe::boolean flush();
+  
+  /// \brief Drop the current block without writing it.
+  ///
+  void discard();
+  
+  /// \brief Check if blocks are compressed when they are flushed.
+  ///
+  bool isCompressing() const { return m_CompressTo != nullptr; }
+  
+  /// \brief Get the offset of the current block in the trace file.
+  ///
+  off_t getBlockStart() const { return m_BlockStart; }
+
+private:
+  int const m_TraceFD;
+  
+  /// If not null, flushed blocks are written by this flusher.
+  OutputFlusher * const m_Flusher;
+  
+  /// If not null, flushed blocks are compressed and written by this allocator.
+  OutputStreamAllocator * const m_CompressTo;
+  
+  /// If not null, compressed blocks are retained by this ring.
+  ThreadEventRing * const m_Ring;
+  
+  /// The image of the current block (including its header).
+  std::vector<char> m_Data;
+  
+  /// Offset of the current block in the trace file.
+  off_t m_BlockStart;
+  
+  /// Offset of the end of the current block in the trace file.
+  off_t m_BlockEnd;
+  
+  /// Number of bytes of the current block that have been written.
+  off_t m_Used;
+  
+  /// Has the buffer changed since it was last flushed?
+  bool m_Dirty;
+  
+  /// Patch records for blocks that have been compressed and written.
+  std::vector<char> m_Patches;
+};
+
+
 /// \brief
 /// Accumulates output in a buffer, then commits it to the
 /// \c OutputStreamAllocator in a single block.
@@ -201,6 +594,7 @@ public:
   : m_Output(Output),
     m_BlockType(Type),
     m_BlockSize(BlockSize),
+    m_Mappings(),
     m_Block(),
     m_HeaderWriter()
   {}
@@ -228,6 +622,9 @@ private:
   
   off_t const m_BlockSize;
   
+  /// Keeps the memory of mapped blocks valid while the stream exists.
+  std::shared_ptr<OutputMappedChunks> m_Mappings;
+  
   llvm::Optional<OutputBlock> m_Block;
   
   std::function<HeaderWriterFnTy> m_HeaderWriter;
@@ -235,60 +632,265 @@ private:
 
 
 /// \brief 
-/// This class is synchronized.
+/// This class is not internally thread-safe.
+///
+/// If the stream is created with an \c OutputBlockBuffer, then small writes
+/// are accumulated in memory and each block is written to the trace file in a
+/// single operation.
 ///
 class OutputBlockProcessDataStream {
 public:
-  OutputBlockProcessDataStream(OutputStreamAllocator &Output)
+  OutputBlockProcessDataStream(OutputStreamAllocator &Output,
+                               std::unique_ptr<OutputBlockBuffer> Buffer)
   : m_Output(Output),
-    m_OutputStream(Output, BlockType::ProcessData, getBlockSize())
+    m_OutputStream(Output, BlockType::ProcessData, getBlockSize()),
+    m_Buffer(std::move(Buffer))
   {}
   
   llvm::Optional<off_t> write(void const *Data, size_t Size);
   
-private:
-  /// The size of standard data blocks.
-  static constexpr off_t getBlockSize() { return 4096; }
+  /// \brief Write any buffered data to the trace file.
+  ///
+  void flush();
+  
+  /// \brief Drop any buffered data without writing it.
+  ///
+  void discard();
   
   /// If a single write is larger than this, use a separate individual block
   /// to store the write.
   static constexpr size_t getSingleBlockThreshold() { return 1024; }
+
+private:
+  /// The size of standard data blocks.
+  static constexpr off_t getBlockSize() { return 4096; }
+  
+  /// The size of buffered data blocks.
+  static constexpr off_t getBufferedBlockSize() { return 64 * 1024; }
   
   OutputStreamAllocator &m_Output;
   
   OutputBlockStream m_OutputStream;
+  
+  std::unique_ptr<OutputBlockBuffer> m_Buffer;
+};
+
+
+/// \brief Retains a thread's most recent compressed event blocks in memory,
+///        for the flight-recorder tracing mode.
+///
+/// Blocks are grouped into segments. Every segment except the first begins
+/// with a checkpoint, which is a snapshot of the thread's stack and of the
+/// shared process state (see \c TraceThreadListener::writeCheckpoint()). When
+/// the retained blocks exceed the ring's capacity, whole segments are dropped
+/// from the front, so the oldest retained segment always begins with a
+/// complete snapshot.
+///
+/// The retained blocks are written to the trace when the ring is written.
+/// Only the oldest retained checkpoint is needed to recreate the thread's
+/// state, so the checkpoint blocks of later segments are omitted (and their
+/// patch records are carried by the next block that is written). Once the
+/// ring has been written, later blocks are written immediately.
+///
+/// The ring is only written when the thread's stream is flushed, which
+/// happens when the process exits normally, when it is terminated by an error
+/// that SeeC detects, or when one of the signals that SeeC polls for (such as
+/// SIGTERM) is received. If the process is killed by a signal that can't be
+/// caught (SIGKILL), or if the tracing runtime itself crashes, then the
+/// retained blocks are lost. This is no worse than the other modes, in which
+/// the ProcessTrace block is also only written at exit.
+///
+/// This class is not internally thread-safe.
+///
+class ThreadEventRing {
+public:
+  /// \brief Create a ring that retains at least Capacity bytes of compressed
+  ///        blocks, which will be written by Output.
+  ///
+  ThreadEventRing(OutputStreamAllocator &Output, uint64_t Capacity)
+  : m_Output(Output),
+    m_Capacity(Capacity),
+    m_Entries(),
+    m_RetainedBytes(0),
+    m_Segment(0),
+    m_SegmentBytes(0),
+    m_CheckpointBlocks(),
+    m_Written(false)
+  {}
+  
+  /// \brief Add a compressed block that has been flushed.
+  ///
+  type_safe::boolean add(offset_uint BlockOffset, std::vector<char> Block);
+  
+  /// \brief Begin a new segment.
+  ///
+  void beginSegment();
+  
+  /// \brief Mark the block at BlockOffset as holding the current segment's
+  ///        checkpoint.
+  ///
+  void addCheckpointBlock(offset_uint BlockOffset);
+  
+  /// \brief Check if enough events have been added to the current segment
+  ///        that a new segment should be started.
+  ///
+  bool isCheckpointDue() const {
+    return !m_Written
+        && m_SegmentBytes >= m_Capacity / getSegmentsPerCapacity();
+  }
+  
+  /// \brief Write the retained blocks to the trace file.
+  ///
+  type_safe::boolean write();
+  
+  /// \brief Drop the retained blocks without writing them.
+  ///
+  void discard();
+
+private:
+  /// The number of segments that fill the ring's capacity.
+  static constexpr uint64_t getSegmentsPerCapacity() { return 4; }
+  
+  /// \brief A retained compressed block.
+  ///
+  struct Entry {
+    /// The segment that the block belongs to.
+    uint64_t Segment;
+    
+    /// Is this block part of its segment's checkpoint?
+    bool IsCheckpoint;
+    
+    /// The complete compressed block.
+    std::vector<char> Block;
+  };
+  
+  /// \brief Drop the oldest segments until the ring is within its capacity.
+  ///
+  void dropSegments();
+  
+  OutputStreamAllocator &m_Output;
+  
+  uint64_t const m_Capacity;
+  
+  /// The retained blocks, in the order that they were flushed.
+  std::deque<Entry> m_Entries;
+  
+  /// Total size of the retained blocks.
+  uint64_t m_RetainedBytes;
+  
+  /// The current segment.
+  uint64_t m_Segment;
+  
+  /// Size of the current segment's blocks (excluding its checkpoint).
+  uint64_t m_SegmentBytes;
+  
+  /// Offsets of the blocks holding the current segment's checkpoint.
+  std::vector<offset_uint> m_CheckpointBlocks;
+  
+  /// Has the ring been written?
+  bool m_Written;
 };
 
 
 /// \brief
 /// This class is not internally thread-safe.
 ///
+/// If the stream is created with an \c OutputBlockBuffer, then events are
+/// accumulated in memory and each block is written to the trace file in a
+/// single operation. Otherwise each event is written to the trace file
+/// immediately.
+///
 class OutputBlockThreadEventStream {
 public:
   OutputBlockThreadEventStream(OutputStreamAllocator &Output,
-                               uint32_t ThreadID)
-  : m_ThreadID(ThreadID),
+                               uint32_t ThreadID,
+                               std::unique_ptr<OutputBlockBuffer> Buffer,
+                               std::unique_ptr<ThreadEventRing> Ring = nullptr)
+  : m_Output(Output),
+    m_ThreadID(ThreadID),
     m_OutputStream(Output, BlockType::ThreadEvents, getBlockSize(),
-                   [this] (OutputBlock &B) { this->writeHeader(B); })
+                   [this] (OutputBlock &B) { this->writeHeader(B); }),
+    m_Ring(std::move(Ring)),
+    m_Buffer(std::move(Buffer)),
+    m_StartNewBlock(false),
+    m_InCheckpoint(false)
   {}
   
-  llvm::Optional<off_t> write(void const * const Data, size_t const Size) {
-    return m_OutputStream.write(Data, Size);
-  }
+  /// \brief Flushes any buffered events and writes the ring (if any).
+  ///
+  ~OutputBlockThreadEventStream();
+  
+  llvm::Optional<off_t> write(void const * const Data, size_t const Size);
   
   llvm::Optional<OutputBlock::WriteRecord>
-  rewritableWrite(const void * const Data, size_t const Size) {
-    return m_OutputStream.rewritableWrite(Data, Size);
-  }
+  rewritableWrite(const void * const Data, size_t const Size);
+  
+  /// \brief Write any buffered events to the trace file.
+  ///
+  void flush();
+  
+  /// \brief Drop any buffered events without writing them.
+  ///
+  void discard();
+  
+  /// \name Flight recorder.
+  /// @{
+  
+  /// \brief Check if a new checkpoint should be written.
+  ///
+  bool isCheckpointDue() const { return m_Ring && m_Ring->isCheckpointDue(); }
+  
+  /// \brief Begin a new ring segment. The following events, until
+  ///        endCheckpoint(), are the segment's checkpoint.
+  ///
+  /// The checkpoint's events are written in blocks of their own.
+  ///
+  void beginCheckpoint();
+  
+  /// \brief End the current segment's checkpoint.
+  ///
+  void endCheckpoint();
+  
+  /// \brief Write memory contents for the current checkpoint.
+  ///
+  /// The data is held in a block of its own, which belongs to the current
+  /// segment's checkpoint, so it is dropped (or omitted) along with the rest
+  /// of the checkpoint.
+  ///
+  /// pre: between beginCheckpoint() and endCheckpoint().
+  ///
+  /// \return the offset of the data, if it was written.
+  ///
+  llvm::Optional<off_t> writeCheckpointData(llvm::ArrayRef<char> Data);
   
+  /// @} (Flight recorder.)
+
 private:
   static constexpr off_t getBlockSize() { return 4096; }
   
+  static constexpr off_t getBufferedBlockSize() { return 64 * 1024; }
+  
   void writeHeader(OutputBlock &Block);
   
+  void getNewBufferedBlock();
+  
+  OutputStreamAllocator &m_Output;
+  
   uint32_t m_ThreadID;
   
   OutputBlockStream m_OutputStream;
+  
+  /// If not null, compressed blocks are retained by this ring. It must be
+  /// destroyed after m_Buffer, which refers to it.
+  std::unique_ptr<ThreadEventRing> m_Ring;
+  
+  std::unique_ptr<OutputBlockBuffer> m_Buffer;
+  
+  /// Should the next write begin a new buffered block?
+  bool m_StartNewBlock;
+  
+  /// Are the events being written part of a checkpoint?
+  bool m_InCheckpoint;
 };
 
 
@@ -306,14 +908,67 @@ class OutputStreamAllocator {
   /// The root file descriptor for the trace file.
   int m_TraceFD;
   
+  /// Should thread events and process data be buffered in memory?
+  bool m_BufferOutput;
+  
+  /// Should buffered thread events be compressed?
+  bool m_CompressThreadEvents;
+  
+  /// If not zero, each thread's events are retained in a \c ThreadEventRing
+  /// of this capacity (in bytes).
+  uint64_t m_ThreadEventRingCapacity;
+  
   /// 
   std::atomic<off_t> m_TraceOffset;
   
+  /// Next free offset in the compressed event offset space.
+  std::atomic<offset_uint> m_CompressedOffset;
+  
+  /// If not null, buffered output is written by this flusher.
+  OutputFlusher *m_Flusher;
+  
+  /// \name Memory-mapped output.
+  /// @{
+  
+  /// Is the trace file written through memory mappings?
+  bool const m_UseMapping;
+  
+  /// The process that created the trace file (only it may trim the file).
+  int const m_OwnerPID;
+  
+  /// Mapped chunks of the trace file, indexed by offset / getMappedChunkSize().
+  std::shared_ptr<OutputMappedChunks> m_MappedChunks;
+  
+  /// The size that the trace file has been extended to.
+  std::atomic<off_t> m_MappedSize;
+  
+  /// Controls extension of the trace file and creation of mappings.
+  std::mutex m_MappingMutex;
+  
+  static constexpr off_t getMappedChunkSize() { return 64 * 1024 * 1024; }
+  
+  static constexpr size_t getMaximumMappedChunks() { return 8192; }
+  
+  /// \brief Ensure that the trace file covers [0, End), mapping new chunks.
+  ///
+  void extendMapping(off_t End);
+  
+  /// \brief Get a pointer to the mapped memory for [Offset, End).
+  ///
+  /// Ensures that the trace file covers the region. Returns nullptr if the
+  /// region is not contained in a single mapped chunk, in which case it must
+  /// be written with pwrite().
+  ///
+  char *getMappedRegion(off_t Offset, off_t End);
+  
+  /// @} (Memory-mapped output.)
+  
   /// \brief Create a new OutputStreamAllocator.
   ///
   OutputStreamAllocator(llvm::StringRef WithTraceName,
                         bool UserSpecifiedTraceName,
-                        int TraceFD);
+                        int TraceFD,
+                        bool UseMapping);
   
   // Don't allow copying.
   OutputStreamAllocator(OutputStreamAllocator const &) = delete;
@@ -335,6 +990,13 @@ public:
   seec::Maybe<std::unique_ptr<OutputStreamAllocator>, seec::Error>
   createOutputStreamAllocator();
   
+  /// \brief Trim the trace file to its final size.
+  ///
+  /// The trace file is unmapped when the last stream that shares its mapped
+  /// chunks has also been destroyed.
+  ///
+  ~OutputStreamAllocator();
+  
   /// @} (Construction.)
   
   
@@ -345,6 +1007,21 @@ public:
   ///
   uint64_t getTotalSize() const;
   
+  /// \brief Check if thread events and process data are buffered in memory.
+  ///
+  bool isOutputBuffered() const { return m_BufferOutput; }
+  
+  /// \brief Check if buffered thread events are compressed.
+  ///
+  bool isCompressingThreadEvents() const { return m_CompressThreadEvents; }
+  
+  /// \brief Get the mapped chunks of the trace file (or nullptr if the trace
+  ///        file is not written through memory mappings).
+  ///
+  std::shared_ptr<OutputMappedChunks> const &getMappedChunks() const {
+    return m_MappedChunks;
+  }
+  
   /// @} (Accessors.)
   
   
@@ -355,10 +1032,55 @@ public:
   ///
   void updateTraceName(llvm::StringRef ProgramName);
   
+  /// \brief Set the flusher that will write buffered output.
+  ///
+  /// This must be set before any streams are created, and cleared before the
+  /// flusher is destroyed. It has no effect unless isOutputBuffered().
+  ///
+  void setFlusher(OutputFlusher *Flusher);
+  
+  /// \brief Retain the most recent Capacity bytes of each thread's events in
+  ///        memory, and write them when the thread's stream is closed.
+  ///
+  /// This must be set before any streams are created. It has no effect
+  /// unless isCompressingThreadEvents().
+  ///
+  void setThreadEventRingCapacity(uint64_t Capacity);
+  
+  /// \brief Wait until all buffered output that has been flushed so far has
+  ///        been written to the trace file.
+  ///
+  void waitForPendingWrites();
+  
   /// \brief Create a new output block in the trace file.
   ///
   llvm::Optional<OutputBlock> getOutputBlock(BlockType Type, off_t NBytes);
   
+  /// \brief Create a new output block in the trace file, which will be filled
+  ///        by the given \c OutputBlockBuffer.
+  ///
+  /// If the buffer is compressing, then the block is allocated in the
+  /// compressed event offset space instead.
+  ///
+  void getBufferedOutputBlock(OutputBlockBuffer &Buffer,
+                              BlockType Type,
+                              off_t NBytes);
+  
+  /// \brief Write a complete compressed block to the end of the trace file.
+  ///
+  /// The block's NextBlock field is set to match its position in the file.
+  ///
+  type_safe::boolean writeCompressedBlock(std::vector<char> Block);
+  
+  /// \brief Write Data to the trace in a new block of its own.
+  ///
+  /// If the write was successful, returns the offset at which the data was
+  /// written.
+  ///
+  llvm::Optional<off_t> writeSingleBlock(BlockType Type,
+                                         void const *Data,
+                                         size_t Size);
+  
   /// \brief Write the Module's bitcode to the trace.
   ///
   seec::Maybe<seec::Error> writeModule(llvm::StringRef Bitcode);
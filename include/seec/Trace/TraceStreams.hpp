@@ -119,6 +119,14 @@ public:
   ///
   void streamClosed(FILE *Stream);
   
+  /// \brief Call Fn(Stream, Info) for each open stream.
+  ///
+  template<typename FnT>
+  void forEachStream(FnT Fn) const {
+    for (auto const &Pair : Streams)
+      Fn(Pair.first, Pair.second);
+  }
+  
   /// @} (FILE streams)
 };
 
@@ -159,6 +167,14 @@ public:
   ///
   void DIRClosed(void const *TheDIR);
   
+  /// \brief Call Fn(Address, Info) for each open DIR.
+  ///
+  template<typename FnT>
+  void forEachDIR(FnT Fn) const {
+    for (auto const &Pair : Dirs)
+      Fn(Pair.first, Pair.second);
+  }
+  
   /// @} (DIRs)
 };
 
@@ -22,6 +22,7 @@
 #include "seec/Trace/TraceFormat.hpp"
 #include "seec/Trace/TraceProcessListener.hpp"
 #include "seec/Trace/TraceStorage.hpp"
+#include "seec/Transforms/RecordExternal/InlineRecords.h"
 #include "seec/Util/Maybe.hpp"
 #include "seec/Util/ModuleIndex.hpp"
 #include "seec/Util/Serialization.hpp"
@@ -120,8 +121,9 @@ class TraceThreadListener
   /// nullptr if no Function is currently active.
   TracedFunction *ActiveFunction;
 
-  /// Global memory lock owned by this thread.
-  std::unique_lock<std::mutex> GlobalMemoryLock;
+  /// Global memory lock owned by this thread. This holds either all of the
+  /// global memory stripes, or only those used by the current load or store.
+  StripedMemoryLock GlobalMemoryLock;
 
   /// Dynamic memory lock owned by this thread.
   std::unique_lock<std::mutex> DynamicMemoryLock;
@@ -296,20 +298,24 @@ public:
   /// \name Memory states
   /// @{
   
-  /// \brief Acquire the GlobalMemoryLock, if we don't have it already.
+  /// \brief Acquire all of the GlobalMemoryLock, if we don't have it already.
   /// At the moment, this is identical to acquireGlobalMemoryReadLock(), but we
   /// may change to a multiple readers / single writer design in the future.
   void acquireGlobalMemoryWriteLock() {
-    if (!GlobalMemoryLock) {
+    if (!GlobalMemoryLock.owns_all()) {
+      // Stripes must be locked in order, so release any that we hold for a
+      // load or store before locking all of them.
+      GlobalMemoryLock.unlock();
       GlobalMemoryLock = ProcessListener.lockMemory();
     }
   }
   
-  /// \brief Acquire the GlobalMemoryLock, if we don't have it already.
+  /// \brief Acquire all of the GlobalMemoryLock, if we don't have it already.
   /// At the moment, this is identical to acquireGlobalMemoryWriteLock(), but we
   /// may change to a multiple readers / single writer design in the future.
   void acquireGlobalMemoryReadLock() {
-    if (!GlobalMemoryLock) {
+    if (!GlobalMemoryLock.owns_all()) {
+      GlobalMemoryLock.unlock();
       GlobalMemoryLock = ProcessListener.lockMemory();
     }
   }
@@ -398,6 +404,32 @@ public:
   ///
   void traceClose();
   
+  /// \brief Write any buffered events to the trace file.
+  ///
+  void traceFlush();
+  
+  /// \brief Disable future writes without writing any buffered events.
+  ///
+  /// This is used by forked child processes, whose buffered events belong to
+  /// the parent process.
+  ///
+  void traceAbandon();
+  
+  /// \brief Check if a flight-recorder checkpoint should be written.
+  ///
+  bool isCheckpointDue() const {
+    return OutputEnabled && EventsOut.isCheckpointDue();
+  }
+  
+  /// \brief Write a flight-recorder checkpoint.
+  ///
+  /// The checkpoint records this thread's stack, the shared memory state, and
+  /// the open streams and DIRs, so that the trace can be read from this point
+  /// if the preceding events are dropped. This must only be called between
+  /// notifications, when this thread holds no locks.
+  ///
+  void writeCheckpoint();
+  
   /// @} (Trace writing control.)
 
 
@@ -559,6 +591,19 @@ public:
   void notifyPostCall(InstrIndexInFn Index, llvm::CallInst const *Call,
                       void const *Address);
 
+  /// \brief Notify a call to a function that the instrumentation identified
+  ///        as detectable (used in place of notifyPreCall()).
+  ///
+  void notifyPreCallDetected(InstrIndexInFn Index, llvm::CallInst const *Call,
+                             detect_calls::Call Callee);
+
+  /// \brief Notify the completion of a call to a function that the
+  ///        instrumentation identified as detectable (used in place of
+  ///        notifyPostCall()).
+  ///
+  void notifyPostCallDetected(InstrIndexInFn Index, llvm::CallInst const *Call,
+                              detect_calls::Call Callee);
+
   void notifyPreCallIntrinsic(InstrIndexInFn Index, llvm::CallInst const *Call);
 
   void notifyPostCallIntrinsic(InstrIndexInFn Index,
@@ -579,6 +624,17 @@ public:
                       void const *Address,
                       std::size_t Size);
 
+private:
+  /// \brief Record the new state of memory after a store.
+  ///
+  /// The caller must hold the lock for the stored memory.
+  ///
+  void recordStore(InstrIndexInFn Index,
+                   llvm::StoreInst const *Store,
+                   void const *Address,
+                   std::size_t Size);
+
+public:
   void notifyPreStore(InstrIndexInFn Index,
                       llvm::StoreInst const *Store,
                       void const *Address,
@@ -589,6 +645,24 @@ public:
                        void const *Address,
                        std::size_t Size);
 
+  /// \brief Notify a load that the instrumentation proved to be statically
+  ///        safe (used in place of notifyPreLoad() and notifyPostLoad()).
+  ///
+  /// Only the initialization of the loaded memory is checked.
+  ///
+  void notifySafeLoad(InstrIndexInFn Index,
+                      llvm::LoadInst const *Load,
+                      void const *Address,
+                      std::size_t Size);
+
+  /// \brief Notify a store that the instrumentation proved to be statically
+  ///        safe (used in place of notifyPreStore() and notifyPostStore()).
+  ///
+  void notifySafeStore(InstrIndexInFn Index,
+                       llvm::StoreInst const *Store,
+                       void const *Address,
+                       std::size_t Size);
+
   void notifyPreDivide(InstrIndexInFn Index,
                        llvm::BinaryOperator const *Instruction);
 
@@ -627,6 +701,16 @@ public:
                    llvm::Instruction const *Instruction,
                    long double Value);
 
+  /// \brief Notify the values of instructions that the instrumented code
+  ///        recorded inline (see InlineRecords.h).
+  ///
+  /// The values are encoded directly into the event stream under a single
+  /// notification, rather than through one notifyValue() per record. Records
+  /// must hold values (not SeeCInlineRecordSetInstruction), and must not be
+  /// for intercepted calls.
+  ///
+  void notifyInlineValues(llvm::ArrayRef<SeeCInlineRecord> Records);
+
   /// @} (Thread Listener Notifications)
   
   
@@ -182,6 +182,11 @@ class RecordedFunction {
 
   /// Thread time at which this function was exited.
   uint64_t ThreadTimeExited;
+  
+  /// Copies of the FunctionStart event written in flight-recorder
+  /// checkpoints, which are rewritten along with the original.
+  std::vector<EventWriter::EventWriteRecord<EventType::FunctionStart>>
+    CheckpointWrites;
 
 public:
   /// \brief Constructor.
@@ -196,7 +201,8 @@ public:
     EventOffsetStart(Write.Offset),
     EventOffsetEnd(0),
     ThreadTimeEntered(WithThreadTimeEntered),
-    ThreadTimeExited(0)
+    ThreadTimeExited(0),
+    CheckpointWrites()
   {}
 
   /// Get the index of the Function in the Module.
@@ -220,6 +226,15 @@ public:
     assert(EventOffsetEnd == 0 && ThreadTimeExited == 0);
   }
 
+  /// \brief Add a copy of the FunctionStart event that was written in a
+  ///        checkpoint, so that it will be rewritten by setCompletion().
+  ///
+  void addCheckpointWrite(
+    EventWriter::EventWriteRecord<EventType::FunctionStart> Write)
+  {
+    CheckpointWrites.push_back(Write);
+  }
+  
   void setCompletion(EventWriter &Writer,
                      offset_uint const WithEventOffsetEnd,
                      uint64_t const WithThreadTimeExited);
@@ -0,0 +1,62 @@
+//===- include/seec/Transforms/RecordExternal/InlineRecords.h -------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Layout of the thread-local buffer used by inline recording. When inline
+/// recording is enabled, InsertExternalRecording writes records for common
+/// record points directly into this buffer (rather than calling the runtime),
+/// and the runtime notifies its listener of the buffered records when the
+/// buffer is full, or before any other notification from the same thread.
+///
+/// This layout is shared by the instrumentation pass, which generates IR for
+/// it, and the tracer runtime, which defines the buffer.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_TRANSFORMS_RECORDEXTERNAL_INLINERECORDS_H
+#define SEEC_TRANSFORMS_RECORDEXTERNAL_INLINERECORDS_H
+
+#include <stdint.h>
+
+/// Number of records held by each thread's buffer.
+#define SEEC_INLINE_RECORDS_CAPACITY 256
+
+extern "C" {
+
+/// \brief Kinds of inline records.
+///
+enum SeeCInlineRecordKind {
+  SeeCInlineRecordSetInstruction = 0,
+  SeeCInlineRecordUInt8          = 1,
+  SeeCInlineRecordUInt16         = 2,
+  SeeCInlineRecordUInt32         = 3,
+  SeeCInlineRecordUInt64         = 4,
+  SeeCInlineRecordFloat          = 5, ///< Value holds the float's bits.
+  SeeCInlineRecordDouble         = 6  ///< Value holds the double's bits.
+};
+
+/// \brief A single inline record (IR type { i32, i32, i64 }).
+///
+struct SeeCInlineRecord {
+  uint32_t Kind;  ///< A SeeCInlineRecordKind.
+  uint32_t Index; ///< Index of the Instruction in its Function.
+  uint64_t Value; ///< Value of the Instruction, zero-extended to 64 bits.
+};
+
+/// \brief A thread's buffer of inline records
+///        (IR type { i64, [SEEC_INLINE_RECORDS_CAPACITY x record] }).
+///
+struct SeeCInlineRecordBuffer {
+  uint64_t Count; ///< Number of records in use.
+  struct SeeCInlineRecord Records[SEEC_INLINE_RECORDS_CAPACITY];
+};
+
+}
+
+#endif // SEEC_TRANSFORMS_RECORDEXTERNAL_INLINERECORDS_H
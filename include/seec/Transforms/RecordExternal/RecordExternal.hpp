@@ -14,6 +14,7 @@
 #ifndef SEEC_TRANSFORMS_RECORDEXTERNAL_RECORDEXTERNAL_HPP
 #define SEEC_TRANSFORMS_RECORDEXTERNAL_RECORDEXTERNAL_HPP
 
+#include "seec/Transforms/RecordExternal/InlineRecords.h"
 #include "seec/Util/ModuleIndex.hpp"
 
 #include "llvm/Pass.h"
@@ -51,12 +52,30 @@ private:
   /// Path to SeeC resources.
   std::string const ResourcePath;
 
+  /// Write records for common record points inline (see InlineRecords.h).
+  bool const InlineRecording;
+
+  /// Don't record values that can be recomputed during replay (see
+  /// RecomputedValues.hpp).
+  bool const MinimalRecording;
+
+  /// The thread-local buffer for inline records, or nullptr if inline
+  /// recording is not being used for this Module.
+  GlobalVariable *InlineRecords;
+
   /// Set of all SeeC interceptor functions used by this Module.
   llvm::DenseMap<llvm::Function *, llvm::Function *> Interceptors;
   
   /// Original Instructions of the current Function
   std::vector<Instruction *> FunctionInstructions;
 
+  /// Flags the Instructions of the current Function whose values are not
+  /// recorded (empty unless MinimalRecording is used).
+  std::vector<bool> RecomputedInstructions;
+
+  /// Allocas in the current Function whose addresses are not captured.
+  llvm::SmallPtrSet<AllocaInst const *, 16> UncapturedAllocas;
+
   /// Index of instruction currently being instrumented
   uint32_t InstructionIndex;
 
@@ -89,6 +108,34 @@ private:
   CallInst *insertRecordUpdateForValue(Instruction &I,
                                        Instruction *Before = nullptr);
 
+  /// \brief Write a record into the inline record buffer.
+  /// \param Kind the kind of record.
+  /// \param RecordValue the record's value (an i64).
+  /// \param Before the record is written before this Instruction, which will
+  ///        be moved into a new BasicBlock.
+  ///
+  void insertInlineRecord(SeeCInlineRecordKind const Kind,
+                          Value *RecordValue,
+                          Instruction *Before);
+
+  /// \brief Check if an access is statically safe.
+  ///
+  /// An access is statically safe if it is entirely within an alloca whose
+  /// address is not captured. Such an access can't fail any of the runtime's
+  /// checks (except that a read may be uninitialized), and no other thread
+  /// can access the same memory.
+  ///
+  bool isStaticallySafeAccess(Value const *Pointer, uint64_t const Size) const;
+
+  /// \brief Get the ID that the runtime uses to detect calls to Fn.
+  ///
+  ConstantInt *getDetectedCall(Function const *Fn) const;
+
+  /// \brief Update an Instruction's runtime value using an inline record.
+  /// \return true iff the inline record was inserted.
+  ///
+  bool insertInlineRecordUpdateForValue(Instruction &I, Instruction *Before);
+
   /// @} (Helper methods.)
   
 public:
@@ -96,12 +143,24 @@ public:
 
   /// \brief Constructor.
   /// \param PathToSeeCResources path to SeeC resources.
+  /// \param WithInlineRecording write records for value updates and
+  ///        instruction changes into a thread-local buffer, rather than
+  ///        calling the runtime for each (if supported by the target).
+  /// \param WithMinimalRecording don't record the values of pure
+  ///        Instructions that can be recomputed when the trace is replayed.
   ///
-  InsertExternalRecording(llvm::StringRef PathToSeeCResources)
+  InsertExternalRecording(llvm::StringRef PathToSeeCResources,
+                          bool const WithInlineRecording = false,
+                          bool const WithMinimalRecording = false)
   : FunctionPass(ID),
     ResourcePath(PathToSeeCResources),
+    InlineRecording(WithInlineRecording),
+    MinimalRecording(WithMinimalRecording),
+    InlineRecords(nullptr),
     Interceptors(),
     FunctionInstructions(),
+    RecomputedInstructions(),
+    UncapturedAllocas(),
     InstructionIndex(),
     Int32Ty(nullptr),
     Int64Ty(nullptr),
@@ -16,12 +16,17 @@
 
 #include "seec/Util/IndexTypesForLLVMObjects.hpp"
 #include "seec/Util/Range.hpp"
+#include "seec/Util/RecomputedValues.hpp"
 
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/Support/Error.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace seec {
@@ -48,6 +53,10 @@ class FunctionIndex {
   /// Map allocas to the llvm.dbg.declare instructions that reference them.
   llvm::DenseMap<llvm::AllocaInst const *, InstrIndexInFn>
     AllocaToDbgDeclareIdx;
+  
+  /// Flags Instructions whose values are recomputed rather than recorded
+  /// (empty unless the Module uses minimal recording).
+  std::vector<bool> RecomputedInstructions;
 
 public:
   /// \brief Constructor.
@@ -57,7 +66,8 @@ public:
     InstructionIdxByPtr(),
     ArgumentPtrByIdx(),
     DbgDeclareInstList(),
-    AllocaToDbgDeclareIdx()
+    AllocaToDbgDeclareIdx(),
+    RecomputedInstructions()
   {
     for (auto &BasicBlock: Function) {
       for (auto &Instruction: BasicBlock) {
@@ -80,6 +90,9 @@ public:
     for (auto &Argument : Function.args()) {
       ArgumentPtrByIdx.push_back(&Argument);
     }
+    
+    if (hasMinimalRecording(*Function.getParent()))
+      RecomputedInstructions = getRecomputedInstructions(Function);
   }
   
   
@@ -115,6 +128,13 @@ public:
     return RetVal;
   }
   
+  /// \brief Check if the value of the Instruction at the given Index is
+  ///        recomputed during replay, rather than recorded.
+  bool isRecomputed(InstrIndexInFn Index) const {
+    return Index < RecomputedInstructions.size()
+           && RecomputedInstructions[Index.raw()];
+  }
+  
   /// @}
   
   
@@ -186,9 +206,54 @@ class ModuleIndex {
   /// Map Functions to their indices.
   llvm::DenseMap<llvm::Function const *, uint32_t> mutable FunctionIdxByPtr;
 
-  /// Store FunctionIndexs by the index of the Function.
-  std::vector<std::unique_ptr<FunctionIndex>> mutable FunctionIndexByIdx;
+  /// Owns the FunctionIndexs (only accessed while holding FunctionIndexMutex).
+  std::vector<std::unique_ptr<FunctionIndex>> mutable FunctionIndexStorage;
+  
+  /// Lookup FunctionIndexs by the index of the Function. Each pointer is
+  /// published (with release ordering) once its FunctionIndex is complete,
+  /// so that lookups don't need to hold FunctionIndexMutex.
+  std::unique_ptr<std::atomic<FunctionIndex *>[]> FunctionIndexByIdx;
 
+  /// Controls lazy construction of FunctionIndexs and materialization.
+  std::mutex mutable FunctionIndexMutex;
+  
+  /// \brief Materialize the Function's body, if it has not been.
+  ///
+  /// pre: FunctionIndexMutex is held.
+  ///
+  static bool materialize(llvm::Function &Function) {
+    if (!Function.isMaterializable())
+      return true;
+    
+    if (auto Err = Function.materialize()) {
+      llvm::consumeError(std::move(Err));
+      return false;
+    }
+    
+    return true;
+  }
+  
+  /// \brief Construct the FunctionIndex for the Function at Index.
+  ///
+  /// If the Module was loaded lazily, then the Function's body is materialized
+  /// first.
+  ///
+  FunctionIndex *createFunctionIndex(std::size_t const Index) const {
+    std::lock_guard<std::mutex> Lock(FunctionIndexMutex);
+    
+    if (auto const Existing = FunctionIndexByIdx[Index].load())
+      return Existing;
+    
+    auto &Function = *(FunctionPtrByIdx[Index]);
+    if (!materialize(Function))
+      return nullptr;
+    
+    FunctionIndexStorage.emplace_back(new FunctionIndex(Function));
+    auto const Created = FunctionIndexStorage.back().get();
+    FunctionIndexByIdx[Index].store(Created, std::memory_order_release);
+    return Created;
+  }
+  
   // do not implement
   ModuleIndex(ModuleIndex const &Other) = delete;
   ModuleIndex &operator=(ModuleIndex const &RHS) = delete;
@@ -200,7 +265,9 @@ public:
   : Module(Module),
     FunctionPtrByIdx(),
     FunctionIdxByPtr(),
-    FunctionIndexByIdx()
+    FunctionIndexStorage(),
+    FunctionIndexByIdx(),
+    FunctionIndexMutex()
   {
     // Index all GlobalVariables
     for (auto GIt = Module.global_begin(), GEnd = Module.global_end();
@@ -214,13 +281,16 @@ public:
     for (auto &Function: Module) {
       FunctionIdxByPtr[&Function] = FunctionPtrByIdx.size();
       FunctionPtrByIdx.push_back(&Function);
-      if (GenerateFunctionIndexForAll) {
-        FunctionIndexByIdx.emplace_back(new FunctionIndex(Function));
-      }
-      else {
-        FunctionIndexByIdx.emplace_back(nullptr); // will be lazily constructed
-      }
     }
+    
+    // FunctionIndexs will be lazily constructed.
+    FunctionIndexByIdx.reset(
+      new std::atomic<FunctionIndex *>[FunctionPtrByIdx.size()]);
+    for (std::size_t i = 0; i < FunctionPtrByIdx.size(); ++i)
+      FunctionIndexByIdx[i].store(nullptr, std::memory_order_relaxed);
+    
+    if (GenerateFunctionIndexForAll)
+      generateFunctionIndexForAll();
   }
   
   /// \brief Get the Module.
@@ -272,26 +342,37 @@ public:
 
   /// \brief Generate the FunctionIndex for all llvm::Functions.
   void generateFunctionIndexForAll() const {
-    for (std::size_t i = 0; i < FunctionIndexByIdx.size(); ++i) {
-      if (!FunctionIndexByIdx[i]) {
-        auto &Function = *(FunctionPtrByIdx[i]);
-        FunctionIndexByIdx[i].reset(new FunctionIndex(Function));
-      }
+    for (std::size_t i = 0; i < FunctionPtrByIdx.size(); ++i) {
+      if (!FunctionIndexByIdx[i].load(std::memory_order_acquire))
+        createFunctionIndex(i);
     }
   }
 
+  /// \brief Materialize the bodies of all llvm::Functions.
+  ///
+  /// Materializing a Function modifies the Module and its LLVMContext, which
+  /// isn't safe while other threads are reading the IR. If the Module was
+  /// loaded lazily, then this must be called before a second thread that
+  /// reads the IR is started.
+  ///
+  void materializeAll() const {
+    std::lock_guard<std::mutex> Lock(FunctionIndexMutex);
+    
+    for (auto const Function : FunctionPtrByIdx)
+      materialize(*Function);
+  }
+
   /// \brief Get the FunctionIndex for the llvm::Function with the given Index.
   FunctionIndex *getFunctionIndex(uint32_t Index) const {
-    if (Index >= FunctionIndexByIdx.size())
+    if (Index >= FunctionPtrByIdx.size())
       return nullptr;
 
-    // if no FunctionIndex exists, construct one now
-    if (!FunctionIndexByIdx[Index]) {
-      auto &Function = *(FunctionPtrByIdx[Index]);
-      FunctionIndexByIdx[Index].reset(new FunctionIndex(Function));
-    }
+    if (auto const Existing =
+          FunctionIndexByIdx[Index].load(std::memory_order_acquire))
+      return Existing;
 
-    return FunctionIndexByIdx[Index].get();
+    // if no FunctionIndex exists, construct one now
+    return createFunctionIndex(Index);
   }
 
   /// \brief Get the FunctionIndex for the given llvm::Function.
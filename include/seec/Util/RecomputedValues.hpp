@@ -0,0 +1,56 @@
+//===- include/seec/Util/RecomputedValues.hpp ----------------------- C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// Selects the Instructions whose runtime values are not recorded in minimal
+/// recording mode. These values are recomputed from their operands when the
+/// trace is replayed. The selection is shared by the instrumentation pass and
+/// the trace reader, so it must depend only on the uninstrumented Function.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_UTIL_RECOMPUTEDVALUES_HPP
+#define SEEC_UTIL_RECOMPUTEDVALUES_HPP
+
+#include <vector>
+
+namespace llvm {
+  class Function;
+  class Module;
+}
+
+namespace seec {
+
+/// \brief Check if a Module was instrumented with minimal recording.
+///
+bool hasMinimalRecording(llvm::Module const &M);
+
+/// \brief Mark a Module as being instrumented with minimal recording.
+///
+/// This must be done before the Module's bitcode is stored in the trace.
+///
+void setMinimalRecording(llvm::Module &M);
+
+/// \brief Find the Instructions whose values are recomputed during replay.
+///
+/// An Instruction is recomputed if it is an integer or floating point
+/// arithmetic, comparison, cast or select, whose operands are constants or
+/// Instructions in the same BasicBlock that have known values, and whose value
+/// is never needed by the tracing runtime. A recorded Instruction must follow
+/// it in its BasicBlock, so that replay reaches the point at which its value
+/// becomes available.
+///
+/// \return a flag for each Instruction in F, in the order that they are
+///         indexed by FunctionIndex.
+///
+std::vector<bool> getRecomputedInstructions(llvm::Function const &F);
+
+} // namespace seec
+
+#endif // SEEC_UTIL_RECOMPUTEDVALUES_HPP
@@ -0,0 +1,94 @@
+//===- Util/WorkerPool.hpp ------------------------------------------ C++ -===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef SEEC_UTIL_WORKERPOOL_HPP
+#define SEEC_UTIL_WORKERPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace seec {
+
+
+/// \brief A pool of long-lived worker threads that run batches of tasks.
+///
+/// Every task in a batch is guaranteed its own worker, so the tasks may wait
+/// for each other (the pool grows to fit the largest batch). Batches must not
+/// be run concurrently.
+///
+class WorkerPool {
+  std::mutex Access;
+  
+  /// Notified when a batch is available, or when the pool is stopping.
+  std::condition_variable WorkAvailable;
+  
+  /// Notified when the last task in a batch completes.
+  std::condition_variable WorkComplete;
+  
+  std::vector<std::thread> Workers;
+  
+  /// The current batch of tasks.
+  std::vector<std::function<void ()>> Tasks;
+  
+  /// The index of the next task in the batch to start.
+  std::size_t NextTask;
+  
+  /// The number of tasks in the batch that have not completed.
+  std::size_t RemainingTasks;
+  
+  bool Stopping;
+  
+  void workerMain();
+
+public:
+  /// \brief Constructor. Workers are not created until they are needed.
+  ///
+  WorkerPool()
+  : Access(),
+    WorkAvailable(),
+    WorkComplete(),
+    Workers(),
+    Tasks(),
+    NextTask(0),
+    RemainingTasks(0),
+    Stopping(false)
+  {}
+  
+  WorkerPool(WorkerPool const &) = delete;
+  
+  WorkerPool &operator=(WorkerPool const &) = delete;
+  
+  /// \brief Destructor. Stops and joins all workers.
+  ///
+  ~WorkerPool();
+  
+  /// \brief Get the number of worker threads.
+  ///
+  std::size_t size() {
+    std::lock_guard<std::mutex> Lock(Access);
+    return Workers.size();
+  }
+  
+  /// \brief Run each task in Batch concurrently, and wait for all of them to
+  ///        complete.
+  ///
+  void run(std::vector<std::function<void ()>> Batch);
+};
+
+
+} // namespace seec
+
+#endif // SEEC_UTIL_WORKERPOOL_HPP
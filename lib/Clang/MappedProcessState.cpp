@@ -81,9 +81,7 @@ ProcessState::ProcessState(seec::cm::ProcessTrace const &ForTrace)
 
 ProcessState::~ProcessState() = default;
 
-void ProcessState::cacheClear() {
-  // Clear process-level cached information.
-  CurrentValueStore = seec::cm::ValueStore::create(Trace.getMapping());
+void ProcessState::cacheStreamsAndDirs() {
   Streams.clear();
   Dirs.clear();
   
@@ -94,12 +92,43 @@ void ProcessState::cacheClear() {
   // Generate DIR information.
   for (auto const &Pair : UnmappedState->getDirs())
     Dirs.insert(std::make_pair(Pair.first, DIRState(Pair.second)));
+}
+
+void ProcessState::cacheClear() {
+  // Clear process-level cached information.
+  CurrentValueStore = seec::cm::ValueStore::create(Trace.getMapping());
+  UnmappedState->getMemory().clearChanges();
+  cacheStreamsAndDirs();
   
   // Clear thread-level cached information.
   for (auto &ThreadPtr : ThreadStates)
     ThreadPtr->cacheClear();
 }
 
+void ProcessState::cacheUpdate() {
+  auto &Memory = UnmappedState->getMemory();
+  
+  // If we don't know which areas changed, then we must clear everything
+  // (this also happens when the state was restored from a snapshot, which
+  // replaces every FunctionState).
+  if (Memory.haveChangesOverflowed()) {
+    cacheClear();
+    return;
+  }
+  
+  // Discard Values for memory that may have changed. Values in unchanged
+  // memory are kept, so clients will get the same objects as before.
+  CurrentValueStore->invalidate(Memory.getChangedAreas());
+  Memory.clearChanges();
+  
+  // Streams and DIRs are few and cheap to regenerate.
+  cacheStreamsAndDirs();
+  
+  // Update thread-level cached information.
+  for (auto &ThreadPtr : ThreadStates)
+    ThreadPtr->cacheUpdate();
+}
+
 void ProcessState::print(llvm::raw_ostream &Out,
                          seec::util::IndentationGuide &Indentation,
                          AugmentationCallbackFn Augmenter)
@@ -120,7 +120,7 @@ MovementResult moveForward(ThreadState &Thread)
                           return isLogicalPoint(T, MappedModule);
                         });
   
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -134,7 +134,7 @@ MovementResult moveForwardToEnd(ThreadState &Thread)
                           return T.isAtEnd();
                         });
   
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -200,7 +200,7 @@ MovementResult moveForwardToCompleteTopLevelStmt(ThreadState &Thread)
       return false;
     });
 
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
 
   return toCMResult(Moved);
 }
@@ -216,7 +216,7 @@ MovementResult moveBackward(ThreadState &Thread)
                           return isLogicalPoint(T, MappedModule);
                         });
   
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -230,7 +230,7 @@ MovementResult moveBackwardToEnd(ThreadState &Thread)
                           return T.isAtStart();
                         });
   
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -267,7 +267,7 @@ MovementResult moveBackwardToCompleteTopLevelStmt(ThreadState &Thread)
       return false;
     });
 
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
 
   return toCMResult(Moved);
 }
@@ -340,7 +340,7 @@ MovementResult moveToFunctionFinished(FunctionState &Function)
                                   && isLogicalPoint(T, MappedModule);
                         });
   
-  Process.cacheClear();
+  Process.cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -357,7 +357,7 @@ MovementResult moveForward(ProcessState &Process)
 {
   auto &Unmapped = Process.getUnmappedProcessState();
   auto const Moved = seec::trace::moveForward(Unmapped);
-  Process.cacheClear();
+  Process.cacheUpdate();
   return toCMResult(Moved);
 }
 
@@ -365,7 +365,16 @@ MovementResult moveBackward(ProcessState &Process)
 {
   auto &Unmapped = Process.getUnmappedProcessState();
   auto const Moved = seec::trace::moveBackward(Unmapped);
-  Process.cacheClear();
+  Process.cacheUpdate();
+  return toCMResult(Moved);
+}
+
+MovementResult moveToProcessTime(ProcessState &Process,
+                                 uint64_t const ProcessTime)
+{
+  auto &Unmapped = Process.getUnmappedProcessState();
+  auto const Moved = seec::trace::moveToProcessTime(Unmapped, ProcessTime);
+  Process.cacheUpdate();
   return toCMResult(Moved);
 }
 
@@ -380,25 +389,9 @@ MovementResult moveToAllocation(ProcessState &Process,
                                 stateptr_ty const Address)
 {
   auto &Unmapped = Process.getUnmappedProcessState();
+  auto const Moved = seec::trace::moveToAllocation(Unmapped, Address);
   
-  // Move backwards until the area is not allocated.
-  auto const Moved =
-    seec::trace::moveBackwardUntil(Unmapped,
-      [=] (seec::trace::ProcessState &P) -> bool {
-        return !P.getContainingMemoryArea(Address).assigned();
-      });
-  
-  // Now move forwards just enough that the area is allocated.
-  if (Moved == trace::MovementResult::PredicateSatisfied
-      && !Unmapped.getContainingMemoryArea(Address).assigned())
-  {
-    seec::trace::moveForwardUntil(Unmapped,
-      [=] (seec::trace::ProcessState &P) -> bool {
-        return P.getContainingMemoryArea(Address).assigned();
-      });
-  }
-  
-  Process.cacheClear();
+  Process.cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -407,25 +400,9 @@ MovementResult moveToDeallocation(ProcessState &Process,
                                   stateptr_ty const Address)
 {
   auto &Unmapped = Process.getUnmappedProcessState();
+  auto const Moved = seec::trace::moveToDeallocation(Unmapped, Address);
   
-  // Move forwards until the area is not allocated.
-  auto const Moved =
-    seec::trace::moveForwardUntil(Unmapped,
-      [=] (seec::trace::ProcessState &P) -> bool {
-        return !P.getContainingMemoryArea(Address).assigned();
-      });
-  
-  // Now move backwards just enough that the area is allocated.
-  if (Moved == trace::MovementResult::PredicateSatisfied
-      && !Unmapped.getContainingMemoryArea(Address).assigned())
-  {
-    seec::trace::moveBackwardUntil(Unmapped,
-      [=] (seec::trace::ProcessState &P) -> bool {
-        return P.getContainingMemoryArea(Address).assigned();
-      });
-  }
-  
-  Process.cacheClear();
+  Process.cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -436,7 +413,7 @@ MovementResult moveForwardUntilMemoryChanges(ProcessState &State,
   auto &Unmapped = State.getUnmappedProcessState();
   auto const Moved = seec::trace::moveForwardUntilMemoryChanges(Unmapped, Area);
   
-  State.cacheClear();
+  State.cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -448,7 +425,7 @@ MovementResult moveBackwardUntilMemoryChanges(ProcessState &State,
   auto const Moved = seec::trace::moveBackwardUntilMemoryChanges(Unmapped,
                                                                  Area);
   
-  State.cacheClear();
+  State.cacheUpdate();
   
   return toCMResult(Moved);
 }
@@ -459,7 +436,7 @@ MovementResult moveBackwardUntilAllocated(ProcessState &State,
   auto &Unmapped = State.getUnmappedProcessState();
   auto const Moved = seec::trace::moveBackwardUntilAllocated(Unmapped, Address);
 
-  State.cacheClear();
+  State.cacheUpdate();
 
   return toCMResult(Moved);
 }
@@ -481,7 +458,7 @@ MovementResult moveBackwardToStreamWriteAt(ProcessState &MappedState,
   auto const Moved =
     seec::trace::moveBackwardToStreamWriteAt(State, Stream, Position);
 
-  MappedState.cacheClear();
+  MappedState.cacheUpdate();
 
   return toCMResult(Moved);
 }
@@ -525,7 +502,7 @@ MovementResult moveForwardUntilEvaluated(ThreadState &Thread,
       return false;
     });
 
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
 
   return toCMResult(Moved);
 }
@@ -562,7 +539,7 @@ MovementResult moveBackwardUntilEvaluated(ThreadState &Thread,
       return false;
     });
 
-  Thread.getParent().cacheClear();
+  Thread.getParent().cacheUpdate();
 
   return toCMResult(Moved);
 }
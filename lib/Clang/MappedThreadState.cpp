@@ -18,6 +18,8 @@
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+
 
 namespace seec {
 
@@ -40,7 +42,11 @@ ThreadState::ThreadState(ProcessState &WithParent,
 ThreadState::~ThreadState() = default;
 
 void ThreadState::cacheClear() {
-  generateCallStack();
+  generateCallStack(0);
+}
+
+void ThreadState::cacheUpdate() {
+  generateCallStack(UnmappedState.getUnchangedCallStackDepth());
 }
 
 void ThreadState::print(llvm::raw_ostream &Out,
@@ -93,14 +99,20 @@ bool ThreadState::isAtEnd() const {
 // Call stack
 //===----------------------------------------------------------------------===//
 
-void ThreadState::generateCallStack() {
-  CallStack.clear();
-  CallStackRefs.clear();
+void ThreadState::generateCallStack(std::size_t From) {
+  auto const &UnmappedCallStack = UnmappedState.getCallStack();
   
-  for (auto const &RawFunctionStatePtr : UnmappedState.getCallStack()) {
-    CallStack.emplace_back(new FunctionState(*this, *RawFunctionStatePtr));
+  From = std::min(From, std::min(CallStack.size(), UnmappedCallStack.size()));
+  
+  CallStack.erase(CallStack.begin() + From, CallStack.end());
+  CallStackRefs.erase(CallStackRefs.begin() + From, CallStackRefs.end());
+  
+  for (auto i = From; i < UnmappedCallStack.size(); ++i) {
+    CallStack.emplace_back(new FunctionState(*this, *UnmappedCallStack[i]));
     CallStackRefs.emplace_back(*CallStack.back());
   }
+  
+  UnmappedState.clearCallStackChanges();
 }
 
 
@@ -40,7 +40,9 @@
 #include "llvm/Support/Host.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cctype>
+#include <map>
 #include <string>
 
 
@@ -72,14 +74,36 @@ Value::~Value() = default;
 // ValueStoreImpl
 //===----------------------------------------------------------------------===//
 
+/// \brief Get the number of bytes of memory that a Value depends on.
+///
+static uint64_t getValueExtent(Value const &Val)
+{
+  auto const MaybeRegion = Val.getUnmappedMemoryRegion();
+  if (MaybeRegion.assigned()) {
+    auto const Length = MaybeRegion.get<0>().getArea().length();
+    if (Length)
+      return Length;
+  }
+
+  return 1;
+}
+
 class TypedValueSet {
   std::vector<std::pair<MatchType, std::shared_ptr<Value const>>> Items;
 
+  /// The largest number of bytes that any Value in this set depends on.
+  uint64_t Extent;
+
 public:
   TypedValueSet()
-  : Items()
+  : Items(),
+    Extent(1)
   {}
 
+  uint64_t getExtent() const { return Extent; }
+
+  bool empty() const { return Items.empty(); }
+
   std::shared_ptr<Value const> getShared(MatchType const &ForType) const {
     for (auto const &Pair : Items)
       if (Pair.first == ForType)
@@ -106,6 +130,7 @@ public:
   }
 
   void add(MatchType const &ForType, std::shared_ptr<Value const> Val) {
+    Extent = std::max(Extent, getValueExtent(*Val));
     Items.emplace_back(ForType, std::move(Val));
   }
 };
@@ -117,7 +142,15 @@ class ValueStoreImpl final {
   // Two-stage lookup to find previously created Value objects.
   // The first stage is the in-memory address of the object.
   // The second stage is the canonical type of the object.
-  mutable llvm::DenseMap<stateptr_ty, TypedValueSet> Store;
+  // The first stage is ordered so that we can find the Values that overlap an
+  // area of memory (see invalidate()).
+  mutable std::map<stateptr_ty, TypedValueSet> Store;
+
+  /// Disjoint areas (from start to end address) that together cover the
+  /// memory of every Value in the Store. A Value that overlaps an address
+  /// starts within the covering area that contains the address, so this
+  /// bounds the search in invalidate() by the extents of nearby Values only.
+  mutable std::map<stateptr_ty, stateptr_ty> Coverage;
 
   /// SeeC-Clang mapping information.
   seec::seec_clang::MappedModule const &Mapping;
@@ -133,6 +166,7 @@ public:
   ValueStoreImpl(seec::seec_clang::MappedModule const &WithMapping)
   : StoreAccess(),
     Store(),
+    Coverage(),
     Mapping(WithMapping)
   {}
 
@@ -146,6 +180,16 @@ public:
            seec::trace::ProcessState const &ProcessState,
            seec::trace::FunctionState const *OwningFunction) const;
 
+  /// \brief Add the area from Start to End to the Coverage.
+  ///
+  /// \pre StoreAccess is locked.
+  ///
+  void addCoverage(stateptr_ty Start, stateptr_ty End) const;
+
+  /// \brief Remove all Values that overlap any of the given areas.
+  ///
+  void invalidate(llvm::ArrayRef<MemoryArea> Areas) const;
+
   /// \brief Get SeeC-Clang mapping information.
   ///
   seec::seec_clang::MappedModule const &getMapping() const { return Mapping; }
@@ -2549,10 +2593,80 @@ ValueStoreImpl::getValue(std::shared_ptr<ValueStore const> StorePtr,
 
   // Store a shared_ptr for this Value in the lookup table.
   TypeMap.add(Matcher, SharedPtr);
+  addCoverage(Address, Address + TypeMap.getExtent());
 
   return SharedPtr;
 }
 
+void ValueStoreImpl::addCoverage(stateptr_ty Start, stateptr_ty End) const
+{
+  // Merge with the covering areas that overlap or adjoin this area.
+  auto It = Coverage.upper_bound(Start);
+  if (It != Coverage.begin() && std::prev(It)->second >= Start) {
+    --It;
+    Start = It->first;
+  }
+
+  while (It != Coverage.end() && It->first <= End) {
+    End = std::max(End, It->second);
+    It = Coverage.erase(It);
+  }
+
+  Coverage.emplace(Start, End);
+}
+
+void ValueStoreImpl::invalidate(llvm::ArrayRef<MemoryArea> Areas) const
+{
+  std::lock_guard<std::mutex> LockStore(StoreAccess);
+
+  for (auto const &Area : Areas) {
+    if (Store.empty())
+      return;
+
+    // No Value starting before the covering area that contains Area's start
+    // can overlap Area.
+    auto FirstCover = Coverage.upper_bound(Area.start());
+    if (FirstCover != Coverage.begin()
+        && std::prev(FirstCover)->second > Area.start())
+      --FirstCover;
+
+    if (FirstCover == Coverage.end() || FirstCover->first >= Area.end())
+      continue;
+
+    auto const Lowest = std::min(FirstCover->first, Area.start());
+
+    auto It = Store.lower_bound(Lowest);
+    auto const End = Store.lower_bound(Area.end());
+    bool Erased = false;
+
+    while (It != End) {
+      if (It->first + It->second.getExtent() > Area.start()) {
+        It = Store.erase(It);
+        Erased = true;
+      }
+      else
+        ++It;
+    }
+
+    if (!Erased)
+      continue;
+
+    // Recalculate the covering areas that contained the removed Values from
+    // the Values that remain in them.
+    auto const LastCover = Coverage.lower_bound(Area.end());
+    auto const RebuildStart = FirstCover->first;
+    auto const RebuildEnd = std::prev(LastCover)->second;
+    Coverage.erase(FirstCover, LastCover);
+
+    auto const RebuildFrom = Store.lower_bound(RebuildStart);
+    auto const RebuildTo = Store.lower_bound(RebuildEnd);
+    for (auto Rebuild = RebuildFrom; Rebuild != RebuildTo; ++Rebuild)
+      if (!Rebuild->second.empty())
+        addCoverage(Rebuild->first,
+                    Rebuild->first + Rebuild->second.getExtent());
+  }
+}
+
 
 //===----------------------------------------------------------------------===//
 // ValueStore
@@ -2575,6 +2689,11 @@ ValueStore::findFromAddressAndType(stateptr_ty Address,
   return Impl->findFromAddressAndType(Address, TypeString);
 }
 
+void ValueStore::invalidate(llvm::ArrayRef<MemoryArea> Areas) const
+{
+  Impl->invalidate(Areas);
+}
+
 
 //===----------------------------------------------------------------------===//
 // getValue() from a type and address.
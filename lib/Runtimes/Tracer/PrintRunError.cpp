@@ -79,6 +79,10 @@ void PrintRunError(seec::runtime_errors::RunError const &Error,
   Diagnostics->setSuppressSystemWarnings(true);
   Diagnostics->setIgnoreAllWarnings(true);
 
+  // The Module may have been loaded lazily, so ensure that every function has
+  // been materialized before mapping it.
+  ModIndex.generateFunctionIndexForAll();
+  
   // Setup the map to find Decls and Stmts from Instructions
   seec::seec_clang::MappedModule MapMod(ModIndex, Diagnostics);
 
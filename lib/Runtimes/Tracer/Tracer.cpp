@@ -33,6 +33,7 @@
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Threading.h"
@@ -40,6 +41,7 @@
 #include "unicode/locid.h"
 
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -51,9 +53,19 @@
 #include <Windows.h>
 #endif
 
+#include "seec/Transforms/RecordExternal/InlineRecords.h"
 #include "seec/Transforms/RecordExternal/RecordInfo.h" // needs <cstdint>
 
 
+extern "C" {
+
+/// Records written by inline recording in the instrumented code. This is
+/// trivially initialized, so the instrumented code can access it directly.
+thread_local SeeCInlineRecordBuffer SeeCInlineRecords;
+
+}
+
+
 namespace seec {
 
 namespace trace {
@@ -62,6 +74,18 @@ static constexpr char const *getTraceSizeLimitEnvVar() {
   return "SEEC_TRACE_LIMIT";
 }
 
+static constexpr char const *getTraceAsyncEnvVar() {
+  return "SEEC_TRACE_ASYNC";
+}
+
+static constexpr char const *getTraceStatsEnvVar() {
+  return "SEEC_TRACE_STATS";
+}
+
+static constexpr char const *getTraceRingEnvVar() {
+  return "SEEC_TRACE_RING";
+}
+
 
 //------------------------------------------------------------------------------
 // ThreadEnvironment
@@ -90,7 +114,11 @@ void ThreadEnvironment::checkOutputSize()
 
     auto &ProcessListener = Process.getProcessListener();
     ProcessListener.traceClose();
+    return;
   }
+  
+  if (ThreadTracer.isCheckpointDue())
+    ThreadTracer.writeCheckpoint();
 }
 
 void ThreadEnvironment::pushFunction(llvm::Function *Fun) {
@@ -109,6 +137,37 @@ llvm::Function *ThreadEnvironment::popFunction() {
   return Fun.Function;
 }
 
+void ThreadEnvironment::flushInlineRecords()
+{
+  auto &Buffer = SeeCInlineRecords;
+  auto const Count = Buffer.Count;
+  
+  // Empty the buffer first, in case a notification is re-entrant. The
+  // listener never runs instrumented code, so nothing is written to the
+  // buffer while its records are compacted in place.
+  Buffer.Count = 0;
+  
+  // Keep the value records, dropping those for intercepted calls (whose
+  // values are recorded by the interceptors).
+  uint64_t Kept = 0;
+  
+  for (uint64_t i = 0; i < Count; ++i) {
+    auto const &Record = Buffer.Records[i];
+    
+    setInstructionIndex(InstrIndexInFn{Record.Index});
+    
+    if (Record.Kind == SeeCInlineRecordSetInstruction
+        || getInstructionIsInterceptedCall())
+      continue;
+    
+    Buffer.Records[Kept++] = Record;
+  }
+  
+  if (Kept)
+    ThreadTracer.notifyInlineValues(
+      llvm::ArrayRef<SeeCInlineRecord>(Buffer.Records, Kept));
+}
+
 llvm::Instruction *ThreadEnvironment::getInstruction() const {
   return getFunctionIndex()
          .getInstruction(InstrIndexInFn{Stack.back().InstructionIndex});
@@ -199,18 +258,56 @@ static offset_uint getUserTraceSizeLimit()
   return (1024 * 1024 * 1024); // 1GiB
 }
 
+/// \brief Get the number of blocks that may wait for the background writer,
+///        or zero if output should not be written in the background.
+///
+/// SEEC_TRACE_ASYNC may be set to the queue length, or to any other value to
+/// use the default queue length.
+///
+/// NOTE: This function uses std::getenv() and thus is not thread-safe.
+///
+static std::size_t getUserTraceAsyncQueueLength()
+{
+  auto const EnvVar = std::getenv(getTraceAsyncEnvVar());
+  if (!EnvVar)
+    return 0;
+  
+  char *Remainder = nullptr;
+  auto const Value = std::strtoull(EnvVar, &Remainder, 10);
+  if (Remainder == EnvVar)
+    return 256;
+  
+  return static_cast<std::size_t>(Value);
+}
+
+/// \brief Get the number of bytes of each thread's events to retain in the
+///        flight-recorder mode, or zero if the mode is not enabled.
+///
+/// NOTE: This function uses std::getenv() and thus is not thread-safe.
+///
+static uint64_t getUserTraceRingCapacity()
+{
+  auto const EnvVarName = getTraceRingEnvVar();
+  if (auto const EnvVar = std::getenv(EnvVarName))
+    return getByteSizeFromEnvVar(EnvVarName, EnvVar);
+  
+  return 0;
+}
+
 ProcessEnvironment::ProcessEnvironment()
 : Context(),
   Mod(),
   ModIndex(),
   StreamAllocator(),
+  Flusher(),
   ICUResourceLoader(),
   ProcessTracer(),
   ThreadLookup(),
   ThreadLookupMutex(),
   InterceptorAddresses(),
   TraceSizeLimit(getUserTraceSizeLimit()),
-  ProgramName()
+  ProgramName(),
+  PrintTraceStatistics(std::getenv(getTraceStatsEnvVar()) != nullptr)
 {
   // On windows, lookup the module's globals.
 #if defined(_WIN32)
@@ -241,15 +338,19 @@ ProcessEnvironment::ProcessEnvironment()
   
   ICUResourceLoader.reset(new ResourceLoader(__SeeC_ResourcePath__));
 
-  // Parse the Module bitcode, which is stored in a global variable.
+  // Load the Module bitcode, which is stored in a global variable. Function
+  // bodies are materialized lazily (by the ModuleIndex) when each function is
+  // first entered, so that short runs do not pay to parse the whole Module.
+  // Materialization isn't thread-safe, so all remaining bodies are
+  // materialized before the program creates its second thread.
+  // The bitcode lives in a global, so it outlives the Module.
   llvm::StringRef BitcodeRef {
     SeeCInfoModuleBitcode,
     static_cast<std::size_t>(SeeCInfoModuleBitcodeLength)
   };
   
-  auto BitcodeBuffer = llvm::MemoryBuffer::getMemBuffer(BitcodeRef, "", false);
-  auto MaybeMod = llvm::parseBitcodeFile(BitcodeBuffer->getMemBufferRef(),
-                                         Context);
+  llvm::MemoryBufferRef BitcodeBuffer(BitcodeRef, "");
+  auto MaybeMod = llvm::getLazyBitcodeModule(BitcodeBuffer, Context);
 
   if (!MaybeMod) {
     llvm::errs() << "\nSeeC: Failed to parse module bitcode.\n";
@@ -277,6 +378,25 @@ ProcessEnvironment::ProcessEnvironment()
     exit(EXIT_FAILURE);
   }
   
+  // Enable the flight recorder, if requested.
+  if (auto const RingCapacity = getUserTraceRingCapacity()) {
+    if (StreamAllocator->isCompressingThreadEvents()) {
+      StreamAllocator->setThreadEventRingCapacity(RingCapacity);
+    }
+    else {
+      llvm::errs() << "\nSeeC: " << getTraceRingEnvVar()
+                   << " requires buffered, compressed output; ignoring.\n";
+    }
+  }
+  
+  // Start the background writer, if requested.
+  if (StreamAllocator->isOutputBuffered()) {
+    if (auto const QueueLength = getUserTraceAsyncQueueLength()) {
+      Flusher.reset(new OutputFlusher(QueueLength));
+      StreamAllocator->setFlusher(Flusher.get());
+    }
+  }
+  
   // Attempt to load ICU resources.
   ICUResourceLoader->loadResource("Trace");
   ICUResourceLoader->loadResource("RuntimeErrors");
@@ -356,7 +476,43 @@ ProcessEnvironment::~ProcessEnvironment()
 {
   // Finalize the trace.
   ThreadLookup.clear();
+  
+  if (PrintTraceStatistics && ProcessTracer) {
+    auto const Stats = ProcessTracer->getDataStatistics();
+    auto const Ratio = Stats.RecordBytes
+                     ? double(Stats.DuplicateBytes) / Stats.RecordBytes
+                     : 0.0;
+    
+    llvm::errs() << "\nSeeC: Process data statistics:\n"
+                 << "  records:             " << Stats.Records << " ("
+                 << Stats.RecordBytes << " bytes)\n"
+                 << "  duplicates:          " << Stats.Duplicates << " ("
+                 << Stats.DuplicateBytes << " bytes)\n"
+                 << "  deduplication ratio: "
+                 << llvm::format("%.1f%%", Ratio * 100.0) << "\n";
+  }
+  
   ProcessTracer.reset();
+  
+  if (Flusher) {
+    StreamAllocator->setFlusher(nullptr);
+    Flusher->drain();
+    
+    if (PrintTraceStatistics) {
+      auto const Stats = Flusher->getStatistics();
+      auto const StallMS =
+        std::chrono::duration_cast<std::chrono::milliseconds>(Stats.StallTime);
+      
+      llvm::errs() << "\nSeeC: Trace output statistics:\n"
+                   << "  background writes:   " << Stats.Writes << "\n"
+                   << "  bytes written:       " << Stats.Bytes << "\n"
+                   << "  maximum queue depth: " << Stats.MaximumDepth << "\n"
+                   << "  producer stalls:     " << Stats.Stalls
+                   << " (" << StallMS.count() << " ms)\n";
+    }
+    
+    Flusher.reset();
+  }
 }
 
 ThreadEnvironment *ProcessEnvironment::getOrCreateCurrentThreadEnvironment()
@@ -371,6 +527,15 @@ ThreadEnvironment *ProcessEnvironment::getOrCreateCurrentThreadEnvironment()
   return ThreadEnvPtr.get();
 }
 
+void ProcessEnvironment::flushAllThreads()
+{
+  std::lock_guard<std::mutex> Lock{ThreadLookupMutex};
+  
+  for (auto const &Entry : ThreadLookup)
+    if (Entry.second)
+      Entry.second->getThreadListener().traceFlush();
+}
+
 void ProcessEnvironment::setProgramName(llvm::StringRef Name)
 {
   ProgramName = llvm::sys::path::filename(Name);
@@ -412,6 +577,11 @@ ThreadEnvironment &getThreadEnvironment() {
 
   assert(TE && "ThreadEnvironment not found!");
 
+  // Any records written inline by the instrumented code must be seen by the
+  // listener before the caller's notification.
+  if (SeeCInlineRecords.Count)
+    TE->flushInlineRecords();
+
   return *TE;
 }
 
@@ -488,6 +658,13 @@ void SeeCRecordSetInstruction(uint32_t const RawIndex) {
   ThreadEnv.setInstructionIndex(Index);
 }
 
+void SeeCRecordFlushInlineRecords() {
+  // getThreadEnvironment() flushes the inline records.
+  auto &ThreadEnv = seec::trace::getThreadEnvironment();
+
+  ThreadEnv.checkOutputSize();
+}
+
 void SeeCRecordPreAlloca(uint32_t const RawIndex,
                          uint64_t const ElemSize,
                          uint64_t const ElemCount)
@@ -552,6 +729,34 @@ void SeeCRecordPostStore(uint32_t RawIndex, void *Address, uint64_t Size) {
   ThreadEnv.checkOutputSize();
 }
 
+void SeeCRecordSafeLoad(uint32_t RawIndex, void *Address, uint64_t Size) {
+  auto const Index = seec::InstrIndexInFn{RawIndex};
+  auto &ThreadEnv = seec::trace::getThreadEnvironment();
+  ThreadEnv.setInstructionIndex(Index);
+
+  auto Load = llvm::dyn_cast<llvm::LoadInst>(ThreadEnv.getInstruction());
+  assert(Load && "Expected LoadInst");
+
+  auto &Listener = ThreadEnv.getThreadListener();
+  Listener.notifySafeLoad(Index, Load, Address, Size);
+
+  ThreadEnv.checkOutputSize();
+}
+
+void SeeCRecordSafeStore(uint32_t RawIndex, void *Address, uint64_t Size) {
+  auto const Index = seec::InstrIndexInFn{RawIndex};
+  auto &ThreadEnv = seec::trace::getThreadEnvironment();
+  ThreadEnv.setInstructionIndex(Index);
+
+  auto Store = llvm::dyn_cast<llvm::StoreInst>(ThreadEnv.getInstruction());
+  assert(Store && "Expected StoreInst");
+
+  auto &Listener = ThreadEnv.getThreadListener();
+  Listener.notifySafeStore(Index, Store, Address, Size);
+
+  ThreadEnv.checkOutputSize();
+}
+
 void SeeCRecordPreCall(uint32_t RawIndex, void *Address) {
   auto const Index = seec::InstrIndexInFn{RawIndex};
   auto &ThreadEnv = seec::trace::getThreadEnvironment();
@@ -584,6 +789,33 @@ void SeeCRecordPostCall(uint32_t RawIndex, void *Address) {
   ThreadEnv.checkOutputSize();
 }
 
+void SeeCRecordPreCallDetected(uint32_t RawIndex, uint32_t RawCallee) {
+  auto const Index = seec::InstrIndexInFn{RawIndex};
+  auto const Callee = static_cast<seec::trace::detect_calls::Call>(RawCallee);
+  auto &ThreadEnv = seec::trace::getThreadEnvironment();
+  ThreadEnv.setInstructionIndex(Index);
+
+  auto Call = llvm::dyn_cast<llvm::CallInst>(ThreadEnv.getInstruction());
+  assert(Call && "Expected CallInst");
+
+  auto &Listener = ThreadEnv.getThreadListener();
+  Listener.notifyPreCallDetected(Index, Call, Callee);
+}
+
+void SeeCRecordPostCallDetected(uint32_t RawIndex, uint32_t RawCallee) {
+  auto const Index = seec::InstrIndexInFn{RawIndex};
+  auto const Callee = static_cast<seec::trace::detect_calls::Call>(RawCallee);
+  auto &ThreadEnv = seec::trace::getThreadEnvironment();
+
+  auto Call = llvm::dyn_cast<llvm::CallInst>(ThreadEnv.getInstruction());
+  assert(Call && "Expected CallInst");
+
+  auto &Listener = ThreadEnv.getThreadListener();
+  Listener.notifyPostCallDetected(Index, Call, Callee);
+
+  ThreadEnv.checkOutputSize();
+}
+
 void SeeCRecordPreCallIntrinsic(uint32_t RawIndex) {
   auto const Index = seec::InstrIndexInFn{RawIndex};
   auto &ThreadEnv = seec::trace::getThreadEnvironment();
@@ -100,6 +100,16 @@ public:
   ///
   void checkOutputSize();
 
+  /// \brief Notify the listener of all records that the instrumented code
+  ///        has written into this thread's inline record buffer, and empty
+  ///        the buffer.
+  ///
+  /// This is called on entry to notifications (see getThreadEnvironment()),
+  /// before the notification has taken any locks, so it does not call
+  /// checkOutputSize(). Notifications check the output size when they exit.
+  ///
+  void flushInlineRecords();
+
   /// @}
   
   
@@ -182,6 +192,9 @@ class ProcessEnvironment {
   /// Allocator for the trace's output streams.
   std::unique_ptr<OutputStreamAllocator> StreamAllocator;
   
+  /// Writes buffered trace output in the background (if enabled).
+  std::unique_ptr<OutputFlusher> Flusher;
+  
   /// Loads ICU resources.
   std::unique_ptr<ResourceLoader> ICUResourceLoader;
 
@@ -203,6 +216,9 @@ class ProcessEnvironment {
   /// The program name as found in argv[0], if we were notified of it.
   std::string ProgramName;
   
+  /// Print statistics about the trace output when the process ends.
+  bool PrintTraceStatistics;
+  
 public:
   /// \brief Constructor.
   ///
@@ -211,7 +227,8 @@ public:
   /// \brief Destructor.
   ///
   /// Ensures that ThreadEnvironment objects, and thus ThreadListener objects,
-  /// are destroyed before the shared ProcessListener object.
+  /// are destroyed before the shared ProcessListener object, and that both
+  /// are destroyed before the Flusher writes the remaining output.
   ///
   ~ProcessEnvironment();
   
@@ -257,6 +274,13 @@ public:
   ///
   ThreadEnvironment *getOrCreateCurrentThreadEnvironment();
   
+  /// \brief Write the buffered events (or retained ring) of every thread.
+  ///
+  /// This is used when the process is about to terminate without destroying
+  /// the thread environments. The other threads may still be running.
+  ///
+  void flushAllThreads();
+  
   /// \brief Set the program name as found in argv[0].
   ///
   void setProgramName(llvm::StringRef Name);
@@ -44,6 +44,19 @@ static std::stack<void (*)()> AtQuickExitFunctions;
 static std::mutex AtQuickExitFunctionsMutex;
 
 
+/// \brief Write all buffered trace output before the process terminates
+///        without running static destructors.
+///
+static void flushTraceBeforeTermination()
+{
+  auto &ProcessEnv = seec::trace::getProcessEnvironment();
+  
+  ProcessEnv.flushAllThreads();
+  ProcessEnv.getProcessListener().traceFlush();
+  ProcessEnv.getStreamAllocator().waitForPendingWrites();
+}
+
+
 /// \brief Implement a checking bsearch.
 ///
 class BinarySearchImpl {
@@ -450,6 +463,8 @@ void
 SEEC_MANGLE_FUNCTION(abort)
 ()
 {
+  seec::flushTraceBeforeTermination();
+  
   std::abort();
 }
 
@@ -496,6 +511,8 @@ SEEC_MANGLE_FUNCTION(quick_exit)
     }
   }
   
+  seec::flushTraceBeforeTermination();
+  
   std::_Exit(exit_code);
 }
 
@@ -508,6 +525,8 @@ void
 SEEC_MANGLE_FUNCTION(_Exit)
 (int exit_code)
 {
+  seec::flushTraceBeforeTermination();
+  
   std::_Exit(exit_code);
 }
 
@@ -33,6 +33,11 @@ SEEC_MANGLE_FUNCTION(pthread_create)
  void *(*start_routine)(void *),
  void *arg)
 {
+  // Function bodies are materialized lazily, which is only safe while a
+  // single thread reads the IR. Materialize everything before the new thread
+  // can enter its first function.
+  seec::trace::getProcessEnvironment().getModuleIndex().materializeAll();
+  
   // Use the SimpleWrapper mechanism.
   return
     seec::SimpleWrapper
@@ -799,9 +799,12 @@ SEEC_MANGLE_FUNCTION(fork)
     // are waiting for us will need to update any environment references that
     // they are currently using (alternatively, no other threads should be
     // allowed to have an environment reference at the synchronization point).
+    // Buffered process data belongs to the parent even if tracing has been
+    // disabled, so it is always dropped.
+    ProcessListener.traceAbandon();
+    
     if (TraceEnabled) {
-      ProcessListener.traceClose();
-      Listener.traceClose();
+      Listener.traceAbandon();
     }
   }
   
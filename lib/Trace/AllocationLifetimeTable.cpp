@@ -0,0 +1,340 @@
+//===- lib/Trace/AllocationLifetimeTable.cpp ------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Trace/AllocationLifetimeTable.hpp"
+#include "seec/Trace/ThreadEventWalker.hpp"
+#include "seec/Trace/TraceReader.hpp"
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace seec {
+
+namespace trace {
+
+
+//------------------------------------------------------------------------------
+// AllocationLifetime
+//------------------------------------------------------------------------------
+
+uint64_t AllocationLifetime::getEarliestLive() const
+{
+  auto const Earliest = Birth.getEarliest();
+  
+  if (BirthEvent->getProcessTime() || Earliest == 0)
+    return Earliest;
+  
+  return Earliest - 1;
+}
+
+
+//------------------------------------------------------------------------------
+// build()
+//------------------------------------------------------------------------------
+
+struct AllocationLifetimeTable::DynamicEvent {
+  uint64_t ProcessTime;
+  
+  uint32_t ThreadID;
+  
+  EventRecordBase const *Event;
+  
+  /// The address of the allocation.
+  stateptr_ty Address;
+};
+
+void AllocationLifetimeTable::addThread(
+  ProcessTrace const &Trace,
+  uint32_t const ThreadID,
+  std::map<stateptr_ty, uint32_t> &KnownRegions,
+  std::vector<DynamicEvent> &Dynamic)
+{
+  typedef AllocationLifetime::KindTy KindTy;
+  
+  class LifetimeFinder : public ThreadEventWalker {
+    AllocationLifetimeTable &Table;
+    
+    std::map<stateptr_ty, uint32_t> &KnownRegions;
+    
+    std::vector<DynamicEvent> &Dynamic;
+    
+    // Lifetimes that started or ended since the most recent process time.
+    std::vector<uint32_t> PendingBirths;
+    std::vector<uint32_t> PendingDeaths;
+    
+    uint32_t born(MemoryArea const &Area,
+                  KindTy const Kind,
+                  EventRecordBase const &Ev) {
+      auto &Lifetimes = Table.Lifetimes;
+      auto const Index = static_cast<uint32_t>(Lifetimes.size());
+      Lifetimes.emplace_back(Area, Kind, getThreadID(), Ev,
+                             MemoryChange(0, 0));
+      PendingBirths.push_back(Index);
+      return Index;
+    }
+    
+    void died(uint32_t const Index, EventRecordBase const &Ev) {
+      Table.Lifetimes[Index].DeathEvent = &Ev;
+      PendingDeaths.push_back(Index);
+    }
+  
+  protected:
+    uint32_t stackAreaAdded(MemoryArea const &Area,
+                            EventRecordBase const &Ev) override {
+      return born(Area,
+                  Ev.getType() == EventType::Alloca ? KindTy::Alloca
+                                                    : KindTy::ByVal,
+                  Ev);
+    }
+    
+    void stackAreaRemoved(StackArea const &Area,
+                          EventRecordBase const &Ev) override {
+      died(Area.Handle, Ev);
+    }
+    
+    void dynamicEvent(EventRecordBase const &Ev,
+                      uint64_t const ProcessTime,
+                      stateptr_ty const Address) override {
+      Dynamic.push_back(DynamicEvent{ProcessTime, getThreadID(), &Ev,
+                                     Address});
+    }
+    
+    void event(EventRecordBase const &Ev) override {
+      switch (Ev.getType()) {
+        case EventType::KnownRegionAdd:
+        {
+          auto const &Record = Ev.as<EventType::KnownRegionAdd>();
+          KnownRegions[Record.getAddress()] =
+            born(MemoryArea(Record.getAddress(), Record.getSize()),
+                 KindTy::KnownRegion, Ev);
+          break;
+        }
+        
+        case EventType::KnownRegionRemove:
+        {
+          auto const &Record = Ev.as<EventType::KnownRegionRemove>();
+          auto const It = KnownRegions.find(Record.getAddress());
+          if (It != KnownRegions.end()) {
+            died(It->second, Ev);
+            KnownRegions.erase(It);
+          }
+          break;
+        }
+        
+        default:
+          break;
+      }
+    }
+    
+    // Set the times of all pending births and deaths.
+    void processTimeReached(uint64_t const Earliest,
+                            uint64_t const Latest) override {
+      auto const Change = MemoryChange(Earliest, Latest);
+      
+      for (auto const Index : PendingBirths)
+        Table.Lifetimes[Index].Birth = Change;
+      
+      for (auto const Index : PendingDeaths)
+        Table.Lifetimes[Index].Death = Change;
+      
+      PendingBirths.clear();
+      PendingDeaths.clear();
+    }
+  
+  public:
+    LifetimeFinder(AllocationLifetimeTable &ForTable,
+                   ProcessTrace const &Trace,
+                   uint32_t const ThreadID,
+                   std::map<stateptr_ty, uint32_t> &WithKnownRegions,
+                   std::vector<DynamicEvent> &WithDynamic)
+    : ThreadEventWalker(Trace, ThreadID),
+      Table(ForTable),
+      KnownRegions(WithKnownRegions),
+      Dynamic(WithDynamic),
+      PendingBirths(),
+      PendingDeaths()
+    {}
+  };
+  
+  LifetimeFinder(*this, Trace, ThreadID, KnownRegions, Dynamic).walk();
+}
+
+void AllocationLifetimeTable::addDynamic(std::vector<DynamicEvent> &Dynamic)
+{
+  typedef AllocationLifetime::KindTy KindTy;
+  
+  // Replay the events in process time order, to find the allocation that each
+  // Free and Realloc ends.
+  std::stable_sort(Dynamic.begin(), Dynamic.end(),
+                   [] (DynamicEvent const &LHS, DynamicEvent const &RHS) {
+                     return LHS.ProcessTime < RHS.ProcessTime;
+                   });
+  
+  // The current lifetime of each allocation, by address.
+  std::map<stateptr_ty, uint32_t> Live;
+  
+  auto const Add = [&] (DynamicEvent const &D,
+                        std::size_t const Size,
+                        KindTy const Kind) -> uint32_t {
+    auto const Index = static_cast<uint32_t>(Lifetimes.size());
+    Lifetimes.emplace_back(MemoryArea(D.Address, Size), Kind, D.ThreadID,
+                           *D.Event, MemoryChange(D.ProcessTime,
+                                                  D.ProcessTime));
+    Live[D.Address] = Index;
+    return Index;
+  };
+  
+  // End the current lifetime of the allocation at D.Address.
+  auto const End = [&] (DynamicEvent const &D) -> uint32_t {
+    auto const It = Live.find(D.Address);
+    if (It == Live.end())
+      return AllocationLifetime::noLifetime();
+    
+    auto const Index = It->second;
+    Lifetimes[Index].DeathEvent = D.Event;
+    Lifetimes[Index].Death = MemoryChange(D.ProcessTime, D.ProcessTime);
+    Live.erase(It);
+    return Index;
+  };
+  
+  for (auto const &D : Dynamic) {
+    auto const &Ev = *D.Event;
+    
+    switch (Ev.getType()) {
+      case EventType::CheckpointMalloc:
+        Add(D, Ev.as<EventType::CheckpointMalloc>().getSize(), KindTy::Malloc);
+        break;
+      
+      case EventType::Malloc:
+        Add(D, Ev.as<EventType::Malloc>().getSize(), KindTy::Malloc);
+        break;
+      
+      case EventType::Free:
+        End(D);
+        break;
+      
+      case EventType::Realloc:
+      {
+        auto const Previous = End(D);
+        auto const Index = Add(D, Ev.as<EventType::Realloc>().getNewSize(),
+                               KindTy::Realloc);
+        
+        if (Previous != AllocationLifetime::noLifetime()) {
+          Lifetimes[Previous].Next = Index;
+          Lifetimes[Index].Previous = Previous;
+        }
+        break;
+      }
+      
+      default:
+        llvm_unreachable("unexpected dynamic memory allocation event");
+    }
+  }
+}
+
+void AllocationLifetimeTable::build(ProcessTrace const &Trace)
+{
+  std::vector<DynamicEvent> Dynamic;
+  std::map<stateptr_ty, uint32_t> KnownRegions;
+  
+  for (uint32_t i = 1; i <= Trace.getNumThreads(); ++i)
+    addThread(Trace, i, KnownRegions, Dynamic);
+  
+  addDynamic(Dynamic);
+  
+  // Sort the indices.
+  auto const BirthOrder = [this] (uint32_t const LHS, uint32_t const RHS) {
+    return Lifetimes[LHS].getEarliestLive()
+           < Lifetimes[RHS].getEarliestLive();
+  };
+  
+  ByBirth.resize(Lifetimes.size());
+  for (uint32_t i = 0; i < ByBirth.size(); ++i)
+    ByBirth[i] = i;
+  
+  std::stable_sort(ByBirth.begin(), ByBirth.end(), BirthOrder);
+  
+  ByStart = ByBirth;
+  std::stable_sort(ByStart.begin(), ByStart.end(),
+                   [this] (uint32_t const LHS, uint32_t const RHS) {
+                     return Lifetimes[LHS].Area.start()
+                            < Lifetimes[RHS].Area.start();
+                   });
+}
+
+
+//------------------------------------------------------------------------------
+// AllocationLifetimeTable
+//------------------------------------------------------------------------------
+
+AllocationLifetimeTable::AllocationLifetimeTable(ProcessTrace const &Trace)
+: Lifetimes(),
+  ByStart(),
+  ByBirth()
+{
+  build(Trace);
+}
+
+AllocationLifetimeTable::~AllocationLifetimeTable() = default;
+
+AllocationLifetime const *
+AllocationLifetimeTable::find(stateptr_ty const Start,
+                              uint64_t const ProcessTime) const
+{
+  // Find the first lifetime that starts after Start, or that starts at Start
+  // and is born after ProcessTime. The lifetime preceding it is the latest
+  // born at Start. Allocations at the same address don't overlap, so if that
+  // lifetime has ended then no earlier lifetime can exist at ProcessTime.
+  auto const It = std::upper_bound(ByStart.begin(), ByStart.end(), Start,
+                    [&] (stateptr_ty const Address, uint32_t const Index) {
+                      auto const &Lifetime = Lifetimes[Index];
+                      return Address < Lifetime.Area.start()
+                             || (Address == Lifetime.Area.start()
+                                 && ProcessTime < Lifetime.getEarliestLive());
+                    });
+  
+  if (It == ByStart.begin())
+    return nullptr;
+  
+  auto const &Lifetime = Lifetimes[*std::prev(It)];
+  
+  if (Lifetime.Area.start() != Start || !Lifetime.mayBeLiveAt(ProcessTime))
+    return nullptr;
+  
+  return &Lifetime;
+}
+
+std::vector<AllocationLifetime const *>
+AllocationLifetimeTable::getLiveAt(uint64_t const ProcessTime) const
+{
+  std::vector<AllocationLifetime const *> Result;
+  
+  for (auto const Index : ByBirth) {
+    auto const &Lifetime = Lifetimes[Index];
+    
+    if (Lifetime.getEarliestLive() > ProcessTime)
+      break;
+    
+    if (Lifetime.mayBeLiveAt(ProcessTime))
+      Result.push_back(&Lifetime);
+  }
+  
+  return Result;
+}
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
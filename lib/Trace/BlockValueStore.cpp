@@ -21,6 +21,8 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <cstring>
+
 #include <type_safe/narrow_cast.hpp>
 
 
@@ -212,6 +214,22 @@ BasicBlockStore::BasicBlockStore(BasicBlockInfo const &Info)
                 llvm::APFloat(0.0f))
 {}
 
+BasicBlockStore::BasicBlockStore(BasicBlockInfo const &Info,
+                                 BasicBlockStore const &Other)
+: m_Data(new char[static_cast<uint32_t>(Info.getTotalDataSize())]),
+  m_ValuesSet(Other.m_ValuesSet),
+  m_LongDoubles(Other.m_LongDoubles)
+{
+  std::memcpy(m_Data.get(),
+              Other.m_Data.get(),
+              static_cast<uint32_t>(Info.getTotalDataSize()));
+}
+
+void BasicBlockStore::clear()
+{
+  m_ValuesSet.assign(m_ValuesSet.size(), false);
+}
+
 bool
 BasicBlockStore::hasValue(BasicBlockInfo const &Info,
                           InstrIndexInFn const InstrIndex)
@@ -369,6 +387,35 @@ const
   return RetVal;
 }
 
+BasicBlockStorePool::BasicBlockStorePool()
+: m_Unused()
+{}
+
+std::unique_ptr<BasicBlockStore>
+BasicBlockStorePool::acquire(llvm::BasicBlock const *BB,
+                             BasicBlockInfo const &Info)
+{
+  auto const It = m_Unused.find(BB);
+  if (It == m_Unused.end() || It->second.empty())
+    return llvm::make_unique<BasicBlockStore>(Info);
+  
+  auto Store = std::move(It->second.back());
+  It->second.pop_back();
+  Store->clear();
+  return Store;
+}
+
+void BasicBlockStorePool::release(llvm::BasicBlock const *BB,
+                                  std::unique_ptr<BasicBlockStore> Store)
+{
+  if (!Store)
+    return;
+  
+  auto &Unused = m_Unused[BB];
+  if (Unused.size() < getMaxUnusedPerBlock())
+    Unused.emplace_back(std::move(Store));
+}
+
 } // value_store
 
 } // namespace trace (in seec)
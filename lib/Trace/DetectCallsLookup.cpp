@@ -67,14 +67,12 @@ seec::Maybe<Call> Lookup::Check(void const *Address) const {
 }
 
 bool Lookup::Set(llvm::StringRef Name, void const *Address) {
-#define DETECT_CALL(PREFIX, NAME, ARGTYPES) \
-  if (Name.equals(#NAME)) { \
-    AddressMap.insert(std::make_pair(Address, Call::PREFIX##NAME)); \
-    return true; \
-  }
-#include "seec/Trace/DetectCallsAll.def"
+  auto const MaybeCall = getCallForName(Name);
+  if (!MaybeCall.assigned())
+    return false;
   
-  return false;
+  AddressMap.insert(std::make_pair(Address, MaybeCall.get<0>()));
+  return true;
 }
 
 
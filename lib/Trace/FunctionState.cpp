@@ -13,6 +13,7 @@
 
 #include "seec/Trace/BlockValueStore.hpp"
 #include "seec/Trace/FunctionState.hpp"
+#include "seec/Trace/GetRecreatedValue.hpp"
 #include "seec/Trace/IsRecordableType.hpp"
 #include "seec/Trace/MemoryState.hpp"
 #include "seec/Trace/ThreadState.hpp"
@@ -20,9 +21,12 @@
 #include "seec/Trace/ProcessState.hpp"
 #include "seec/Util/ModuleIndex.hpp"
 
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+
 namespace seec {
 
 namespace trace {
@@ -95,8 +99,87 @@ FunctionState::FunctionState(ThreadState &Parent,
   ClearedBlocks()
 {}
 
+FunctionState::FunctionState(ThreadState &WithParent,
+                             FunctionState const &Other)
+: Parent(&WithParent),
+  FunctionLookup(Other.FunctionLookup),
+  ValueStoreInfo(Other.ValueStoreInfo),
+  Index(Other.Index),
+  m_Trace(llvm::make_unique<FunctionTrace>(*Other.m_Trace)),
+  ActiveInstruction(Other.ActiveInstruction),
+  ActiveInstructionComplete(Other.ActiveInstructionComplete),
+  Allocas(),
+  ParamByVals(Other.ParamByVals),
+  RuntimeErrors(),
+  ActiveBlocks(),
+  BackwardsJumps(Other.BackwardsJumps),
+  ClearedBlocks()
+{
+  // AllocaStates and RuntimeErrorStates refer to their parent, so they must
+  // be recreated rather than copied.
+  Allocas.reserve(Other.Allocas.size());
+  for (auto const &Alloca : Other.Allocas)
+    Allocas.emplace_back(*this,
+                         Alloca.getInstructionIndex(),
+                         Alloca.getAddress(),
+                         Alloca.getElementSize(),
+                         Alloca.getElementCount());
+  
+  RuntimeErrors.reserve(Other.RuntimeErrors.size());
+  for (auto const &Error : Other.RuntimeErrors)
+    RuntimeErrors.emplace_back(*this,
+                               Error.getInstructionIndex(),
+                               Error.getRunError().clone(),
+                               Error.getThreadTime());
+  
+  for (auto const &Pair : Other.ActiveBlocks) {
+    auto const Info = ValueStoreInfo.getBasicBlockInfo(Pair.first);
+    assert(Info && "no basic block info for block?");
+    ActiveBlocks[Pair.first] =
+      llvm::make_unique<value_store::BasicBlockStore>(*Info, *Pair.second);
+  }
+  
+  for (auto const &Pair : Other.ClearedBlocks) {
+    auto const Info = ValueStoreInfo.getBasicBlockInfo(Pair.first);
+    assert(Info && "no basic block info for block?");
+    ClearedBlocks.emplace_back(
+      Pair.first,
+      llvm::make_unique<value_store::BasicBlockStore>(*Info, *Pair.second));
+  }
+}
+
 FunctionState::~FunctionState() = default;
 
+std::unique_ptr<FunctionState>
+FunctionState::clone(ThreadState &WithParent) const
+{
+  return std::unique_ptr<FunctionState>(new FunctionState(WithParent, *this));
+}
+
+std::size_t FunctionState::getApproximateSize() const
+{
+  std::size_t Size = sizeof(*this)
+                   + Allocas.capacity() * sizeof(AllocaState)
+                   + ParamByVals.capacity() * sizeof(ParamByValState)
+                   + RuntimeErrors.capacity() * sizeof(RuntimeErrorState)
+                   + BackwardsJumps.size()
+                     * sizeof(BasicBlockBackwardsJumpRecord);
+  
+  auto const BlockSize = [this] (llvm::BasicBlock const *BB) -> std::size_t {
+    auto const Info = ValueStoreInfo.getBasicBlockInfo(BB);
+    return sizeof(value_store::BasicBlockStore)
+           + (Info ? static_cast<uint32_t>(Info->getTotalDataSize()) : 0);
+  };
+  
+  for (auto const &Pair : ActiveBlocks)
+    Size += BlockSize(Pair.first);
+  
+  for (auto const &Pair : ClearedBlocks)
+    Size += BlockSize(Pair.first);
+  
+  return Size;
+}
+
 llvm::Function const *FunctionState::getFunction() const {
   return Parent->getParent().getModule().getFunction(Index);
 }
@@ -130,6 +213,165 @@ FunctionState::getContainingMemoryArea(stateptr_ty Address) const {
   return seec::Maybe<MemoryArea>();
 }
 
+value_store::BasicBlockStorePool &FunctionState::getStorePool()
+{
+  return Parent->getBasicBlockStorePool();
+}
+
+void FunctionState::activateEmptyStore(llvm::BasicBlock const *BB)
+{
+  auto const BBInfo = ValueStoreInfo.getBasicBlockInfo(BB);
+  assert(BBInfo && "no basic block info for block?");
+  
+  auto &Pool = getStorePool();
+  auto &Store = ActiveBlocks[BB];
+  Pool.release(BB, std::move(Store));
+  Store = Pool.acquire(BB, *BBInfo);
+  assert(Store && "null BasicBlockStore");
+}
+
+/// \brief Set the runtime value recorded by an instruction event.
+///
+static void setValueFromEvent(FunctionState &State, EventRecordBase const &Ev)
+{
+  auto const Instruction = State.getInstruction(*Ev.getIndex());
+  
+  switch (Ev.getType()) {
+    case EventType::InstructionWithUInt8:
+      State.setValueUInt64(Instruction,
+                           Ev.as<EventType::InstructionWithUInt8>().getValue());
+      break;
+    
+    case EventType::InstructionWithUInt16:
+      State.setValueUInt64(Instruction,
+                           Ev.as<EventType::InstructionWithUInt16>()
+                             .getValue());
+      break;
+    
+    case EventType::InstructionWithUInt32:
+      State.setValueUInt64(Instruction,
+                           Ev.as<EventType::InstructionWithUInt32>()
+                             .getValue());
+      break;
+    
+    case EventType::InstructionWithUInt64:
+      State.setValueUInt64(Instruction,
+                           Ev.as<EventType::InstructionWithUInt64>()
+                             .getValue());
+      break;
+    
+    case EventType::InstructionWithPtr:
+      State.setValuePtr(Instruction,
+                        Ev.as<EventType::InstructionWithPtr>().getValue());
+      break;
+    
+    case EventType::InstructionWithFloat:
+      State.setValueFloat(Instruction,
+                          Ev.as<EventType::InstructionWithFloat>().getValue());
+      break;
+    
+    case EventType::InstructionWithDouble:
+      State.setValueDouble(Instruction,
+                           Ev.as<EventType::InstructionWithDouble>()
+                             .getValue());
+      break;
+    
+    case EventType::InstructionWithLongDouble:
+    {
+      auto const &LDEv = Ev.as<EventType::InstructionWithLongDouble>();
+      uint64_t const Words[2] = { LDEv.getValueWord1(), LDEv.getValueWord2() };
+      
+      if (Instruction->getType()->isX86_FP80Ty()) {
+        State.setValueAPFloat(Instruction,
+                              llvm::APFloat(llvm::APFloat::x87DoubleExtended(),
+                                            llvm::APInt(80, Words)));
+      }
+      else {
+        llvm_unreachable("unhandled long double type");
+      }
+      break;
+    }
+    
+    default:
+      break;
+  }
+}
+
+void FunctionState::restoreClearedBlocks(EventReference const &FromEvent)
+{
+  /// \brief A BasicBlock whose runtime values are being restored.
+  ///
+  struct OpenBlock {
+    llvm::BasicBlock const *Block;
+    
+    /// Index of the BasicBlock's first Instruction.
+    uint32_t Begin;
+    
+    /// Index following the BasicBlock's last Instruction.
+    uint32_t End;
+  };
+  
+  auto const FromIndex = *FromEvent->getIndex();
+  auto const FromBB = FunctionLookup->getInstruction(FromIndex)->getParent();
+  auto const ToBB = getActiveInstruction()->getParent();
+  
+  // The jump cleared all BBs from the one it jumped to, up to and including
+  // the one it jumped from. Give each of them an empty store.
+  std::vector<OpenBlock> Open;
+  
+  for (auto BB = ToBB; true; BB = BB->getNextNode()) {
+    auto const Info = ValueStoreInfo.getBasicBlockInfo(BB);
+    assert(Info && "no basic block info for block?");
+    
+    auto const Begin = Info->getInstructionIndexBase().raw();
+    auto const Count = static_cast<uint32_t>(Info->getInstructionCount());
+    Open.push_back(OpenBlock{BB, Begin, Begin + Count});
+    activateEmptyStore(BB);
+    
+    if (BB == FromBB) {
+      break;
+    }
+  }
+  
+  // Re-add values from the preceding instructions, until we find the previous
+  // backwards jump that cleared each BB.
+  auto const &Trace = Parent->getTrace();
+  auto LaterIndex = FromIndex;
+  
+  for (auto MaybeEv = llvm::Optional<EventReference>(FromEvent);
+       MaybeEv && !Open.empty();
+       MaybeEv = MaybeEv->getPreviousInstructionInFunction(Trace))
+  {
+    auto const &Ev = **MaybeEv;
+    auto const Index = *Ev.getIndex();
+    
+    // If we jumped backwards from this instruction, then all BBs from the
+    // one jumped to, up to and including this one, were cleared.
+    if (LaterIndex < Index) {
+      auto const From = Index.raw();
+      auto const To = LaterIndex.raw();
+      
+      Open.erase(std::remove_if(Open.begin(), Open.end(),
+                                [=] (OpenBlock const &Block) {
+                                  return Block.Begin <= From
+                                         && To < Block.End;
+                                }),
+                 Open.end());
+    }
+    
+    LaterIndex = Index;
+    
+    auto const BB = FunctionLookup->getInstruction(Index)->getParent();
+    auto const IsOpen = std::any_of(Open.begin(), Open.end(),
+                                    [=] (OpenBlock const &Block) {
+                                      return Block.Block == BB;
+                                    });
+    
+    if (IsOpen)
+      setValueFromEvent(*this, Ev);
+  }
+}
+
 void FunctionState::forwardingToInstruction(InstrIndexInFn const Index)
 {
   auto const Current = getActiveInstruction();
@@ -158,31 +400,51 @@ void FunctionState::forwardingToInstruction(InstrIndexInFn const Index)
       }
       
       BackwardsJumps.emplace_back(CBB, ClearCount);
+      
+      // Forget the oldest jump, so that loops use a bounded amount of memory.
+      // If we rewind over it then its BBs will be restored from the trace.
+      if (BackwardsJumps.size() > getMaxRetainedBackwardsJumps()) {
+        auto &Pool = getStorePool();
+        
+        for (std::size_t i = 0; i < BackwardsJumps.front().NumCleared; ++i) {
+          auto &Record = ClearedBlocks.front();
+          Pool.release(Record.first, std::move(Record.second));
+          ClearedBlocks.pop_front();
+        }
+        
+        BackwardsJumps.pop_front();
+      }
     }
   }
   
   if (!ActiveBlocks.count(IBB)) {
     // Make the new Instruction's BasicBlock active.
-    auto const BBInfo = ValueStoreInfo.getBasicBlockInfo(IBB);
-    assert(BBInfo && "no basic block info for block?");
-    ActiveBlocks[IBB] = llvm::make_unique<value_store::BasicBlockStore>
-                                         (*BBInfo);
-    assert(ActiveBlocks[IBB] && "null BasicBlockStore");
+    activateEmptyStore(IBB);
   }
 }
 
-void FunctionState::rewindingToInstruction(InstrIndexInFn const Index)
+void FunctionState::rewindingToInstruction(InstrIndexInFn const Index,
+                                           EventReference const &Event)
 {
   auto const I = FunctionLookup->getInstruction(Index);
   auto const IBB = I->getParent();
   
   // If we jumped from a succeeding BB, unclear those that were jumped over.
   if (*ActiveInstruction < Index) {
+    if (BackwardsJumps.empty()) {
+      restoreClearedBlocks(Event);
+      return;
+    }
+    
     assert(IBB == BackwardsJumps.back().FromBlock);
     
+    auto &Pool = getStorePool();
+    
     for (std::size_t i = 0; i < BackwardsJumps.back().NumCleared; ++i) {
       auto &Record = ClearedBlocks.back();
-      ActiveBlocks[Record.first] = std::move(Record.second);
+      auto &Store = ActiveBlocks[Record.first];
+      Pool.release(Record.first, std::move(Store));
+      Store = std::move(Record.second);
       ClearedBlocks.pop_back();
     }
     
@@ -190,6 +452,21 @@ void FunctionState::rewindingToInstruction(InstrIndexInFn const Index)
   }
 }
 
+void FunctionState::releaseBasicBlockStores()
+{
+  auto &Pool = getStorePool();
+  
+  for (auto &Pair : ActiveBlocks)
+    Pool.release(Pair.first, std::move(Pair.second));
+  
+  for (auto &Pair : ClearedBlocks)
+    Pool.release(Pair.first, std::move(Pair.second));
+  
+  ActiveBlocks.clear();
+  BackwardsJumps.clear();
+  ClearedBlocks.clear();
+}
+
 void FunctionState::setValueUInt64(llvm::Instruction const *ForInstruction,
                                    uint64_t const Value)
 {
@@ -255,6 +532,221 @@ void FunctionState::setValueAPFloat(llvm::Instruction const *ForInstruction,
   Store->setAPFloat(*Info, *Index, std::move(Value));
 }
 
+/// \brief Evaluate a recomputed Instruction that has an integer type.
+///
+static llvm::Optional<llvm::APInt>
+evaluateInt(FunctionState const &State, llvm::Instruction const &I)
+{
+  auto const BitWidth = I.getType()->getIntegerBitWidth();
+
+  if (auto const BO = llvm::dyn_cast<llvm::BinaryOperator>(&I)) {
+    auto const LHS = getAPInt(State, BO->getOperand(0));
+    auto const RHS = getAPInt(State, BO->getOperand(1));
+    if (!LHS || !RHS)
+      return llvm::Optional<llvm::APInt>();
+
+    switch (BO->getOpcode()) {
+      case llvm::Instruction::Add:  return *LHS + *RHS;
+      case llvm::Instruction::Sub:  return *LHS - *RHS;
+      case llvm::Instruction::Mul:  return *LHS * *RHS;
+      case llvm::Instruction::And:  return *LHS & *RHS;
+      case llvm::Instruction::Or:   return *LHS | *RHS;
+      case llvm::Instruction::Xor:  return *LHS ^ *RHS;
+      case llvm::Instruction::Shl:  return LHS->shl(*RHS);
+      case llvm::Instruction::LShr: return LHS->lshr(*RHS);
+      case llvm::Instruction::AShr: return LHS->ashr(*RHS);
+      default: break;
+    }
+  }
+  else if (auto const ICmp = llvm::dyn_cast<llvm::ICmpInst>(&I)) {
+    auto const LHS = getAPInt(State, ICmp->getOperand(0));
+    auto const RHS = getAPInt(State, ICmp->getOperand(1));
+    if (!LHS || !RHS)
+      return llvm::Optional<llvm::APInt>();
+
+    auto const Result = [&] () -> bool {
+      switch (ICmp->getPredicate()) {
+        case llvm::CmpInst::ICMP_EQ:  return *LHS == *RHS;
+        case llvm::CmpInst::ICMP_NE:  return *LHS != *RHS;
+        case llvm::CmpInst::ICMP_UGT: return LHS->ugt(*RHS);
+        case llvm::CmpInst::ICMP_UGE: return LHS->uge(*RHS);
+        case llvm::CmpInst::ICMP_ULT: return LHS->ult(*RHS);
+        case llvm::CmpInst::ICMP_ULE: return LHS->ule(*RHS);
+        case llvm::CmpInst::ICMP_SGT: return LHS->sgt(*RHS);
+        case llvm::CmpInst::ICMP_SGE: return LHS->sge(*RHS);
+        case llvm::CmpInst::ICMP_SLT: return LHS->slt(*RHS);
+        case llvm::CmpInst::ICMP_SLE: return LHS->sle(*RHS);
+        default: llvm_unreachable("invalid icmp predicate");
+      }
+    }();
+
+    return llvm::APInt(1, Result);
+  }
+  else if (auto const FCmp = llvm::dyn_cast<llvm::FCmpInst>(&I)) {
+    auto const LHS = getAPFloat(State, FCmp->getOperand(0));
+    auto const RHS = getAPFloat(State, FCmp->getOperand(1));
+    if (!LHS || !RHS)
+      return llvm::Optional<llvm::APInt>();
+
+    // Each bit of an fcmp predicate selects one of the possible orderings:
+    // bit 0 is equal, bit 1 is greater, bit 2 is less, and bit 3 unordered.
+    unsigned Bit = 0;
+
+    switch (LHS->compare(*RHS)) {
+      case llvm::APFloat::cmpEqual:       Bit = 0; break;
+      case llvm::APFloat::cmpGreaterThan: Bit = 1; break;
+      case llvm::APFloat::cmpLessThan:    Bit = 2; break;
+      case llvm::APFloat::cmpUnordered:   Bit = 3; break;
+    }
+
+    return llvm::APInt(1, (FCmp->getPredicate() >> Bit) & 1);
+  }
+  else if (auto const Cast = llvm::dyn_cast<llvm::CastInst>(&I)) {
+    auto const Op = Cast->getOperand(0);
+
+    switch (Cast->getOpcode()) {
+      case llvm::Instruction::Trunc:
+        if (auto const Value = getAPInt(State, Op))
+          return Value->trunc(BitWidth);
+        break;
+
+      case llvm::Instruction::ZExt:
+        if (auto const Value = getAPInt(State, Op))
+          return Value->zext(BitWidth);
+        break;
+
+      case llvm::Instruction::SExt:
+        if (auto const Value = getAPInt(State, Op))
+          return Value->sext(BitWidth);
+        break;
+
+      case llvm::Instruction::PtrToInt:
+        if (auto const Value = getAPInt(State, Op))
+          return Value->zextOrTrunc(BitWidth);
+        break;
+
+      case llvm::Instruction::FPToUI: // Fall-through intentional.
+      case llvm::Instruction::FPToSI:
+        if (auto const Value = getAPFloat(State, Op)) {
+          auto const IsUnsigned = Cast->getOpcode()==llvm::Instruction::FPToUI;
+          llvm::APSInt Result(BitWidth, IsUnsigned);
+          bool IsExact = false;
+          Value->convertToInteger(Result, llvm::APFloat::rmTowardZero,
+                                  &IsExact);
+          return static_cast<llvm::APInt>(Result);
+        }
+        break;
+
+      case llvm::Instruction::BitCast:
+        if (auto const Value = getAPFloat(State, Op))
+          return Value->bitcastToAPInt();
+        break;
+
+      default:
+        break;
+    }
+  }
+  else if (auto const Select = llvm::dyn_cast<llvm::SelectInst>(&I)) {
+    if (auto const Cond = getAPInt(State, Select->getCondition()))
+      return getAPInt(State, Cond->getBoolValue() ? Select->getTrueValue()
+                                                  : Select->getFalseValue());
+  }
+
+  return llvm::Optional<llvm::APInt>();
+}
+
+/// \brief Evaluate a recomputed Instruction that has a float or double type.
+///
+static llvm::Optional<llvm::APFloat>
+evaluateFP(FunctionState const &State, llvm::Instruction const &I)
+{
+  auto const &Semantics = I.getType()->isFloatTy()
+                        ? llvm::APFloat::IEEEsingle()
+                        : llvm::APFloat::IEEEdouble();
+  auto const Rounding = llvm::APFloat::rmNearestTiesToEven;
+
+  if (auto const BO = llvm::dyn_cast<llvm::BinaryOperator>(&I)) {
+    auto Result = getAPFloat(State, BO->getOperand(0));
+    auto const RHS = getAPFloat(State, BO->getOperand(1));
+    if (!Result || !RHS)
+      return llvm::Optional<llvm::APFloat>();
+
+    switch (BO->getOpcode()) {
+      case llvm::Instruction::FAdd: Result->add(*RHS, Rounding);      break;
+      case llvm::Instruction::FSub: Result->subtract(*RHS, Rounding); break;
+      case llvm::Instruction::FMul: Result->multiply(*RHS, Rounding); break;
+      default: return llvm::Optional<llvm::APFloat>();
+    }
+
+    return Result;
+  }
+  else if (auto const Cast = llvm::dyn_cast<llvm::CastInst>(&I)) {
+    auto const Op = Cast->getOperand(0);
+
+    switch (Cast->getOpcode()) {
+      case llvm::Instruction::FPTrunc: // Fall-through intentional.
+      case llvm::Instruction::FPExt:
+        if (auto Value = getAPFloat(State, Op)) {
+          bool LosesInfo = false;
+          Value->convert(Semantics, Rounding, &LosesInfo);
+          return Value;
+        }
+        break;
+
+      case llvm::Instruction::UIToFP: // Fall-through intentional.
+      case llvm::Instruction::SIToFP:
+        if (auto const Value = getAPInt(State, Op)) {
+          auto const IsSigned = Cast->getOpcode()==llvm::Instruction::SIToFP;
+          llvm::APFloat Result(Semantics);
+          Result.convertFromAPInt(*Value, IsSigned, Rounding);
+          return Result;
+        }
+        break;
+
+      case llvm::Instruction::BitCast:
+        if (auto const Value = getAPInt(State, Op))
+          return llvm::APFloat(Semantics, *Value);
+        break;
+
+      default:
+        break;
+    }
+  }
+  else if (auto const Select = llvm::dyn_cast<llvm::SelectInst>(&I)) {
+    if (auto const Cond = getAPInt(State, Select->getCondition()))
+      return getAPFloat(State, Cond->getBoolValue() ? Select->getTrueValue()
+                                                    : Select->getFalseValue());
+  }
+
+  return llvm::Optional<llvm::APFloat>();
+}
+
+void FunctionState::recomputeValue(value_store::BasicBlockStore &Store,
+                                   value_store::BasicBlockInfo const &Info,
+                                   InstrIndexInFn const Index,
+                                   llvm::Instruction const *I) const
+{
+  if (!FunctionLookup->isRecomputed(Index) || Store.hasValue(Info, Index))
+    return;
+
+  // The operands precede I in its BasicBlock, so their values are available
+  // (and will be recomputed first, if necessary).
+  auto const Type = I->getType();
+
+  if (Type->isIntegerTy()) {
+    if (auto const Value = evaluateInt(*this, *I))
+      Store.setUInt64(Info, Index, Value->getZExtValue());
+  }
+  else if (Type->isFloatTy()) {
+    if (auto const Value = evaluateFP(*this, *I))
+      Store.setFloat(Info, Index, Value->convertToFloat());
+  }
+  else if (Type->isDoubleTy()) {
+    if (auto const Value = evaluateFP(*this, *I))
+      Store.setDouble(Info, Index, Value->convertToDouble());
+  }
+}
+
 bool FunctionState::isDominatedByActive(llvm::Instruction const *Inst) const
 {
   if (!ActiveInstruction)
@@ -292,6 +784,7 @@ bool FunctionState::hasValue(llvm::Instruction const *ForInstruction) const
   
   auto &Store = ActiveBBIter->second;
   assert(Index && Info && Store);
+  recomputeValue(*Store, *Info, *Index, ForInstruction);
 
   return Store->hasValue(*Info, *Index);
 }
@@ -331,6 +824,7 @@ FunctionState::getValueUInt64(llvm::Instruction const *ForInstruction) const
     if (ActiveBBIter != ActiveBlocks.end()) {
       auto &Store = ActiveBBIter->second;
       assert(Index && Info && Store);
+      recomputeValue(*Store, *Info, *Index, ForInstruction);
       RetVal = Store->getUInt64(*Info, *Index);
     }
   }
@@ -371,6 +865,7 @@ FunctionState::getValueFloat(llvm::Instruction const *ForInstruction) const
     if (ActiveBBIter != ActiveBlocks.end()) {
       auto &Store = ActiveBBIter->second;
       assert(Index && Info && Store);
+      recomputeValue(*Store, *Info, *Index, ForInstruction);
       RetVal = Store->getFloat(*Info, *Index);
     }
   }
@@ -391,6 +886,7 @@ FunctionState::getValueDouble(llvm::Instruction const *ForInstruction) const
     if (ActiveBBIter != ActiveBlocks.end()) {
       auto &Store = ActiveBBIter->second;
       assert(Index && Info && Store);
+      recomputeValue(*Store, *Info, *Index, ForInstruction);
       RetVal = Store->getDouble(*Info, *Index);
     }
   }
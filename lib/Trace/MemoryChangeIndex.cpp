@@ -0,0 +1,370 @@
+//===- lib/Trace/MemoryChangeIndex.cpp ------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Trace/MemoryChangeIndex.hpp"
+#include "seec/Trace/ThreadEventWalker.hpp"
+#include "seec/Trace/TraceReader.hpp"
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+namespace seec {
+
+namespace trace {
+
+
+//------------------------------------------------------------------------------
+// build()
+//------------------------------------------------------------------------------
+
+namespace {
+
+/// \brief A dynamic memory allocation event, with its thread's context.
+///
+struct AllocationEvent {
+  uint64_t ProcessTime;
+  
+  EventRecordBase const *Event;
+  
+  /// The address of the allocation.
+  uint64_t Address;
+};
+
+/// \brief Finds the changes made to memory by a single thread.
+///
+/// Dynamic memory allocation events are collected rather than added, because
+/// the size of an allocation that is freed depends on the events in other
+/// threads.
+///
+class ThreadChangeFinder : public ThreadEventWalker {
+  /// The index that changes are added to.
+  std::function<void (MemoryArea const &, uint64_t, uint64_t)> AddChange;
+  
+  /// Collects dynamic memory allocation events from all threads.
+  std::vector<AllocationEvent> &Allocations;
+  
+  /// Changes made since the most recent process time.
+  std::vector<MemoryArea> Pending;
+  
+  void addPending(MemoryArea const &Area) {
+    if (Area.length())
+      Pending.push_back(Area);
+  }
+
+protected:
+  uint32_t stackAreaAdded(MemoryArea const &Area,
+                          EventRecordBase const &Ev) override {
+    addPending(Area);
+    return 0;
+  }
+  
+  void stackAreaRemoved(StackArea const &Area,
+                        EventRecordBase const &Ev) override {
+    addPending(Area.Area);
+  }
+  
+  void dynamicEvent(EventRecordBase const &Ev,
+                    uint64_t const ProcessTime,
+                    stateptr_ty const Address) override {
+    Allocations.push_back(AllocationEvent{ProcessTime, &Ev, Address});
+  }
+  
+  /// \brief Add the changes made by events that set a process time.
+  ///
+  void event(EventRecordBase const &Ev) override {
+    auto const MaybeTime = Ev.getProcessTime();
+    if (!MaybeTime)
+      return;
+    
+    auto const Time = *MaybeTime;
+    auto const Change = [&, Time] (uint64_t const Address,
+                                   std::size_t const Length) {
+      if (Length)
+        AddChange(MemoryArea(Address, Length), Time, Time);
+    };
+    
+    switch (Ev.getType()) {
+      case EventType::StateUntypedSmall:
+      {
+        auto const &Record = Ev.as<EventType::StateUntypedSmall>();
+        Change(Record.getAddress(), Record.getSize());
+        break;
+      }
+      
+      case EventType::StateUntyped:
+      {
+        auto const &Record = Ev.as<EventType::StateUntyped>();
+        Change(Record.getAddress(), Record.getDataSize());
+        break;
+      }
+      
+      case EventType::StateMemmove:
+      {
+        auto const &Record = Ev.as<EventType::StateMemmove>();
+        Change(Record.getDestinationAddress(), Record.getSize());
+        break;
+      }
+      
+      case EventType::StateClear:
+      {
+        auto const &Record = Ev.as<EventType::StateClear>();
+        Change(Record.getAddress(), Record.getClearSize());
+        break;
+      }
+      
+      default:
+        break;
+    }
+  }
+  
+  /// \brief Add all pending changes.
+  ///
+  void processTimeReached(uint64_t const Earliest,
+                          uint64_t const Latest) override {
+    for (auto const &Area : Pending)
+      AddChange(Area, Earliest, Latest);
+    
+    Pending.clear();
+  }
+
+public:
+  ThreadChangeFinder(
+    ProcessTrace const &Trace,
+    uint32_t const ThreadID,
+    std::function<void (MemoryArea const &, uint64_t, uint64_t)> WithAdd,
+    std::vector<AllocationEvent> &WithAllocations)
+  : ThreadEventWalker(Trace, ThreadID),
+    AddChange(std::move(WithAdd)),
+    Allocations(WithAllocations),
+    Pending()
+  {}
+};
+
+} // anonymous namespace
+
+void MemoryChangeIndex::build(ProcessTrace const &Trace)
+{
+  std::vector<AllocationEvent> Allocations;
+  
+  auto const Add = [this] (MemoryArea const &Area,
+                           uint64_t const Earliest,
+                           uint64_t const Latest) {
+                     add(Area, Earliest, Latest);
+                   };
+  
+  for (uint32_t i = 1; i <= Trace.getNumThreads(); ++i)
+    ThreadChangeFinder(Trace, i, Add, Allocations).walk();
+  
+  // Replay the dynamic memory allocation events in process time order, to
+  // find the size of each allocation that is freed.
+  std::stable_sort(Allocations.begin(), Allocations.end(),
+                   [] (AllocationEvent const &LHS, AllocationEvent const &RHS) {
+                     return LHS.ProcessTime < RHS.ProcessTime;
+                   });
+  
+  std::map<uint64_t, std::size_t> Mallocs;
+  
+  for (auto const &Allocation : Allocations) {
+    auto const Time = Allocation.ProcessTime;
+    auto const Address = Allocation.Address;
+    auto const &Ev = *Allocation.Event;
+    
+    switch (Ev.getType()) {
+      case EventType::CheckpointMalloc:
+        Mallocs[Address] = Ev.as<EventType::CheckpointMalloc>().getSize();
+        break;
+      
+      case EventType::Malloc:
+      {
+        auto const Size = Ev.as<EventType::Malloc>().getSize();
+        Mallocs[Address] = Size;
+        if (Size)
+          add(MemoryArea(Address, Size), Time, Time);
+        break;
+      }
+      
+      case EventType::Free:
+      {
+        auto const It = Mallocs.find(Address);
+        auto const Size = It != Mallocs.end() ? It->second : 0;
+        if (It != Mallocs.end())
+          Mallocs.erase(It);
+        add(MemoryArea(Address, Size ? Size : 1), Time, Time);
+        break;
+      }
+      
+      case EventType::Realloc:
+      {
+        auto const &Record = Ev.as<EventType::Realloc>();
+        auto const Size = std::max(Record.getOldSize(), Record.getNewSize());
+        Mallocs[Address] = Record.getNewSize();
+        if (Size)
+          add(MemoryArea(Address, Size), Time, Time);
+        break;
+      }
+      
+      default:
+        llvm_unreachable("unexpected allocation event");
+    }
+  }
+  
+  // Sort each page's changes.
+  for (auto &Pair : Pages) {
+    auto &ByLatest = Pair.second.ByLatest;
+    auto &ByEarliest = Pair.second.ByEarliest;
+    
+    std::stable_sort(ByLatest.begin(), ByLatest.end(),
+                     [] (Entry const &LHS, Entry const &RHS) {
+                       return LHS.Latest < RHS.Latest;
+                     });
+    
+    ByEarliest.resize(ByLatest.size());
+    for (uint32_t i = 0; i < ByEarliest.size(); ++i)
+      ByEarliest[i] = i;
+    
+    std::stable_sort(ByEarliest.begin(), ByEarliest.end(),
+                     [&] (uint32_t const LHS, uint32_t const RHS) {
+                       return ByLatest[LHS].Earliest < ByLatest[RHS].Earliest;
+                     });
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// MemoryChangeIndex
+//------------------------------------------------------------------------------
+
+void MemoryChangeIndex::add(MemoryArea const &Area,
+                            uint64_t const Earliest,
+                            uint64_t const Latest)
+{
+  auto const PageSize = uint64_t(1) << getPageShift();
+  auto const First = Area.start() >> getPageShift();
+  auto const Last = Area.last() >> getPageShift();
+  
+  for (auto Number = First; Number <= Last; ++Number) {
+    auto const PageStart = Number << getPageShift();
+    auto const Begin = std::max(Area.start(), PageStart) - PageStart;
+    auto const End = std::min(Area.end() - PageStart, PageSize);
+    
+    Pages[Number].ByLatest.push_back(Entry{Earliest,
+                                           Latest,
+                                           static_cast<uint16_t>(Begin),
+                                           static_cast<uint16_t>(End)});
+  }
+}
+
+MemoryChangeIndex::MemoryChangeIndex(ProcessTrace const &Trace)
+: Pages()
+{
+  build(Trace);
+}
+
+llvm::Optional<MemoryChange>
+MemoryChangeIndex::findNext(MemoryArea const &Area,
+                            uint64_t const ProcessTime) const
+{
+  llvm::Optional<MemoryChange> Result;
+  
+  if (!Area.length())
+    return Result;
+  
+  auto const PageSize = uint64_t(1) << getPageShift();
+  auto const First = Area.start() >> getPageShift();
+  auto const Last = Area.last() >> getPageShift();
+  
+  for (auto Number = First; Number <= Last; ++Number) {
+    auto const PageIt = Pages.find(Number);
+    if (PageIt == Pages.end())
+      continue;
+    
+    auto const PageStart = Number << getPageShift();
+    auto const Begin = std::max(Area.start(), PageStart) - PageStart;
+    auto const End = std::min(Area.end() - PageStart, PageSize);
+    
+    auto const &ByLatest = PageIt->second.ByLatest;
+    auto It = std::upper_bound(ByLatest.begin(), ByLatest.end(), ProcessTime,
+                               [] (uint64_t const Time, Entry const &E) {
+                                 return Time < E.Latest;
+                               });
+    
+    for (; It != ByLatest.end(); ++It) {
+      if (Result && It->Latest >= Result->getLatest())
+        break;
+      
+      if (It->Begin < End && Begin < It->End) {
+        Result = MemoryChange(It->Earliest, It->Latest);
+        break;
+      }
+    }
+  }
+  
+  return Result;
+}
+
+llvm::Optional<MemoryChange>
+MemoryChangeIndex::findPrevious(MemoryArea const &Area,
+                                uint64_t const ProcessTime) const
+{
+  llvm::Optional<MemoryChange> Result;
+  
+  if (!Area.length())
+    return Result;
+  
+  auto const PageSize = uint64_t(1) << getPageShift();
+  auto const First = Area.start() >> getPageShift();
+  auto const Last = Area.last() >> getPageShift();
+  
+  for (auto Number = First; Number <= Last; ++Number) {
+    auto const PageIt = Pages.find(Number);
+    if (PageIt == Pages.end())
+      continue;
+    
+    auto const PageStart = Number << getPageShift();
+    auto const Begin = std::max(Area.start(), PageStart) - PageStart;
+    auto const End = std::min(Area.end() - PageStart, PageSize);
+    
+    auto const &ByLatest = PageIt->second.ByLatest;
+    auto const &ByEarliest = PageIt->second.ByEarliest;
+    
+    // Find the first change whose earliest time is after ProcessTime, then
+    // search backwards from there.
+    auto It = std::upper_bound(ByEarliest.begin(), ByEarliest.end(),
+                               ProcessTime,
+                               [&] (uint64_t const Time, uint32_t const Index) {
+                                 return Time < ByLatest[Index].Earliest;
+                               });
+    
+    while (It != ByEarliest.begin()) {
+      auto const &E = ByLatest[*--It];
+      
+      if (Result && E.Earliest <= Result->getEarliest())
+        break;
+      
+      if (E.Begin < End && Begin < E.End) {
+        Result = MemoryChange(E.Earliest, E.Latest);
+        break;
+      }
+    }
+  }
+  
+  return Result;
+}
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
@@ -16,6 +16,7 @@
 #include "seec/Util/Range.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 
 namespace seec {
@@ -26,52 +27,213 @@ static constexpr bool debugPrintStateChanges() { return false; }
 
 
 //------------------------------------------------------------------------------
-// MemoryAllocation Mutators
+// Initialization bits
 //------------------------------------------------------------------------------
 
-llvm::ArrayRef<char>
+/// \brief Get the mask for bits [Begin, End) of a single word.
+///
+static uint64_t getWordMask(std::size_t const Begin, std::size_t const End)
+{
+  auto const Count = End - Begin;
+  auto const Ones = Count == 64 ? ~uint64_t(0) : (uint64_t(1) << Count) - 1;
+  return Ones << Begin;
+}
+
+/// \brief Call Fn(WordIndex, Mask) for each word covering bits [Begin, End),
+///        until Fn returns false.
+///
+/// \return true iff Fn returned true for every word.
+///
+template<typename FnT>
+static bool forEachWord(std::size_t Begin, std::size_t const End, FnT Fn)
+{
+  while (Begin < End) {
+    auto const Bit = Begin % 64;
+    auto const Count = std::min<std::size_t>(64 - Bit, End - Begin);
+    
+    if (!Fn(Begin / 64, getWordMask(Bit, Bit + Count)))
+      return false;
+    
+    Begin += Count;
+  }
+  
+  return true;
+}
+
+static void setBits(uint64_t * const Words,
+                    std::size_t const Begin,
+                    std::size_t const End,
+                    bool const Value)
+{
+  forEachWord(Begin, End,
+              [=] (std::size_t const Word, uint64_t const Mask) {
+                if (Value)
+                  Words[Word] |= Mask;
+                else
+                  Words[Word] &= ~Mask;
+                return true;
+              });
+}
+
+static bool allBitsSet(uint64_t const * const Words,
+                       std::size_t const Begin,
+                       std::size_t const End)
+{
+  return forEachWord(Begin, End,
+                     [=] (std::size_t const Word, uint64_t const Mask) {
+                       return (Words[Word] & Mask) == Mask;
+                     });
+}
+
+static bool anyBitSet(uint64_t const * const Words,
+                      std::size_t const Begin,
+                      std::size_t const End)
+{
+  return !forEachWord(Begin, End,
+                      [=] (std::size_t const Word, uint64_t const Mask) {
+                        return (Words[Word] & Mask) == 0;
+                      });
+}
+
+static bool getBit(uint64_t const * const Words, std::size_t const Index)
+{
+  return (Words[Index / 64] >> (Index % 64)) & 1;
+}
+
+
+//------------------------------------------------------------------------------
+// MemoryAllocation Pages
+//------------------------------------------------------------------------------
+
+template<typename FnT>
+bool MemoryAllocation::forEachPagePart(std::size_t Offset,
+                                       std::size_t const Length,
+                                       FnT &&Fn)
+{
+  auto const End = Offset + Length;
+  
+  while (Offset < End) {
+    auto const Begin = Offset & (getPageSize() - 1);
+    auto const PartEnd = std::min(getPageSize(), Begin + (End - Offset));
+    
+    if (!Fn(PagePart{Offset >> getPageShift(), Begin, PartEnd}))
+      return false;
+    
+    Offset += PartEnd - Begin;
+  }
+  
+  return true;
+}
+
+MemoryAllocation::Page &
+MemoryAllocation::getWritablePage(std::size_t const Index)
+{
+  auto &Slot = Pages[Index];
+  
+  if (!Slot)
+    Slot = std::make_shared<Page>();
+  else if (Slot.use_count() > 1)
+    Slot = std::make_shared<Page>(*Slot);
+  
+  return *Slot;
+}
+
+void MemoryAllocation::setInitialization(PagePart const &Part,
+                                         bool const Initialized)
+{
+  // Pages that don't exist are already uninitialized.
+  if (!Initialized && !Pages[Part.Index])
+    return;
+  
+  setBits(getWritablePage(Part.Index).Init, Part.Begin, Part.End, Initialized);
+}
+
+
+//------------------------------------------------------------------------------
+// MemoryAllocation Accessors
+//------------------------------------------------------------------------------
+
+std::vector<char>
 MemoryAllocation::getAreaData(MemoryArea const &Area) const
 {
   assert(MemoryArea(Address, Size).contains(Area));
 
-  auto const Offset = Area.address() - Address;
-  return llvm::ArrayRef<char>(Data.data() + Offset, Area.length());
+  std::vector<char> Result(Area.length());
+  auto Out = Result.data();
+
+  forEachPagePart(Area.address() - Address, Area.length(),
+    [&] (PagePart const &Part) {
+      if (auto const P = getPage(Part.Index))
+        std::memcpy(Out, P->Data + Part.Begin, Part.End - Part.Begin);
+      Out += Part.End - Part.Begin;
+      return true;
+    });
+
+  return Result;
 }
 
-llvm::ArrayRef<unsigned char>
+std::vector<unsigned char>
 MemoryAllocation::getAreaInitialization(MemoryArea const &Area) const
 {
   assert(MemoryArea(Address, Size).contains(Area));
 
-  auto const Offset = Area.address() - Address;
-  return llvm::ArrayRef<unsigned char>(Init.data() + Offset, Area.length());
+  auto const Complete = std::numeric_limits<unsigned char>::max();
+
+  std::vector<unsigned char> Result(Area.length());
+  auto Out = Result.data();
+
+  forEachPagePart(Area.address() - Address, Area.length(),
+    [&] (PagePart const &Part) {
+      if (auto const P = getPage(Part.Index))
+        for (auto i = Part.Begin; i < Part.End; ++i)
+          Out[i - Part.Begin] = getBit(P->Init, i) ? Complete : 0;
+      Out += Part.End - Part.Begin;
+      return true;
+    });
+
+  return Result;
 }
 
-bool MemoryAllocation::isCompletelyInitialized() const
+bool MemoryAllocation::isAreaCompletelyInitialized(MemoryArea const &Area)
+const
 {
-  auto const Complete = std::numeric_limits<unsigned char>::max();
-  if (Init.empty())
+  assert(MemoryArea(Address, Size).contains(Area));
+
+  if (Area.length() == 0)
     return false;
 
-  return std::all_of(Init.cbegin(), Init.cend(),
-                     [=](unsigned char const Byte) { return Byte == Complete;});
+  return forEachPagePart(Area.address() - Address, Area.length(),
+    [this] (PagePart const &Part) {
+      auto const P = getPage(Part.Index);
+      return P && allBitsSet(P->Init, Part.Begin, Part.End);
+    });
 }
 
-bool MemoryAllocation::isPartiallyInitialized() const
+bool MemoryAllocation::isAreaPartiallyInitialized(MemoryArea const &Area)
+const
 {
-  if (Init.empty())
+  assert(MemoryArea(Address, Size).contains(Area));
+
+  if (Area.length() == 0)
     return false;
 
-  return std::any_of(Init.cbegin(), Init.cend(),
-                     [] (unsigned char const Value) { return Value != 0; });
+  return !forEachPagePart(Area.address() - Address, Area.length(),
+    [this] (PagePart const &Part) {
+      auto const P = getPage(Part.Index);
+      return !P || !anyBitSet(P->Init, Part.Begin, Part.End);
+    });
 }
 
-bool MemoryAllocation::isUninitialized() const
+bool MemoryAllocation::isAreaUninitialized(MemoryArea const &Area) const
 {
-  return std::all_of(Init.cbegin(), Init.cend(),
-                     [] (unsigned char const C) { return C == 0; });
+  return !isAreaPartiallyInitialized(Area);
 }
 
+
+//------------------------------------------------------------------------------
+// MemoryAllocation Mutators
+//------------------------------------------------------------------------------
+
 void MemoryAllocation::addBlock(MappedMemoryBlock const &Block)
 {
   if (debugPrintStateChanges()) {
@@ -82,13 +244,16 @@ void MemoryAllocation::addBlock(MappedMemoryBlock const &Block)
 
   clearArea(Block.area());
 
-  auto const Offset = Block.address() - Address;
+  auto In = Block.data();
 
-  std::memcpy(Data.data() + Offset, Block.data(), Block.length());
-
-  std::memset(Init.data() + Offset,
-              std::numeric_limits<unsigned char>::max(),
-              Block.length());
+  forEachPagePart(Block.address() - Address, Block.length(),
+    [&] (PagePart const &Part) {
+      auto &P = getWritablePage(Part.Index);
+      std::memcpy(P.Data + Part.Begin, In, Part.End - Part.Begin);
+      setBits(P.Init, Part.Begin, Part.End, true);
+      In += Part.End - Part.Begin;
+      return true;
+    });
 }
 
 void MemoryAllocation::addArea(stateptr_ty const AtAddress,
@@ -105,15 +270,31 @@ void MemoryAllocation::addArea(stateptr_ty const AtAddress,
 
   clearArea(MemoryArea(AtAddress, WithData.size()));
 
-  auto const Offset = AtAddress - Address;
+  auto DataIn = WithData.data();
+  auto InitIn = WithInitialization.data();
+
+  // The area was cleared, so only the initialized bits need to be set.
+  forEachPagePart(AtAddress - Address, WithData.size(),
+    [&] (PagePart const &Part) {
+      auto &P = getWritablePage(Part.Index);
+      std::memcpy(P.Data + Part.Begin, DataIn, Part.End - Part.Begin);
 
-  std::memcpy(Data.data() + Offset,
-              WithData.data(),
-              WithData.size());
+      for (auto i = Part.Begin; i < Part.End; ++i)
+        if (InitIn[i - Part.Begin])
+          P.Init[i / 64] |= uint64_t(1) << (i % 64);
 
-  std::memcpy(Init.data() + Offset,
-              WithInitialization.data(),
-              WithInitialization.size());
+      DataIn += Part.End - Part.Begin;
+      InitIn += Part.End - Part.Begin;
+      return true;
+    });
+}
+
+/// \brief Check if a part covers an entire page.
+///
+template<typename PartT>
+static bool isFullPage(PartT const &Part, std::size_t const PageSize)
+{
+  return Part.Begin == 0 && Part.End == PageSize;
 }
 
 void MemoryAllocation::clearArea(MemoryArea const &Area)
@@ -127,43 +308,82 @@ void MemoryAllocation::clearArea(MemoryArea const &Area)
   assert(MemoryArea(Address, Size).contains(Area));
   assert(Area.length() != 0);
 
-  auto const Complete = std::numeric_limits<unsigned char>::max();
-
   auto const Offset = Area.address() - Address;
   auto const Length = Area.length();
 
-  auto const InitBegin = Init.begin() + Offset;
-  auto const InitEnd   = InitBegin + Length;
+  // Determine the initialization of the edges (the pages that are partially
+  // covered by this area). Pages that are completely covered are retired
+  // rather than copied, so their initialization doesn't matter.
+  std::size_t EdgeLength = 0;
+  bool AnyInitialized = false;
+  bool AllInitialized = true;
 
-  // Determine this area's initialization.
-  EPreviousAreaType Type = EPreviousAreaType::Partial;
+  forEachPagePart(Offset, Length,
+    [&] (PagePart const &Part) {
+      if (isFullPage(Part, getPageSize()))
+        return true;
 
-  if (std::all_of(InitBegin, InitEnd,
-                  [] (unsigned char const C) { return C == 0; }))
-  {
-    Type = EPreviousAreaType::Uninitialized;
-  }
-  else if (std::all_of(InitBegin, InitEnd,
-           [=] (unsigned char const C) { return C == Complete; }))
-  {
-    Type = EPreviousAreaType::Complete;
-  }
+      auto const P = getPage(Part.Index);
+      EdgeLength += Part.End - Part.Begin;
+
+      if (P && anyBitSet(P->Init, Part.Begin, Part.End))
+        AnyInitialized = true;
+      if (!P || !allBitsSet(P->Init, Part.Begin, Part.End))
+        AllInitialized = false;
+
+      return true;
+    });
+
+  auto const Type = !AnyInitialized ? EPreviousAreaType::Uninitialized
+                  : AllInitialized  ? EPreviousAreaType::Complete
+                                    : EPreviousAreaType::Partial;
 
   PreviousType.push_back(Type);
 
-  // This is the only case in which we need to save the initialization.
+  auto const InitStart = PreviousInit.size();
   if (Type == EPreviousAreaType::Partial)
-    PreviousInit.insert(PreviousInit.end(), InitBegin, InitEnd);
-
-  // This is the only case in which we need to save the data. This is also the
-  // only case in which "clearing" the area requires us to do anything (set the
-  // initialization of the bytes to zero).
-  if (Type != EPreviousAreaType::Uninitialized) {
-    PreviousData.insert(PreviousData.end(),
-                        Data.begin() + Offset,
-                        Data.begin() + Offset + Length);
-    std::fill(InitBegin, InitEnd, 0);
-  }
+    PreviousInit.resize(InitStart + (EdgeLength + 7) / 8);
+
+  std::size_t Position = 0;
+
+  forEachPagePart(Offset, Length,
+    [&] (PagePart const &Part) {
+      // Retire completely covered pages.
+      if (isFullPage(Part, getPageSize())) {
+        PreviousPages.emplace_back(std::move(Pages[Part.Index]));
+        Pages[Part.Index].reset();
+        return true;
+      }
+
+      auto const P = getPage(Part.Index);
+
+      // This is the only case in which we need to save the initialization.
+      if (Type == EPreviousAreaType::Partial && P) {
+        for (auto i = Part.Begin; i < Part.End; ++i) {
+          if (getBit(P->Init, i)) {
+            auto const Bit = Position + (i - Part.Begin);
+            PreviousInit[InitStart + Bit / 8] |= 1u << (Bit % 8);
+          }
+        }
+      }
+
+      // This is the only case in which we need to save the data. This is also
+      // the only case in which "clearing" the area requires us to do anything
+      // (set the initialization of the bytes to zero).
+      if (Type != EPreviousAreaType::Uninitialized) {
+        if (P)
+          PreviousData.insert(PreviousData.end(),
+                              P->Data + Part.Begin,
+                              P->Data + Part.End);
+        else
+          PreviousData.resize(PreviousData.size() + (Part.End - Part.Begin));
+
+        setInitialization(Part, false);
+      }
+
+      Position += Part.End - Part.Begin;
+      return true;
+    });
 }
 
 void MemoryAllocation::rewindArea(MemoryArea const &Area)
@@ -177,13 +397,9 @@ void MemoryAllocation::rewindArea(MemoryArea const &Area)
   assert(MemoryArea(Address, Size).contains(Area));
   assert(Area.length() != 0);
 
-  auto const Complete = std::numeric_limits<unsigned char>::max();
-
   auto const Offset = Area.address() - Address;
   auto const Length = Area.length();
 
-  auto const InitBegin = Init.begin() + Offset;
-
   assert(!PreviousType.empty());
   auto const Type = PreviousType.back();
   PreviousType.pop_back();
@@ -199,29 +415,81 @@ void MemoryAllocation::rewindArea(MemoryArea const &Area)
     }
   }
 
-  // Set area as uninitialized.
-  if (Type == EPreviousAreaType::Uninitialized)
-    std::fill_n(InitBegin, Length, 0);
-
-  // Restore initialization of area.
-  if (Type == EPreviousAreaType::Partial) {
-    assert(PreviousInit.size() >= Length);
-    auto const PrevInitIt = PreviousInit.end() - Length;
-    std::copy(PrevInitIt, PreviousInit.end(), InitBegin);
-    PreviousInit.erase(PrevInitIt, PreviousInit.end());
-  }
+  // Find the amount of saved state.
+  std::size_t EdgeLength = 0;
+  std::size_t FullPages = 0;
 
-  // Set area as completely initialized.
-  if (Type == EPreviousAreaType::Complete)
-    std::fill_n(InitBegin, Length, Complete);
+  forEachPagePart(Offset, Length,
+    [&] (PagePart const &Part) {
+      if (isFullPage(Part, getPageSize()))
+        ++FullPages;
+      else
+        EdgeLength += Part.End - Part.Begin;
+      return true;
+    });
+
+  auto const SavedDataLength = Type != EPreviousAreaType::Uninitialized
+                             ? EdgeLength : 0;
+  auto const SavedInitLength = Type == EPreviousAreaType::Partial
+                             ? (EdgeLength + 7) / 8 : 0;
+
+  assert(PreviousPages.size() >= FullPages);
+  assert(PreviousData.size() >= SavedDataLength);
+  assert(PreviousInit.size() >= SavedInitLength);
+
+  auto const PagesStart = PreviousPages.size() - FullPages;
+  auto const DataStart = PreviousData.size() - SavedDataLength;
+  auto const InitStart = PreviousInit.size() - SavedInitLength;
+
+  auto PageIt = PreviousPages.begin() + PagesStart;
+  auto DataIt = PreviousData.begin() + DataStart;
+  std::size_t Position = 0;
+
+  forEachPagePart(Offset, Length,
+    [&] (PagePart const &Part) {
+      // Restore retired pages.
+      if (isFullPage(Part, getPageSize())) {
+        Pages[Part.Index] = std::move(*PageIt++);
+        return true;
+      }
+
+      auto const Count = Part.End - Part.Begin;
+
+      switch (Type) {
+        case EPreviousAreaType::Uninitialized:
+          setInitialization(Part, false);
+          break;
+
+        case EPreviousAreaType::Partial:
+        {
+          auto &P = getWritablePage(Part.Index);
+          for (auto i = Part.Begin; i < Part.End; ++i) {
+            auto const Bit = Position + (i - Part.Begin);
+            auto const Saved = (PreviousInit[InitStart + Bit / 8] >> (Bit % 8))
+                               & 1u;
+            setBits(P.Init, i, i + 1, Saved != 0);
+          }
+          break;
+        }
+
+        case EPreviousAreaType::Complete:
+          setInitialization(Part, true);
+          break;
+      }
+
+      if (Type != EPreviousAreaType::Uninitialized) {
+        auto &P = getWritablePage(Part.Index);
+        std::copy(DataIt, DataIt + Count, P.Data + Part.Begin);
+        DataIt += Count;
+      }
+
+      Position += Count;
+      return true;
+    });
 
-  // Restore data of area.
-  if (Type != EPreviousAreaType::Uninitialized) {
-    assert(PreviousData.size() >= Length);
-    auto const PrevDataIt = PreviousData.end() - Length;
-    std::copy(PrevDataIt, PreviousData.end(), Data.begin() + Offset);
-    PreviousData.erase(PrevDataIt, PreviousData.end());
-  }
+  PreviousPages.resize(PagesStart);
+  PreviousData.resize(DataStart);
+  PreviousInit.resize(InitStart);
 }
 
 void MemoryAllocation::resize(std::size_t const NewSize)
@@ -231,11 +499,34 @@ void MemoryAllocation::resize(std::size_t const NewSize)
                  << " : resize from " << Size << " to " << NewSize << "\n";
   }
 
-  Data.resize(NewSize);
-  Init.resize(NewSize);
+  // Chars beyond the end of the allocation are always uninitialized, because
+  // shrinking allocations are cleared first (see allocationResize()).
+  Pages.resize((NewSize + getPageSize() - 1) >> getPageShift());
   Size = NewSize;
 }
 
+std::size_t MemoryAllocation::getApproximateSize() const
+{
+  auto const PageBytes = [] (std::shared_ptr<Page> const &P) -> std::size_t {
+                           return P ? sizeof(Page) / P.use_count() : 0;
+                         };
+
+  std::size_t Bytes = sizeof(*this)
+                    + Pages.capacity() * sizeof(std::shared_ptr<Page>)
+                    + PreviousType.capacity() * sizeof(EPreviousAreaType)
+                    + PreviousData.capacity()
+                    + PreviousInit.capacity()
+                    + PreviousPages.capacity() * sizeof(std::shared_ptr<Page>);
+
+  for (auto const &P : Pages)
+    Bytes += PageBytes(P);
+
+  for (auto const &P : PreviousPages)
+    Bytes += PageBytes(P);
+
+  return Bytes;
+}
+
 //------------------------------------------------------------------------------
 // MemoryStateRegion
 //------------------------------------------------------------------------------
@@ -250,48 +541,43 @@ bool MemoryStateRegion::isAllocated() const
 
 bool MemoryStateRegion::isCompletelyInitialized() const
 {
-  auto const Complete = std::numeric_limits<unsigned char>::max();
-  auto const Initialization = getByteInitialization();
-  if (Initialization.empty())
-    return false;
+  if (auto const Alloc = State.findAllocation(Area.start()))
+    if (MemoryArea(Alloc->getAddress(), Alloc->getSize()).contains(Area))
+      return Alloc->isAreaCompletelyInitialized(Area);
 
-  return std::all_of(Initialization.begin(), Initialization.end(),
-                     [=](unsigned char const Byte) { return Byte == Complete;});
+  return false;
 }
 
 bool MemoryStateRegion::isPartiallyInitialized() const
 {
-  auto const Initialization = getByteInitialization();
-  if (Initialization.empty())
-    return false;
+  if (auto const Alloc = State.findAllocation(Area.start()))
+    if (MemoryArea(Alloc->getAddress(), Alloc->getSize()).contains(Area))
+      return Alloc->isAreaPartiallyInitialized(Area);
 
-  return std::any_of(Initialization.begin(), Initialization.end(),
-                     [] (unsigned char const Value) { return Value != 0; });
+  return false;
 }
 
 bool MemoryStateRegion::isUninitialized() const
 {
-  auto const Init = getByteInitialization();
-  return std::all_of(Init.begin(), Init.end(),
-                     [] (unsigned char const C) { return C == 0; });
+  return !isPartiallyInitialized();
 }
 
-llvm::ArrayRef<unsigned char> MemoryStateRegion::getByteInitialization() const
+std::vector<unsigned char> MemoryStateRegion::getByteInitialization() const
 {
   if (auto const Alloc = State.findAllocation(Area.start()))
     if (MemoryArea(Alloc->getAddress(), Alloc->getSize()).contains(Area))
       return Alloc->getAreaInitialization(Area);
 
-  return llvm::ArrayRef<unsigned char>();
+  return std::vector<unsigned char>();
 }
 
-llvm::ArrayRef<char> MemoryStateRegion::getByteValues() const
+std::vector<char> MemoryStateRegion::getByteValues() const
 {
   if (auto const Alloc = State.findAllocation(Area.start()))
     if (MemoryArea(Alloc->getAddress(), Alloc->getSize()).contains(Area))
       return Alloc->getAreaData(Area);
 
-  return llvm::ArrayRef<char>();
+  return std::vector<char>();
 }
 
 //------------------------------------------------------------------------------
@@ -350,6 +636,28 @@ MemoryState::findAllocation(stateptr_ty const ForAddress) const
   return &(It->second);
 }
 
+void MemoryState::addChangedArea(MemoryArea const &Area)
+{
+  if (ChangesOverflowed)
+    return;
+
+  if (ChangedAreas.size() < getMaxChangedAreas()) {
+    ChangedAreas.push_back(Area);
+    return;
+  }
+
+  // Too many areas have changed to be worth recording.
+  ChangesOverflowed = true;
+  ChangedAreas.clear();
+  ChangedAreas.shrink_to_fit();
+}
+
+void MemoryState::clearChanges()
+{
+  ChangedAreas.clear();
+  ChangesOverflowed = false;
+}
+
 void MemoryState::allocationAdd(stateptr_ty const Address,
                                 std::size_t const Size)
 {
@@ -360,6 +668,8 @@ void MemoryState::allocationAdd(stateptr_ty const Address,
                                           std::forward_as_tuple(Address),
                                           std::forward_as_tuple(Address, Size));
   assert(Result.second && "Allocation already exists!");
+
+  addChangedArea(MemoryArea(Address, Size));
 }
 
 void MemoryState::allocationRemove(stateptr_ty const Address,
@@ -371,8 +681,10 @@ void MemoryState::allocationRemove(stateptr_ty const Address,
   auto const It = Allocations.find(Address);
   assert(It != Allocations.end() && "Allocation does not exist!");
 
-  PreviousAllocations.emplace(std::move(It->second));
+  PreviousAllocations.emplace_back(std::move(It->second));
   Allocations.erase(It);
+
+  addChangedArea(MemoryArea(Address, Size));
 }
 
 void MemoryState::allocationResize(stateptr_ty const Address,
@@ -391,6 +703,8 @@ void MemoryState::allocationResize(stateptr_ty const Address,
   auto &Alloc = getAllocation(MemoryArea(Address, CurrentSize));
   assert(Alloc.getSize() == CurrentSize);
 
+  addChangedArea(MemoryArea(Address, std::max(CurrentSize, NewSize)));
+
   // If the allocation is shrinking, then "clear" the disappearing area so that
   // we can rewind it in the Unresize.
   if (NewSize < CurrentSize)
@@ -408,13 +722,15 @@ void MemoryState::allocationUnremove(stateptr_ty const Address,
 
   assert(!PreviousAllocations.empty() && "No previous allocations!");
 
-  auto &Top = PreviousAllocations.top();
+  auto &Top = PreviousAllocations.back();
   assert(Top.getAddress() == Address && "Previous allocation does not match!");
 
   auto const Result = Allocations.emplace(Address, std::move(Top));
   assert(Result.second && "Allocation already exists!");
 
-  PreviousAllocations.pop();
+  PreviousAllocations.pop_back();
+
+  addChangedArea(MemoryArea(Address, Size));
 }
 
 void MemoryState::allocationUnadd(stateptr_ty const Address,
@@ -427,6 +743,8 @@ void MemoryState::allocationUnadd(stateptr_ty const Address,
   assert(It != Allocations.end() && "Allocation does not exist!");
 
   Allocations.erase(It);
+
+  addChangedArea(MemoryArea(Address, Size));
 }
 
 void MemoryState::allocationUnresize(stateptr_ty const Address,
@@ -445,6 +763,8 @@ void MemoryState::allocationUnresize(stateptr_ty const Address,
   auto &Alloc = getAllocation(MemoryArea(Address, CurrentSize));
   assert(Alloc.getSize() == CurrentSize);
 
+  addChangedArea(MemoryArea(Address, std::max(CurrentSize, NewSize)));
+
   Alloc.resize(NewSize);
 
   // If this resize (originally) shrank the allocation, then rewind the area
@@ -457,11 +777,13 @@ void MemoryState::allocationUnresize(stateptr_ty const Address,
 void MemoryState::addBlock(MappedMemoryBlock const &Block)
 {
   getAllocation(Block.area()).addBlock(Block);
+  addChangedArea(Block.area());
 }
 
 void MemoryState::removeBlock(MemoryArea Area)
 {
   getAllocation(Area).rewindArea(Area);
+  addChangedArea(Area);
 }
 
 void MemoryState::addCopy(stateptr_ty const Source,
@@ -476,6 +798,8 @@ void MemoryState::addCopy(stateptr_ty const Source,
   DAlloc.addArea(Destination,
                  SAlloc.getAreaData(SArea),
                  SAlloc.getAreaInitialization(SArea));
+
+  addChangedArea(MemoryArea(Destination, Size));
 }
 
 void MemoryState::removeCopy(stateptr_ty const Source,
@@ -484,6 +808,7 @@ void MemoryState::removeCopy(stateptr_ty const Source,
 {
   auto const DArea = MemoryArea(Destination, Size);
   getAllocation(DArea).rewindArea(DArea);
+  addChangedArea(DArea);
 }
 
 void MemoryState::addClear(MemoryArea Area)
@@ -510,6 +835,7 @@ void MemoryState::addClear(MemoryArea Area)
   }
 
   It->second.clearArea(Area);
+  addChangedArea(Area);
 }
 
 void MemoryState::removeClear(MemoryArea Area)
@@ -536,6 +862,21 @@ void MemoryState::removeClear(MemoryArea Area)
   }
 
   It->second.rewindArea(Area);
+  addChangedArea(Area);
+}
+
+std::size_t MemoryState::getApproximateSize() const
+{
+  std::size_t Size = sizeof(*this)
+                   + ChangedAreas.capacity() * sizeof(MemoryArea);
+  
+  for (auto const &Pair : Allocations)
+    Size += Pair.second.getApproximateSize();
+  
+  for (auto const &Previous : PreviousAllocations)
+    Size += Previous.getApproximateSize();
+  
+  return Size;
 }
 
 
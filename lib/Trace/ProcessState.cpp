@@ -11,17 +11,22 @@
 ///
 //===----------------------------------------------------------------------===//
 
+#include "seec/Trace/AllocationLifetimeTable.hpp"
 #include "seec/Trace/BlockValueStore.hpp"
+#include "seec/Trace/MemoryChangeIndex.hpp"
 #include "seec/Trace/ProcessState.hpp"
 #include "seec/Trace/TraceReader.hpp"
 #include "seec/Util/Fallthrough.hpp"
 #include "seec/Util/ModuleIndex.hpp"
+#include "seec/Util/WorkerPool.hpp"
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <thread>
 #include <functional>
+#include <utility>
 
 namespace seec {
 
@@ -39,6 +44,7 @@ ProcessState::ProcessState(std::shared_ptr<ProcessTrace const> TracePtr,
                                         (Module->getModule(), *Module)),
   DL(&(Module->getModule())),
   ProcessTime(0),
+  StartProcessTime(0),
   ThreadStates(Trace->getNumThreads()),
   Mallocs(),
   PreviousMallocs(),
@@ -46,7 +52,11 @@ ProcessState::ProcessState(std::shared_ptr<ProcessTrace const> TracePtr,
   KnownMemory(),
   Streams(),
   StreamsClosed(),
-  Dirs()
+  Dirs(),
+  Snapshots(llvm::make_unique<ProcessStateSnapshotIndex>()),
+  MovementWorkers(llvm::make_unique<WorkerPool>()),
+  MemoryChanges(),
+  AllocationLifetimes()
 {
   // Setup initial memory state for global variables.
   for (std::size_t i = 0; i < Module->getGlobalCount(); ++i) {
@@ -106,10 +116,60 @@ ProcessState::ProcessState(std::shared_ptr<ProcessTrace const> TracePtr,
   for (std::size_t i = 0; i < NumThreads; ++i) {
     ThreadStates[i].reset(new ThreadState(*this, Trace->getThreadTrace(i+1)));
   }
+  
+  // If the oldest events were dropped by the flight recorder, then the events
+  // of each thread whose ring wrapped begin with a checkpoint. The shared
+  // state is recreated from the earliest checkpoint, and the other threads'
+  // checkpoints only recreate their own stacks. Events of those threads that
+  // were made between the earliest checkpoint and their own checkpoints are
+  // lost, so this is an approximation when several threads wrapped.
+  //
+  // A thread whose ring never wrapped has no checkpoint, and still holds the
+  // events that it made before the earliest checkpoint. Its stack is
+  // recreated from those events, but their effects on the shared state are
+  // already part of the checkpoint.
+  std::vector<std::pair<uint64_t, ThreadState *>> Checkpoints;
+  std::vector<ThreadState *> WithoutCheckpoints;
+  
+  for (auto &Thread : ThreadStates) {
+    if (auto const Time = Thread->getCheckpointProcessTime())
+      Checkpoints.emplace_back(*Time, Thread.get());
+    else
+      WithoutCheckpoints.push_back(Thread.get());
+  }
+  
+  if (!Checkpoints.empty()) {
+    std::sort(Checkpoints.begin(), Checkpoints.end());
+    
+    for (auto const &Checkpoint : Checkpoints)
+      Checkpoint.second->addCheckpoint(&Checkpoint == &Checkpoints.front());
+    
+    StartProcessTime = Checkpoints.front().first;
+    ProcessTime = StartProcessTime;
+    
+    for (auto const Thread : WithoutCheckpoints)
+      Thread->addEventsBeforeCheckpoint(StartProcessTime);
+  }
 }
 
 ProcessState::~ProcessState() = default;
 
+MemoryChangeIndex const &ProcessState::getMemoryChangeIndex()
+{
+  if (!MemoryChanges)
+    MemoryChanges = llvm::make_unique<MemoryChangeIndex>(*Trace);
+  
+  return *MemoryChanges;
+}
+
+AllocationLifetimeTable const &ProcessState::getAllocationLifetimes()
+{
+  if (!AllocationLifetimes)
+    AllocationLifetimes = llvm::make_unique<AllocationLifetimeTable>(*Trace);
+  
+  return *AllocationLifetimes;
+}
+
 void ProcessState::addMalloc(stateptr_ty const Address,
                              std::size_t const Size,
                              llvm::Instruction const *Allocator)
@@ -11,15 +11,20 @@
 ///
 //===----------------------------------------------------------------------===//
 
+#include "seec/Trace/AllocationLifetimeTable.hpp"
+#include "seec/Trace/MemoryChangeIndex.hpp"
 #include "seec/Trace/ProcessState.hpp"
 #include "seec/Trace/StateMovement.hpp"
+#include "seec/Trace/StateSnapshot.hpp"
 #include "seec/Trace/ThreadState.hpp"
 #include "seec/Trace/TraceSearch.hpp"
+#include "seec/Util/WorkerPool.hpp"
 
+#include <algorithm>
 #include <condition_variable>
+#include <functional>
 #include <initializer_list>
 #include <map>
-#include <thread>
 #include <vector>
 
 namespace seec {
@@ -29,6 +34,14 @@ namespace trace {
 
 /// \brief Implements state movement logic.
 ///
+/// Each ThreadState is moved by its own worker, taken from the ProcessState's
+/// pool, and the workers synchronize on the ProcessState's process time. When
+/// only one ThreadState needs to be checked (because the trace has a single
+/// thread, or only a thread-level predicate was given), that ThreadState is
+/// first moved in place, without workers. If it reaches an event that must
+/// wait for another thread, its partial movement is rewound and the workers
+/// take over.
+///
 class ThreadedStateMovementHelper {
   /// Controls access to the ProcessState.
   std::mutex ProcessStateMutex;
@@ -39,6 +52,32 @@ class ThreadedStateMovementHelper {
   /// Indicates that the movement has satisfied a predicate.
   std::atomic<bool> MovementComplete;
   
+  /// Indicates that a ThreadState is being moved in place, so it must not
+  /// wait for other threads.
+  bool MovingInPlace;
+  
+  /// Indicates that in-place movement stopped because it had to wait for
+  /// another thread.
+  bool NeedsWorkers;
+  
+  /// \brief Check if the in-place movement must stop, because WaitFor is
+  ///        false and there is nothing else to update the ProcessState.
+  ///
+  /// If so, the changes since RewindNextEvent are rewound by calling Rewind.
+  ///
+  template<typename PredT, typename RewindT>
+  bool stopInPlace(std::unique_lock<std::mutex> &UpdateLock,
+                   PredT WaitFor,
+                   RewindT Rewind) {
+    if (!MovingInPlace || WaitFor())
+      return false;
+    
+    UpdateLock.unlock();
+    NeedsWorkers = true;
+    Rewind();
+    return true;
+  }
+
 public:
   /// \name Constructors
   /// @{
@@ -47,7 +86,9 @@ public:
   ThreadedStateMovementHelper()
   : ProcessStateMutex(),
     ProcessStateCV(),
-    MovementComplete(false)
+    MovementComplete(false),
+    MovingInPlace(false),
+    NeedsWorkers(false)
   {}
   
   ThreadedStateMovementHelper(ThreadedStateMovementHelper const &) = delete;
@@ -80,12 +121,20 @@ public:
                                ? *MaybeNewProcessTime - 1
                                : *MaybeNewProcessTime;
           
+          auto const Reached = [=, &ProcState](){
+                                 return MovementComplete ||
+                                        ProcState.getProcessTime() >= WaitUntil;
+                               };
+          
           UpdateLock.lock();
-          ProcessStateCV.wait(UpdateLock,
-                              [=, &ProcState](){
-                                return MovementComplete ||
-                                       ProcState.getProcessTime() >= WaitUntil;
-                              });
+          
+          if (stopInPlace(UpdateLock, Reached, [&] () {
+                while (State.getNextEvent() != RewindNextEvent)
+                  State.removePreviousEvent();
+              }))
+            return false;
+          
+          ProcessStateCV.wait(UpdateLock, Reached);
           
           if (MovementComplete) {
             // We can release the lock, because we'll only be rewinding local
@@ -118,7 +167,7 @@ public:
 
   bool removePreviousEventBlock(ThreadState &State,
                                 std::unique_lock<std::mutex> &UpdateLock) {
-    auto const FirstEvent = State.getTrace().events().begin();
+    auto const FirstEvent = State.getStartEvent();
     auto const RewindNextEvent = State.getNextEvent();
     if (RewindNextEvent == FirstEvent)
       return false;
@@ -143,12 +192,20 @@ public:
                                ? *MaybeNewProcessTime
                                : *MaybeNewProcessTime - 1;
           
+          auto const Reached = [=, &ProcState](){
+                                 return MovementComplete ||
+                                        ProcState.getProcessTime() <= WaitUntil;
+                               };
+          
           UpdateLock.lock();
-          ProcessStateCV.wait(UpdateLock,
-                              [=, &ProcState](){
-                                return MovementComplete ||
-                                       ProcState.getProcessTime() <= WaitUntil;
-                              });
+          
+          if (stopInPlace(UpdateLock, Reached, [&] () {
+                while (State.getNextEvent() != RewindNextEvent)
+                  State.addNextEvent();
+              }))
+            return false;
+          
+          ProcessStateCV.wait(UpdateLock, Reached);
           
           if (MovementComplete) {
             // We can release the lock, because we'll only be rewinding local
@@ -180,63 +237,170 @@ public:
     return removePreviousEventBlock(State, UpdateLock);
   }
   
+  /// \brief Move a single ThreadState forward until a predicate is satisfied,
+  ///        another worker satisfies the movement, or the ThreadState reaches
+  ///        the end of its trace.
+  ///
+  void moveThreadForward(ProcessState &State,
+                         ThreadState &Thread,
+                         ProcessPredTy const &ProcessPredicate,
+                         ThreadPredTy const &ThreadPred,
+                         std::atomic<bool> &Moved,
+                         std::atomic<bool> &PredicateWasSatisfied)
+  {
+    auto const LastEvent = Thread.getTrace().events().end();
+    
+    while (Thread.getNextEvent() != LastEvent) {
+      // Add the next event block from this thread.
+      std::unique_lock<std::mutex> Lock(ProcessStateMutex, std::defer_lock);
+      if (addNextEventBlock(Thread, Lock))
+        Moved = true;
+      
+      // Check if another worker satisfied the movement, or if we must stop
+      // moving in place.
+      if (MovementComplete || NeedsWorkers)
+        break;
+      
+      // If the event acquired the shared process lock, then it might have
+      // updated the ProcessState, in which case check the ProcessPredicate.
+      if (Lock && ProcessPredicate && ProcessPredicate(State)) {
+        MovementComplete = true;
+        PredicateWasSatisfied = true;
+        ProcessStateCV.notify_all();
+        break;
+      }
+      
+      // Check the thread-specific predicate, if one exists.
+      if (ThreadPred && ThreadPred(Thread)) {
+        MovementComplete = true;
+        PredicateWasSatisfied = true;
+        ProcessStateCV.notify_all();
+        break;
+      }
+    }
+  }
+  
+  /// \brief Move a single ThreadState backward until a predicate is
+  ///        satisfied, another worker satisfies the movement, or the
+  ///        ThreadState reaches the start of its trace.
+  ///
+  void moveThreadBackward(ProcessState &State,
+                          ThreadState &Thread,
+                          ProcessPredTy const &ProcessPredicate,
+                          ThreadPredTy const &ThreadPred,
+                          std::atomic<bool> &Moved,
+                          std::atomic<bool> &PredicateWasSatisfied)
+  {
+    auto const FirstEvent = Thread.getStartEvent();
+    
+    while (Thread.getNextEvent() != FirstEvent) {
+      // Remove the previous event block from this thread.
+      std::unique_lock<std::mutex> Lock(ProcessStateMutex, std::defer_lock);
+      if (removePreviousEventBlock(Thread, Lock))
+        Moved = true;
+      
+      // Check if another worker satisfied the movement, or if we must stop
+      // moving in place.
+      if (MovementComplete || NeedsWorkers)
+        break;
+      
+      // If the event acquired the shared process lock, then it might have
+      // updated the ProcessState, in which case check the ProcessPredicate.
+      if (Lock && ProcessPredicate && ProcessPredicate(State)) {
+        MovementComplete = true;
+        PredicateWasSatisfied = true;
+        ProcessStateCV.notify_all();
+        break;
+      }
+      
+      // Check the thread-specific predicate, if one exists.
+      if (ThreadPred && ThreadPred(Thread)) {
+        MovementComplete = true;
+        PredicateWasSatisfied = true;
+        ProcessStateCV.notify_all();
+        break;
+      }
+    }
+  }
+  
+  /// \brief Find the ThreadState that can be moved in place, if any.
+  ///
+  static ThreadState *getInPlaceThread(ProcessState &State,
+                                       ProcessPredTy const &ProcessPredicate,
+                                       ThreadPredMapTy const &ThreadPredicates)
+  {
+    auto const &Threads = State.getThreadStates();
+    
+    if (Threads.size() == 1)
+      return Threads.front().get();
+    
+    if (ProcessPredicate || ThreadPredicates.size() != 1)
+      return nullptr;
+    
+    for (auto const &Thread : Threads)
+      if (Thread.get() == ThreadPredicates.begin()->first)
+        return Thread.get();
+    
+    return nullptr;
+  }
+  
+  /// \brief Get the predicate for a ThreadState, if one exists.
+  ///
+  static ThreadPredTy getThreadPredicate(ThreadPredMapTy const &Predicates,
+                                         ThreadState const *Thread)
+  {
+    auto const It = Predicates.find(Thread);
+    return It != Predicates.end() ? It->second : ThreadPredTy{};
+  }
+  
+  /// \brief Move all ThreadStates using the ProcessState's workers.
+  ///
+  template<typename MoveThreadFnT>
+  void moveWithWorkers(ProcessState &State,
+                       ThreadPredMapTy const &ThreadPredicates,
+                       MoveThreadFnT MoveThread)
+  {
+    std::vector<std::function<void ()>> Tasks;
+    
+    for (auto &ThreadStatePtr : State.getThreadStates()) {
+      auto const RawPtr = ThreadStatePtr.get();
+      auto const ThreadPred = getThreadPredicate(ThreadPredicates, RawPtr);
+      
+      Tasks.emplace_back([=, &MoveThread] () {
+                           MoveThread(*RawPtr, ThreadPred);
+                         });
+    }
+    
+    State.getMovementWorkers().run(std::move(Tasks));
+  }
+  
   MovementResult moveForward(ProcessState &State,
                              ProcessPredTy ProcessPredicate,
                              ThreadPredMapTy ThreadPredicates)
   {
     std::atomic<bool> Moved(false);
     std::atomic<bool> PredicateWasSatisfied(false);
-    std::vector<std::thread> Workers;
     
-    for (auto &ThreadStatePtr : State.getThreadStates()) {
-      auto const RawPtr = ThreadStatePtr.get();
-      ThreadPredTy ThreadPred;
-      
-      // Get the thread-specific predicate, if one exists.
-      auto const ThreadPredIt = ThreadPredicates.find(RawPtr);
-      if (ThreadPredIt != ThreadPredicates.end())
-        ThreadPred = ThreadPredIt->second;
-      
-      // Create a new worker thread to move this ThreadState.
-      Workers.emplace_back(
-      [=, &State, &ProcessPredicate, &Moved, &PredicateWasSatisfied]()
-      {
-        // Thread worker code
-        auto const LastEvent = RawPtr->getTrace().events().end();
-        
-        while (RawPtr->getNextEvent() != LastEvent) {
-          // Add the next event block from this thread.
-          std::unique_lock<std::mutex> Lock(ProcessStateMutex, std::defer_lock);
-          if (addNextEventBlock(*RawPtr, Lock))
-            Moved = true;
-          
-          // Check if another worker satisfied the movement.
-          if (MovementComplete)
-            break;
-          
-          // If the event acquired the shared process lock, then it might have
-          // updated the ProcessState, in which case check the ProcessPredicate.
-          if (Lock && ProcessPredicate && ProcessPredicate(State)) {
-            MovementComplete = true;
-            PredicateWasSatisfied = true;
-            ProcessStateCV.notify_all();
-            break;
-          }
-          
-          // Check the thread-specific predicate, if one exists.
-          if (ThreadPred && ThreadPred(*RawPtr)) {
-            MovementComplete = true;
-            PredicateWasSatisfied = true;
-            ProcessStateCV.notify_all();
-            break;
-          }
-        }
-      });
+    auto const MoveThread = [&] (ThreadState &Thread,
+                                 ThreadPredTy const &ThreadPred) {
+      moveThreadForward(State, Thread, ProcessPredicate, ThreadPred,
+                        Moved, PredicateWasSatisfied);
+    };
+    
+    // Attempt to move in place.
+    if (auto const Thread = getInPlaceThread(State, ProcessPredicate,
+                                             ThreadPredicates)) {
+      MovingInPlace = true;
+      MoveThread(*Thread, getThreadPredicate(ThreadPredicates, Thread));
+      MovingInPlace = false;
+    }
+    else {
+      NeedsWorkers = true;
     }
     
-    // Wait for all thread workers to complete.
-    for (auto &Worker : Workers) {
-      Worker.join();
+    if (NeedsWorkers) {
+      NeedsWorkers = false;
+      moveWithWorkers(State, ThreadPredicates, MoveThread);
     }
     
     if (PredicateWasSatisfied)
@@ -253,57 +417,27 @@ public:
   {
     std::atomic<bool> Moved(false);
     std::atomic<bool> PredicateWasSatisfied(false);
-    std::vector<std::thread> Workers;
     
-    for (auto &ThreadStatePtr : State.getThreadStates()) {
-      auto RawPtr = ThreadStatePtr.get();
-      ThreadPredTy ThreadPred;
-      
-      // Get the thread-specific predicate, if one exists.
-      auto const ThreadPredIt = ThreadPredicates.find(RawPtr);
-      if (ThreadPredIt != ThreadPredicates.end())
-        ThreadPred = ThreadPredIt->second;
-      
-      // Create a new worker thread to move this ThreadState.
-      Workers.emplace_back(
-      [=, &State, &ProcessPredicate, &Moved, &PredicateWasSatisfied]()
-      {
-        // Thread worker code
-        auto const FirstEvent = RawPtr->getTrace().events().begin();
-        
-        while (RawPtr->getNextEvent() != FirstEvent) {
-          // Add the next event block from this thread.
-          std::unique_lock<std::mutex> Lock(ProcessStateMutex, std::defer_lock);
-          if (removePreviousEventBlock(*RawPtr, Lock))
-            Moved = true;
-          
-          // Check if another worker satisfied the movement.
-          if (MovementComplete)
-            break;
-          
-          // If the event acquired the shared process lock, then it might have
-          // updated the ProcessState, in which case check the ProcessPredicate.
-          if (Lock && ProcessPredicate && ProcessPredicate(State)) {
-            MovementComplete = true;
-            PredicateWasSatisfied = true;
-            ProcessStateCV.notify_all();
-            break;
-          }
-          
-          // Check the thread-specific predicate, if one exists.
-          if (ThreadPred && ThreadPred(*RawPtr)) {
-            MovementComplete = true;
-            PredicateWasSatisfied = true;
-            ProcessStateCV.notify_all();
-            break;
-          }
-        }
-      });
+    auto const MoveThread = [&] (ThreadState &Thread,
+                                 ThreadPredTy const &ThreadPred) {
+      moveThreadBackward(State, Thread, ProcessPredicate, ThreadPred,
+                         Moved, PredicateWasSatisfied);
+    };
+    
+    // Attempt to move in place.
+    if (auto const Thread = getInPlaceThread(State, ProcessPredicate,
+                                             ThreadPredicates)) {
+      MovingInPlace = true;
+      MoveThread(*Thread, getThreadPredicate(ThreadPredicates, Thread));
+      MovingInPlace = false;
+    }
+    else {
+      NeedsWorkers = true;
     }
     
-    // Wait for all thread workers to complete.
-    for (auto &Worker : Workers) {
-      Worker.join();
+    if (NeedsWorkers) {
+      NeedsWorkers = false;
+      moveWithWorkers(State, ThreadPredicates, MoveThread);
     }
     
     if (PredicateWasSatisfied)
@@ -349,7 +483,7 @@ MovementResult moveBackward(ProcessState &State)
 {
   auto const ProcessTime = State.getProcessTime();
   
-  if (ProcessTime == 0)
+  if (ProcessTime <= State.getStartProcessTime())
     return MovementResult::Unmoved;
   
   return moveBackwardUntil(State,
@@ -358,62 +492,313 @@ MovementResult moveBackward(ProcessState &State)
                            });
 }
 
-MovementResult moveForwardUntilMemoryChanges(ProcessState &State,
-                                             MemoryArea const &Area)
+MovementResult moveToProcessTime(ProcessState &State,
+                                 uint64_t const ProcessTime)
 {
-  auto const Region = State.getMemory().getRegion(Area);
-  auto const CurrentInit = Region.getByteInitialization();
-  auto const CurrentData = Region.getByteValues();
+  auto const Target = std::max(State.getStartProcessTime(),
+                               std::min(ProcessTime,
+                                        State.getTrace().getFinalProcessTime()));
+  
+  auto const Current = State.getProcessTime();
+  if (Target == Current)
+    return MovementResult::Unmoved;
+  
+  auto &Snapshots = State.getSnapshots();
+  bool Moved = false;
+  
+  // Restore the latest snapshot before the target, if replaying from it is
+  // cheaper than moving from the current time.
+  if (auto const Latest = Snapshots.getLatestAtOrBefore(Target)) {
+    auto const Distance = Current < Target ? Target - Current
+                                           : Current - Target;
+    
+    if (Target - *Latest < Distance && *Latest != Current) {
+      Snapshots.restore(State, *Latest);
+      Moved = true;
+    }
+  }
+  
+  if (State.getProcessTime() > Target)
+    return moveBackwardUntil(State,
+                             [=] (ProcessState &P) {
+                               return P.getProcessTime() <= Target;
+                             });
+  
+  // Move forward one snapshot interval at a time, taking snapshots as we go.
+  while (State.getProcessTime() < Target) {
+    if (Snapshots.isSnapshotDue(State.getProcessTime()))
+      Snapshots.add(State);
+    
+    auto const Step = State.getProcessTime() + Snapshots.getInterval();
+    auto const StepTarget = std::min(Step, Target);
+    
+    auto const Result = moveForwardUntil(State,
+                                         [=] (ProcessState &P) {
+                                           return P.getProcessTime()
+                                                  >= StepTarget;
+                                         });
+    
+    if (Result == MovementResult::Unmoved)
+      break;
+    
+    Moved = true;
+    
+    if (Result == MovementResult::ReachedEnd)
+      return Result;
+  }
+  
+  if (State.getProcessTime() >= Target)
+    return MovementResult::PredicateSatisfied;
+  
+  return Moved ? MovementResult::ReachedEnd : MovementResult::Unmoved;
+}
 
-  std::vector<unsigned char> Init(CurrentInit.begin(), CurrentInit.end());
-  std::vector<unsigned char> Data(CurrentData.begin(), CurrentData.end());
+namespace {
 
-  // This takes advantage of the fact that movement modifies the ProcessState
-  // in-place (hence the Region is still valid).
-  return moveForwardUntil(State,
-          [&] (ProcessState &) -> bool {
-            if (!Region.isAllocated())
-              return true;
+/// \brief Checks if the memory state in an area has changed.
+///
+/// This takes advantage of the fact that movement modifies the ProcessState
+/// in-place (hence the Region remains valid).
+///
+class MemoryChangeChecker {
+  MemoryStateRegion const Region;
+  
+  std::vector<unsigned char> Init;
+  
+  std::vector<unsigned char> Data;
 
-            auto const NewInit = Region.getByteInitialization();
-            auto const NewData = Region.getByteValues();
+public:
+  MemoryChangeChecker(ProcessState const &State, MemoryArea const &Area)
+  : Region(State.getMemory().getRegion(Area)),
+    Init(),
+    Data()
+  {
+    auto const CurrentInit = Region.getByteInitialization();
+    auto const CurrentData = Region.getByteValues();
+    Init.assign(CurrentInit.begin(), CurrentInit.end());
+    Data.assign(CurrentData.begin(), CurrentData.end());
+  }
+  
+  bool operator()() const {
+    if (!Region.isAllocated())
+      return true;
+    
+    auto const NewInit = Region.getByteInitialization();
+    auto const NewData = Region.getByteValues();
+    
+    for (std::size_t i = 0; i < Init.size(); ++i)
+      if (Init[i] != NewInit[i] ||
+          (Init[i] & Data[i]) != (NewInit[i] & NewData[i]))
+        return true;
+    
+    return false;
+  }
+};
 
-            for (std::size_t i = 0; i < Init.size(); ++i)
-              if (Init[i] != NewInit[i] ||
-                  (Init[i] & Data[i]) != (NewInit[i] & NewData[i]))
-                return true;
+} // anonymous namespace
 
-            return false;
-          });
+MovementResult moveForwardUntilMemoryChanges(ProcessState &State,
+                                             MemoryArea const &Area)
+{
+  MemoryChangeChecker const HasChanged(State, Area);
+  auto const &Index = State.getMemoryChangeIndex();
+  auto const Start = State.getProcessTime();
+  
+  // Jump to each change to Area in the index, and replay the process times in
+  // which the change may become visible. Nothing else can change Area, so the
+  // process times between changes are skipped.
+  while (auto const Change = Index.findNext(Area, State.getProcessTime())) {
+    if (Change->getEarliest() > State.getProcessTime() + 1) {
+      moveToProcessTime(State, Change->getEarliest() - 1);
+      if (HasChanged())
+        return MovementResult::PredicateSatisfied;
+    }
+    
+    auto const Latest = Change->getLatest();
+    auto const Result = moveForwardUntil(State,
+                          [&] (ProcessState &P) {
+                            return HasChanged() || P.getProcessTime() >= Latest;
+                          });
+    
+    if (HasChanged())
+      return MovementResult::PredicateSatisfied;
+    if (Result != MovementResult::PredicateSatisfied)
+      return Result;
+  }
+  
+  // There are no more changes to Area.
+  moveToProcessTime(State, State.getTrace().getFinalProcessTime());
+  if (HasChanged())
+    return MovementResult::PredicateSatisfied;
+  
+  return State.getProcessTime() != Start ? MovementResult::ReachedEnd
+                                         : MovementResult::Unmoved;
 }
 
 MovementResult moveBackwardUntilMemoryChanges(ProcessState &State,
                                               MemoryArea const &Area)
 {
-  auto const Region = State.getMemory().getRegion(Area);
-  auto const CurrentInit = Region.getByteInitialization();
-  auto const CurrentData = Region.getByteValues();
+  MemoryChangeChecker const HasChanged(State, Area);
+  auto const &Index = State.getMemoryChangeIndex();
+  auto const Start = State.getProcessTime();
+  
+  // Jump to each change to Area in the index, and replay the process times in
+  // which the change may become invisible. Nothing else can change Area, so
+  // the process times between changes are skipped.
+  while (auto const Change = Index.findPrevious(Area, State.getProcessTime())) {
+    if (Change->getLatest() < State.getProcessTime()) {
+      moveToProcessTime(State, Change->getLatest());
+      if (HasChanged())
+        return MovementResult::PredicateSatisfied;
+    }
+    
+    auto const Earliest = Change->getEarliest();
+    auto const Result = moveBackwardUntil(State,
+                          [&] (ProcessState &P) {
+                            return HasChanged()
+                                   || P.getProcessTime() < Earliest;
+                          });
+    
+    if (HasChanged())
+      return MovementResult::PredicateSatisfied;
+    if (Result != MovementResult::PredicateSatisfied)
+      return Result;
+  }
+  
+  // There are no earlier changes to Area.
+  moveToProcessTime(State, State.getStartProcessTime());
+  if (HasChanged())
+    return MovementResult::PredicateSatisfied;
+  
+  return State.getProcessTime() != Start ? MovementResult::ReachedBeginning
+                                         : MovementResult::Unmoved;
+}
 
-  std::vector<unsigned char> Init(CurrentInit.begin(), CurrentInit.end());
-  std::vector<unsigned char> Data(CurrentData.begin(), CurrentData.end());
+namespace {
 
-  // This takes advantage of the fact that movement modifies the ProcessState
-  // in-place (hence the Region is still valid).
-  return moveBackwardUntil(State,
-          [&] (ProcessState &) -> bool {
-            if (!Region.isAllocated())
-              return true;
+/// \brief Check if the area containing Address is allocated.
+///
+bool isAllocated(ProcessState const &State, stateptr_ty const Address)
+{
+  return State.getContainingMemoryArea(Address).assigned();
+}
+
+/// \brief Find the lifetime of the allocation containing Address in State.
+///
+AllocationLifetime const *findLifetime(ProcessState &State,
+                                       stateptr_ty const Address)
+{
+  auto const Area = State.getContainingMemoryArea(Address);
+  if (!Area.assigned())
+    return nullptr;
+  
+  return State.getAllocationLifetimes().find(Area.get<MemoryArea>().start(),
+                                             State.getProcessTime());
+}
 
-            auto const NewInit = Region.getByteInitialization();
-            auto const NewData = Region.getByteValues();
+} // anonymous namespace
 
-            for (std::size_t i = 0; i < Init.size(); ++i)
-              if (Init[i] != NewInit[i] ||
-                  (Init[i] & Data[i]) != (NewInit[i] & NewData[i]))
-                return true;
+MovementResult searchForAllocation(ProcessState &State,
+                                   stateptr_ty const Address)
+{
+  auto const Allocated = [=] (ProcessState &P) {
+                           return isAllocated(P, Address);
+                         };
+  
+  // Move backwards until the area is not allocated.
+  auto const Moved = moveBackwardUntil(State,
+                                       [=] (ProcessState &P) {
+                                         return !Allocated(P);
+                                       });
+  
+  // Now move forwards just enough that the area is allocated.
+  if (Moved == MovementResult::PredicateSatisfied && !Allocated(State))
+    moveForwardUntil(State, Allocated);
+  
+  return Moved;
+}
 
-            return false;
-          });
+MovementResult searchForDeallocation(ProcessState &State,
+                                     stateptr_ty const Address)
+{
+  auto const Allocated = [=] (ProcessState &P) {
+                           return isAllocated(P, Address);
+                         };
+  
+  // Move forwards until the area is not allocated.
+  auto const Moved = moveForwardUntil(State,
+                                      [=] (ProcessState &P) {
+                                        return !Allocated(P);
+                                      });
+  
+  // Now move backwards just enough that the area is allocated.
+  if (Moved == MovementResult::PredicateSatisfied && !Allocated(State))
+    moveBackwardUntil(State, Allocated);
+  
+  return Moved;
+}
+
+MovementResult moveToAllocation(ProcessState &State,
+                                stateptr_ty const Address)
+{
+  auto Lifetime = findLifetime(State, Address);
+  if (!Lifetime)
+    return searchForAllocation(State, Address);
+  
+  // Find the Malloc that started a sequence of Reallocs.
+  auto const &Table = State.getAllocationLifetimes();
+  while (auto const Previous = Table.getPrevious(*Lifetime)) {
+    if (!Previous->getArea().contains(Address))
+      break;
+    Lifetime = Previous;
+  }
+  
+  // Jump to just before the allocation may be visible, then replay until it
+  // is. If it is already visible then the allocating thread's events were
+  // ordered differently within the process time, so fall back to searching.
+  auto const Earliest = Lifetime->getBirth().getEarliest();
+  moveToProcessTime(State, Earliest ? Earliest - 1 : 0);
+  
+  if (isAllocated(State, Address))
+    return searchForAllocation(State, Address);
+  
+  return moveForwardUntil(State, [=] (ProcessState &P) {
+                                   return isAllocated(P, Address);
+                                 });
+}
+
+MovementResult moveToDeallocation(ProcessState &State,
+                                  stateptr_ty const Address)
+{
+  auto Lifetime = findLifetime(State, Address);
+  if (!Lifetime)
+    return searchForDeallocation(State, Address);
+  
+  // Find the end of a sequence of Reallocs.
+  auto const &Table = State.getAllocationLifetimes();
+  while (auto const Next = Table.getNext(*Lifetime)) {
+    if (!Next->getArea().contains(Address))
+      break;
+    Lifetime = Next;
+  }
+  
+  if (!Lifetime->hasDeath()) {
+    auto const Start = State.getProcessTime();
+    moveToProcessTime(State, State.getTrace().getFinalProcessTime());
+    return State.getProcessTime() != Start ? MovementResult::ReachedEnd
+                                           : MovementResult::Unmoved;
+  }
+  
+  // Jump to the time at which the deallocation must be visible, then replay
+  // backward until the area is allocated.
+  moveToProcessTime(State, Lifetime->getDeath().getLatest());
+  
+  if (isAllocated(State, Address))
+    return searchForDeallocation(State, Address);
+  
+  return moveBackwardUntil(State, [=] (ProcessState &P) {
+                                    return isAllocated(P, Address);
+                                  });
 }
 
 MovementResult moveBackwardToStreamWriteAt(ProcessState &State,
@@ -0,0 +1,284 @@
+//===- lib/Trace/StateSnapshot.cpp ----------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Trace/FunctionState.hpp"
+#include "seec/Trace/ProcessState.hpp"
+#include "seec/Trace/StateSnapshot.hpp"
+#include "seec/Trace/ThreadState.hpp"
+#include "seec/Trace/TraceReader.hpp"
+
+#include "llvm/ADT/STLExtras.h"
+
+#include <vector>
+
+namespace seec {
+
+namespace trace {
+
+
+//------------------------------------------------------------------------------
+// ProcessStateSnapshot
+//------------------------------------------------------------------------------
+
+/// \brief A copy of the variable data of a \c ProcessState and its
+///        \c ThreadState objects.
+///
+class ProcessStateSnapshot {
+  /// \brief A copy of the variable data of a single \c ThreadState.
+  ///
+  struct ThreadSnapshot {
+    EventReference NextEvent;
+    
+    EventReference StartEvent;
+    
+    uint64_t ProcessTime;
+    
+    uint64_t ThreadTime;
+    
+    /// Copies of the call stack. These still belong to the original
+    /// \c ThreadState, and are cloned again when they are restored.
+    std::vector<std::unique_ptr<FunctionState>> CallStack;
+    
+    ThreadSnapshot(ThreadState &Thread)
+    : NextEvent(*Thread.m_NextEvent),
+      StartEvent(*Thread.m_StartEvent),
+      ProcessTime(Thread.ProcessTime),
+      ThreadTime(Thread.ThreadTime),
+      CallStack()
+    {
+      CallStack.reserve(Thread.CallStack.size());
+      for (auto const &Function : Thread.CallStack)
+        CallStack.emplace_back(Function->clone(Thread));
+    }
+  };
+  
+  uint64_t ProcessTime;
+  
+  std::map<stateptr_ty, MallocState> Mallocs;
+  
+  std::vector<MallocState> PreviousMallocs;
+  
+  MemoryState Memory;
+  
+  IntervalMapVector<stateptr_ty, MemoryPermission> KnownMemory;
+  
+  llvm::DenseMap<stateptr_ty, StreamState> Streams;
+  
+  std::vector<StreamState> StreamsClosed;
+  
+  llvm::DenseMap<stateptr_ty, DIRState> Dirs;
+  
+  std::vector<ThreadSnapshot> Threads;
+  
+  /// The approximate number of bytes used by this snapshot.
+  std::size_t ApproximateSize;
+  
+  /// \brief Calculate the approximate number of bytes used by this snapshot.
+  ///
+  std::size_t calculateApproximateSize() const {
+    std::size_t Size = sizeof(*this)
+                     + Memory.getApproximateSize()
+                     + Mallocs.size() * sizeof(decltype(Mallocs)::value_type)
+                     + PreviousMallocs.capacity() * sizeof(MallocState)
+                     + KnownMemory.size()
+                       * sizeof(decltype(KnownMemory)::value_type);
+    
+    for (auto const &Pair : Streams)
+      Size += sizeof(StreamState) + Pair.second.getWritten().capacity();
+    
+    for (auto const &Stream : StreamsClosed)
+      Size += sizeof(StreamState) + Stream.getWritten().capacity();
+    
+    for (auto const &Thread : Threads) {
+      Size += sizeof(ThreadSnapshot);
+      for (auto const &Function : Thread.CallStack)
+        Size += Function->getApproximateSize();
+    }
+    
+    return Size;
+  }
+
+public:
+  /// \brief Take a snapshot of State.
+  ///
+  ProcessStateSnapshot(ProcessState const &State)
+  : ProcessTime(State.ProcessTime),
+    Mallocs(State.Mallocs),
+    PreviousMallocs(State.PreviousMallocs),
+    Memory(State.Memory),
+    KnownMemory(State.KnownMemory),
+    Streams(State.Streams),
+    StreamsClosed(State.StreamsClosed),
+    Dirs(State.Dirs),
+    Threads(),
+    ApproximateSize(0)
+  {
+    Threads.reserve(State.ThreadStates.size());
+    for (auto const &Thread : State.ThreadStates)
+      Threads.emplace_back(*Thread);
+    
+    ApproximateSize = calculateApproximateSize();
+  }
+  
+  /// \brief Get the process time that this snapshot represents.
+  ///
+  uint64_t getProcessTime() const { return ProcessTime; }
+  
+  /// \brief Get the approximate number of bytes used by this snapshot.
+  ///
+  std::size_t getApproximateSize() const { return ApproximateSize; }
+  
+  /// \brief Restore State to this snapshot.
+  ///
+  void restore(ProcessState &State) const {
+    assert(State.ThreadStates.size() == Threads.size());
+    
+    State.ProcessTime = ProcessTime;
+    State.Mallocs = Mallocs;
+    State.PreviousMallocs = PreviousMallocs;
+    State.Memory = MemoryState(Memory);
+    State.KnownMemory = KnownMemory;
+    State.Streams = Streams;
+    State.StreamsClosed = std::vector<StreamState>(StreamsClosed);
+    State.Dirs = Dirs;
+    
+    for (std::size_t i = 0; i < Threads.size(); ++i) {
+      auto const &Snapshot = Threads[i];
+      auto &Thread = *State.ThreadStates[i];
+      
+      *Thread.m_NextEvent = Snapshot.NextEvent;
+      *Thread.m_StartEvent = Snapshot.StartEvent;
+      Thread.ProcessTime = Snapshot.ProcessTime;
+      Thread.ThreadTime = Snapshot.ThreadTime;
+      
+      Thread.CallStack.clear();
+      for (auto const &Function : Snapshot.CallStack)
+        Thread.CallStack.emplace_back(Function->clone(Thread));
+      Thread.UnchangedCallStackDepth = 0;
+    }
+  }
+};
+
+
+//------------------------------------------------------------------------------
+// ProcessStateSnapshotIndex
+//------------------------------------------------------------------------------
+
+ProcessStateSnapshotIndex::ProcessStateSnapshotIndex()
+: m_Interval(getDefaultInterval()),
+  m_MemoryBudget(getDefaultMemoryBudget()),
+  m_MemoryUsed(0),
+  m_Snapshots()
+{}
+
+ProcessStateSnapshotIndex::~ProcessStateSnapshotIndex() = default;
+
+void ProcessStateSnapshotIndex::enforceMemoryBudget()
+{
+  while (m_MemoryUsed > m_MemoryBudget) {
+    if (m_Snapshots.size() <= 1) {
+      clear();
+      return;
+    }
+    
+    // Double the interval and keep only the snapshots that are spaced by at
+    // least the new interval.
+    m_Interval *= 2;
+    
+    auto It = m_Snapshots.begin();
+    auto LastKept = It->first;
+    
+    for (++It; It != m_Snapshots.end(); ) {
+      if (It->first - LastKept >= m_Interval) {
+        LastKept = It->first;
+        ++It;
+      }
+      else {
+        m_MemoryUsed -= It->second->getApproximateSize();
+        It = m_Snapshots.erase(It);
+      }
+    }
+  }
+}
+
+void ProcessStateSnapshotIndex::setInterval(uint64_t const Interval)
+{
+  m_Interval = Interval ? Interval : 1;
+}
+
+void ProcessStateSnapshotIndex::setMemoryBudget(std::size_t const Bytes)
+{
+  m_MemoryBudget = Bytes;
+  enforceMemoryBudget();
+}
+
+bool ProcessStateSnapshotIndex::isSnapshotDue(uint64_t const ProcessTime) const
+{
+  if (m_MemoryBudget == 0)
+    return false;
+  
+  auto const Latest = getLatestAtOrBefore(ProcessTime);
+  return !Latest || ProcessTime - *Latest >= m_Interval;
+}
+
+llvm::Optional<uint64_t>
+ProcessStateSnapshotIndex::getLatestAtOrBefore(uint64_t const ProcessTime)
+const
+{
+  auto It = m_Snapshots.upper_bound(ProcessTime);
+  if (It == m_Snapshots.begin())
+    return llvm::None;
+  
+  --It;
+  return It->first;
+}
+
+void ProcessStateSnapshotIndex::add(ProcessState const &State)
+{
+  if (m_MemoryBudget == 0)
+    return;
+  
+  auto Snapshot = llvm::make_unique<ProcessStateSnapshot>(State);
+  auto const Size = Snapshot->getApproximateSize();
+  
+  auto &Slot = m_Snapshots[State.getProcessTime()];
+  if (Slot)
+    m_MemoryUsed -= Slot->getApproximateSize();
+  
+  Slot = std::move(Snapshot);
+  m_MemoryUsed += Size;
+  
+  enforceMemoryBudget();
+}
+
+bool ProcessStateSnapshotIndex::restore(ProcessState &State,
+                                        uint64_t const ProcessTime) const
+{
+  auto const It = m_Snapshots.find(ProcessTime);
+  if (It == m_Snapshots.end())
+    return false;
+  
+  It->second->restore(State);
+  return true;
+}
+
+void ProcessStateSnapshotIndex::clear()
+{
+  m_Snapshots.clear();
+  m_MemoryUsed = 0;
+}
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
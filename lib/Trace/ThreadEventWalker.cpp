@@ -0,0 +1,168 @@
+//===- lib/Trace/ThreadEventWalker.cpp ------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Trace/ThreadEventWalker.hpp"
+#include "seec/Trace/TraceReader.hpp"
+
+#include <algorithm>
+
+namespace seec {
+
+namespace trace {
+
+
+ThreadEventWalker::ThreadEventWalker(ProcessTrace const &WithTrace,
+                                     uint32_t const WithThreadID)
+: Trace(WithTrace),
+  ThreadID(WithThreadID),
+  LastProcessTime(0),
+  LastPointer(0),
+  Frames(1),
+  Restore(nullptr),
+  Restored()
+{}
+
+ThreadEventWalker::~ThreadEventWalker() = default;
+
+void ThreadEventWalker::addStackArea(MemoryArea const &Area,
+                                     EventRecordBase const &Ev)
+{
+  auto const Handle = stackAreaAdded(Area, Ev);
+  Frames.back().push_back(StackArea{Area, &Ev, Handle});
+}
+
+void ThreadEventWalker::finishRestore()
+{
+  auto &Frame = Frames.back();
+  
+  auto const End = std::remove_if(Frame.begin(), Frame.end(),
+    [this] (StackArea const &Area) {
+      if (Area.Event->getType() != EventType::Alloca
+          || std::count(Restored.begin(), Restored.end(), Area.Event))
+        return false;
+      
+      stackAreaRemoved(Area, *Restore);
+      return true;
+    });
+  
+  Frame.erase(End, Frame.end());
+  
+  Restore = nullptr;
+  Restored.clear();
+}
+
+void ThreadEventWalker::finishFrame(EventRecordBase const &Ev)
+{
+  for (auto const &Area : Frames.back())
+    stackAreaRemoved(Area, Ev);
+  
+  if (Frames.size() > 1)
+    Frames.pop_back();
+  else
+    Frames.back().clear();
+}
+
+void ThreadEventWalker::reachProcessTime(uint64_t const ProcessTime)
+{
+  processTimeReached(std::min(LastProcessTime + 1, ProcessTime), ProcessTime);
+  LastProcessTime = ProcessTime;
+}
+
+void ThreadEventWalker::walk()
+{
+  for (auto const &Ev : Trace.getThreadTrace(ThreadID).events()) {
+    if (Restore && Ev.getType() != EventType::StackRestoreAlloca)
+      finishRestore();
+    
+    switch (Ev.getType()) {
+      case EventType::FunctionStart:
+        Frames.emplace_back();
+        break;
+      
+      case EventType::FunctionEnd:
+        finishFrame(Ev);
+        break;
+      
+      case EventType::InstructionWithPtr:
+        LastPointer = Ev.as<EventType::InstructionWithPtr>().getValue();
+        break;
+      
+      case EventType::Alloca:
+      {
+        auto const &Record = Ev.as<EventType::Alloca>();
+        auto const Size = Record.getElementSize() * Record.getElementCount();
+        addStackArea(MemoryArea(LastPointer, Size), Ev);
+        break;
+      }
+      
+      case EventType::ByValRegionAdd:
+      {
+        auto const &Record = Ev.as<EventType::ByValRegionAdd>();
+        addStackArea(MemoryArea(Record.getAddress(), Record.getSize()), Ev);
+        break;
+      }
+      
+      case EventType::StackRestore:
+        Restore = &Ev;
+        break;
+      
+      case EventType::StackRestoreAlloca:
+      {
+        auto const Offset = Ev.as<EventType::StackRestoreAlloca>().getAlloca();
+        Restored.push_back(&Trace.getEventAtOffset<EventType::Alloca>(Offset));
+        break;
+      }
+      
+      case EventType::Malloc:
+        dynamicEvent(Ev, Ev.as<EventType::Malloc>().getProcessTime(),
+                     LastPointer);
+        break;
+      
+      case EventType::Free:
+      {
+        auto const &Record = Ev.as<EventType::Free>();
+        dynamicEvent(Ev, Record.getProcessTime(), Record.getAddress());
+        break;
+      }
+      
+      case EventType::Realloc:
+      {
+        auto const &Record = Ev.as<EventType::Realloc>();
+        dynamicEvent(Ev, Record.getProcessTime(), Record.getAddress());
+        break;
+      }
+      
+      case EventType::CheckpointMalloc:
+        dynamicEvent(Ev, 0, Ev.as<EventType::CheckpointMalloc>().getAddress());
+        break;
+      
+      default:
+        break;
+    }
+    
+    event(Ev);
+    
+    if (auto const MaybeTime = Ev.getProcessTime())
+      reachProcessTime(*MaybeTime);
+  }
+  
+  if (Restore)
+    finishRestore();
+  
+  reachProcessTime(Trace.getFinalProcessTime());
+}
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
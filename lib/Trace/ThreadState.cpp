@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "seec/Preprocessor/MakeMemberFnChecker.hpp"
+#include "seec/Trace/BlockValueStore.hpp"
 #include "seec/Trace/ProcessState.hpp"
 #include "seec/Trace/StreamState.hpp"
 #include "seec/Trace/ThreadState.hpp"
@@ -22,6 +23,8 @@
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <iterator>
+
 namespace seec {
 
 namespace trace {
@@ -131,16 +134,51 @@ ThreadState::ThreadState(ProcessState &Parent,
 : Parent(Parent),
   Trace(Trace),
   m_NextEvent(llvm::make_unique<EventReference>(Trace.events().begin())),
+  m_StartEvent(llvm::make_unique<EventReference>(Trace.events().begin())),
   ProcessTime(Parent.getProcessTime()),
   ThreadTime(0),
-  CallStack()
+  BlockStorePool(llvm::make_unique<value_store::BasicBlockStorePool>()),
+  CallStack(),
+  UnchangedCallStackDepth(0),
+  ExitSummaries(),
+  ExitSummariesSize(0)
 {}
 
+ThreadState::~ThreadState() = default;
+
 
 //------------------------------------------------------------------------------
 // Adding events
 //------------------------------------------------------------------------------
 
+void ThreadState::addExitSummary(FunctionState const &State) {
+  auto const &FnTrace = State.getTrace();
+  if (FnTrace.getEventEnd() - FnTrace.getEventStart()
+      < getMinimumSummarizedEventSize())
+    return;
+  
+  auto const Key = FnTrace.getEventStart();
+  if (ExitSummaries.count(Key))
+    return;
+  
+  auto Summary = State.clone(*this);
+  ExitSummariesSize += Summary->getApproximateSize();
+  ExitSummaries.emplace(Key, std::move(Summary));
+  
+  // Keep the summaries that are nearest to this one, as they are the most
+  // likely to be used when stepping around the current position.
+  while (ExitSummariesSize > getExitSummariesBudget()
+         && ExitSummaries.size() > 1) {
+    auto const First = ExitSummaries.begin();
+    auto const Last = std::prev(ExitSummaries.end());
+    auto const Farthest = (Key - First->first > Last->first - Key) ? First
+                                                                   : Last;
+    
+    ExitSummariesSize -= Farthest->second->getApproximateSize();
+    ExitSummaries.erase(Farthest);
+  }
+}
+
 void ThreadState::addEvent(EventRecord<EventType::None> const &Ev) {}
 
 // It's OK to find this Event in the middle of a trace, because the trace has
@@ -188,6 +226,9 @@ void ThreadState::addEvent(EventRecord<EventType::FunctionEnd> const &Ev) {
   for (auto const &Alloca : Allocas)
     Parent.Memory.allocationRemove(Alloca.getAddress(), Alloca.getTotalSize());
 
+  addExitSummary(*CallStack.back());
+
+  CallStack.back()->releaseBasicBlockStores();
   CallStack.pop_back();
   ThreadTime = StartEv.getThreadTimeExited();
 }
@@ -508,6 +549,28 @@ void ThreadState::addEvent(EventRecord<EventType::RuntimeError> const &Ev) {
   CallStack.back()->addRuntimeError(std::move(ReadError));
 }
 
+void ThreadState::addEvent(EventRecord<EventType::Checkpoint> const &Ev) {
+  Parent.ProcessTime = Ev.getProcessTime();
+  ProcessTime = Ev.getProcessTime();
+}
+
+void
+ThreadState::addEvent(EventRecord<EventType::CheckpointMalloc> const &Ev) {
+  // The allocating instruction is identified by index, because the events
+  // that originally recorded it may have been dropped.
+  llvm::Instruction const *Allocator = nullptr;
+  if (auto const FIndex = Parent.getModule().getFunctionIndex(
+                            Ev.getFunctionIndex()))
+    Allocator = FIndex->getInstruction(Ev.getAllocatorIndex());
+  
+  Parent.addMalloc(Ev.getAddress(), Ev.getSize(), Allocator);
+  Parent.Memory.allocationAdd(Ev.getAddress(), Ev.getSize());
+}
+
+void ThreadState::addEvent(EventRecord<EventType::CheckpointEnd> const &Ev) {
+  ThreadTime = Ev.getThreadTime();
+}
+
 //------------------------------------------------------------------------------
 // readdEvent()
 //------------------------------------------------------------------------------
@@ -682,6 +745,8 @@ void ThreadState::readdEvent(EventRecord<EventType::ByValRegionAdd> const &Ev) {
 }
 
 void ThreadState::addNextEvent() {
+  noteCallStackChange();
+
   switch ((*m_NextEvent)->getType()) {
 #define SEEC_TRACE_EVENT(NAME, MEMBERS, TRAITS)                                \
     case EventType::NAME:                                                      \
@@ -692,9 +757,62 @@ void ThreadState::addNextEvent() {
     default: llvm_unreachable("Reference to unknown event type!");
   }
 
+  noteCallStackChange();
   ++*m_NextEvent;
 }
 
+llvm::Optional<uint64_t> ThreadState::getCheckpointProcessTime() const {
+  auto const Events = Trace.events();
+  if (Events.begin() == Events.end()
+      || Events.begin()->getType() != EventType::Checkpoint)
+    return llvm::None;
+  
+  return Events.begin()->as<EventType::Checkpoint>().getProcessTime();
+}
+
+void ThreadState::addCheckpoint(bool const WithSharedState) {
+  if (!getCheckpointProcessTime())
+    return;
+  
+  auto const End = Trace.events().end();
+  
+  while (*m_NextEvent != End) {
+    auto const Type = (*m_NextEvent)->getType();
+    
+    if (WithSharedState || !(*m_NextEvent)->modifiesSharedState())
+      addNextEvent();
+    else
+      ++*m_NextEvent;
+    
+    if (Type == EventType::CheckpointEnd)
+      break;
+  }
+  
+  *m_StartEvent = *m_NextEvent;
+}
+
+void ThreadState::addEventsBeforeCheckpoint(uint64_t const CheckpointTime) {
+  auto const End = Trace.events().end();
+  
+  while (*m_NextEvent != End) {
+    auto const MaybeTime = (*m_NextEvent)->getProcessTime();
+    if (MaybeTime && *MaybeTime > CheckpointTime)
+      break;
+    
+    if (!(*m_NextEvent)->modifiesSharedState()) {
+      addNextEvent();
+      continue;
+    }
+    
+    if (MaybeTime)
+      ProcessTime = *MaybeTime;
+    
+    ++*m_NextEvent;
+  }
+  
+  *m_StartEvent = *m_NextEvent;
+}
+
 
 //------------------------------------------------------------------------------
 // Removing events
@@ -705,32 +823,28 @@ void ThreadState::makePreviousInstructionActive(EventReference PriorTo) {
 
   // Find the previous instruction event that is part of the same function
   // invocation as PriorTo, if there is such an event.
-  auto MaybeRef = rfindInFunction(Trace,
-                                  rangeBefore(Trace.events(), PriorTo),
-                                  [](EventRecordBase const &Ev) -> bool {
-                                    return Ev.isInstruction();
-                                  });
+  auto const MaybeRef = PriorTo.getPreviousInstructionInFunction(Trace);
 
-  if (!MaybeRef.assigned()) {
+  if (!MaybeRef) {
     FuncState.clearActiveInstruction();
     return;
   }
   
   // Set the previous instruction as active.
-  auto MaybeIndex = MaybeRef.get<0>()->getIndex();
+  auto MaybeIndex = (*MaybeRef)->getIndex();
   assert(MaybeIndex.hasValue());
 
   // Set the correct BasicBlocks to be active.
-  FuncState.rewindingToInstruction(*MaybeIndex);
+  FuncState.rewindingToInstruction(*MaybeIndex, *MaybeRef);
   
-  if (MaybeRef.get<0>()->getType() != EventType::PreInstruction)
+  if ((*MaybeRef)->getType() != EventType::PreInstruction)
     FuncState.setActiveInstructionComplete(*MaybeIndex);
   else
     FuncState.setActiveInstructionIncomplete(*MaybeIndex);
   
   // Find all runtime errors attached to the previous instruction, and make
   // them active.
-  auto ErrorSearchRange = EventRange(MaybeRef.get<0>(), PriorTo);
+  auto ErrorSearchRange = EventRange(*MaybeRef, PriorTo);
   
   for (auto Ev : ErrorSearchRange) {
     if (Ev.getType() != EventType::RuntimeError)
@@ -751,16 +865,7 @@ void ThreadState::makePreviousInstructionActive(EventRecordBase const &PriorTo)
 }
 
 void ThreadState::setPreviousViewOfProcessTime(EventReference PriorTo) {
-  // Find the previous event that sets the process time, if there is one.
-  auto MaybeRef = rfind(rangeBefore(Trace.events(), PriorTo),
-                        [](EventRecordBase const &Ev) -> bool {
-                          return Ev.getProcessTime().hasValue();
-                        });
-  
-  if (!MaybeRef.assigned())
-    ProcessTime = 0;
-  else
-    ProcessTime = *(MaybeRef.get<0>()->getProcessTime());
+  ProcessTime = PriorTo.getPreviousProcessTime(Trace);
 }
 
 void ThreadState::setPreviousViewOfProcessTime(EventRecordBase const &PriorTo)
@@ -787,11 +892,32 @@ void ThreadState::removeEvent(EventRecord<EventType::FunctionStart> const &Ev) {
   assert(CallStack.back()->getIndex() == Index
          && "Removing FunctionStart does not match currently active function");
 
+  CallStack.back()->releaseBasicBlockStores();
   CallStack.pop_back();
   ThreadTime = Info.getThreadTimeEntered() - 1;
 }
 
+void ThreadState::restoreFunctionAllocations(FunctionState const &State) {
+  // Restore alloca allocations (reverse order):
+  for (auto const &Alloca : seec::reverse(State.getAllocas()))
+    Parent.Memory.allocationUnremove(Alloca.getAddress(),
+                                     Alloca.getTotalSize());
+
+  // Restore byval areas (reverse order):
+  for (auto const &ByVal : seec::reverse(State.getParamByValStates()))
+    Parent.Memory.allocationUnremove(ByVal.getArea().address(),
+                                     ByVal.getArea().length());
+}
+
 void ThreadState::removeEvent(EventRecord<EventType::FunctionEnd> const &Ev) {
+  // If the function's final state was summarized then restore it directly.
+  auto const SummaryIt = ExitSummaries.find(Ev.getEventOffsetStart());
+  if (SummaryIt != ExitSummaries.end()) {
+    CallStack.emplace_back(SummaryIt->second->clone(*this));
+    restoreFunctionAllocations(*CallStack.back());
+    ThreadTime = CallStack.back()->getTrace().getThreadTimeExited() - 1;
+    return;
+  }
   
   auto const &StartEv = Parent.getTrace()
                               .getEventAtOffset<EventType::FunctionStart>
@@ -817,9 +943,9 @@ void ThreadState::removeEvent(EventRecord<EventType::FunctionEnd> const &Ev) {
   
   CallStack.emplace_back(std::move(State));
   
-  // Now we need to restore all function-level events. For now, we use the
-  // naive method, which is to simply re-add all events from the start of the
-  // function to the end.
+  // Now we need to restore all function-level events. We re-add all events
+  // from the start of the function to the end, which is why long-running
+  // functions are summarized when they exit (see addExitSummary()).
   auto MaybeEvRef = Trace.getThreadEventBlockSequence().getReferenceTo(Ev);
   assert(MaybeEvRef && "Malformed event trace");
   auto const &EvRef = *MaybeEvRef;
@@ -853,15 +979,8 @@ void ThreadState::removeEvent(EventRecord<EventType::FunctionEnd> const &Ev) {
     }
   }
 
-  // Restore alloca allocations (reverse order):
-  for (auto const &Alloca : seec::reverse(StateRef.getAllocas()))
-    Parent.Memory.allocationUnremove(Alloca.getAddress(),
-                                     Alloca.getTotalSize());
-
-  // Restore byval areas (reverse order):
-  for (auto const &ByVal : seec::reverse(StateRef.getParamByValStates()))
-    Parent.Memory.allocationUnremove(ByVal.getArea().address(),
-                                     ByVal.getArea().length());
+  restoreFunctionAllocations(StateRef);
+  addExitSummary(StateRef);
 
   // Set the thread time to the value that it had prior to this event.
   ThreadTime = TraceRef.getThreadTimeExited() - 1;
@@ -1200,8 +1319,19 @@ void ThreadState::removeEvent(EventRecord<EventType::RuntimeError> const &Ev) {
   CallStack.back()->removeLastRuntimeError();
 }
 
+// Checkpoint events precede the thread's start event, so they are never
+// removed.
+void ThreadState::removeEvent(EventRecord<EventType::Checkpoint> const &Ev) {}
+
+void
+ThreadState::removeEvent(EventRecord<EventType::CheckpointMalloc> const &Ev) {}
+
+void ThreadState::removeEvent(EventRecord<EventType::CheckpointEnd> const &Ev)
+{}
+
 void ThreadState::removePreviousEvent() {
   --*m_NextEvent;
+  noteCallStackChange();
 
   switch ((*m_NextEvent)->getType()) {
 #define SEEC_TRACE_EVENT(NAME, MEMBERS, TRAITS)                                \
@@ -1212,6 +1342,8 @@ void ThreadState::removePreviousEvent() {
 #include "seec/Trace/Events.def"
     default: llvm_unreachable("Reference to unknown event type!");
   }
+
+  noteCallStackChange();
 }
 
 
@@ -1220,7 +1352,7 @@ uint32_t ThreadState::getThreadID() const {
 }
 
 bool ThreadState::isAtStart() const {
-  return *m_NextEvent == Trace.events().begin();
+  return *m_NextEvent == *m_StartEvent;
 }
 
 bool ThreadState::isAtEnd() const {
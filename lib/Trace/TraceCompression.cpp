@@ -0,0 +1,333 @@
+//===- lib/Trace/TraceCompression.cpp -------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Trace/TraceCompression.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+
+namespace seec {
+
+namespace trace {
+
+
+/// Size of the block header (BlockType, NextBlock).
+static constexpr size_t BlockHeaderSize = sizeof(BlockType) + sizeof(uint64_t);
+
+/// Size of the compressed block's fixed fields (ThreadID, BlockOffset,
+/// BlockSize, PatchSize).
+static constexpr size_t CompressedHeaderSize = sizeof(uint32_t)
+                                             + sizeof(uint64_t)
+                                             + sizeof(uint64_t)
+                                             + sizeof(uint64_t);
+
+/// Size of the uncompressed block's fixed fields (block header and ThreadID).
+static constexpr size_t EventsStart = BlockHeaderSize + sizeof(uint32_t);
+
+/// Maximum length of a single literal or zero run.
+static constexpr size_t MaximumRun = 128;
+
+
+/// \brief Get the size of an event record of the given type, or zero if the
+///        type is not valid.
+///
+static size_t getEventSizeOrZero(EventType const Type)
+{
+  switch (Type) {
+#define SEEC_TRACE_EVENT(NAME, MEMBERS, TRAITS) \
+    case EventType::NAME: return sizeof(EventRecord<EventType::NAME>);
+#include "seec/Trace/Events.def"
+    default: return 0;
+  }
+}
+
+template<typename T>
+static void append(std::vector<char> &Out, T const &Value)
+{
+  auto const Bytes = reinterpret_cast<char const *>(&Value);
+  Out.insert(Out.end(), Bytes, Bytes + sizeof(T));
+}
+
+template<typename T>
+static T readAt(char const *Data)
+{
+  T Value;
+  std::memcpy(&Value, Data, sizeof(T));
+  return Value;
+}
+
+
+//------------------------------------------------------------------------------
+// Event delta encoding
+//------------------------------------------------------------------------------
+
+/// \brief XOR each event record with the record that precedes it.
+///
+/// Any trailing bytes that do not form a complete record are copied unchanged
+/// (apart from the type of the first such record).
+///
+static std::vector<char> deltaEncodeEvents(llvm::ArrayRef<char> Events)
+{
+  std::vector<char> Out(Events.begin(), Events.end());
+  
+  size_t Position = 0;
+  size_t PreviousPosition = 0;
+  size_t PreviousSize = 0;
+  
+  while (Position + sizeof(EventRecordBase) <= Events.size()) {
+    // The type is always encoded, so that the decoder can recover it before
+    // it knows whether this is a complete record.
+    if (PreviousSize)
+      Out[Position] ^= Events[PreviousPosition];
+    
+    auto const Type = static_cast<EventType>(Events[Position]);
+    auto const Size = getEventSizeOrZero(Type);
+    if (Size == 0 || Position + Size > Events.size())
+      break;
+    
+    auto const Common = std::min(Size, PreviousSize);
+    for (size_t i = 1; i < Common; ++i)
+      Out[Position + i] ^= Events[PreviousPosition + i];
+    
+    PreviousPosition = Position;
+    PreviousSize = Size;
+    Position += Size;
+  }
+  
+  return Out;
+}
+
+/// \brief Reverse deltaEncodeEvents() in place.
+///
+static void deltaDecodeEvents(char * const Events, size_t const Length)
+{
+  size_t Position = 0;
+  size_t PreviousPosition = 0;
+  size_t PreviousSize = 0;
+  
+  while (Position + sizeof(EventRecordBase) <= Length) {
+    // The type is the first byte of every record, so it can be recovered
+    // before we know the size of the record.
+    if (PreviousSize)
+      Events[Position] ^= Events[PreviousPosition];
+    
+    auto const Type = static_cast<EventType>(Events[Position]);
+    auto const Size = getEventSizeOrZero(Type);
+    if (Size == 0 || Position + Size > Length)
+      break;
+    
+    auto const Common = std::min(Size, PreviousSize);
+    for (size_t i = 1; i < Common; ++i)
+      Events[Position + i] ^= Events[PreviousPosition + i];
+    
+    PreviousPosition = Position;
+    PreviousSize = Size;
+    Position += Size;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Zero run encoding
+//------------------------------------------------------------------------------
+
+// A control byte below 0x80 is followed by (value + 1) literal bytes. A control
+// byte of 0x80 or above represents ((value & 0x7F) + 1) zero bytes.
+
+static void runEncode(llvm::ArrayRef<char> Data, std::vector<char> &Out)
+{
+  size_t Position = 0;
+  
+  while (Position < Data.size()) {
+    // Count the zero run at this position.
+    size_t Zeros = 0;
+    while (Position + Zeros < Data.size() && Data[Position + Zeros] == 0
+           && Zeros < MaximumRun)
+      ++Zeros;
+    
+    if (Zeros >= 2 || (Zeros == 1 && Position + 1 == Data.size())) {
+      Out.push_back(static_cast<char>(0x80 | (Zeros - 1)));
+      Position += Zeros;
+      continue;
+    }
+    
+    // Find the end of the literal run: stop before a run of two zeros.
+    size_t Literal = 0;
+    while (Position + Literal < Data.size() && Literal < MaximumRun) {
+      auto const Here = Position + Literal;
+      if (Data[Here] == 0 && Here + 1 < Data.size() && Data[Here + 1] == 0)
+        break;
+      ++Literal;
+    }
+    
+    Out.push_back(static_cast<char>(Literal - 1));
+    Out.insert(Out.end(), Data.begin() + Position,
+                          Data.begin() + Position + Literal);
+    Position += Literal;
+  }
+}
+
+static bool runDecode(llvm::ArrayRef<char> Encoded,
+                      char * const Out,
+                      size_t const Length)
+{
+  size_t In = 0;
+  size_t Position = 0;
+  
+  while (In < Encoded.size()) {
+    auto const Control = static_cast<unsigned char>(Encoded[In++]);
+    auto const Run = static_cast<size_t>(Control & 0x7F) + 1;
+    
+    if (Position + Run > Length)
+      return false;
+    
+    if (Control & 0x80) {
+      std::memset(Out + Position, 0, Run);
+    }
+    else {
+      if (In + Run > Encoded.size())
+        return false;
+      
+      std::memcpy(Out + Position, Encoded.data() + In, Run);
+      In += Run;
+    }
+    
+    Position += Run;
+  }
+  
+  return Position == Length;
+}
+
+
+//------------------------------------------------------------------------------
+// Compressed blocks
+//------------------------------------------------------------------------------
+
+void appendThreadEventPatch(std::vector<char> &Patches,
+                            offset_uint const Offset,
+                            void const * const Data,
+                            size_t const Size)
+{
+  append(Patches, Offset);
+  append(Patches, static_cast<uint32_t>(Size));
+  
+  auto const Bytes = static_cast<char const *>(Data);
+  Patches.insert(Patches.end(), Bytes, Bytes + Size);
+}
+
+std::vector<char> compressThreadEventBlock(llvm::ArrayRef<char> Image,
+                                           offset_uint const BlockOffset,
+                                           llvm::ArrayRef<char> Patches)
+{
+  assert(Image.size() >= EventsStart && "incomplete thread event block");
+  
+  // Checkpoint data blocks keep their own type, as they are always held in
+  // the compressed form.
+  auto const Type = readAt<BlockType>(Image.data());
+  
+  std::vector<char> Out;
+  Out.reserve(BlockHeaderSize + CompressedHeaderSize + Patches.size()
+              + Image.size() / 2);
+  
+  append(Out, Type == BlockType::ThreadCheckpointData
+              ? BlockType::ThreadCheckpointData
+              : BlockType::ThreadEventsCompressed);
+  append(Out, uint64_t(0)); // NextBlock is set by the caller.
+  
+  Out.insert(Out.end(), Image.begin() + BlockHeaderSize,
+                        Image.begin() + EventsStart); // ThreadID
+  append(Out, uint64_t(BlockOffset));
+  append(Out, uint64_t(Image.size()));
+  append(Out, uint64_t(Patches.size()));
+  Out.insert(Out.end(), Patches.begin(), Patches.end());
+  
+  runEncode(deltaEncodeEvents(Image.drop_front(EventsStart)), Out);
+  
+  return Out;
+}
+
+std::vector<char> prependThreadEventPatches(llvm::ArrayRef<char> Block,
+                                            llvm::ArrayRef<char> Patches)
+{
+  assert(Block.size() >= BlockHeaderSize + CompressedHeaderSize
+         && "incomplete compressed block");
+  
+  auto const Fields = Block.data() + BlockHeaderSize;
+  auto const PatchSize = readAt<uint64_t>(Fields + 20);
+  auto const PatchStart = BlockHeaderSize + CompressedHeaderSize;
+  
+  std::vector<char> Out;
+  Out.reserve(Block.size() + Patches.size());
+  
+  append(Out, readAt<BlockType>(Block.data()));
+  append(Out, uint64_t(0)); // NextBlock is set by the caller.
+  
+  Out.insert(Out.end(), Fields, Fields + 20); // ThreadID, BlockOffset, BlockSize
+  append(Out, uint64_t(PatchSize + Patches.size()));
+  Out.insert(Out.end(), Patches.begin(), Patches.end());
+  Out.insert(Out.end(), Block.begin() + PatchStart, Block.end());
+  
+  return Out;
+}
+
+llvm::Optional<CompressedThreadEventBlock>
+CompressedThreadEventBlock::read(llvm::ArrayRef<char> Data)
+{
+  if (Data.size() < CompressedHeaderSize)
+    return llvm::None;
+  
+  auto const Raw = Data.data();
+  auto const ThreadID    = readAt<uint32_t>(Raw);
+  auto const BlockOffset = readAt<uint64_t>(Raw + 4);
+  auto const BlockSize   = readAt<uint64_t>(Raw + 12);
+  auto const PatchSize   = readAt<uint64_t>(Raw + 20);
+  
+  if (BlockSize < EventsStart
+      || PatchSize > Data.size() - CompressedHeaderSize)
+    return llvm::None;
+  
+  auto const Rest = Data.drop_front(CompressedHeaderSize);
+  
+  return CompressedThreadEventBlock(ThreadID,
+                                    BlockOffset,
+                                    BlockSize,
+                                    Rest.take_front(PatchSize),
+                                    Rest.drop_front(PatchSize));
+}
+
+bool CompressedThreadEventBlock::decompress(char * const Out) const
+{
+  // Recreate the uncompressed block's header.
+  auto const Type = BlockType::ThreadEvents;
+  uint64_t const NextBlock = m_BlockOffset + m_BlockSize;
+  
+  std::memcpy(Out, &Type, sizeof(Type));
+  std::memcpy(Out + sizeof(Type), &NextBlock, sizeof(NextBlock));
+  std::memcpy(Out + BlockHeaderSize, &m_ThreadID, sizeof(m_ThreadID));
+  
+  auto const Events = Out + EventsStart;
+  auto const Length = m_BlockSize - EventsStart;
+  
+  if (!runDecode(m_Encoded, Events, Length))
+    return false;
+  
+  deltaDecodeEvents(Events, Length);
+  return true;
+}
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
@@ -0,0 +1,149 @@
+//===- lib/Trace/TraceDataStore.cpp ---------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Trace/TraceDataStore.hpp"
+#include "seec/Trace/TraceStorage.hpp"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstring>
+
+
+namespace seec {
+
+namespace trace {
+
+
+ProcessDataStore::ProcessDataStore(OutputStreamAllocator &Allocator)
+: m_Allocator(Allocator),
+  m_Stream(Allocator.getProcessDataStream()),
+  m_StreamMutex(),
+  m_Abandoned(false),
+  m_Shards(new Shard[getShardCount()])
+{}
+
+ProcessDataStore::~ProcessDataStore() = default;
+
+offset_uint ProcessDataStore::writeNew(char const * const Data,
+                                       size_t const Size)
+{
+  if (m_Abandoned)
+    return 0;
+  
+  llvm::Optional<off_t> Written;
+  
+  if (Size >= OutputBlockProcessDataStream::getSingleBlockThreshold()) {
+    // The allocator is thread-safe, so large payloads are written without
+    // waiting for the shared stream.
+    Written = m_Allocator.writeSingleBlock(BlockType::ProcessData, Data, Size);
+  }
+  else {
+    std::lock_guard<std::mutex> StreamLock(m_StreamMutex);
+    
+    if (!m_Stream)
+      return 0;
+    
+    Written = m_Stream->write(Data, Size);
+  }
+  
+  return Written ? *Written : 0;
+}
+
+offset_uint ProcessDataStore::write(char const * const Data, size_t const Size)
+{
+  auto const Hash = static_cast<size_t>(
+                      llvm::hash_value(llvm::StringRef(Data, Size)));
+  
+  auto &TheShard = m_Shards[Hash % getShardCount()];
+  
+  // The shard remains locked while a new payload is written, so that
+  // concurrent writes of the same payload are only written once.
+  std::lock_guard<std::mutex> ShardLock(TheShard.Mutex);
+  
+  ++TheShard.Stats.Records;
+  TheShard.Stats.RecordBytes += Size;
+  
+  auto const Range = TheShard.Entries.equal_range(Hash);
+  for (auto It = Range.first; It != Range.second; ++It) {
+    auto const &Existing = It->second;
+    
+    if (Existing.Size == Size
+        && std::memcmp(Existing.Data.get(), Data, Size) == 0) {
+      ++TheShard.Stats.Duplicates;
+      TheShard.Stats.DuplicateBytes += Size;
+      return Existing.Offset;
+    }
+  }
+  
+  auto const Offset = writeNew(Data, Size);
+  if (!Offset)
+    return 0;
+  
+  // Keep a copy of the payload for comparison, if there is room.
+  auto const ShardLimit = getRetainedBytesLimit() / getShardCount();
+  if (Size <= ShardLimit - TheShard.RetainedBytes) {
+    Entry NewEntry;
+    NewEntry.Data.reset(new char[Size ? Size : 1]);
+    NewEntry.Size = Size;
+    NewEntry.Offset = Offset;
+    std::memcpy(NewEntry.Data.get(), Data, Size);
+    
+    TheShard.Entries.emplace(Hash, std::move(NewEntry));
+    TheShard.RetainedBytes += Size;
+  }
+  
+  return Offset;
+}
+
+void ProcessDataStore::flush()
+{
+  std::lock_guard<std::mutex> StreamLock(m_StreamMutex);
+  
+  if (m_Stream)
+    m_Stream->flush();
+}
+
+void ProcessDataStore::abandon()
+{
+  m_Abandoned = true;
+  
+  std::lock_guard<std::mutex> StreamLock(m_StreamMutex);
+  
+  if (m_Stream) {
+    m_Stream->discard();
+    m_Stream.reset();
+  }
+}
+
+ProcessDataStore::Statistics ProcessDataStore::getStatistics() const
+{
+  Statistics Total = Statistics();
+  
+  for (unsigned i = 0; i < getShardCount(); ++i) {
+    auto &TheShard = m_Shards[i];
+    std::lock_guard<std::mutex> ShardLock(TheShard.Mutex);
+    
+    Total.Records        += TheShard.Stats.Records;
+    Total.RecordBytes    += TheShard.Stats.RecordBytes;
+    Total.Duplicates     += TheShard.Stats.Duplicates;
+    Total.DuplicateBytes += TheShard.Stats.DuplicateBytes;
+  }
+  
+  return Total;
+}
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
@@ -13,6 +13,7 @@
 
 #include "seec/Trace/TraceMemory.hpp"
 
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <algorithm>
@@ -23,19 +24,54 @@ namespace seec {
 
 namespace trace {
 
-TraceMemoryAllocation *
-TraceMemoryState::getAllocationAtOrPreceding(uintptr_t const Address)
+//------------------------------------------------------------------------------
+// Shadow bit helpers
+//------------------------------------------------------------------------------
+
+/// \brief Get a mask of the lowest Count bits.
+///
+static uint64_t getLowMask(unsigned const Count)
 {
-  // Find the first allocation starting at a higher address.
-  auto It = m_Allocations.upper_bound(Address);
-  if (It == m_Allocations.begin())
-    return nullptr;
-  
-  // Rewind to the first allocation starting at an equal or lower address.
-  --It;
-  return &(It->second);
+  return Count >= 64 ? ~uint64_t(0) : ((uint64_t(1) << Count) - 1);
+}
+
+/// \brief Set or clear the bits [Begin, End) of Words.
+///
+static void setBitRange(uint64_t * const Words,
+                        std::size_t Begin,
+                        std::size_t const End,
+                        bool const Value)
+{
+  while (Begin < End) {
+    auto const Bit = static_cast<unsigned>(Begin % 64);
+    auto const Count = static_cast<unsigned>(
+                         std::min<std::size_t>(64 - Bit, End - Begin));
+    auto const Mask = getLowMask(Count) << Bit;
+    
+    if (Value)
+      Words[Begin / 64] |= Mask;
+    else
+      Words[Begin / 64] &= ~Mask;
+    
+    Begin += Count;
+  }
 }
 
+static uintptr_t getPageNumber(uintptr_t const Address)
+{
+  return Address >> getShadowPageShift();
+}
+
+static std::size_t getPageOffset(uintptr_t const Address)
+{
+  return Address & (getShadowPageSize() - 1);
+}
+
+
+//------------------------------------------------------------------------------
+// TraceMemoryState
+//------------------------------------------------------------------------------
+
 TraceMemoryAllocation const *
 TraceMemoryState::getAllocationAtOrPreceding(uintptr_t const Address) const
 {
@@ -49,79 +85,221 @@ TraceMemoryState::getAllocationAtOrPreceding(uintptr_t const Address) const
   return &(It->second);
 }
 
-TraceMemoryAllocation &
-TraceMemoryState::getAllocationContaining(uintptr_t const Address,
-                                          std::size_t const Length)
+bool TraceMemoryState::isAllocated(uintptr_t const Address,
+                                   std::size_t const Length) const
 {
-  auto AllocPtr = getAllocationAtOrPreceding(Address);
-  assert(AllocPtr->getArea().contains(MemoryArea(Address, Length)));
-  return *AllocPtr;
+  auto const AllocPtr = findAllocationContaining(Address);
+  return AllocPtr && AllocPtr->getArea().contains(MemoryArea(Address, Length));
 }
 
-TraceMemoryAllocation const &
-TraceMemoryState::getAllocationContaining(uintptr_t const Address,
-                                          std::size_t const Length) const
+TraceMemoryShadowPage &TraceMemoryState::getPage(uintptr_t const Address)
 {
-  auto AllocPtr = getAllocationAtOrPreceding(Address);
-  assert(AllocPtr->getArea().contains(MemoryArea(Address, Length)));
-  return *AllocPtr;
+  auto const It = m_Pages.find(getPageNumber(Address));
+  assert(It != m_Pages.end() && "no shadow for unallocated memory");
+  return *(It->second);
+}
+
+TraceMemoryShadowPage const &
+TraceMemoryState::getPage(uintptr_t const Address) const
+{
+  auto const It = m_Pages.find(getPageNumber(Address));
+  assert(It != m_Pages.end() && "no shadow for unallocated memory");
+  return *(It->second);
+}
+
+void TraceMemoryState::attachPages(MemoryArea const Area)
+{
+  if (!Area.length())
+    return;
+  
+  auto const Last = getPageNumber(Area.last());
+  for (auto Page = getPageNumber(Area.start()); Page <= Last; ++Page) {
+    auto &PagePtr = m_Pages[Page];
+    if (!PagePtr)
+      PagePtr.reset(new TraceMemoryShadowPage());
+    ++(PagePtr->Users);
+  }
+}
+
+void TraceMemoryState::detachPages(MemoryArea const Area,
+                                   TraceMemoryAllocation const &Alloc)
+{
+  if (!Area.length())
+    return;
+  
+  auto const Last = getPageNumber(Area.last());
+  for (auto Page = getPageNumber(Area.start()); Page <= Last; ++Page) {
+    auto const It = m_Pages.find(Page);
+    assert(It != m_Pages.end() && "allocation's shadow page is missing");
+    
+    auto &ShadowPage = *(It->second);
+    if (ShadowPage.Owner == &Alloc)
+      ShadowPage.Owner = nullptr;
+    
+    if (--ShadowPage.Users == 0)
+      m_Pages.erase(It);
+  }
+}
+
+void TraceMemoryState::setPageOwner(TraceMemoryAllocation const &Alloc)
+{
+  auto const Area = Alloc.getArea();
+  if (Area.length() < getShadowPageSize())
+    return;
+  
+  // Only pages that are entirely within the allocation are owned by it.
+  auto const First = getPageNumber(Area.start() + getShadowPageSize() - 1);
+  auto const Last  = getPageNumber(Area.end()) - 1;
+  
+  for (auto Page = First; Page <= Last; ++Page)
+    m_Pages[Page]->Owner = &Alloc;
+}
+
+void TraceMemoryState::setState(uintptr_t Address,
+                                std::size_t Length,
+                                bool const Initialized)
+{
+  while (Length) {
+    auto const Offset = getPageOffset(Address);
+    auto const Count  = std::min(Length, getShadowPageSize() - Offset);
+    
+    setBitRange(getPage(Address).Bits, Offset, Offset + Count, Initialized);
+    
+    Address += Count;
+    Length  -= Count;
+  }
+}
+
+uint64_t TraceMemoryState::readBits(uintptr_t const Address,
+                                    unsigned const Count) const
+{
+  assert(Count <= 64);
+  
+  uint64_t Result = 0;
+  unsigned Read = 0;
+  
+  while (Read < Count) {
+    auto const Offset = getPageOffset(Address + Read);
+    auto const Bit = static_cast<unsigned>(Offset % 64);
+    auto const N = std::min(64 - Bit, Count - Read);
+    auto const Word = getPage(Address + Read).Bits[Offset / 64];
+    
+    Result |= ((Word >> Bit) & getLowMask(N)) << Read;
+    Read += N;
+  }
+  
+  return Result;
+}
+
+void TraceMemoryState::writeBits(uintptr_t const Address,
+                                 unsigned const Count,
+                                 uint64_t const Bits)
+{
+  assert(Count <= 64);
+  
+  unsigned Written = 0;
+  
+  while (Written < Count) {
+    auto const Offset = getPageOffset(Address + Written);
+    auto const Bit = static_cast<unsigned>(Offset % 64);
+    auto const N = std::min(64 - Bit, Count - Written);
+    auto &Word = getPage(Address + Written).Bits[Offset / 64];
+    auto const Mask = getLowMask(N);
+    
+    Word = (Word & ~(Mask << Bit)) | (((Bits >> Written) & Mask) << Bit);
+    Written += N;
+  }
+}
+
+std::size_t TraceMemoryState::getLengthOfState(uintptr_t const Address,
+                                               std::size_t const MaxLength,
+                                               bool const Initialized) const
+{
+  std::size_t Length = 0;
+  
+  while (Length < MaxLength) {
+    auto const Offset = getPageOffset(Address + Length);
+    auto const Bit = static_cast<unsigned>(Offset % 64);
+    auto const Available = std::min<std::size_t>(64 - Bit, MaxLength - Length);
+    
+    auto Word = getPage(Address + Length).Bits[Offset / 64];
+    if (!Initialized)
+      Word = ~Word;
+    
+    // Bits shifted in from the top are zero, so the run ends at the word.
+    auto const Run = std::min<std::size_t>(llvm::countTrailingOnes(Word >> Bit),
+                                           Available);
+    Length += Run;
+    
+    if (Run < Available)
+      break;
+  }
+  
+  return Length;
 }
 
 void TraceMemoryState::add(uintptr_t Address,
                            std::size_t Length)
 {
-  auto &Alloc = getAllocationContaining(Address, Length);
-  std::fill_n(Alloc.getShadowAt(Address), Length, getInitializedByte());
+  assert(isAllocated(Address, Length));
+  setState(Address, Length, true);
 }
 
 void TraceMemoryState::memmove(uintptr_t const Source,
                                uintptr_t const Destination,
                                std::size_t const Size)
 {
-  auto &SrcAlloc = getAllocationContaining(Source, Size);
-  auto &DstAlloc = getAllocationContaining(Destination, Size);
+  assert(isAllocated(Source, Size));
+  assert(isAllocated(Destination, Size));
+  
+  // Read all of the source's shadow before writing any, because the areas
+  // may overlap.
+  std::vector<uint64_t> Bits((Size + 63) / 64);
   
-  std::memcpy(DstAlloc.getShadowAt(Destination),
-              SrcAlloc.getShadowAt(Source),
-              Size);
+  for (std::size_t i = 0; i < Bits.size(); ++i) {
+    auto const Count = std::min<std::size_t>(64, Size - (i * 64));
+    Bits[i] = readBits(Source + (i * 64), Count);
+  }
+  
+  for (std::size_t i = 0; i < Bits.size(); ++i) {
+    auto const Count = std::min<std::size_t>(64, Size - (i * 64));
+    writeBits(Destination + (i * 64), Count, Bits[i]);
+  }
 }
 
 void TraceMemoryState::clear(uintptr_t Address,  std::size_t Length)
 {
-  auto &Alloc = getAllocationContaining(Address, Length);
-  std::fill_n(Alloc.getShadowAt(Address), Length, getUninitializedByte());
+  assert(isAllocated(Address, Length));
+  setState(Address, Length, false);
 }
 
 bool TraceMemoryState::hasKnownState(uintptr_t Address,
                                      std::size_t Length) const
 {
-  auto &Alloc = getAllocationContaining(Address, Length);
-  auto const Start = Alloc.getShadowAt(Address);
-  auto const End   = Start + Length;
-  
-  return std::all_of(Start, End,
-                     [=](char const C) {
-                       return C == getInitializedByte();
-                     });
+  assert(isAllocated(Address, Length));
+  return getLengthOfState(Address, Length, true) == Length;
 }
 
 size_t TraceMemoryState::getLengthOfKnownState(uintptr_t Address,
                                                std::size_t MaxLength)
 const
 {
-  auto &Alloc = getAllocationContaining(Address, MaxLength);
-  auto const Start = Alloc.getShadowAt(Address);
-  auto const End   = Start + MaxLength;
-  auto const Uninit = std::find_if_not(Start, End,
-                                       [=](char const C) {
-                                         return C == getInitializedByte();
-                                       });
-  return std::distance(Start, Uninit);
+  assert(isAllocated(Address, MaxLength));
+  return getLengthOfState(Address, MaxLength, true);
 }
 
 TraceMemoryAllocation const *
 TraceMemoryState::findAllocationContaining(uintptr_t const Address) const
 {
+  // Every allocated byte has a shadow page, and if an allocation covers the
+  // entire page then it is recorded there.
+  auto const PageIt = m_Pages.find(getPageNumber(Address));
+  if (PageIt == m_Pages.end())
+    return nullptr;
+  
+  if (auto const Owner = PageIt->second->Owner)
+    return Owner;
+  
   auto AllocPtr = getAllocationAtOrPreceding(Address);
   if (AllocPtr && AllocPtr->getArea().contains(Address))
     return AllocPtr;
@@ -137,12 +315,20 @@ void TraceMemoryState::addAllocation(uintptr_t const Address,
                                                                Size)));
 
   assert(Result.second && "allocation already existed?");
+  
+  auto const &Alloc = Result.first->second;
+  attachPages(Alloc.getArea());
+  setPageOwner(Alloc);
+  
+  // The shadow pages may hold the state of previous allocations.
+  setState(Address, Size, false);
 }
 
 void TraceMemoryState::removeAllocation(uintptr_t const Address)
 {
   auto const It = m_Allocations.find(Address);
   assert(It != m_Allocations.end() && "allocation doesn't exist?");
+  detachPages(It->second.getArea(), It->second);
   m_Allocations.erase(It);
 }
 
@@ -151,7 +337,19 @@ void TraceMemoryState::resizeAllocation(uintptr_t const Address,
 {
   auto const It = m_Allocations.find(Address);
   assert(It != m_Allocations.end() && "allocation doesn't exist?");
-  It->second.resize(NewSize);
+  
+  auto &Alloc = It->second;
+  auto const OldArea = Alloc.getArea();
+  
+  // Attach the new pages before detaching the old pages, so that the shadow
+  // of the retained memory is kept.
+  Alloc.resize(NewSize);
+  attachPages(Alloc.getArea());
+  detachPages(OldArea, Alloc);
+  setPageOwner(Alloc);
+  
+  if (NewSize > OldArea.length())
+    setState(OldArea.end(), NewSize - OldArea.length(), false);
 }
 
 } // namespace trace (in seec)
@@ -0,0 +1,183 @@
+//===- lib/Trace/TracePointerStore.cpp ------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Trace/TracePointerStore.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+namespace seec {
+
+namespace trace {
+
+
+/// \brief The targets of pointers in one page of memory.
+///
+struct PointerTargetStore::Page {
+  PointerTarget Slots[getPageSize() / getSlotSize()];
+  
+  /// Number of non-empty slots.
+  std::size_t Used;
+  
+  Page()
+  : Slots(),
+    Used(0)
+  {}
+};
+
+
+PointerTargetStore::PointerTargetStore()
+: m_Pages(),
+  m_Unaligned()
+{}
+
+PointerTargetStore::~PointerTargetStore() = default;
+
+template<typename FnT>
+void PointerTargetStore::forEachSlotIn(MemoryArea const Area, FnT Fn)
+{
+  // Find the first aligned address in the area.
+  auto const Start = (Area.start() + getSlotSize() - 1) & ~(getSlotSize() - 1);
+  auto const End = Area.end();
+  if (Start >= End)
+    return;
+  
+  auto const FirstPage = Start >> getPageShift();
+  auto const LastPage = (End - 1) >> getPageShift();
+  
+  auto const VisitPage = [&] (uintptr_t const PageNumber, Page &ThePage) {
+    uintptr_t const PageStart = PageNumber << getPageShift();
+    uintptr_t const From = std::max<uintptr_t>(Start, PageStart);
+    uintptr_t const To = std::min<uintptr_t>(End, PageStart + getPageSize());
+    
+    for (auto Address = From; Address < To; Address += getSlotSize())
+      Fn(ThePage, (Address - PageStart) / getSlotSize(), Address);
+  };
+  
+  if (LastPage - FirstPage >= m_Pages.size()) {
+    // The area is larger than the memory we have targets for (e.g. when a
+    // large allocation is freed), so only visit the pages that exist.
+    for (auto &Pair : m_Pages)
+      if (Pair.first >= FirstPage && Pair.first <= LastPage)
+        VisitPage(Pair.first, *Pair.second);
+  }
+  else {
+    for (auto PageNumber = FirstPage; PageNumber <= LastPage; ++PageNumber) {
+      auto const It = m_Pages.find(PageNumber);
+      if (It != m_Pages.end())
+        VisitPage(PageNumber, *It->second);
+    }
+  }
+}
+
+void PointerTargetStore::put(uintptr_t const Address,
+                             PointerTarget const &Target)
+{
+  if (!Target)
+    return;
+  
+  if (Address % getSlotSize()) {
+    m_Unaligned[Address] = Target;
+    return;
+  }
+  
+  auto &PagePtr = m_Pages[Address >> getPageShift()];
+  if (!PagePtr)
+    PagePtr.reset(new Page());
+  
+  auto &Slot = PagePtr->Slots[(Address % getPageSize()) / getSlotSize()];
+  if (!Slot)
+    ++(PagePtr->Used);
+  
+  Slot = Target;
+}
+
+PointerTarget PointerTargetStore::get(uintptr_t const Address) const
+{
+  if (Address % getSlotSize()) {
+    auto const It = m_Unaligned.find(Address);
+    return It != m_Unaligned.end() ? It->second : PointerTarget(0, 0);
+  }
+  
+  auto const It = m_Pages.find(Address >> getPageShift());
+  if (It == m_Pages.end())
+    return PointerTarget(0, 0);
+  
+  return It->second->Slots[(Address % getPageSize()) / getSlotSize()];
+}
+
+void PointerTargetStore::set(uintptr_t const Address,
+                             PointerTarget const &Target)
+{
+  clear(MemoryArea(Address, getSlotSize()));
+  put(Address, Target);
+}
+
+void PointerTargetStore::clear(MemoryArea const Area)
+{
+  if (!Area.length())
+    return;
+  
+  std::vector<uintptr_t> EmptyPages;
+  
+  forEachSlotIn(Area,
+    [&] (Page &ThePage, std::size_t const Index, uintptr_t const Address) {
+      auto &Slot = ThePage.Slots[Index];
+      if (!Slot)
+        return;
+      
+      Slot = PointerTarget();
+      if (--ThePage.Used == 0)
+        EmptyPages.push_back(Address >> getPageShift());
+    });
+  
+  for (auto const PageNumber : EmptyPages)
+    m_Pages.erase(PageNumber);
+  
+  if (!m_Unaligned.empty())
+    m_Unaligned.erase(m_Unaligned.lower_bound(Area.start()),
+                      m_Unaligned.lower_bound(Area.end()));
+}
+
+void PointerTargetStore::copy(uintptr_t const From,
+                              uintptr_t const To,
+                              std::size_t const Length)
+{
+  if (!Length)
+    return;
+  
+  // Take the source targets first, because the ranges may overlap.
+  std::vector<std::pair<std::size_t, PointerTarget>> Targets;
+  
+  forEachSlotIn(MemoryArea(From, Length),
+    [&] (Page &ThePage, std::size_t const Index, uintptr_t const Address) {
+      if (auto const &Slot = ThePage.Slots[Index])
+        Targets.emplace_back(Address - From, Slot);
+    });
+  
+  auto const UnalignedEnd = m_Unaligned.lower_bound(From + Length);
+  for (auto It = m_Unaligned.lower_bound(From); It != UnalignedEnd; ++It)
+    Targets.emplace_back(It->first - From, It->second);
+  
+  clear(MemoryArea(To, Length));
+  
+  for (auto const &Target : Targets)
+    put(To + Target.first, Target.second);
+}
+
+
+} // namespace trace (in seec)
+
+} // namespace seec
@@ -45,8 +45,7 @@ TraceProcessListener::TraceProcessListener(llvm::Module &Module,
   GlobalVariableInitialData(MIndex.getGlobalCount()),
   FunctionAddresses(MIndex.getFunctionCount()),
   FunctionLookup(),
-  DataOut(),
-  DataOutMutex(),
+  DataOut(StreamAlloc),
   Time(0),
   NextThreadID(1),
   ActiveThreadCount(0),
@@ -58,6 +57,7 @@ TraceProcessListener::TraceProcessListener(llvm::Module &Module,
   RegionTemporalIDs(),
   RegionTemporalIDsMutex(),
   InMemoryPointerObjects(),
+  InMemoryPointerObjectsMutex(),
   DynamicMemoryAllocations(),
   DynamicMemoryAllocationsMutex(),
   StreamsMutex(),
@@ -66,15 +66,8 @@ TraceProcessListener::TraceProcessListener(llvm::Module &Module,
   DirsMutex(),
   Dirs()
 {
-  // Open traces and enable output.
-  {
-    std::lock_guard<std::mutex> Lock(DataOutMutex);
-    if (!DataOut) {
-      DataOut = StreamAllocator.getProcessDataStream();
-    }
-    
-    OutputEnabled = true;
-  }
+  // Enable output.
+  OutputEnabled = true;
   
   StreamsInitial.emplace_back(reinterpret_cast<uintptr_t>(stdin));
   Streams.streamOpened(stdin,
@@ -146,6 +139,18 @@ void TraceProcessListener::traceWriteProcessData() {
 
 void TraceProcessListener::traceClose() {
   OutputEnabled = false;
+  
+  traceFlush();
+  StreamAllocator.waitForPendingWrites();
+}
+
+void TraceProcessListener::traceFlush() {
+  DataOut.flush();
+}
+
+void TraceProcessListener::traceAbandon() {
+  OutputEnabled = false;
+  DataOut.abandon();
 }
 
 
@@ -242,24 +247,23 @@ PointerTarget
 TraceProcessListener::getInMemoryPointerObject(uintptr_t const PtrLocation)
 const
 {
-  auto const It = InMemoryPointerObjects.find(PtrLocation);
+  // Loads and stores of different memory may be notified concurrently, so
+  // the pointer objects have their own lock.
+  std::lock_guard<std::mutex> Lock(InMemoryPointerObjectsMutex);
+  auto const Object = InMemoryPointerObjects.get(PtrLocation);
 
 #if SEEC_DEBUG_IMPO
-  if (It == InMemoryPointerObjects.end())
-    llvm::errs() << "impo @" << PtrLocation << " not found.\n";
-  else
-    llvm::errs() << "impo @" << PtrLocation << " = " << It->second << "\n";
+  llvm::errs() << "impo @" << PtrLocation << " = " << Object << "\n";
 #endif
 
-  return It != InMemoryPointerObjects.end() ? It->second
-                                            : PointerTarget(0, 0);
+  return Object;
 }
 
 void TraceProcessListener::setInMemoryPointerObject(uintptr_t const PtrLocation,
                                                     PointerTarget const &Object)
 {
-  clearInMemoryPointerObjects(MemoryArea(PtrLocation, sizeof(void *)));
-  InMemoryPointerObjects[PtrLocation] = Object;
+  std::lock_guard<std::mutex> Lock(InMemoryPointerObjectsMutex);
+  InMemoryPointerObjects.set(PtrLocation, Object);
 #if SEEC_DEBUG_IMPO
   llvm::errs() << "set impo @" << PtrLocation << " to " << Object << "\n";
 #endif
@@ -267,51 +271,20 @@ void TraceProcessListener::setInMemoryPointerObject(uintptr_t const PtrLocation,
 
 void TraceProcessListener::clearInMemoryPointerObjects(MemoryArea const Area)
 {
-  auto const It = InMemoryPointerObjects.lower_bound(Area.start());
-  if (It == InMemoryPointerObjects.end() || It->first >= Area.end())
-    return;
-
-  auto const End = InMemoryPointerObjects.lower_bound(Area.end());
+  std::lock_guard<std::mutex> Lock(InMemoryPointerObjectsMutex);
 #if SEEC_DEBUG_IMPO
-  llvm::errs() << "clearing " << std::distance(It, End) << " impos in range ["
-               << Area.start() << ", " << Area.end() << ")\n";
+  llvm::errs() << "clearing impos in range [" << Area.start() << ", "
+               << Area.end() << ")\n";
 #endif
-  InMemoryPointerObjects.erase(It, End);
+  InMemoryPointerObjects.clear(Area);
 }
 
 void TraceProcessListener::copyInMemoryPointerObjects(uintptr_t const From,
                                                       uintptr_t const To,
                                                       std::size_t const Length)
 {
-  auto const End = From + Length;
-  auto const BeginIt = InMemoryPointerObjects.lower_bound(From);
-  auto const EndIt   = InMemoryPointerObjects.lower_bound(End);
-
-  // If the memory areas don't intersect then we can copy directly from the
-  // source range to the destination range. Otherwise we have to copy into
-  // an intermediate container and then copy into the destination range.
-  if (!MemoryArea(From,Length).intersects(MemoryArea(To,Length))) {
-    clearInMemoryPointerObjects(MemoryArea(To, Length));
-    auto const InsertHintIt = InMemoryPointerObjects.lower_bound(To);
-
-    for (auto I = BeginIt; I != EndIt; ++I)
-      InMemoryPointerObjects.insert(InsertHintIt,
-                                    std::make_pair(To + (I->first - From),
-                                                   I->second));
-  }
-  else {
-    std::vector<decltype(InMemoryPointerObjects)::value_type> Objects;
-    Objects.reserve(Length);
-
-    for (auto I = BeginIt; I != EndIt; ++I)
-      Objects.emplace_back(To + (I->first - From), I->second);
-
-    clearInMemoryPointerObjects(MemoryArea(To, Length));
-    auto const InsertHintIt = InMemoryPointerObjects.lower_bound(To);
-
-    for (auto &&Object : Objects)
-      InMemoryPointerObjects.insert(InsertHintIt, Object);
-  }
+  std::lock_guard<std::mutex> Lock(InMemoryPointerObjectsMutex);
+  InMemoryPointerObjects.copy(From, To, Length);
 }
 
 
@@ -320,20 +293,9 @@ void TraceProcessListener::copyInMemoryPointerObjects(uintptr_t const From,
 //===----------------------------------------------------------------------===//
 
 offset_uint TraceProcessListener::recordData(char const *Data, size_t Size) {
-  // Don't allow concurrent access to DataOut - multiple threads may wreck
-  // the output (and the offsets returned).
-  std::lock_guard<std::mutex> DataOutLock(DataOutMutex);
-  
-  if (!DataOut)
-    return 0;
-
-  auto const WrittenOffset = DataOut->write(Data, Size);
-  if (!WrittenOffset)
-    return 0;
-
   // Return the offset that the data was written at, which will be used by
-  // events to refer to the data.
-  return *WrittenOffset;
+  // events to refer to the data. DataOut is thread-safe.
+  return DataOut.write(Data, Size);
 }
 
 void TraceProcessListener::addKnownMemoryRegion(uintptr_t Address,
@@ -371,10 +333,12 @@ const
   return nullptr;
 }
 
-void TraceProcessListener::setCurrentDynamicMemoryAllocation(uintptr_t Address,
-                                                             uint32_t Thread,
-                                                             offset_uint Offset,
-                                                             std::size_t Size)
+void TraceProcessListener::
+setCurrentDynamicMemoryAllocation(uintptr_t Address,
+                                  uint32_t Thread,
+                                  offset_uint Offset,
+                                  std::size_t Size,
+                                  llvm::Instruction const * const Allocator)
 {
   std::lock_guard<std::mutex> Lock(DynamicMemoryAllocationsMutex);
 
@@ -382,14 +346,15 @@ void TraceProcessListener::setCurrentDynamicMemoryAllocation(uintptr_t Address,
   auto It = DynamicMemoryAllocations.find(Address);
   if (It != DynamicMemoryAllocations.end()) {
     TraceMemory.resizeAllocation(Address, Size);
-    It->second.update(Thread, Offset, Size);
+    It->second.update(Thread, Offset, Size, Allocator);
     incrementRegionTemporalID(Address);
   }
   else {
     TraceMemory.addAllocation(Address, Size);
     DynamicMemoryAllocations.insert(
       std::make_pair(Address,
-                      DynamicAllocation(Thread, Offset, Address, Size)));
+                      DynamicAllocation(Thread, Offset, Address, Size,
+                                        Allocator)));
     incrementRegionTemporalID(Address);
   }
 }
@@ -13,6 +13,7 @@
 
 #include "seec/RuntimeErrors/ArgumentTypes.hpp"
 #include "seec/RuntimeErrors/RuntimeErrors.hpp"
+#include "seec/Trace/TraceCompression.hpp"
 #include "seec/Trace/TraceReader.hpp"
 #include "seec/Trace/TraceSearch.hpp"
 #include "seec/Util/Serialization.hpp"
@@ -25,9 +26,15 @@
 #include <wx/archive.h>
 #include <wx/wfstream.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstring>
+#include <future>
+#include <map>
 #include <memory>
 #include <numeric>
+#include <thread>
 #include <vector>
 
 namespace seec {
@@ -39,40 +46,83 @@ namespace trace {
 // ThreadEventBlockSequence
 //------------------------------------------------------------------------------
 
+/// \brief Call Fn(i) for each i in [0, Count), spreading the calls across the
+///        available hardware threads.
+///
+/// \param MinimumPerThread don't start a thread for fewer calls than this.
+///
+template<typename FnT>
+static void parallelFor(std::size_t const Count,
+                        std::size_t const MinimumPerThread,
+                        FnT Fn)
+{
+  auto const Hardware = std::max(1u, std::thread::hardware_concurrency());
+  auto const ThreadCount = std::min<std::size_t>(Hardware,
+                                                 Count / MinimumPerThread);
+  
+  if (ThreadCount <= 1) {
+    for (std::size_t i = 0; i < Count; ++i) {
+      Fn(i);
+    }
+    
+    return;
+  }
+  
+  std::atomic<std::size_t> Next(0);
+  
+  auto const Work = [&] () {
+    for (auto i = Next++; i < Count; i = Next++) {
+      Fn(i);
+    }
+  };
+  
+  std::vector<std::future<void>> Workers;
+  for (std::size_t i = 1; i < ThreadCount; ++i) {
+    Workers.emplace_back(std::async(std::launch::async, Work));
+  }
+  
+  Work();
+  
+  for (auto &Worker : Workers) {
+    Worker.get();
+  }
+}
+
 ThreadEventBlockSequence::
   ThreadEventBlockSequence(std::vector<InputBlock> const &Blocks)
 : m_Sequence(new ThreadEventBlock[Blocks.size() + 2]),
   m_BlockCount(Blocks.size())
 {
-  size_t Index = 1;
-  for (auto &Block : Blocks) {
-    // Skip the thread event block header (thread id).    
-    auto Data = Block.getData().slice(sizeof(uint32_t));
-    
-    EventRecordBase const * const Start =
-      reinterpret_cast<EventRecordBase const *>(Data.data());
-    
-    EventRecordBase const * const BlockEnd =
-      reinterpret_cast<EventRecordBase const *>
-                      (Data.end() - sizeof(EventRecordBase));
-    
-    EventRecordBase const * End = Start;
-    while (true) {
-      auto const Size = End->getEventSize();
-      auto const Next = reinterpret_cast<EventRecordBase const *>(
-                          reinterpret_cast<char const *>(End) + Size);
+  // Finding the last event in a block means walking all of its events, but
+  // the blocks are independent, so they are walked concurrently.
+  parallelFor(Blocks.size(), /* MinimumPerThread */ 8,
+    [&] (std::size_t const Index) {
+      // Skip the thread event block header (thread id).
+      auto Data = Blocks[Index].getData().slice(sizeof(uint32_t));
       
-      if (Next <= BlockEnd && Next->getType() != EventType::None) {
-        End = Next;
-      }
-      else {
-        break;
+      EventRecordBase const * const Start =
+        reinterpret_cast<EventRecordBase const *>(Data.data());
+      
+      EventRecordBase const * const BlockEnd =
+        reinterpret_cast<EventRecordBase const *>
+                        (Data.end() - sizeof(EventRecordBase));
+      
+      EventRecordBase const * End = Start;
+      while (true) {
+        auto const Size = End->getEventSize();
+        auto const Next = reinterpret_cast<EventRecordBase const *>(
+                            reinterpret_cast<char const *>(End) + Size);
+        
+        if (Next <= BlockEnd && Next->getType() != EventType::None) {
+          End = Next;
+        }
+        else {
+          break;
+        }
       }
-    }
-    
-    m_Sequence[Index] = ThreadEventBlock(*Start, *End);
-    ++Index;
-  }
+      
+      m_Sequence[Index + 1] = ThreadEventBlock(*Start, *End);
+    });
 }
 
 namespace {
@@ -262,6 +312,13 @@ InputBufferAllocator::createForFile(llvm::StringRef Path,
   while (BlockStart < Buffer.getBufferEnd() - BlockHeaderSize) {
     BlockType const Type = *reinterpret_cast<BlockType const *>(BlockStart);
     uint64_t const NextBlock = *reinterpret_cast<uint64_t const *>(BlockStart + sizeof(Type));
+    
+    // A zeroed header marks unused space at the end of the file (e.g. if a
+    // memory-mapped trace was not trimmed because the process was killed).
+    if (Type == BlockType::Empty && NextBlock == 0) {
+      break;
+    }
+    
     char const * const BlockEnd = Buffer.getBufferStart() + NextBlock;
     
     InputBlock const Block(Type, BlockStart + BlockHeaderSize, BlockEnd);
@@ -287,7 +344,10 @@ InputBufferAllocator::createForFile(llvm::StringRef Path,
     else if (Type == BlockType::ProcessData) {
       // Nothing to do.
     }
-    else if (Type == BlockType::ThreadEvents) {
+    else if (Type == BlockType::ThreadEvents
+             || Type == BlockType::ThreadEventsCompressed
+             || Type == BlockType::ThreadCheckpointData) {
+      // All kinds of thread block begin with the thread ID.
       uint32_t const ID = *reinterpret_cast<uint32_t const *>(Block.getData().data());
       
       if (BlocksThreadEvents.size() < ID) {
@@ -311,21 +371,338 @@ InputBufferAllocator::createForFile(llvm::StringRef Path,
                                {"errors", "MalformedTraceFile"}));
   }
   
-  // Thread sorting.
-  std::vector<ThreadEventBlockSequence> ThreadEventSequences;
-  ThreadEventSequences.reserve(BlocksThreadEvents.size());
+  // Index the compressed blocks. A thread's blocks must either be all
+  // compressed or all uncompressed (checkpoint data blocks are always
+  // compressed). If a block was written more than once, then the last copy is
+  // the most complete.
+  struct CompressedBlockInfo {
+    offset_uint Offset;
+    uint64_t Size;
+    uint32_t ThreadIndex;
+    bool IsData;
+    InputBlock Block;
+  };
+  
+  std::vector<CompressedBlockInfo> CompressedInfo;
   
-  for (auto &Blocks : BlocksThreadEvents) {
-    ThreadEventSequences.emplace_back(Blocks);
+  for (uint32_t Index = 0; Index < BlocksThreadEvents.size(); ++Index) {
+    auto const &Blocks = BlocksThreadEvents[Index];
+    
+    auto const CompressedCount =
+      std::count_if(Blocks.begin(), Blocks.end(),
+                    [] (InputBlock const &Block) {
+                      return Block.getType()
+                               == BlockType::ThreadEventsCompressed
+                          || Block.getType()
+                               == BlockType::ThreadCheckpointData;
+                    });
+    
+    if (CompressedCount == 0) {
+      continue;
+    }
+    
+    if (size_t(CompressedCount) != Blocks.size()) {
+      return Error(
+        LazyMessageByRef::create("Trace",
+                                 {"errors", "MalformedTraceFile"}));
+    }
+    
+    for (auto const &Block : Blocks) {
+      auto const Compressed = CompressedThreadEventBlock::read(Block.getData());
+      if (!Compressed
+          || Compressed->getBlockOffset() < compressedEventOffsetBase())
+      {
+        return Error(
+          LazyMessageByRef::create("Trace",
+                                   {"errors", "MalformedTraceFile"}));
+      }
+      
+      auto const IsData = Block.getType() == BlockType::ThreadCheckpointData;
+      
+      CompressedInfo.push_back(CompressedBlockInfo{Compressed->getBlockOffset(),
+                                                   Compressed->getBlockSize(),
+                                                   Index,
+                                                   IsData,
+                                                   Block});
+    }
+  }
+  
+  std::stable_sort(CompressedInfo.begin(), CompressedInfo.end(),
+                   [] (CompressedBlockInfo const &L,
+                       CompressedBlockInfo const &R) {
+                     return L.Offset < R.Offset;
+                   });
+  
+  std::vector<CompressedBlockInfo> LatestInfo;
+  
+  for (auto const &Info : CompressedInfo) {
+    if (!LatestInfo.empty() && LatestInfo.back().Offset == Info.Offset) {
+      LatestInfo.back() = Info;
+    }
+    else {
+      LatestInfo.push_back(Info);
+    }
+  }
+  
+  std::unique_ptr<CompressedBlockEntry[]>
+    CompressedBlocks(new CompressedBlockEntry[LatestInfo.size()]);
+  
+  for (size_t i = 0; i < LatestInfo.size(); ++i) {
+    CompressedBlocks[i].Offset = LatestInfo[i].Offset;
+    CompressedBlocks[i].Size = LatestInfo[i].Size;
+    CompressedBlocks[i].ThreadIndex = LatestInfo[i].ThreadIndex;
+    CompressedBlocks[i].IsData = LatestInfo[i].IsData;
+    CompressedBlocks[i].Data = LatestInfo[i].Block.getData();
+    CompressedBlocks[i].Image = nullptr;
   }
   
   return InputBufferAllocator(std::move(*MaybeBuffer),
                               *BlockModuleBitcode,
                               *BlockProcessTrace,
-                              std::move(ThreadEventSequences),
+                              std::move(BlocksThreadEvents),
+                              std::move(CompressedBlocks),
+                              LatestInfo.size(),
                               std::move(TempFiles));
 }
 
+/// \brief Round Size up to a multiple of 16, and leave room for a terminating
+///        (zeroed) event record.
+///
+static uint64_t getDecompressedImageSize(uint64_t const Size)
+{
+  return ((Size + 15) / 16) * 16 + 16;
+}
+
+/// \brief Call Fn(Event, Offset) for each event in a sequence of decompressed
+///        thread event blocks, until Fn returns false.
+///
+template<typename FnT>
+static void forEachImageEvent(std::vector<InputBlock> const &Images,
+                              std::vector<offset_uint> const &ImageOffsets,
+                              FnT Fn)
+{
+  auto const BlockHeaderSize = sizeof(BlockType) + sizeof(uint64_t);
+  
+  for (std::size_t i = 0; i < Images.size(); ++i) {
+    // Skip the thread event block header (thread id).
+    auto const Data = Images[i].getData().slice(sizeof(uint32_t));
+    auto const DataOffset = ImageOffsets[i] + BlockHeaderSize
+                                            + sizeof(uint32_t);
+    
+    std::size_t Position = 0;
+    
+    while (Position + sizeof(EventRecordBase) <= Data.size()) {
+      auto const Event = reinterpret_cast<EventRecordBase const *>(
+                           Data.data() + Position);
+      
+      if (Event->getType() == EventType::None
+          || Position + Event->getEventSize() > Data.size())
+        break;
+      
+      if (!Fn(*Event, DataOffset + Position))
+        return;
+      
+      Position += Event->getEventSize();
+    }
+  }
+}
+
+/// \brief Redirect FunctionEnd events to the copies of their FunctionStart
+///        events that are held in a leading flight-recorder checkpoint.
+///
+/// When a thread's oldest events were dropped by the flight recorder, its
+/// events begin with a checkpoint that recreates the functions that were
+/// active at that time. The original FunctionStart events are gone, but the
+/// FunctionEnd events of those functions still refer to them.
+///
+static void
+remapCheckpointFunctions(std::vector<InputBlock> const &Images,
+                         std::vector<offset_uint> const &ImageOffsets)
+{
+  std::map<offset_uint, offset_uint> CopyOf;
+  offset_uint LastStart = 0;
+  bool IsFirst = true;
+  
+  forEachImageEvent(Images, ImageOffsets,
+    [&] (EventRecordBase const &Event, offset_uint const Offset) -> bool {
+      if (IsFirst) {
+        IsFirst = false;
+        if (Event.getType() != EventType::Checkpoint)
+          return false;
+      }
+      
+      switch (Event.getType()) {
+        case EventType::FunctionStart:
+          LastStart = Offset;
+          return true;
+        case EventType::CheckpointFunction:
+          CopyOf[Event.as<EventType::CheckpointFunction>().getFunctionStart()]
+            = LastStart;
+          return true;
+        case EventType::CheckpointEnd:
+          return false;
+        default:
+          return true;
+      }
+    });
+  
+  if (CopyOf.empty())
+    return;
+  
+  forEachImageEvent(Images, ImageOffsets,
+    [&] (EventRecordBase const &Event, offset_uint) -> bool {
+      if (Event.getType() != EventType::FunctionEnd)
+        return true;
+      
+      auto const &End = Event.as<EventType::FunctionEnd>();
+      auto const It = CopyOf.find(End.getEventOffsetStart());
+      if (It == CopyOf.end())
+        return true;
+      
+      EventRecord<EventType::FunctionEnd> const
+        Remapped(End.getPreviousEventSize(), It->second);
+      std::memcpy(const_cast<EventRecordBase *>(&Event), &Remapped,
+                  sizeof(Remapped));
+      return true;
+    });
+}
+
+void InputBufferAllocator::createThreadSequence(uint32_t const Index) const
+{
+  auto const &Blocks = m_BlocksForThreads[Index];
+  
+  if (Blocks.empty() || Blocks.front().getType() == BlockType::ThreadEvents)
+  {
+    m_BlockSequencesForThreads[Index].reset(
+      new ThreadEventBlockSequence(Blocks));
+    return;
+  }
+  
+  auto const Begin = &m_CompressedBlocks[0];
+  auto const End = Begin + m_CompressedBlockCount;
+  
+  // Allocate storage for all of this thread's blocks. Each block is placed at
+  // a multiple of 16 bytes, which preserves the alignment of its events (as
+  // the uncompressed blocks are allocated at 64KiB boundaries).
+  std::vector<CompressedBlockEntry *> Entries;
+  std::vector<uint64_t> Positions;
+  uint64_t TotalSize = 0;
+  
+  for (auto It = Begin; It != End; ++It) {
+    if (It->ThreadIndex == Index) {
+      Entries.push_back(It);
+      Positions.push_back(TotalSize);
+      TotalSize += getDecompressedImageSize(It->Size);
+    }
+  }
+  
+  std::unique_ptr<char[]> Storage(new char[TotalSize]());
+  
+  // Decompress the blocks concurrently.
+  std::unique_ptr<bool[]> Decompressed(new bool[Entries.size()]());
+  
+  parallelFor(Entries.size(), /* MinimumPerThread */ 2,
+    [&] (std::size_t const i) {
+      auto const Compressed =
+        CompressedThreadEventBlock::read(Entries[i]->Data);
+      Decompressed[i] = Compressed
+                        && Compressed->decompress(Storage.get() + Positions[i]);
+    });
+  
+  std::vector<InputBlock> Images;
+  std::vector<offset_uint> ImageOffsets;
+  
+  for (std::size_t i = 0; i < Entries.size(); ++i) {
+    if (!Decompressed[i]) {
+      llvm::errs() << "SeeC: couldn't decompress thread event block.\n";
+      continue;
+    }
+    
+    auto &Entry = *Entries[i];
+    auto const Image = Storage.get() + Positions[i];
+    
+    Entry.Image = Image;
+    
+    // Checkpoint data is only referred to by offset.
+    if (Entry.IsData)
+      continue;
+    
+    auto const BlockHeaderSize = sizeof(BlockType) + sizeof(uint64_t);
+    Images.emplace_back(BlockType::ThreadEvents,
+                        Image + BlockHeaderSize,
+                        Image + getDecompressedImageSize(Entry.Size));
+    ImageOffsets.push_back(Entry.Offset);
+  }
+  
+  // Apply rewrites of events that were made after their blocks were written.
+  // These are applied in the order that they were written.
+  for (auto const &Block : Blocks) {
+    auto const Compressed = CompressedThreadEventBlock::read(Block.getData());
+    if (!Compressed) {
+      continue;
+    }
+    
+    Compressed->forEachPatch(
+      [=] (offset_uint const Offset, llvm::ArrayRef<char> Data) {
+        auto const It = std::upper_bound(Begin, End, Offset,
+                          [] (offset_uint const Value,
+                              CompressedBlockEntry const &Entry) {
+                            return Value < Entry.Offset;
+                          });
+        
+        if (It == Begin) {
+          return;
+        }
+        
+        auto const &Entry = *std::prev(It);
+        auto const Image = Entry.Image.load();
+        
+        if (Entry.ThreadIndex == Index && Image
+            && Offset + Data.size() <= Entry.Offset + Entry.Size)
+        {
+          std::memcpy(const_cast<char *>(Image) + (Offset - Entry.Offset),
+                      Data.data(), Data.size());
+        }
+      });
+  }
+  
+  remapCheckpointFunctions(Images, ImageOffsets);
+  
+  m_DecompressedStorage.emplace_back(std::move(Storage));
+  m_BlockSequencesForThreads[Index].reset(new ThreadEventBlockSequence(Images));
+}
+
+char const *
+InputBufferAllocator::getCompressedDataRaw(offset_uint const Offset) const
+{
+  auto const Begin = &m_CompressedBlocks[0];
+  auto const End = Begin + m_CompressedBlockCount;
+  
+  auto const It = std::upper_bound(Begin, End, Offset,
+                    [] (offset_uint const Value,
+                        CompressedBlockEntry const &Entry) {
+                      return Value < Entry.Offset;
+                    });
+  
+  assert(It != Begin && "offset is not in a compressed block");
+  
+  auto &Entry = *std::prev(It);
+  auto Image = Entry.Image.load();
+  
+  if (!Image) {
+    std::lock_guard<std::mutex> Lock(*m_CacheMutex);
+    
+    if (!m_BlockSequencesForThreads[Entry.ThreadIndex]) {
+      createThreadSequence(Entry.ThreadIndex);
+    }
+    
+    Image = Entry.Image.load();
+    assert(Image && "couldn't decompress thread event block");
+  }
+  
+  return Image + (Offset - Entry.Offset);
+}
+
 seec::Maybe<InputBufferAllocator, seec::Error>
 InputBufferAllocator::createFor(llvm::StringRef Path)
 {
@@ -451,6 +828,116 @@ deserializeRuntimeError(EventRange Records) {
 }
 
 
+//------------------------------------------------------------------------------
+// EventReference
+//------------------------------------------------------------------------------
+
+llvm::Optional<EventReference>
+EventReference::getPreviousInstructionInFunction(ThreadTrace const &Trace)
+const
+{
+  if (Record->isInstruction())
+    return Trace.getEventIndex().getPreviousInstructionInFunction(*this);
+  
+  // Only instructions are indexed, so search for other events.
+  auto const MaybeRef = rfindInFunction(Trace,
+                                        rangeBefore(Trace.events(), *this),
+                                        [](EventRecordBase const &Ev) -> bool {
+                                          return Ev.isInstruction();
+                                        });
+  
+  if (MaybeRef.assigned())
+    return MaybeRef.get<0>();
+  
+  return llvm::None;
+}
+
+uint64_t EventReference::getPreviousProcessTime(ThreadTrace const &Trace) const
+{
+  if (Record->getProcessTime())
+    return Trace.getEventIndex().getPreviousProcessTime(*this);
+  
+  // Only events that set the process time are indexed, so search for others.
+  auto const MaybeRef = rfind(rangeBefore(Trace.events(), *this),
+                              [](EventRecordBase const &Ev) -> bool {
+                                return Ev.getProcessTime().hasValue();
+                              });
+  
+  if (MaybeRef.assigned())
+    return *(MaybeRef.get<0>()->getProcessTime());
+  
+  return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// ThreadEventIndex
+//------------------------------------------------------------------------------
+
+ThreadEventIndex::ThreadEventIndex(EventRange Events)
+: PreviousInstruction(),
+  PreviousProcessTime()
+{
+  // The latest instruction in each active function invocation. The first
+  // entry holds events that precede the thread's first FunctionStart.
+  std::vector<Position> Frames(1, Position{nullptr, nullptr});
+  
+  uint64_t LastProcessTime = 0;
+  
+  for (auto It = Events.begin(), End = Events.end(); It != End; ++It) {
+    auto const &Ev = *It;
+    
+    switch (Ev.getType()) {
+      case EventType::FunctionStart:
+        Frames.push_back(Position{nullptr, nullptr});
+        break;
+      
+      case EventType::FunctionEnd:
+        // A FunctionEnd belongs to the child function's invocation.
+        if (Frames.size() > 1)
+          Frames.pop_back();
+        else
+          Frames.back() = Position{nullptr, nullptr};
+        break;
+      
+      default:
+        if (Ev.isInstruction()) {
+          if (Frames.back().Record)
+            PreviousInstruction.insert(std::make_pair(&Ev, Frames.back()));
+          
+          Frames.back() = Position{&Ev, It.m_BlockAndState.getPointer()};
+        }
+        break;
+    }
+    
+    if (auto const MaybeProcessTime = Ev.getProcessTime()) {
+      if (LastProcessTime)
+        PreviousProcessTime.insert(std::make_pair(&Ev, LastProcessTime));
+      
+      LastProcessTime = *MaybeProcessTime;
+    }
+  }
+}
+
+llvm::Optional<EventReference>
+ThreadEventIndex::getPreviousInstructionInFunction(EventReference const &Ev)
+const
+{
+  auto const It = PreviousInstruction.find(&*Ev);
+  if (It == PreviousInstruction.end())
+    return llvm::None;
+  
+  return EventReference(*It->second.Record, *It->second.Block);
+}
+
+uint64_t
+ThreadEventIndex::getPreviousProcessTime(EventReference const &Ev) const
+{
+  auto const It = PreviousProcessTime.find(&*Ev);
+  return It != PreviousProcessTime.end() ? It->second : 0;
+}
+
+
 //------------------------------------------------------------------------------
 // FunctionTrace
 //------------------------------------------------------------------------------
@@ -477,6 +964,15 @@ ThreadTrace::getReferenceToOffset(offset_uint const Offset) const {
   return *MaybeEvRef;
 }
 
+ThreadEventIndex const &ThreadTrace::getEventIndex() const {
+  std::call_once(m_EventIndexFlag,
+                 [this] () {
+                   m_EventIndex = llvm::make_unique<ThreadEventIndex>(events());
+                 });
+  
+  return *m_EventIndex;
+}
+
 
 //------------------------------------------------------------------------------
 // ProcessTrace
@@ -559,7 +1055,7 @@ ProcessTrace::readFrom(std::unique_ptr<InputBufferAllocator> Allocator)
   uint64_t Version = 0;
   TraceReader >> Version;
 
-  if (Version != formatVersion()) {
+  if (Version < minimumFormatVersion() || Version > formatVersion()) {
     auto const Expected = formatVersion();
     return Error(LazyMessageByRef::create("Trace",
                                           {"errors",
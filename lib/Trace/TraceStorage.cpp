@@ -4,6 +4,7 @@
 ///
 //===----------------------------------------------------------------------===//
 
+#include "seec/Trace/TraceCompression.hpp"
 #include "seec/Trace/TraceStorage.hpp"
 #include "seec/Util/ScopeExit.hpp"
 
@@ -11,17 +12,25 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <system_error>
+#include <thread>
 
 #if defined(__unix__)
+  #include <sys/mman.h>
   #include <unistd.h>
+  #define SEEC_TRACE_MMAP_SUPPORTED 1
 #elif (defined(__APPLE__) && defined(__MACH__))
+  #include <sys/mman.h>
   #include <sys/types.h>
   #include <sys/uio.h>
   #include <unistd.h>
+  #define SEEC_TRACE_MMAP_SUPPORTED 1
 #elif defined(_WIN32)
   #include <process.h>
   #include <windows.h>
@@ -38,6 +47,26 @@ namespace trace {
 
 static char const *getTraceExtension() { return "seec"; }
 
+static constexpr char const *getTraceUnbufferedEnvVar() {
+  return "SEEC_TRACE_UNBUFFERED";
+}
+
+static constexpr char const *getTraceMappedEnvVar() {
+  return "SEEC_TRACE_MMAP";
+}
+
+static constexpr char const *getTraceUncompressedEnvVar() {
+  return "SEEC_TRACE_UNCOMPRESSED";
+}
+
+static int getCurrentPID() {
+#if defined(_WIN32)
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
 // MinGW doesn't implement pwrite. This is a simple workaround for SeeC, noting
 // that we never mix write() and pwrite() on the same file descriptor (this is
 // important because this workaround for pwrite() modifies the file pointer,
@@ -82,9 +111,12 @@ ssize_t pwrite(int fd, const void *buf, size_t count, long long offset)
 OutputBlock::OutputBlock(int TraceFD,
                          BlockType Type,
                          off_t BlockEnd,
-                         off_t Offset)
+                         off_t Offset,
+                         char *Mapped)
 : m_TraceFD(TraceFD),
+  m_BlockStart(Offset),
   m_BlockEnd(BlockEnd),
+  m_Mapped(Mapped),
   m_Offset(Offset)
 {
   write(&Type, sizeof(Type));
@@ -101,6 +133,11 @@ llvm::Optional<off_t> OutputBlock::write(const void *buf, size_t nbyte)
     assert(nbyte <= std::numeric_limits<int64_t>::max());
     
     if (int64_t(nbyte) <= m_BlockEnd - DataOffset) {
+      if (m_Mapped) {
+        std::memcpy(m_Mapped + (DataOffset - m_BlockStart), buf, nbyte);
+        return DataOffset;
+      }
+      
       auto const NWritten = pwrite(m_TraceFD, buf, nbyte, DataOffset);
       if (NWritten >= 0 && uint64_t(NWritten) == nbyte) {
         return DataOffset;
@@ -124,12 +161,39 @@ OutputBlock::rewritableWrite(const void * const buf, size_t const nbyte)
   
   auto Off = write(buf, nbyte);
   if (Off) {
-    Ret.emplace(m_TraceFD, *Off, nbyte);
+    if (m_Mapped) {
+      Ret.emplace(m_TraceFD, m_Mapped + (*Off - m_BlockStart), *Off, nbyte);
+    }
+    else {
+      Ret.emplace(m_TraceFD, *Off, nbyte);
+    }
   }
   
   return Ret;
 }
 
+type_safe::boolean
+OutputBlock::WriteRecord::rewrite(const void * const buf, size_t const nbyte)
+{
+  assert(nbyte == m_Length);
+  
+  if (m_Buffer && m_Buffer->holds(m_Offset, nbyte)) {
+    m_Buffer->overwrite(m_Offset, buf, nbyte);
+    return true;
+  }
+  
+  if (m_Mapped) {
+    std::memcpy(m_Mapped, buf, nbyte);
+    return true;
+  }
+  
+  if (m_Buffer) {
+    return m_Buffer->writeThrough(m_Offset, buf, nbyte);
+  }
+  
+  return OutputBlock::writeat(m_TraceFD, buf, nbyte, m_Offset);
+}
+
 type_safe::boolean OutputBlock::writeat(int const fd,
                                         const void * const buf,
                                         size_t const nbyte,
@@ -140,6 +204,414 @@ type_safe::boolean OutputBlock::writeat(int const fd,
 }
 
 
+//------------------------------------------------------------------------------
+// OutputMappedChunks
+//------------------------------------------------------------------------------
+
+OutputMappedChunks::OutputMappedChunks(size_t const Count,
+                                       off_t const ChunkSize)
+: m_Count(Count),
+  m_ChunkSize(ChunkSize),
+  m_Chunks(new std::atomic<char *>[Count])
+{
+  for (size_t i = 0; i < Count; ++i) {
+    m_Chunks[i] = nullptr;
+  }
+}
+
+OutputMappedChunks::~OutputMappedChunks()
+{
+#if defined(SEEC_TRACE_MMAP_SUPPORTED)
+  for (size_t i = 0; i < m_Count; ++i) {
+    if (auto const Chunk = m_Chunks[i].load()) {
+      munmap(Chunk, m_ChunkSize);
+    }
+  }
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// OutputFlusher
+//------------------------------------------------------------------------------
+
+/// \brief Round Value up to a power of two (at least two).
+///
+static size_t getQueueCapacity(size_t const Value)
+{
+  size_t Capacity = 2;
+  while (Capacity < Value) {
+    Capacity <<= 1;
+  }
+  return Capacity;
+}
+
+OutputFlusher::OutputFlusher(size_t const Capacity)
+: m_Cells(new Cell[getQueueCapacity(Capacity)]),
+  m_Mask(getQueueCapacity(Capacity) - 1),
+  m_EnqueuePos(0),
+  m_DequeuePos(0),
+  m_OwnerPID(getCurrentPID()),
+  m_Stop(false),
+  m_WriterWaiting(false),
+  m_WakeMutex(),
+  m_WakeCV(),
+  m_Thread(),
+  m_Completed(0),
+  m_Bytes(0),
+  m_MaximumDepth(0),
+  m_Stalls(0),
+  m_StallNanoseconds(0)
+{
+  for (size_t i = 0; i <= m_Mask; ++i) {
+    m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+  }
+  
+  m_Thread = std::thread([this] () { this->run(); });
+}
+
+OutputFlusher::~OutputFlusher()
+{
+  if (!isOwner()) {
+    // The writer thread doesn't exist in a forked child, so we can't join it.
+    // Release the handle without destroying it (which would terminate), and
+    // leave the queued requests for the parent to write.
+    new std::thread(std::move(m_Thread));
+    return;
+  }
+  
+  drain();
+  
+  m_Stop.store(true);
+  notifyWriter();
+  m_Thread.join();
+}
+
+bool OutputFlusher::tryPush(Request &Value)
+{
+  auto Pos = m_EnqueuePos.load(std::memory_order_relaxed);
+  Cell *C = nullptr;
+  
+  while (true) {
+    C = &m_Cells[Pos & m_Mask];
+    auto const Seq = C->Sequence.load(std::memory_order_acquire);
+    auto const Diff = static_cast<intptr_t>(Seq) - static_cast<intptr_t>(Pos);
+    
+    if (Diff == 0) {
+      if (m_EnqueuePos.compare_exchange_weak(Pos, Pos + 1,
+                                             std::memory_order_relaxed))
+        break;
+    }
+    else if (Diff < 0) {
+      return false; // The queue is full.
+    }
+    else {
+      Pos = m_EnqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+  
+  C->Value = std::move(Value);
+  C->Sequence.store(Pos + 1, std::memory_order_release);
+  
+  // Record the queue depth (the writer may already have overtaken us).
+  uint64_t const Completed = m_Completed.load();
+  uint64_t const Depth = Pos + 1 > Completed ? (Pos + 1) - Completed : 0;
+  auto Max = m_MaximumDepth.load(std::memory_order_relaxed);
+  while (Depth > Max
+         && !m_MaximumDepth.compare_exchange_weak(Max, Depth,
+                                                  std::memory_order_relaxed))
+    ;
+  
+  return true;
+}
+
+bool OutputFlusher::tryPop(Request &Value)
+{
+  auto const Pos = m_DequeuePos.load(std::memory_order_relaxed);
+  auto &C = m_Cells[Pos & m_Mask];
+  auto const Seq = C.Sequence.load(std::memory_order_acquire);
+  
+  if (static_cast<intptr_t>(Seq) - static_cast<intptr_t>(Pos + 1) < 0) {
+    return false; // The queue is empty.
+  }
+  
+  m_DequeuePos.store(Pos + 1, std::memory_order_relaxed);
+  Value = std::move(C.Value);
+  C.Sequence.store(Pos + m_Mask + 1, std::memory_order_release);
+  
+  return true;
+}
+
+void OutputFlusher::notifyWriter()
+{
+  if (m_WriterWaiting.load()) {
+    std::lock_guard<std::mutex> Lock(m_WakeMutex);
+    m_WakeCV.notify_one();
+  }
+}
+
+void OutputFlusher::run()
+{
+  Request Value;
+  
+  while (true) {
+    if (tryPop(Value)) {
+      auto const Size = Value.Data.size();
+      auto const NWritten = pwrite(Value.FD, Value.Data.data(), Size,
+                                   Value.Offset);
+      
+      if (NWritten < 0) {
+        perror("OutputFlusher pwrite failed:");
+      }
+      else if (uint64_t(NWritten) != Size) {
+        perror("OutputFlusher pwrite incomplete:");
+      }
+      
+      Value.Data = std::vector<char>();
+      m_Bytes.fetch_add(Size, std::memory_order_relaxed);
+      m_Completed.fetch_add(1);
+      continue;
+    }
+    
+    if (m_Stop.load()) {
+      return;
+    }
+    
+    // Wait for more requests. Producers only notify us if they see that we
+    // are waiting, so the timeout bounds the delay if a notification is
+    // missed between checking the queue and waiting.
+    std::unique_lock<std::mutex> Lock(m_WakeMutex);
+    m_WriterWaiting.store(true);
+    
+    if (m_EnqueuePos.load() == m_DequeuePos.load(std::memory_order_relaxed)
+        && !m_Stop.load())
+    {
+      m_WakeCV.wait_for(Lock, std::chrono::milliseconds(10));
+    }
+    
+    m_WriterWaiting.store(false);
+  }
+}
+
+bool OutputFlusher::isOwner() const
+{
+  return getCurrentPID() == m_OwnerPID;
+}
+
+void OutputFlusher::write(int const FD,
+                          off_t const Offset,
+                          std::vector<char> Data)
+{
+  Request Value{FD, Offset, std::move(Data)};
+  
+  if (!isOwner()) {
+    // There is no writer thread in a forked child, so write synchronously.
+    if (pwrite(FD, Value.Data.data(), Value.Data.size(), Offset) < 0) {
+      perror("OutputFlusher pwrite failed:");
+    }
+    return;
+  }
+  
+  if (tryPush(Value)) {
+    notifyWriter();
+    return;
+  }
+  
+  // The queue is full: wait for the writer thread to make room. We must not
+  // write the request ourselves, because an earlier image of the same region
+  // may still be queued.
+  auto const Start = std::chrono::steady_clock::now();
+  
+  do {
+    notifyWriter();
+    std::this_thread::yield();
+  } while (!tryPush(Value));
+  
+  notifyWriter();
+  
+  auto const Stall = std::chrono::steady_clock::now() - Start;
+  m_Stalls.fetch_add(1, std::memory_order_relaxed);
+  m_StallNanoseconds.fetch_add(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(Stall).count(),
+    std::memory_order_relaxed);
+}
+
+void OutputFlusher::drain()
+{
+  if (!isOwner()) {
+    return;
+  }
+  
+  uint64_t const Target = m_EnqueuePos.load();
+  
+  while (m_Completed.load() < Target) {
+    notifyWriter();
+    std::this_thread::yield();
+  }
+}
+
+uint64_t OutputFlusher::getDepth() const
+{
+  return m_EnqueuePos.load() - m_Completed.load();
+}
+
+OutputFlusher::Statistics OutputFlusher::getStatistics() const
+{
+  Statistics Stats;
+  
+  Stats.Writes = m_Completed.load();
+  Stats.Bytes = m_Bytes.load();
+  Stats.MaximumDepth = m_MaximumDepth.load();
+  Stats.Stalls = m_Stalls.load();
+  Stats.StallTime = std::chrono::nanoseconds(m_StallNanoseconds.load());
+  
+  return Stats;
+}
+
+
+//------------------------------------------------------------------------------
+// OutputBlockBuffer
+//------------------------------------------------------------------------------
+
+void OutputBlockBuffer::reset(BlockType Type,
+                              off_t const BlockStart,
+                              off_t const BlockEnd)
+{
+  if (m_Flusher && m_Dirty && !m_CompressTo) {
+    // Hand the finished block to the flusher rather than copying it.
+    m_Flusher->write(m_TraceFD, m_BlockStart, std::move(m_Data));
+    m_Data = std::vector<char>();
+    m_Dirty = false;
+  }
+  else {
+    flush();
+  }
+  
+  auto const Size = static_cast<size_t>(BlockEnd - BlockStart);
+  m_Data.assign(Size, 0);
+  
+  m_BlockStart = BlockStart;
+  m_BlockEnd = BlockEnd;
+  m_Used = 0;
+  
+  write(&Type, sizeof(Type));
+  
+  uint64_t NextBlock = BlockEnd;
+  write(&NextBlock, sizeof(NextBlock));
+}
+
+llvm::Optional<off_t> OutputBlockBuffer::write(const void * const buf,
+                                               size_t const nbyte)
+{
+  assert(nbyte <= std::numeric_limits<int64_t>::max());
+  
+  if (int64_t(nbyte) > (m_BlockEnd - m_BlockStart) - m_Used) {
+    return llvm::Optional<off_t>();
+  }
+  
+  off_t const DataOffset = m_BlockStart + m_Used;
+  std::memcpy(m_Data.data() + m_Used, buf, nbyte);
+  m_Used += nbyte;
+  m_Dirty = true;
+  
+  return DataOffset;
+}
+
+llvm::Optional<OutputBlock::WriteRecord>
+OutputBlockBuffer::rewritableWrite(const void * const buf, size_t const nbyte)
+{
+  llvm::Optional<OutputBlock::WriteRecord> Ret;
+  
+  auto Off = write(buf, nbyte);
+  if (Off) {
+    Ret.emplace(m_TraceFD, *this, *Off, nbyte);
+  }
+  
+  return Ret;
+}
+
+void OutputBlockBuffer::overwrite(off_t const Offset,
+                                  const void * const buf,
+                                  size_t const nbyte)
+{
+  assert(holds(Offset, nbyte));
+  
+  std::memcpy(m_Data.data() + (Offset - m_BlockStart), buf, nbyte);
+  m_Dirty = true;
+}
+
+type_safe::boolean OutputBlockBuffer::writeThrough(off_t const Offset,
+                                                   const void * const buf,
+                                                   size_t const nbyte)
+{
+  if (m_CompressTo) {
+    appendThreadEventPatch(m_Patches, Offset, buf, nbyte);
+    m_Dirty = true;
+    return true;
+  }
+  
+  if (m_Flusher) {
+    auto const Bytes = static_cast<char const *>(buf);
+    m_Flusher->write(m_TraceFD, Offset, std::vector<char>(Bytes, Bytes + nbyte));
+    return true;
+  }
+  
+  auto const BytesWritten = pwrite(m_TraceFD, buf, nbyte, Offset);
+  return BytesWritten >= 0 && uint64_t(BytesWritten) == nbyte;
+}
+
+type_safe::boolean OutputBlockBuffer::flush()
+{
+  if (!m_Dirty) {
+    return true;
+  }
+  
+  m_Dirty = false;
+  
+  if (m_CompressTo) {
+    auto const Image = llvm::ArrayRef<char>(m_Data.data(), m_Used);
+    auto Block = compressThreadEventBlock(Image, m_BlockStart, m_Patches);
+    m_Patches.clear();
+    
+    if (m_Ring)
+      return m_Ring->add(m_BlockStart, std::move(Block));
+    
+    return m_CompressTo->writeCompressedBlock(std::move(Block));
+  }
+  
+  if (m_Flusher) {
+    // The block remains buffered, so the flusher gets a copy.
+    m_Flusher->write(m_TraceFD, m_BlockStart, m_Data);
+    return true;
+  }
+  
+  // Write the entire block, so that the unused tail is zeroed in the file.
+  auto const NWritten = pwrite(m_TraceFD, m_Data.data(), m_Data.size(),
+                               m_BlockStart);
+  
+  if (NWritten >= 0 && uint64_t(NWritten) == m_Data.size()) {
+    return true;
+  }
+  else if (NWritten < 0) {
+    perror("OutputBlockBuffer pwrite failed:");
+  }
+  else {
+    perror("OutputBlockBuffer pwrite incomplete:");
+  }
+  
+  return false;
+}
+
+void OutputBlockBuffer::discard()
+{
+  m_BlockStart = 0;
+  m_BlockEnd = 0;
+  m_Used = 0;
+  m_Dirty = false;
+  m_Patches.clear();
+}
+
+
 //------------------------------------------------------------------------------
 // OutputBlockBuilder
 //------------------------------------------------------------------------------
@@ -227,6 +699,10 @@ void OutputBlockStream::getNewBlock()
 {
   m_Block.reset();
   
+  if (!m_Mappings) {
+    m_Mappings = m_Output.getMappedChunks();
+  }
+  
   auto NewBlock = m_Output.getOutputBlock(m_BlockType, m_BlockSize);
   if (NewBlock) {
     m_Block.emplace(std::move(*NewBlock));
@@ -248,25 +724,299 @@ OutputBlockProcessDataStream::write(const void * const Data,
 {
   llvm::Optional<off_t> Ret;
   
-  if (Size < getSingleBlockThreshold()) {
-    Ret = m_OutputStream.write(Data, Size);
+  if (Size >= getSingleBlockThreshold()) {
+    Ret = m_Output.writeSingleBlock(BlockType::ProcessData, Data, Size);
+  }
+  else if (m_Buffer) {
+    Ret = m_Buffer->write(Data, Size);
+    
+    if (!Ret) {
+      // The current block is full (or we don't have one yet).
+      m_Output.getBufferedOutputBlock(*m_Buffer,
+                                      BlockType::ProcessData,
+                                      getBufferedBlockSize());
+      Ret = m_Buffer->write(Data, Size);
+    }
   }
   else {
-    auto const TotalSize = OutputBlock::getHeaderSize() + Size;
-    auto SingleBlock = m_Output.getOutputBlock(BlockType::ProcessData,
-                                               TotalSize);
-    assert(SingleBlock);
-    Ret = SingleBlock->write(Data, Size);
+    Ret = m_OutputStream.write(Data, Size);
   }
   
   return Ret;
 }
 
+void OutputBlockProcessDataStream::flush()
+{
+  if (m_Buffer) {
+    m_Buffer->flush();
+  }
+}
+
+void OutputBlockProcessDataStream::discard()
+{
+  if (m_Buffer) {
+    m_Buffer->discard();
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// ThreadEventRing
+//------------------------------------------------------------------------------
+
+type_safe::boolean ThreadEventRing::add(offset_uint const BlockOffset,
+                                        std::vector<char> Block)
+{
+  if (m_Written)
+    return m_Output.writeCompressedBlock(std::move(Block));
+  
+  auto const IsCheckpoint = std::find(m_CheckpointBlocks.begin(),
+                                      m_CheckpointBlocks.end(),
+                                      BlockOffset)
+                            != m_CheckpointBlocks.end();
+  
+  if (!IsCheckpoint)
+    m_SegmentBytes += Block.size();
+  
+  m_RetainedBytes += Block.size();
+  m_Entries.push_back(Entry{m_Segment, IsCheckpoint, std::move(Block)});
+  
+  dropSegments();
+  
+  return true;
+}
+
+void ThreadEventRing::beginSegment()
+{
+  ++m_Segment;
+  m_SegmentBytes = 0;
+  m_CheckpointBlocks.clear();
+}
+
+void ThreadEventRing::addCheckpointBlock(offset_uint const BlockOffset)
+{
+  m_CheckpointBlocks.push_back(BlockOffset);
+}
+
+void ThreadEventRing::dropSegments()
+{
+  // The current segment is never dropped, so that there is always a complete
+  // checkpoint to begin the retained events.
+  while (m_RetainedBytes > m_Capacity
+         && !m_Entries.empty()
+         && m_Entries.front().Segment != m_Segment)
+  {
+    auto const Segment = m_Entries.front().Segment;
+    
+    while (!m_Entries.empty() && m_Entries.front().Segment == Segment) {
+      m_RetainedBytes -= m_Entries.front().Block.size();
+      m_Entries.pop_front();
+    }
+  }
+}
+
+type_safe::boolean ThreadEventRing::write()
+{
+  if (m_Written)
+    return true;
+  
+  m_Written = true;
+  
+  if (m_Entries.empty())
+    return true;
+  
+  auto const BlockHeaderSize = sizeof(BlockType) + sizeof(uint64_t);
+  auto const FirstSegment = m_Entries.front().Segment;
+  
+  // Patch records from omitted checkpoint blocks, which must be carried by
+  // the next block that is written. Each block is held until the next block
+  // is found, so that trailing patch records can be given to the last block.
+  std::vector<char> Carried;
+  Entry *Pending = nullptr;
+  type_safe::boolean Success = true;
+  
+  for (auto &TheEntry : m_Entries) {
+    if (TheEntry.IsCheckpoint && TheEntry.Segment != FirstSegment) {
+      auto const Data = llvm::ArrayRef<char>(TheEntry.Block)
+                          .drop_front(BlockHeaderSize);
+      if (auto const Compressed = CompressedThreadEventBlock::read(Data)) {
+        auto const Patches = Compressed->getPatches();
+        Carried.insert(Carried.end(), Patches.begin(), Patches.end());
+      }
+      
+      continue;
+    }
+    
+    if (Pending && !m_Output.writeCompressedBlock(std::move(Pending->Block)))
+      Success = false;
+    
+    if (!Carried.empty()) {
+      TheEntry.Block = prependThreadEventPatches(TheEntry.Block, Carried);
+      Carried.clear();
+    }
+    
+    Pending = &TheEntry;
+  }
+  
+  if (Pending) {
+    if (!Carried.empty())
+      Pending->Block = prependThreadEventPatches(Pending->Block, Carried);
+    
+    if (!m_Output.writeCompressedBlock(std::move(Pending->Block)))
+      Success = false;
+  }
+  
+  m_Entries.clear();
+  m_RetainedBytes = 0;
+  
+  return Success;
+}
+
+void ThreadEventRing::discard()
+{
+  m_Entries.clear();
+  m_RetainedBytes = 0;
+  m_SegmentBytes = 0;
+  m_CheckpointBlocks.clear();
+}
+
 
 //------------------------------------------------------------------------------
 // OutputBlockThreadEventStream
 //------------------------------------------------------------------------------
 
+OutputBlockThreadEventStream::~OutputBlockThreadEventStream()
+{
+  if (m_Buffer)
+    m_Buffer->flush();
+  
+  if (m_Ring)
+    m_Ring->write();
+}
+
+llvm::Optional<off_t>
+OutputBlockThreadEventStream::write(void const * const Data, size_t const Size)
+{
+  if (!m_Buffer) {
+    return m_OutputStream.write(Data, Size);
+  }
+  
+  if (m_StartNewBlock) {
+    getNewBufferedBlock();
+  }
+  
+  auto Ret = m_Buffer->write(Data, Size);
+  
+  if (!Ret) {
+    // The current block is full (or we don't have one yet).
+    getNewBufferedBlock();
+    Ret = m_Buffer->write(Data, Size);
+  }
+  
+  return Ret;
+}
+
+llvm::Optional<OutputBlock::WriteRecord>
+OutputBlockThreadEventStream::rewritableWrite(const void * const Data,
+                                              size_t const Size)
+{
+  if (!m_Buffer) {
+    return m_OutputStream.rewritableWrite(Data, Size);
+  }
+  
+  if (m_StartNewBlock) {
+    getNewBufferedBlock();
+  }
+  
+  llvm::Optional<OutputBlock::WriteRecord> Ret;
+  
+  if (auto Result = m_Buffer->rewritableWrite(Data, Size)) {
+    Ret.emplace(*Result);
+  }
+  else {
+    // The current block is full (or we don't have one yet).
+    getNewBufferedBlock();
+    if (auto Result = m_Buffer->rewritableWrite(Data, Size)) {
+      Ret.emplace(*Result);
+    }
+  }
+  
+  return Ret;
+}
+
+void OutputBlockThreadEventStream::flush()
+{
+  if (m_Buffer) {
+    m_Buffer->flush();
+  }
+  
+  // The stream is only flushed when the process is about to terminate, so
+  // this is the last chance to write the retained events.
+  if (m_Ring) {
+    m_Ring->write();
+  }
+}
+
+void OutputBlockThreadEventStream::discard()
+{
+  if (m_Buffer) {
+    m_Buffer->discard();
+  }
+  
+  if (m_Ring) {
+    m_Ring->discard();
+  }
+}
+
+void OutputBlockThreadEventStream::beginCheckpoint()
+{
+  if (!m_Ring)
+    return;
+  
+  m_Buffer->flush();
+  m_Ring->beginSegment();
+  m_StartNewBlock = true;
+  m_InCheckpoint = true;
+}
+
+void OutputBlockThreadEventStream::endCheckpoint()
+{
+  if (!m_Ring)
+    return;
+  
+  m_Buffer->flush();
+  m_StartNewBlock = true;
+  m_InCheckpoint = false;
+}
+
+llvm::Optional<off_t>
+OutputBlockThreadEventStream::writeCheckpointData(llvm::ArrayRef<char> Data)
+{
+  if (!m_Ring || !m_InCheckpoint)
+    return llvm::Optional<off_t>();
+  
+  // The data follows the thread ID and a zero word, which stops the block
+  // compression from treating it as events.
+  uint32_t const Padding = 0;
+  off_t const HeaderSize = sizeof(BlockType) + sizeof(uint64_t)
+                         + sizeof(m_ThreadID) + sizeof(Padding);
+  
+  m_Output.getBufferedOutputBlock(*m_Buffer,
+                                  BlockType::ThreadCheckpointData,
+                                  HeaderSize + Data.size());
+  
+  m_Ring->addCheckpointBlock(m_Buffer->getBlockStart());
+  
+  m_Buffer->write(&m_ThreadID, sizeof(m_ThreadID));
+  m_Buffer->write(&Padding, sizeof(Padding));
+  auto const Ret = m_Buffer->write(Data.data(), Data.size());
+  
+  // Following events must begin a new block.
+  m_StartNewBlock = true;
+  
+  return Ret;
+}
+
 void OutputBlockThreadEventStream::writeHeader(OutputBlock &Block)
 {
   auto const Off = Block.write(&m_ThreadID, sizeof(m_ThreadID));
@@ -276,6 +1026,22 @@ void OutputBlockThreadEventStream::writeHeader(OutputBlock &Block)
   // Next Thread Block
 }
 
+void OutputBlockThreadEventStream::getNewBufferedBlock()
+{
+  m_Output.getBufferedOutputBlock(*m_Buffer,
+                                  BlockType::ThreadEvents,
+                                  getBufferedBlockSize());
+  
+  m_StartNewBlock = false;
+  
+  if (m_InCheckpoint) {
+    m_Ring->addCheckpointBlock(m_Buffer->getBlockStart());
+  }
+  
+  auto const Off = m_Buffer->write(&m_ThreadID, sizeof(m_ThreadID));
+  assert(Off.hasValue() && "couldn't write thread event block header");
+}
+
 
 //------------------------------------------------------------------------------
 // OutputStreamAllocator
@@ -284,12 +1050,31 @@ void OutputBlockThreadEventStream::writeHeader(OutputBlock &Block)
 OutputStreamAllocator::
 OutputStreamAllocator(llvm::StringRef WithTracePath,
                       bool UserSpecifiedTraceName,
-                      int const TraceFD)
+                      int const TraceFD,
+                      bool const UseMapping)
 : m_TracePath(WithTracePath),
   m_UserSpecifiedTraceName(UserSpecifiedTraceName),
   m_TraceFD(TraceFD),
-  m_TraceOffset(0)
+  m_BufferOutput(std::getenv(getTraceUnbufferedEnvVar()) == nullptr
+                 && !UseMapping),
+  m_CompressThreadEvents(m_BufferOutput
+                         && std::getenv(getTraceUncompressedEnvVar()) == nullptr),
+  m_ThreadEventRingCapacity(0),
+  m_TraceOffset(0),
+  m_CompressedOffset(compressedEventOffsetBase()),
+  m_Flusher(nullptr),
+  m_UseMapping(UseMapping),
+  m_OwnerPID(getCurrentPID()),
+  m_MappedChunks(),
+  m_MappedSize(0),
+  m_MappingMutex()
 {
+  if (m_UseMapping) {
+    m_MappedChunks = std::make_shared<OutputMappedChunks>
+                                     (getMaximumMappedChunks(),
+                                      getMappedChunkSize());
+  }
+  
   // Setup the file header.
   auto const Written = write(m_TraceFD, "SEECSEEC", 8);
   if (Written < 0) {
@@ -300,6 +1085,100 @@ OutputStreamAllocator(llvm::StringRef WithTracePath,
   m_TraceOffset += 8;
 }
 
+OutputStreamAllocator::~OutputStreamAllocator()
+{
+  if (!m_UseMapping) {
+    return;
+  }
+  
+#if defined(SEEC_TRACE_MMAP_SUPPORTED)
+  // Streams may still hold mapped blocks, so the chunks are unmapped when the
+  // last owner of m_MappedChunks is destroyed. Only allocated space is ever
+  // written, so it remains safe to trim the file now.
+  m_MappedChunks.reset();
+  
+  // The file was extended in whole chunks, so trim it back to the space that
+  // was actually allocated. A forked child shares the file with its parent,
+  // so it must leave the file alone.
+  if (m_TraceFD != -1 && getCurrentPID() == m_OwnerPID) {
+    if (ftruncate(m_TraceFD, m_TraceOffset.load()) != 0) {
+      perror("SeeC: trimming trace file failed:");
+    }
+  }
+#endif
+}
+
+void OutputStreamAllocator::extendMapping(off_t const End)
+{
+  if (End <= m_MappedSize.load(std::memory_order_acquire)) {
+    return;
+  }
+  
+#if defined(SEEC_TRACE_MMAP_SUPPORTED)
+  std::lock_guard<std::mutex> Lock(m_MappingMutex);
+  
+  auto const MappedSize = m_MappedSize.load(std::memory_order_relaxed);
+  if (End <= MappedSize) {
+    return;
+  }
+  
+  auto const ChunkSize = getMappedChunkSize();
+  auto const NewSize = ((End + ChunkSize - 1) / ChunkSize) * ChunkSize;
+  
+  if (ftruncate(m_TraceFD, NewSize) != 0) {
+    perror("SeeC: extending trace file failed:");
+    return;
+  }
+  
+  for (off_t ChunkStart = MappedSize; ChunkStart < NewSize;
+       ChunkStart += ChunkSize)
+  {
+    auto const Index = static_cast<size_t>(ChunkStart / ChunkSize);
+    if (Index >= getMaximumMappedChunks()) {
+      break;
+    }
+    
+    auto const Chunk = mmap(nullptr, ChunkSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, m_TraceFD, ChunkStart);
+    
+    if (Chunk == MAP_FAILED) {
+      perror("SeeC: mapping trace file failed:");
+      continue;
+    }
+    
+    m_MappedChunks->set(Index, static_cast<char *>(Chunk));
+  }
+  
+  m_MappedSize.store(NewSize, std::memory_order_release);
+#endif
+}
+
+char *OutputStreamAllocator::getMappedRegion(off_t const Offset,
+                                             off_t const End)
+{
+  extendMapping(End);
+  
+  if (End > m_MappedSize.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  
+  auto const ChunkSize = getMappedChunkSize();
+  auto const Index = static_cast<size_t>(Offset / ChunkSize);
+  
+  if (Index >= getMaximumMappedChunks()
+      || (End - 1) / ChunkSize != Offset / ChunkSize)
+  {
+    return nullptr;
+  }
+  
+  auto const Chunk = m_MappedChunks->get(Index);
+  if (!Chunk) {
+    return nullptr;
+  }
+  
+  return Chunk + (Offset - (Index * ChunkSize));
+}
+
 bool OutputStreamAllocator::deleteAll()
 {
   bool Result = true;
@@ -391,9 +1270,12 @@ OutputStreamAllocator::createOutputStreamAllocator()
   int const TraceFD = _open_osfhandle(reinterpret_cast<intptr_t>(TraceHandle),
                                       _O_CREAT | _O_WRONLY | _O_TRUNC);
 #else
+  // Mapping the file requires that it is opened for reading.
+  bool const UseMapping = std::getenv(getTraceMappedEnvVar()) != nullptr;
+  
   mode_t const TraceMode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
   int const TraceFD = open(FullPath.c_str(),
-                           O_WRONLY | O_CREAT | O_TRUNC,
+                           (UseMapping ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC,
                            TraceMode);
 #endif
   
@@ -403,11 +1285,16 @@ OutputStreamAllocator::createOutputStreamAllocator()
                                std::make_pair("error", strerror(errno)))};
   }
   
+#if !defined(SEEC_TRACE_MMAP_SUPPORTED)
+  bool const UseMapping = false;
+#endif
+  
   // Create the OutputStreamAllocator.
   std::unique_ptr<OutputStreamAllocator> Allocator (
     new (std::nothrow) OutputStreamAllocator(FullPath,
                                              UserSpecifiedTraceName,
-                                             TraceFD));
+                                             TraceFD,
+                                             UseMapping));
   
   if (!Allocator)
     return Error{LazyMessageByRef::create("Trace",
@@ -447,12 +1334,100 @@ void OutputStreamAllocator::updateTraceName(llvm::StringRef ProgramName)
   }
 }
 
+void OutputStreamAllocator::setFlusher(OutputFlusher * const Flusher)
+{
+  m_Flusher = m_BufferOutput ? Flusher : nullptr;
+}
+
+void OutputStreamAllocator::setThreadEventRingCapacity(uint64_t const Capacity)
+{
+  m_ThreadEventRingCapacity = m_CompressThreadEvents ? Capacity : 0;
+}
+
+void OutputStreamAllocator::waitForPendingWrites()
+{
+  if (m_Flusher) {
+    m_Flusher->drain();
+  }
+}
+
 llvm::Optional<OutputBlock>
 OutputStreamAllocator::getOutputBlock(BlockType Type, off_t NBytes)
 {
   off_t const Offset = m_TraceOffset.fetch_add(NBytes);
   off_t const End = Offset + NBytes;
-  return OutputBlock(m_TraceFD, Type, End, Offset);
+  
+  char * const Mapped = m_UseMapping ? getMappedRegion(Offset, End) : nullptr;
+  
+  return OutputBlock(m_TraceFD, Type, End, Offset, Mapped);
+}
+
+void OutputStreamAllocator::getBufferedOutputBlock(OutputBlockBuffer &Buffer,
+                                                   BlockType Type,
+                                                   off_t NBytes)
+{
+  off_t const Offset = Buffer.isCompressing()
+                     ? m_CompressedOffset.fetch_add(NBytes)
+                     : m_TraceOffset.fetch_add(NBytes);
+  
+  Buffer.reset(Type, Offset, Offset + NBytes);
+}
+
+type_safe::boolean
+OutputStreamAllocator::writeCompressedBlock(std::vector<char> Block)
+{
+  off_t const Offset = m_TraceOffset.fetch_add(Block.size());
+  
+  uint64_t const NextBlock = Offset + Block.size();
+  std::memcpy(Block.data() + sizeof(BlockType), &NextBlock, sizeof(NextBlock));
+  
+  if (m_Flusher) {
+    m_Flusher->write(m_TraceFD, Offset, std::move(Block));
+    return true;
+  }
+  
+  auto const NWritten = pwrite(m_TraceFD, Block.data(), Block.size(), Offset);
+  if (NWritten >= 0 && uint64_t(NWritten) == Block.size()) {
+    return true;
+  }
+  else if (NWritten < 0) {
+    perror("OutputStreamAllocator pwrite failed:");
+  }
+  else {
+    perror("OutputStreamAllocator pwrite incomplete:");
+  }
+  
+  return false;
+}
+
+llvm::Optional<off_t>
+OutputStreamAllocator::writeSingleBlock(BlockType const Type,
+                                        void const * const Data,
+                                        size_t const Size)
+{
+  auto const TotalSize = OutputBlock::getHeaderSize() + Size;
+  
+  if (!m_Flusher) {
+    auto SingleBlock = getOutputBlock(Type, TotalSize);
+    assert(SingleBlock);
+    return SingleBlock->write(Data, Size);
+  }
+  
+  // Build the complete block so that it is written in a single operation.
+  off_t const Offset = m_TraceOffset.fetch_add(TotalSize);
+  uint64_t const NextBlock = Offset + TotalSize;
+  
+  std::vector<char> Block(TotalSize);
+  auto Out = Block.data();
+  std::memcpy(Out, &Type, sizeof(Type));
+  Out += sizeof(Type);
+  std::memcpy(Out, &NextBlock, sizeof(NextBlock));
+  Out += sizeof(NextBlock);
+  std::memcpy(Out, Data, Size);
+  
+  m_Flusher->write(m_TraceFD, Offset, std::move(Block));
+  
+  return Offset + OutputBlock::getHeaderSize();
 }
 
 seec::Maybe<seec::Error>
@@ -488,13 +1463,39 @@ OutputStreamAllocator::getProcessTraceStream()
 std::unique_ptr<OutputBlockProcessDataStream>
 OutputStreamAllocator::getProcessDataStream()
 {
-  return llvm::make_unique<OutputBlockProcessDataStream>(*this);
+  std::unique_ptr<OutputBlockBuffer> Buffer;
+  
+  if (m_BufferOutput) {
+    Buffer = llvm::make_unique<OutputBlockBuffer>(m_TraceFD, m_Flusher);
+  }
+  
+  return llvm::make_unique<OutputBlockProcessDataStream>(*this,
+                                                         std::move(Buffer));
 }
 
 std::unique_ptr<OutputBlockThreadEventStream>
 OutputStreamAllocator::getThreadEventStream(uint32_t const ThreadID)
 {
-  return llvm::make_unique<OutputBlockThreadEventStream>(*this, ThreadID);
+  std::unique_ptr<OutputBlockBuffer> Buffer;
+  
+  std::unique_ptr<ThreadEventRing> Ring;
+  
+  if (m_CompressThreadEvents) {
+    if (m_ThreadEventRingCapacity) {
+      Ring = llvm::make_unique<ThreadEventRing>(*this,
+                                                m_ThreadEventRingCapacity);
+    }
+    
+    Buffer = llvm::make_unique<OutputBlockBuffer>(m_TraceFD, *this,
+                                                  Ring.get());
+  }
+  else if (m_BufferOutput) {
+    Buffer = llvm::make_unique<OutputBlockBuffer>(m_TraceFD, m_Flusher);
+  }
+  
+  return llvm::make_unique<OutputBlockThreadEventStream>(*this, ThreadID,
+                                                         std::move(Buffer),
+                                                         std::move(Ring));
 }
 
 
@@ -286,17 +286,34 @@ bool TraceThreadListener::recordDirClose(void const * const TheDIR)
 // Dynamic memory
 //------------------------------------------------------------------------------
 
+/// \brief Get the active instruction of the innermost function that is not a
+///        shim, which is the allocator of memory that is allocated now.
+///
+static llvm::Instruction const *
+getInnermostActiveInstruction(std::vector<TracedFunction> const &Stack)
+{
+  auto const It = std::find_if(Stack.rbegin(), Stack.rend(),
+                               [] (TracedFunction const &TF) {
+                                 return !TF.isShim();
+                               });
+  
+  return It != Stack.rend() ? It->getActiveInstruction() : nullptr;
+}
+
 void TraceThreadListener::recordMalloc(uintptr_t Address, std::size_t Size) {
   ProcessTime = getCIProcessTime();
   
   auto Write = EventsOut.write<EventType::Malloc>(Size, ProcessTime);
   auto const Offset = Write ? Write->Offset : 0;
 
+  auto const Allocator = getInnermostActiveInstruction(FunctionStack);
+  
   // update dynamic allocation lookup
   ProcessListener.setCurrentDynamicMemoryAllocation(Address,
                                                     ThreadID,
                                                     Offset,
-                                                    Size);
+                                                    Size,
+                                                    Allocator);
 }
 
 void TraceThreadListener::recordRealloc(uintptr_t const Address,
@@ -321,10 +338,15 @@ void TraceThreadListener::recordRealloc(uintptr_t const Address,
     MemoryState->resizeAllocation(Address, NewSize);
   }
   
+  // The realloc is now the allocating instruction (as it is when the trace
+  // is replayed).
+  auto const Allocator = getInnermostActiveInstruction(FunctionStack);
+  
   ProcessListener.setCurrentDynamicMemoryAllocation(Alloc->address(),
                                                     Alloc->thread(),
                                                     Alloc->offset(),
-                                                    NewSize);
+                                                    NewSize,
+                                                    Allocator);
   ProcessListener.incrementRegionTemporalID(Address);
 }
 
@@ -579,6 +601,321 @@ void TraceThreadListener::traceClose()
   OutputEnabled = false;
 }
 
+void TraceThreadListener::traceFlush()
+{
+  EventsOut.flush();
+}
+
+void TraceThreadListener::traceAbandon()
+{
+  EventsOut.abandon();
+  OutputEnabled = false;
+}
+
+
+//------------------------------------------------------------------------------
+// Flight recorder checkpoints.
+//------------------------------------------------------------------------------
+
+/// \brief Write the event that recreates an instruction's runtime value.
+///
+/// \return true iff an event was written.
+///
+static bool writeCheckpointValue(EventWriter &EventsOut,
+                                 InstrIndexInFn const Index,
+                                 llvm::Type const * const Type,
+                                 RuntimeValue const &Value)
+{
+  if (Type->isPointerTy()) {
+    EventsOut.write<EventType::InstructionWithPtr>(Index, Value.getUIntPtr());
+  }
+  else if (Type->isIntegerTy()) {
+    auto const Bits = Type->getIntegerBitWidth();
+    auto const Int = Value.getUInt64();
+    
+    if (Bits <= 8)
+      EventsOut.write<EventType::InstructionWithUInt8>
+                     (static_cast<uint8_t>(Int), Index);
+    else if (Bits <= 16)
+      EventsOut.write<EventType::InstructionWithUInt16>
+                     (static_cast<uint16_t>(Int), Index);
+    else if (Bits <= 32)
+      EventsOut.write<EventType::InstructionWithUInt32>
+                     (static_cast<uint32_t>(Int), Index);
+    else
+      EventsOut.write<EventType::InstructionWithUInt64>(Index, Int);
+  }
+  else if (Type->isFloatTy()) {
+    EventsOut.write<EventType::InstructionWithFloat>(Index, Value.getFloat());
+  }
+  else if (Type->isDoubleTy()) {
+    EventsOut.write<EventType::InstructionWithDouble>(Index, Value.getDouble());
+  }
+  else if (Type->isX86_FP80Ty()) {
+    auto const LongDouble = Value.getLongDouble();
+    uint64_t Words[2] = {0, 0};
+    
+    static_assert(sizeof(LongDouble) <= sizeof(Words), "long double too large!");
+    memcpy(reinterpret_cast<char *>(Words),
+           reinterpret_cast<char const *>(&LongDouble),
+           sizeof(LongDouble));
+    
+    EventsOut.write<EventType::InstructionWithLongDouble>
+                   (Index, Words[0], Words[1]);
+  }
+  else {
+    return false;
+  }
+  
+  return true;
+}
+
+void TraceThreadListener::writeCheckpoint()
+{
+  if (!OutputEnabled)
+    return;
+  
+  // Checkpoints are only written between notifications.
+  if (GlobalMemoryLock.owns_lock() || DynamicMemoryLock.owns_lock()
+      || StreamsLock.owns_lock() || DirsLock.owns_lock())
+    return;
+  
+  // Take copies of the open streams and DIRs first, so that we never hold
+  // their locks while holding the global memory lock.
+  std::vector<std::pair<FILE *, TraceStream>> Streams;
+  ProcessListener.getStreamsAccessor()->forEachStream(
+    [&] (FILE *Stream, TraceStream const &Info) {
+      if (Stream != stdin && Stream != stdout && Stream != stderr)
+        Streams.emplace_back(Stream, Info);
+    });
+  
+  std::vector<std::pair<uintptr_t, TraceDIR>> Dirs;
+  ProcessListener.getDirsAccessor()->forEachDIR(
+    [&] (uintptr_t const Address, TraceDIR const &Info) {
+      Dirs.emplace_back(Address, Info);
+    });
+  
+  // The shared state is copied while the global memory lock is held, and is
+  // written once the lock has been released, so that other threads are only
+  // held up while the memory is copied.
+  struct KnownRegion {
+    uintptr_t Address;
+    std::size_t Length;
+    bool Readable;
+    bool Writable;
+  };
+  
+  struct InitializedRange {
+    uintptr_t Address;
+    std::size_t Length;
+    std::size_t Position; // Position of the range's data in its snapshot.
+  };
+  
+  std::vector<KnownRegion> Regions;
+  std::vector<DynamicAllocation> Allocations;
+  std::vector<InitializedRange> SmallRanges;
+  std::vector<InitializedRange> LargeRanges;
+  std::vector<char> SmallData;
+  std::vector<char> LargeData;
+  
+  auto const SmallLimit =
+    EventRecord<EventType::StateUntypedSmall>::sizeofData();
+  
+  acquireGlobalMemoryWriteLock();
+  
+  auto const CheckpointTime = ProcessListener.getTime();
+  ProcessTime = CheckpointTime;
+  
+  for (auto const &Region : ProcessListener.getKnownMemory()) {
+    auto const Access = Region.Value;
+    
+    auto const Readable = (Access == seec::MemoryPermission::ReadOnly) ||
+                          (Access == seec::MemoryPermission::ReadWrite);
+    
+    auto const Writable = (Access == seec::MemoryPermission::WriteOnly) ||
+                          (Access == seec::MemoryPermission::ReadWrite);
+    
+    Regions.push_back(KnownRegion{Region.Begin,
+                                  (Region.End - Region.Begin) + 1, // Inclusive.
+                                  Readable,
+                                  Writable});
+  }
+  
+  ProcessListener.forEachCurrentDynamicMemoryAllocation(
+    [&] (DynamicAllocation const &Alloc) {
+      Allocations.push_back(Alloc);
+    });
+  
+  ProcessListener.getTraceMemoryStateAccessor()->forEachInitializedRange(
+    [&] (uintptr_t const Address, std::size_t const Length) {
+      auto &Ranges = Length <= SmallLimit ? SmallRanges : LargeRanges;
+      auto &Data = Length <= SmallLimit ? SmallData : LargeData;
+      auto const Bytes = reinterpret_cast<char const *>(Address);
+      
+      Ranges.push_back(InitializedRange{Address, Length, Data.size()});
+      Data.insert(Data.end(), Bytes, Bytes + Length);
+    });
+  
+  GlobalMemoryLock.unlock();
+  
+  // All of the checkpoint's events are kept in their own blocks, so that the
+  // checkpoint can be dropped if it is not the oldest retained checkpoint.
+  EventsOut.beginCheckpoint();
+  EventsOut.write<EventType::Checkpoint>(CheckpointTime);
+  
+  // Shared state: known regions, dynamic memory, streams and DIRs.
+  for (auto const &Region : Regions)
+    EventsOut.write<EventType::KnownRegionAdd>(Region.Address,
+                                               Region.Length,
+                                               Region.Readable,
+                                               Region.Writable);
+  
+  auto const &ModIndex = ProcessListener.moduleIndex();
+  
+  for (auto const &Alloc : Allocations) {
+    // The allocator is identified by index, as the events that recorded it
+    // may be dropped from the ring.
+    auto FunctionIndex = std::numeric_limits<uint32_t>::max();
+    auto AllocatorIndex = InstrIndexInFn{0};
+    
+    if (auto const Allocator = Alloc.allocator()) {
+      auto const Fn = Allocator->getParent()->getParent();
+      auto const FnIdx = ModIndex.getIndexOfFunction(Fn);
+      auto const FIndex = FnIdx ? ModIndex.getFunctionIndex(*FnIdx) : nullptr;
+      auto const InstrIdx = FIndex ? FIndex->getIndexOfInstruction(Allocator)
+                                   : llvm::Optional<InstrIndexInFn>();
+      if (InstrIdx) {
+        FunctionIndex = *FnIdx;
+        AllocatorIndex = *InstrIdx;
+      }
+    }
+    
+    EventsOut.write<EventType::CheckpointMalloc>(Alloc.address(),
+                                                 Alloc.size(),
+                                                 FunctionIndex,
+                                                 AllocatorIndex);
+  }
+  
+  for (auto const &Stream : Streams)
+    EventsOut.write<EventType::FileOpen>
+                   (CheckpointTime,
+                    reinterpret_cast<uintptr_t>(Stream.first),
+                    Stream.second.getFilenameOffset(),
+                    Stream.second.getModeOffset());
+  
+  for (auto const &Dir : Dirs)
+    EventsOut.write<EventType::DirOpen>(CheckpointTime,
+                                        Dir.first,
+                                        Dir.second.getDirnameOffset());
+  
+  // This thread's stack, from the outermost function.
+  TracedFunction const *Innermost = nullptr;
+  for (auto const &Function : FunctionStack)
+    if (!Function.isShim())
+      Innermost = &Function;
+  
+  for (auto &Function : FunctionStack) {
+    if (Function.isShim())
+      continue;
+    
+    auto &Record = Function.getRecordedFunction();
+    
+    auto const Write = EventsOut.write<EventType::FunctionStart>
+                                      (Record.getIndex(),
+                                       offset_uint(0),
+                                       offset_uint(0),
+                                       Record.getThreadTimeEntered(),
+                                       uint64_t(0));
+    if (Write)
+      Record.addCheckpointWrite(*Write);
+    
+    EventsOut.write<EventType::CheckpointFunction>
+                   (Record.getEventOffsetStart());
+    
+    for (auto const &ByVal : Function.getByValArgs()) {
+      auto const &Area = ByVal.getArea();
+      EventsOut.write<EventType::ByValRegionAdd>
+                     (ByVal.getArgument()->getArgNo(),
+                      Area.start(),
+                      Area.length());
+    }
+    
+    auto const &Index = Function.getFunctionIndex();
+    
+    for (auto const &Alloca : Function.getAllocas()) {
+      auto const AllocaIdx = Index.getIndexOfInstruction(Alloca.instruction());
+      if (!AllocaIdx)
+        continue;
+      
+      EventsOut.write<EventType::InstructionWithPtr>(*AllocaIdx,
+                                                     Alloca.address());
+      EventsOut.write<EventType::Alloca>(Alloca.elementSize(),
+                                         Alloca.elementCount());
+    }
+    
+    auto const Active = Function.getActiveInstruction();
+    
+    for (uint32_t i = 0; i < Index.getInstructionCount(); ++i) {
+      auto const Idx = InstrIndexInFn{i};
+      auto const Instruction = Index.getInstruction(Idx);
+      if (Instruction == Active || llvm::isa<llvm::AllocaInst>(Instruction))
+        continue;
+      
+      auto const Value = Function.getCurrentRuntimeValue(Idx);
+      if (Value && Value->assigned())
+        writeCheckpointValue(EventsOut, Idx, Instruction->getType(), *Value);
+    }
+    
+    // Finish with the active instruction, so that it is the current
+    // instruction when the checkpoint has been read.
+    if (!Active)
+      continue;
+    
+    auto const ActiveIdx = Index.getIndexOfInstruction(Active);
+    if (!ActiveIdx)
+      continue;
+    
+    if (&Function != Innermost || llvm::isa<llvm::CallInst>(Active)) {
+      EventsOut.write<EventType::PreInstruction>(*ActiveIdx);
+      continue;
+    }
+    
+    auto const Value = Function.getCurrentRuntimeValue(*ActiveIdx);
+    if (!Value || !Value->assigned()
+        || !writeCheckpointValue(EventsOut, *ActiveIdx, Active->getType(),
+                                 *Value))
+      EventsOut.write<EventType::Instruction>(*ActiveIdx);
+  }
+  
+  // Memory state. Large ranges are held in a block of the checkpoint's own,
+  // so that their data is dropped with the checkpoint.
+  for (auto const &Range : SmallRanges) {
+    EventRecord<EventType::StateUntypedSmall>::typeofData DataStore;
+    char *DataStorePtr = reinterpret_cast<char *>(&DataStore);
+    memcpy(DataStorePtr, SmallData.data() + Range.Position, Range.Length);
+    
+    EventsOut.write<EventType::StateUntypedSmall>
+                   (static_cast<uint8_t>(Range.Length),
+                    Range.Address,
+                    CheckpointTime,
+                    DataStore);
+  }
+  
+  if (!LargeRanges.empty()) {
+    if (auto const DataOffset = EventsOut.writeCheckpointData(LargeData)) {
+      for (auto const &Range : LargeRanges)
+        EventsOut.write<EventType::StateUntyped>
+                       (Range.Address,
+                        CheckpointTime,
+                        offset_uint(*DataOffset + Range.Position),
+                        Range.Length);
+    }
+  }
+  
+  EventsOut.write<EventType::CheckpointEnd>(Time);
+  EventsOut.endCheckpoint();
+}
+
 
 //------------------------------------------------------------------------------
 // Accessors
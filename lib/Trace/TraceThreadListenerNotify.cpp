@@ -472,6 +472,31 @@ void TraceThreadListener::notifyPostCall(InstrIndexInFn Index,
   detectPostCall(CallInst, Index, Address);
 }
 
+void TraceThreadListener::notifyPreCallDetected(InstrIndexInFn Index,
+                                                llvm::CallInst const *CallInst,
+                                                detect_calls::Call Callee) {
+  // Handle common behaviour when entering and exiting notifications.
+  enterNotification();
+  auto OnExit = scopeExit([=](){exitPreNotification();});
+  ActiveFunction->setActiveInstruction(CallInst);
+
+  detectPreCall(CallInst, Index, Callee);
+  
+  // Emit a PreInstruction so that the call becomes active.
+  ++Time;
+  EventsOut.write<EventType::PreInstruction>(Index);
+}
+
+void TraceThreadListener::notifyPostCallDetected(InstrIndexInFn Index,
+                                                 llvm::CallInst const *CallInst,
+                                                 detect_calls::Call Callee) {
+  // Handle common behaviour when entering and exiting notifications.
+  enterNotification();
+  auto OnExit = scopeExit([=](){exitPostNotification();});
+  
+  detectPostCall(CallInst, Index, Callee);
+}
+
 void TraceThreadListener::notifyPreCallIntrinsic(InstrIndexInFn Index,
                                                  llvm::CallInst const *CI) {
   using namespace seec::trace::detect_calls;
@@ -586,9 +611,12 @@ void TraceThreadListener::notifyPreLoad(InstrIndexInFn Index,
   auto OnExit = scopeExit([=](){exitPreNotification();});
   ActiveFunction->setActiveInstruction(Load);
 
-  GlobalMemoryLock = ProcessListener.lockMemory();
-
   auto const Address = reinterpret_cast<uintptr_t>(Data);
+  
+  // Only lock the stripes of memory that this load reads, so that threads
+  // accessing different memory may proceed concurrently.
+  GlobalMemoryLock = ProcessListener.lockMemory(Address, Size);
+  
   auto const Access = seec::runtime_errors::format_selects::MemoryAccess::Read;
 
   RuntimeErrorChecker Checker(*this, Index);
@@ -655,9 +683,13 @@ void TraceThreadListener::notifyPreStore(InstrIndexInFn Index,
   auto OnExit = scopeExit([=](){exitPreNotification();});
   ActiveFunction->setActiveInstruction(Store);
 
-  GlobalMemoryLock = ProcessListener.lockMemory();
-
   auto const Address = reinterpret_cast<uintptr_t>(Data);
+  
+  // Only lock the stripes of memory that this store writes. The store's new
+  // state is recorded while these stripes are held, so stores to the same
+  // memory are recorded in process time order.
+  GlobalMemoryLock = ProcessListener.lockMemory(Address, Size);
+  
   auto const Access = seec::runtime_errors::format_selects::MemoryAccess::Write;
 
   RuntimeErrorChecker Checker(*this, Index);
@@ -669,14 +701,10 @@ void TraceThreadListener::notifyPreStore(InstrIndexInFn Index,
   Checker.checkMemoryAccess(Address, Size, Access, MaybeArea.get<0>());
 }
 
-void TraceThreadListener::notifyPostStore(InstrIndexInFn Index,
-                                          llvm::StoreInst const *Store,
-                                          void const *Address,
-                                          std::size_t Size) {
-  // Handle common behaviour when entering and exiting notifications.
-  enterNotification();
-  auto OnExit = scopeExit([=](){exitPostNotification();});
-  
+void TraceThreadListener::recordStore(InstrIndexInFn Index,
+                                      llvm::StoreInst const *Store,
+                                      void const *Address,
+                                      std::size_t Size) {
   ++Time;
   EventsOut.write<EventType::Instruction>(Index);
 
@@ -701,6 +729,64 @@ void TraceThreadListener::notifyPostStore(InstrIndexInFn Index,
   }
 }
 
+void TraceThreadListener::notifyPostStore(InstrIndexInFn Index,
+                                          llvm::StoreInst const *Store,
+                                          void const *Address,
+                                          std::size_t Size) {
+  // Handle common behaviour when entering and exiting notifications.
+  enterNotification();
+  auto OnExit = scopeExit([=](){exitPostNotification();});
+  
+  recordStore(Index, Store, Address, Size);
+}
+
+void TraceThreadListener::notifySafeLoad(InstrIndexInFn Index,
+                                         llvm::LoadInst const *Load,
+                                         void const *Data,
+                                         std::size_t Size)
+{
+  // Handle common behaviour when entering and exiting notifications.
+  enterNotification();
+  auto OnExit = scopeExit([=](){exitPostNotification();});
+  ActiveFunction->setActiveInstruction(Load);
+
+  auto const Address = reinterpret_cast<uintptr_t>(Data);
+  GlobalMemoryLock = ProcessListener.lockMemory(Address, Size);
+
+  // The load is within a live object, so the only check that may fail is
+  // the check for uninitialized memory.
+  auto const Access = seec::runtime_errors::format_selects::MemoryAccess::Read;
+
+  RuntimeErrorChecker Checker(*this, Index);
+  Checker.checkMemoryAccess(Address, Size, Access, MemoryArea(Address, Size));
+
+  // No other thread can access this memory, so we can get the pointer's
+  // origin before the load occurs.
+  if (Load->getType()->isPointerTy()) {
+    auto const Origin = ProcessListener.getInMemoryPointerObject(Address);
+    if (Origin)
+      ActiveFunction->setPointerObject(Load, Origin);
+  }
+}
+
+void TraceThreadListener::notifySafeStore(InstrIndexInFn Index,
+                                          llvm::StoreInst const *Store,
+                                          void const *Address,
+                                          std::size_t Size)
+{
+  // Handle common behaviour when entering and exiting notifications.
+  enterNotification();
+  auto OnExit = scopeExit([=](){exitPostNotification();});
+  ActiveFunction->setActiveInstruction(Store);
+
+  // No checks are required, but we must hold the lock while the new state is
+  // recorded (it is released by exitPostNotification()).
+  GlobalMemoryLock =
+    ProcessListener.lockMemory(reinterpret_cast<uintptr_t>(Address), Size);
+
+  recordStore(Index, Store, Address, Size);
+}
+
 template<bool Signed, typename DivisorType>
 void checkIntegerDivisor(TraceThreadListener &Listener,
                          llvm::BinaryOperator const *Instruction,
@@ -1142,6 +1228,98 @@ void TraceThreadListener::notifyValue(InstrIndexInFn Index,
   }
 }
 
+/// \brief Write the event for an inline record's value and set the run-time
+///        value of its instruction.
+///
+template<EventType ET, typename T, typename... ArgTypes>
+static void writeInlineValue(EventWriter &EventsOut,
+                             RuntimeValue &RTValue,
+                             T const Value,
+                             ArgTypes&&... Args)
+{
+  auto const Write = EventsOut.write<ET>(std::forward<ArgTypes>(Args)...);
+
+  // Ensure that RTValues are still valid when tracing is disabled.
+  RTValue.set(Write ? Write->Offset : 0, Value);
+}
+
+void TraceThreadListener::notifyInlineValues(
+  llvm::ArrayRef<SeeCInlineRecord> const Records)
+{
+  // Handle common behaviour when entering and exiting notifications.
+  enterNotification();
+  auto OnExit = scopeExit([=](){exitNotification();});
+
+  auto &Function = *getActiveFunction();
+
+  for (auto const &Record : Records) {
+    auto const Index = InstrIndexInFn{Record.Index};
+    auto &RTValue = *Function.getCurrentRuntimeValue(Index);
+
+    ++Time;
+
+    switch (static_cast<SeeCInlineRecordKind>(Record.Kind)) {
+      case SeeCInlineRecordSetInstruction:
+        llvm_unreachable("SetInstruction records hold no value.");
+        break;
+
+      case SeeCInlineRecordUInt8:
+      {
+        auto const Value = static_cast<uint8_t>(Record.Value);
+        writeInlineValue<EventType::InstructionWithUInt8>
+                        (EventsOut, RTValue, Value, Value, Index);
+        break;
+      }
+
+      case SeeCInlineRecordUInt16:
+      {
+        auto const Value = static_cast<uint16_t>(Record.Value);
+        writeInlineValue<EventType::InstructionWithUInt16>
+                        (EventsOut, RTValue, Value, Value, Index);
+        break;
+      }
+
+      case SeeCInlineRecordUInt32:
+      {
+        auto const Value = static_cast<uint32_t>(Record.Value);
+        writeInlineValue<EventType::InstructionWithUInt32>
+                        (EventsOut, RTValue, Value, Value, Index);
+        break;
+      }
+
+      case SeeCInlineRecordUInt64:
+      {
+        auto const Value = static_cast<uint64_t>(Record.Value);
+        writeInlineValue<EventType::InstructionWithUInt64>
+                        (EventsOut, RTValue, Value, Index, Value);
+        break;
+      }
+
+      case SeeCInlineRecordFloat:
+      {
+        auto const Bits = static_cast<uint32_t>(Record.Value);
+        float Value;
+        static_assert(sizeof(Value) == sizeof(Bits), "unexpected float size");
+        memcpy(&Value, &Bits, sizeof(Value));
+        writeInlineValue<EventType::InstructionWithFloat>
+                        (EventsOut, RTValue, Value, Index, Value);
+        break;
+      }
+
+      case SeeCInlineRecordDouble:
+      {
+        double Value;
+        static_assert(sizeof(Value) == sizeof(Record.Value),
+                      "unexpected double size");
+        memcpy(&Value, &Record.Value, sizeof(Value));
+        writeInlineValue<EventType::InstructionWithDouble>
+                        (EventsOut, RTValue, Value, Index, Value);
+        break;
+      }
+    }
+  }
+}
+
 } // namespace trace (in seec)
 
 } // namespace seec
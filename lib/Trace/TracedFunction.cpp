@@ -45,6 +45,15 @@ void RecordedFunction::setCompletion(EventWriter &Writer,
                                 ThreadTimeEntered,
                                 ThreadTimeExited);
   assert(Rewrite);
+  
+  for (auto &Write : CheckpointWrites) {
+    Writer.rewrite(Write,
+                   Index,
+                   Write.Offset,
+                   EventOffsetEnd,
+                   ThreadTimeEntered,
+                   ThreadTimeExited);
+  }
 }
 
 
@@ -15,18 +15,24 @@
 
 #include "seec/Clang/MDNames.hpp"
 #include "seec/Runtimes/MangleFunction.h"
+#include "seec/Trace/DetectCallsLookup.hpp"
 #include "seec/Transforms/RecordExternal/RecordExternal.hpp"
 #include "seec/Util/Maybe.hpp"
+#include "seec/Util/RecomputedValues.hpp"
 
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/TypeBuilder.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/DataTypes.h"
@@ -95,13 +101,148 @@ createFunctionInterceptorPrototype(llvm::Function *ForFn,
   return dyn_cast<Function>(NewFn);
 }
 
+void
+InsertExternalRecording::insertInlineRecord(SeeCInlineRecordKind const Kind,
+                                            Value *RecordValue,
+                                            Instruction *Before)
+{
+  auto const BufferTy = InlineRecords->getValueType();
+  auto const Zero = ConstantInt::get(Int32Ty, 0);
+
+  // Get the number of records currently in the buffer.
+  Constant *CountIndices[] = { Zero, Zero };
+  auto const CountPtr =
+    ConstantExpr::getInBoundsGetElementPtr(BufferTy, InlineRecords,
+                                           CountIndices);
+  auto const Count = new LoadInst(Int64Ty, CountPtr, "", Before);
+
+  // Write the record's fields into the next free record.
+  auto const WriteField = [&] (unsigned const Field, Value *FieldValue) {
+    Value *Indices[] = {
+      Zero,
+      ConstantInt::get(Int32Ty, 1),
+      Count,
+      ConstantInt::get(Int32Ty, Field)
+    };
+
+    auto const FieldPtr =
+      GetElementPtrInst::CreateInBounds(BufferTy, InlineRecords, Indices, "",
+                                        Before);
+    new StoreInst(FieldValue, FieldPtr, Before);
+  };
+
+  WriteField(0, ConstantInt::get(Int32Ty, Kind));
+  WriteField(1, ConstantInt::get(Int32Ty, InstructionIndex));
+  WriteField(2, RecordValue);
+
+  // Increment the count.
+  auto const NewCount =
+    BinaryOperator::CreateAdd(Count, ConstantInt::get(Int64Ty, 1), "", Before);
+  new StoreInst(NewCount, CountPtr, Before);
+
+  // If the buffer is now full, then ask the runtime to empty it. This is the
+  // only time that the runtime is called, so the branch is rarely taken.
+  auto const IsFull =
+    new ICmpInst(Before, ICmpInst::ICMP_EQ, NewCount,
+                 ConstantInt::get(Int64Ty, SEEC_INLINE_RECORDS_CAPACITY));
+
+  auto const Weights = MDBuilder(Before->getContext())
+                         .createBranchWeights(1,
+                                              SEEC_INLINE_RECORDS_CAPACITY - 1);
+
+  auto const FlushTerm = SplitBlockAndInsertIfThen(IsFull, Before,
+                                                   /* Unreachable */ false,
+                                                   Weights);
+
+  CallInst::Create(RecordFlushInlineRecords, "", FlushTerm);
+}
+
+bool
+InsertExternalRecording::insertInlineRecordUpdateForValue(Instruction &I,
+                                                          Instruction *Before)
+{
+  // Values returned from calls must be checked against intercepted calls by
+  // the runtime, so they are never recorded inline.
+  if (!InlineRecords || isa<CallInst>(I))
+    return false;
+
+  auto const Ty = I.getType();
+  if (!Before)
+    Before = I.getNextNode();
+
+  SeeCInlineRecordKind Kind;
+  Value *RecordValue = &I;
+
+  if (auto const IntTy = dyn_cast<IntegerType>(Ty)) {
+    auto const BitWidth = IntTy->getBitWidth();
+
+    if (BitWidth <= 8)
+      Kind = SeeCInlineRecordUInt8;
+    else if (BitWidth <= 16)
+      Kind = SeeCInlineRecordUInt16;
+    else if (BitWidth <= 32)
+      Kind = SeeCInlineRecordUInt32;
+    else if (BitWidth <= 64)
+      Kind = SeeCInlineRecordUInt64;
+    else
+      return false;
+  }
+  else if (Ty->isFloatTy()) {
+    Kind = SeeCInlineRecordFloat;
+    RecordValue = new BitCastInst(&I, Int32Ty, "", Before);
+  }
+  else if (Ty->isDoubleTy()) {
+    Kind = SeeCInlineRecordDouble;
+    RecordValue = new BitCastInst(&I, Int64Ty, "", Before);
+  }
+  else {
+    // Pointers (and other types) require the runtime's attention.
+    return false;
+  }
+
+  if (RecordValue->getType() != Int64Ty)
+    RecordValue = new ZExtInst(RecordValue, Int64Ty, "", Before);
+
+  insertInlineRecord(Kind, RecordValue, Before);
+  return true;
+}
+
+bool
+InsertExternalRecording::isStaticallySafeAccess(Value const *Pointer,
+                                                uint64_t const Size) const
+{
+  int64_t Offset = 0;
+  auto const Base = GetPointerBaseWithConstantOffset(Pointer, Offset, *DL);
+
+  auto const Alloca = dyn_cast<AllocaInst>(Base);
+  if (!Alloca || !UncapturedAllocas.count(Alloca))
+    return false;
+
+  // The runtime only creates an area for allocas with a non-zero size.
+  auto const Count = dyn_cast<ConstantInt>(Alloca->getArraySize());
+  if (!Count)
+    return false;
+
+  auto const AllocSize = DL->getTypeAllocSize(Alloca->getAllocatedType())
+                       * Count->getZExtValue();
+
+  return Size != 0
+      && Offset >= 0
+      && static_cast<uint64_t>(Offset) <= AllocSize
+      && Size <= AllocSize - static_cast<uint64_t>(Offset);
+}
+
 /// Insert a call to notify SeeC of the new run-time value of I.
 /// \param I the Instruction whose new run-time value is being recorded.
-/// \return The Instruction which calls the notification function.
+/// \return The Instruction which calls the notification function, or nullptr
+///         if no call was required.
 ///
 CallInst *
 InsertExternalRecording::insertRecordUpdateForValue(Instruction &I,
                                                     Instruction *Before) {
+  if (insertInlineRecordUpdateForValue(I, Before))
+    return nullptr;
+
   LLVMContext &Context = I.getContext();
   Type const *Ty = I.getType();
 
@@ -353,6 +494,11 @@ bool InsertExternalRecording::doInitialization(Module &M) {
   // Index the module (prior to adding any functions)
   ModIndex.reset(new seec::ModuleIndex(M));
   
+  // Mark minimal recording in the stored bitcode, so that the trace reader
+  // knows which values it must recompute.
+  if (MinimalRecording)
+    seec::setMinimalRecording(M);
+  
   // Get bitcode for the uninstrumented Module.
   std::string const ModuleBitcode = GetModuleBitcode(M);
 
@@ -408,6 +554,30 @@ bool InsertExternalRecording::doInitialization(Module &M) {
       TypeBuilder<LLVM_FUNCTION_TYPE, true>::get(Context)));
 #include "seec/Transforms/RecordExternal/RecordPoints.def"
 
+  // Add a declaration for the inline record buffer, which is defined by the
+  // runtime. The runtime library's thread-local storage can't be accessed
+  // directly on Windows, so inline recording isn't used there.
+  InlineRecords = nullptr;
+
+  if (InlineRecording && !Triple(M.getTargetTriple()).isOSWindows()) {
+    auto const RecordTy = StructType::get(Context,
+                                          {Int32Ty, Int32Ty, Int64Ty});
+
+    auto const BufferTy =
+      StructType::get(Context,
+                      {Int64Ty,
+                       ArrayType::get(RecordTy,
+                                      SEEC_INLINE_RECORDS_CAPACITY)});
+
+    if (auto Existing = M.getNamedGlobal("SeeCInlineRecords"))
+      Existing->eraseFromParent();
+
+    InlineRecords =
+      new GlobalVariable(M, BufferTy, false, GlobalValue::ExternalLinkage,
+                         nullptr, "SeeCInlineRecords", nullptr,
+                         GlobalValue::GeneralDynamicTLSModel);
+  }
+
   // Perform SeeC's function interception.
   for (auto &F : M) {
     // If the function is defined by the user's program, and they haven't
@@ -470,6 +640,20 @@ bool InsertExternalRecording::runOnFunction(Function &F) {
   for (auto It = inst_begin(F), End = inst_end(F); It != End; ++It)
     FunctionInstructions.push_back(&*It);
 
+  // Find the Instructions whose values will be recomputed during replay.
+  // This must use the uninstrumented Function, as the trace reader does.
+  if (MinimalRecording)
+    RecomputedInstructions = seec::getRecomputedInstructions(F);
+
+  // Find allocas whose addresses are not captured. This must be done before
+  // instrumenting, because the instrumentation passes addresses to the
+  // runtime.
+  for (auto const Instr : FunctionInstructions)
+    if (auto const Alloca = dyn_cast<AllocaInst>(Instr))
+      if (!PointerMayBeCaptured(Alloca, /* ReturnCaptures */ true,
+                                        /* StoreCaptures */ true))
+        UncapturedAllocas.insert(Alloca);
+
   // Insert function entry notifications.
   auto const FirstIn = FunctionInstructions.front();
 
@@ -559,18 +743,27 @@ bool InsertExternalRecording::runOnFunction(Function &F) {
   // Visit each original instruction for instrumentation
   InstructionIndex = 0;
   for (auto const Instr : FunctionInstructions) {
-    visit(Instr);
+    // Recomputed Instructions are pure, so their only instrumentation would
+    // be the update of their value.
+    if (RecomputedInstructions.empty()
+        || !RecomputedInstructions[InstructionIndex])
+      visit(Instr);
     ++InstructionIndex;
   }
 
   // Clear FunctionInstructions so that it's ready for the next Function
   FunctionInstructions.clear();
+  RecomputedInstructions.clear();
+  UncapturedAllocas.clear();
 
   return true;
 }
 
 void InsertExternalRecording::getAnalysisUsage(AnalysisUsage &AU) const {
-  AU.setPreservesCFG();
+  // Inline records split BasicBlocks to call the runtime when the buffer is
+  // full.
+  if (!InlineRecording)
+    AU.setPreservesCFG();
 }
 
 void InsertExternalRecording::visitBinaryOperator(BinaryOperator &I) {
@@ -639,6 +832,8 @@ void InsertExternalRecording::visitAllocaInst(AllocaInst &I) {
 /// Insert a call to a tracing function prior to a load instruction.
 /// \param LI a reference to the load instruction.
 void InsertExternalRecording::visitLoadInst(LoadInst &LI) {
+  auto const Size = DL->getTypeStoreSize(LI.getType());
+
   // Create an array with the arguments
   Value *Args[] = {
     // The index of LI in this function's instruction list
@@ -648,9 +843,19 @@ void InsertExternalRecording::visitLoadInst(LoadInst &LI) {
     CastInst::CreatePointerCast(LI.getPointerOperand(), Int8PtrTy, "", &LI),
 
     // The size of the store, as an i64
-    ConstantInt::get(Int64Ty, DL->getTypeStoreSize(LI.getType()), false)
+    ConstantInt::get(Int64Ty, Size, false)
   };
 
+  // Statically safe loads only need to check initialization (the runtime
+  // checks the members of struct types individually, so those are excluded).
+  if (!LI.getType()->isStructTy()
+      && isStaticallySafeAccess(LI.getPointerOperand(), Size))
+  {
+    CallInst::Create(RecordSafeLoad, Args, "", &LI);
+    insertRecordUpdateForValue(LI);
+    return;
+  }
+
   // Create the call to the recording function, prior to the load instruction
   CallInst::Create(RecordPreLoad, Args, "", &LI);
 
@@ -681,6 +886,16 @@ void InsertExternalRecording::visitStoreInst(StoreInst &SI) {
     ConstantInt::get(Int64Ty, DL->getTypeStoreSize(StoreValue->getType()))
   };
 
+  // Statically safe stores only need to be recorded.
+  if (isStaticallySafeAccess(SI.getPointerOperand(),
+                             DL->getTypeStoreSize(StoreValue->getType())))
+  {
+    CallInst *Call = CallInst::Create(RecordSafeStore, Args);
+    assert(Call && "Couldn't create call instruction.");
+    Call->insertAfter(&SI);
+    return;
+  }
+
   // Create the call to the recording function prior to the store
   CallInst::Create(RecordPreStore, Args, "", &SI);
 
@@ -703,6 +918,23 @@ void InsertExternalRecording::visitPHINode(PHINode &I) {
   insertRecordUpdateForValue(I, &*it);
 }
 
+/// \brief Get the ID of a function known to the runtime's call detection.
+/// \return the ID as an i32 constant, or nullptr if Fn is null or unknown.
+///
+ConstantInt *
+InsertExternalRecording::getDetectedCall(Function const *Fn) const {
+  if (!Fn)
+    return nullptr;
+
+  auto const MaybeCall =
+    seec::trace::detect_calls::getCallForName(Fn->getName());
+  if (!MaybeCall.assigned())
+    return nullptr;
+
+  auto const ID = static_cast<uint32_t>(MaybeCall.get<0>());
+  return cast<ConstantInt>(ConstantInt::get(Int32Ty, ID));
+}
+
 /// Insert calls to tracing functions to handle a call instruction. There are
 /// three tracing functions: pre-call, post-call, and the generic update for
 /// the return value, if it is valid.
@@ -727,8 +959,15 @@ void InsertExternalRecording::visitCallInst(CallInst &CI) {
   }
 
   if (IsIntercepted) {
-    Value *Args[] = {ConstantInt::get(Int32Ty, InstructionIndex)};
-    CallInst::Create(RecordSetInstruction, Args, "", &CI);
+    if (InlineRecords) {
+      insertInlineRecord(SeeCInlineRecordSetInstruction,
+                         ConstantInt::get(Int64Ty, 0),
+                         &CI);
+    }
+    else {
+      Value *Args[] = {ConstantInt::get(Int32Ty, InstructionIndex)};
+      CallInst::Create(RecordSetInstruction, Args, "", &CI);
+    }
     return;
   }
 
@@ -767,6 +1006,19 @@ void InsertExternalRecording::visitCallInst(CallInst &CI) {
     assert(PostCall && "Couldn't create call instruction.");
     PostCall->insertAfter(&CI);
   }
+  else if (auto const Callee = getDetectedCall(CalledFunction)) {
+    // The runtime can dispatch on the callee's ID, rather than looking up
+    // the called address.
+    Value *Args[] = { IndexConstant, Callee };
+
+    // Call pre-call function
+    CallInst::Create(RecordPreCallDetected, Args, "", &CI);
+
+    // Call post-call function
+    CallInst *PostCall = CallInst::Create(RecordPostCallDetected, Args);
+    assert(PostCall && "Couldn't create call instruction.");
+    PostCall->insertAfter(&CI);
+  }
   else {
     Value *Args[] = {
       IndexConstant,
@@ -0,0 +1,241 @@
+//===- lib/Util/RecomputedValues.cpp --------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Util/RecomputedValues.hpp"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+
+namespace seec {
+
+namespace {
+
+/// Name of the NamedMDNode that marks a Module as using minimal recording.
+char const * const MDMinimalRecordingStr = "seec.recording.minimal";
+
+/// \brief Check if values of type Ty can be recomputed.
+///
+bool isEvaluableType(llvm::Type const *Ty)
+{
+  if (auto const IntTy = llvm::dyn_cast<llvm::IntegerType>(Ty))
+    return IntTy->getBitWidth() <= 64;
+
+  return Ty->isFloatTy() || Ty->isDoubleTy();
+}
+
+/// \brief Check if the trace holds the values of I whenever it is recorded.
+///
+bool isRecordedKind(llvm::Instruction const &I)
+{
+  auto const Ty = I.getType();
+  if (!isEvaluableType(Ty) && !Ty->isPointerTy())
+    return false;
+
+  return llvm::isa<llvm::LoadInst>(I)
+      || llvm::isa<llvm::PHINode>(I)
+      || llvm::isa<llvm::AllocaInst>(I)
+      || llvm::isa<llvm::GetElementPtrInst>(I)
+      || llvm::isa<llvm::BinaryOperator>(I)
+      || llvm::isa<llvm::CmpInst>(I)
+      || llvm::isa<llvm::CastInst>(I)
+      || llvm::isa<llvm::SelectInst>(I);
+}
+
+/// \brief Check if the tracing runtime reads the operands of a division.
+///
+bool isDivision(llvm::BinaryOperator const &I)
+{
+  switch (I.getOpcode()) {
+    case llvm::Instruction::UDiv: // Fall-through intentional.
+    case llvm::Instruction::SDiv: // Fall-through intentional.
+    case llvm::Instruction::FDiv: // Fall-through intentional.
+    case llvm::Instruction::URem: // Fall-through intentional.
+    case llvm::Instruction::SRem: // Fall-through intentional.
+    case llvm::Instruction::FRem:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/// \brief Check if I's value could be computed from its operands' values.
+///
+bool isRecomputableKind(llvm::Instruction const &I)
+{
+  if (!isEvaluableType(I.getType()))
+    return false;
+
+  if (auto const BO = llvm::dyn_cast<llvm::BinaryOperator>(&I)) {
+    switch (BO->getOpcode()) {
+      case llvm::Instruction::Add:  // Fall-through intentional.
+      case llvm::Instruction::Sub:  // Fall-through intentional.
+      case llvm::Instruction::Mul:  // Fall-through intentional.
+      case llvm::Instruction::And:  // Fall-through intentional.
+      case llvm::Instruction::Or:   // Fall-through intentional.
+      case llvm::Instruction::Xor:  // Fall-through intentional.
+      case llvm::Instruction::FAdd: // Fall-through intentional.
+      case llvm::Instruction::FSub: // Fall-through intentional.
+      case llvm::Instruction::FMul:
+        return true;
+
+      // Shifts by at least the bit width give target-specific results, so
+      // only shifts by a valid constant amount are recomputed.
+      case llvm::Instruction::Shl:  // Fall-through intentional.
+      case llvm::Instruction::LShr: // Fall-through intentional.
+      case llvm::Instruction::AShr:
+      {
+        auto const Amount =
+          llvm::dyn_cast<llvm::ConstantInt>(BO->getOperand(1));
+        return Amount
+            && Amount->getValue().ult(I.getType()->getIntegerBitWidth());
+      }
+
+      default:
+        return false;
+    }
+  }
+  else if (auto const Cmp = llvm::dyn_cast<llvm::CmpInst>(&I)) {
+    auto const OpTy = Cmp->getOperand(0)->getType();
+    return isEvaluableType(OpTy) || OpTy->isPointerTy();
+  }
+  else if (auto const Cast = llvm::dyn_cast<llvm::CastInst>(&I)) {
+    auto const SrcTy = Cast->getSrcTy();
+
+    switch (Cast->getOpcode()) {
+      case llvm::Instruction::Trunc:   // Fall-through intentional.
+      case llvm::Instruction::ZExt:    // Fall-through intentional.
+      case llvm::Instruction::SExt:    // Fall-through intentional.
+      case llvm::Instruction::FPTrunc: // Fall-through intentional.
+      case llvm::Instruction::FPExt:   // Fall-through intentional.
+      case llvm::Instruction::FPToUI:  // Fall-through intentional.
+      case llvm::Instruction::FPToSI:  // Fall-through intentional.
+      case llvm::Instruction::UIToFP:  // Fall-through intentional.
+      case llvm::Instruction::SIToFP:  // Fall-through intentional.
+      case llvm::Instruction::BitCast:
+        return isEvaluableType(SrcTy);
+      case llvm::Instruction::PtrToInt:
+        return SrcTy->isPointerTy();
+      default:
+        return false;
+    }
+  }
+  else if (auto const Select = llvm::dyn_cast<llvm::SelectInst>(&I)) {
+    return Select->getCondition()->getType()->isIntegerTy(1);
+  }
+
+  return false;
+}
+
+/// \brief Check if all of I's operands will have known values during replay.
+///
+bool hasKnownOperands(llvm::Instruction const &I)
+{
+  for (auto const &Op : I.operands()) {
+    auto const V = Op.get();
+
+    if (llvm::isa<llvm::ConstantInt>(V)
+        || llvm::isa<llvm::ConstantFP>(V)
+        || llvm::isa<llvm::ConstantPointerNull>(V))
+      continue;
+
+    // Other BasicBlocks may have been re-executed (or cleared) since I was
+    // executed, so only values from I's execution of its BasicBlock are used.
+    auto const OpI = llvm::dyn_cast<llvm::Instruction>(V);
+    if (!OpI || OpI->getParent() != I.getParent() || !isRecordedKind(*OpI))
+      return false;
+  }
+
+  return true;
+}
+
+/// \brief Check if the tracing runtime never reads I's value.
+///
+bool hasOnlyUntracedUses(llvm::Instruction const &I)
+{
+  for (auto const User : I.users()) {
+    if (auto const BO = llvm::dyn_cast<llvm::BinaryOperator>(User)) {
+      if (isDivision(*BO))
+        return false;
+    }
+    else if (!llvm::isa<llvm::CmpInst>(User)
+             && !llvm::isa<llvm::CastInst>(User)
+             && !llvm::isa<llvm::SelectInst>(User)
+             && !llvm::isa<llvm::PHINode>(User)
+             && !llvm::isa<llvm::GetElementPtrInst>(User)
+             && !llvm::isa<llvm::BranchInst>(User)
+             && !llvm::isa<llvm::SwitchInst>(User))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // anonymous namespace
+
+bool hasMinimalRecording(llvm::Module const &M)
+{
+  return M.getNamedMetadata(MDMinimalRecordingStr) != nullptr;
+}
+
+void setMinimalRecording(llvm::Module &M)
+{
+  auto const MD = M.getOrInsertNamedMetadata(MDMinimalRecordingStr);
+  if (MD->getNumOperands() == 0) {
+    auto &Context = M.getContext();
+    MD->addOperand(llvm::MDNode::get(Context,
+                                     llvm::MDString::get(Context, "minimal")));
+  }
+}
+
+std::vector<bool> getRecomputedInstructions(llvm::Function const &F)
+{
+  std::vector<bool> Recomputed;
+
+  for (auto const &BB : F)
+    for (auto const &I : BB)
+      Recomputed.push_back(isRecomputableKind(I)
+                           && hasKnownOperands(I)
+                           && hasOnlyUntracedUses(I));
+
+  // Replay only reaches a BasicBlock's Instructions through its events, so
+  // any Instruction that is not followed by an event in its BasicBlock must
+  // be recorded. Recording it provides an event for those preceding it.
+  std::size_t End = 0;
+
+  for (auto const &BB : F) {
+    End += BB.size();
+
+    auto Index = End;
+    bool FollowedByEvent = false;
+
+    for (auto It = BB.rbegin(), RE = BB.rend(); It != RE; ++It) {
+      --Index;
+
+      if (Recomputed[Index] && !FollowedByEvent)
+        Recomputed[Index] = false;
+
+      if (!Recomputed[Index]
+          && (isRecordedKind(*It) || llvm::isa<llvm::StoreInst>(*It)))
+        FollowedByEvent = true;
+    }
+  }
+
+  return Recomputed;
+}
+
+} // namespace seec
@@ -0,0 +1,78 @@
+//===- lib/Util/WorkerPool.cpp --------------------------------------------===//
+//
+//                                    SeeC
+//
+// This file is distributed under The MIT License (MIT). See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+///
+//===----------------------------------------------------------------------===//
+
+#include "seec/Util/WorkerPool.hpp"
+
+namespace seec {
+
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> Lock(Access);
+    Stopping = true;
+  }
+  
+  WorkAvailable.notify_all();
+  
+  for (auto &Worker : Workers)
+    Worker.join();
+}
+
+void WorkerPool::workerMain()
+{
+  std::unique_lock<std::mutex> Lock(Access);
+  
+  while (true) {
+    WorkAvailable.wait(Lock, [this] () {
+                               return Stopping || NextTask < Tasks.size();
+                             });
+    
+    if (Stopping)
+      return;
+    
+    auto &Task = Tasks[NextTask++];
+    
+    Lock.unlock();
+    Task();
+    Lock.lock();
+    
+    if (--RemainingTasks == 0)
+      WorkComplete.notify_all();
+  }
+}
+
+void WorkerPool::run(std::vector<std::function<void ()>> Batch)
+{
+  if (Batch.empty())
+    return;
+  
+  std::unique_lock<std::mutex> Lock(Access);
+  
+  // Ensure that every task can run at the same time.
+  while (Workers.size() < Batch.size())
+    Workers.emplace_back([this] () { workerMain(); });
+  
+  Tasks = std::move(Batch);
+  NextTask = 0;
+  RemainingTasks = Tasks.size();
+  
+  WorkAvailable.notify_all();
+  WorkComplete.wait(Lock, [this] () { return RemainingTasks == 0; });
+  
+  Tasks.clear();
+  NextTask = 0;
+}
+
+
+} // namespace seec
@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Usage: benchmark_open.sh <seec-print> [VAR=value ...] <program> [args ...]
+#
+# Runs an instrumented program with the given environment, then reports the
+# wall-clock time taken to open the resulting trace (reading the trace file and
+# indexing every thread's event blocks).
+
+printer=$1
+shift
+
+until [ -z "$1" ]
+do
+  if echo "$1" | grep -q "="
+  then
+    variable=${1%%=*} # extract name
+    value=${1##*=}    # extract value
+    export $variable=$value
+    shift
+  else
+    break
+  fi
+done
+
+program=$1
+shift
+
+if [ -z "$SEEC_TRACE_NAME" ]; then
+  echo "SEEC_TRACE_NAME must be set."
+  exit 1
+fi
+
+rm -f "$SEEC_TRACE_NAME" || true
+
+"$program" $* 1>/dev/null
+status=$?
+
+if [ $status -ne 0 ]; then
+  exit $status
+fi
+
+# With no other options the printer opens the trace and then exits.
+start=$(date +%s%N)
+"$printer" "$SEEC_TRACE_NAME" 1>/dev/null
+status=$?
+end=$(date +%s%N)
+
+if [ $status -ne 0 ]; then
+  exit $status
+fi
+
+elapsed_ns=$((end - start))
+size=$(wc -c < "$SEEC_TRACE_NAME")
+
+echo "program:     $(basename "$program") $*"
+echo "open (ms):   $((elapsed_ns / 1000000))"
+echo "trace bytes: $size"
+
+if [ $elapsed_ns -gt 0 ]; then
+  echo "MiB/s:       $((size * 1000000000 / elapsed_ns / 1048576))"
+fi
@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Usage: benchmark_stepping.sh <seec-print> [VAR=value ...] <program> [args ...]
+#
+# Runs an instrumented program with the given environment, then steps through
+# every process time in the resulting trace, forwards and then backwards, and
+# reports the wall-clock time taken per step.
+
+printer=$1
+shift
+
+until [ -z "$1" ]
+do
+  if echo "$1" | grep -q "="
+  then
+    variable=${1%%=*} # extract name
+    value=${1##*=}    # extract value
+    export $variable=$value
+    shift
+  else
+    break
+  fi
+done
+
+program=$1
+shift
+
+if [ -z "$SEEC_TRACE_NAME" ]; then
+  echo "SEEC_TRACE_NAME must be set."
+  exit 1
+fi
+
+rm -f "$SEEC_TRACE_NAME" || true
+
+"$program" $* 1>/dev/null
+status=$?
+
+if [ $status -ne 0 ]; then
+  exit $status
+fi
+
+start=$(date +%s%N)
+steps=$("$printer" -S -reverse -quiet "$SEEC_TRACE_NAME" | awk '/^steps:/ { print $2 }')
+end=$(date +%s%N)
+
+if [ -z "$steps" ]; then
+  exit 1
+fi
+
+elapsed_ns=$((end - start))
+
+echo "program:     $(basename "$program") $*"
+echo "time (ms):   $((elapsed_ns / 1000000))"
+echo "steps:       $steps"
+
+if [ $steps -gt 0 ]; then
+  echo "ns/step:     $((elapsed_ns / steps))"
+fi
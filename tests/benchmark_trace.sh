@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Usage: benchmark_trace.sh <seec-print> [VAR=value ...] <program> [args ...]
+#
+# Runs an instrumented program with the given environment, then reports the
+# wall-clock time taken, the number of events recorded in the trace, and the
+# number of events recorded per second.
+
+printer=$1
+shift
+
+until [ -z "$1" ]
+do
+  if echo "$1" | grep -q "="
+  then
+    variable=${1%%=*} # extract name
+    value=${1##*=}    # extract value
+    export $variable=$value
+    shift
+  else
+    break
+  fi
+done
+
+program=$1
+shift
+
+if [ -z "$SEEC_TRACE_NAME" ]; then
+  echo "SEEC_TRACE_NAME must be set."
+  exit 1
+fi
+
+rm -f "$SEEC_TRACE_NAME" || true
+
+start=$(date +%s%N)
+"$program" $* 1>/dev/null
+status=$?
+end=$(date +%s%N)
+
+if [ $status -ne 0 ]; then
+  exit $status
+fi
+
+elapsed_ns=$((end - start))
+events=$("$printer" -counts "$SEEC_TRACE_NAME" | awk 'NR > 1 { s += $3 } END { print s + 0 }')
+size=$(wc -c < "$SEEC_TRACE_NAME")
+
+echo "program:     $(basename "$program") $*"
+echo "time (ms):   $((elapsed_ns / 1000000))"
+echo "events:      $events"
+echo "trace bytes: $size"
+
+if [ $elapsed_ns -gt 0 ]; then
+  echo "events/s:    $((events * 1000000000 / elapsed_ns))"
+fi
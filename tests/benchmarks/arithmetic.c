@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* An arithmetic-heavy loop, so that most trace events are value updates.
+   Used to compare calling the runtime for each update against inline
+   recording (SEEC_INLINE_RECORDING) and minimal recording
+   (SEEC_MINIMAL_RECORDING). */
+
+int main(int argc, char *argv[])
+{
+  long iterations = 100000;
+  if (argc > 1)
+    iterations = atol(argv[1]);
+
+  unsigned long hash = 5381;
+  double mean = 0.0;
+
+  for (long i = 0; i < iterations; ++i) {
+    hash = (hash * 33) ^ (unsigned long)i;
+    mean += ((double)(hash % 1000) - mean) / (double)(i + 1);
+  }
+
+  printf("%lu %f\n", hash, mean);
+  return 0;
+}
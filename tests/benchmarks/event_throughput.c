@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Generates a large number of small trace events (value updates, loads and
+   stores) with very little other work, so that the cost of writing events
+   dominates. */
+
+int main(int argc, char *argv[])
+{
+  long iterations = 100000;
+  if (argc > 1)
+    iterations = atol(argv[1]);
+
+  int values[64] = {0};
+  long sum = 0;
+
+  for (long i = 0; i < iterations; ++i) {
+    int const slot = i % 64;
+    values[slot] = values[slot] * 3 + (int)i;
+    sum += values[slot];
+  }
+
+  printf("%ld\n", sum);
+  return 0;
+}
@@ -0,0 +1,28 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A loop that is dominated by direct calls to standard library functions
+   that the runtime detects (from <ctype.h> and <string.h>), to measure the
+   overhead of detecting each call. */
+
+int main(int argc, char *argv[])
+{
+  long iterations = 100000;
+  if (argc > 1)
+    iterations = atol(argv[1]);
+
+  char text[] = "The quick brown fox jumps over the lazy dog";
+  unsigned long count = 0;
+
+  for (long i = 0; i < iterations; ++i) {
+    char *c = text + (i % (long)strlen(text));
+    *c = (char)toupper((unsigned char)*c);
+    count += memchr(text, 'Z', sizeof(text)) != NULL;
+    *c = (char)tolower((unsigned char)*c);
+  }
+
+  printf("%lu %s\n", count, text);
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Each thread performs a small number of stores to its own array, so that the
+   trace has many short steps. Replaying the trace one step at a time measures
+   the fixed cost of each step, rather than the cost of the events in it. The
+   main thread does the work of the first worker, so that a single worker
+   produces a single-threaded trace. */
+
+#define ITERATIONS 2000
+#define MAX_THREADS 8
+#define SLOTS 64
+
+struct worker {
+  int values[SLOTS];
+};
+
+static struct worker workers[MAX_THREADS];
+
+static void *work(void *arg)
+{
+  struct worker *w = arg;
+
+  for (int i = 0; i < ITERATIONS; ++i)
+    w->values[i % SLOTS] += i;
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  int threads = 1;
+  if (argc > 1)
+    threads = atoi(argv[1]);
+  if (threads < 1 || threads > MAX_THREADS)
+    return EXIT_FAILURE;
+
+  pthread_t ids[MAX_THREADS];
+
+  for (int i = 1; i < threads; ++i)
+    if (pthread_create(&ids[i], NULL, work, &workers[i]))
+      return EXIT_FAILURE;
+
+  work(&workers[0]);
+
+  for (int i = 1; i < threads; ++i)
+    pthread_join(ids[i], NULL);
+
+  printf("%d\n", workers[0].values[0]);
+  return 0;
+}
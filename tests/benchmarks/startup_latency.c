@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Does almost nothing, so that the cost of starting the tracer dominates. The
+   program contains many functions that are only called when requested, which
+   models a large program whose test runs only exercise a small part of it. */
+
+#define UNUSED_FUNCTION(N)                                                     \
+  static long unused_##N(long x)                                               \
+  {                                                                            \
+    long values[8] = {0};                                                      \
+    for (long i = 0; i < x; ++i)                                               \
+      values[i % 8] += i * N;                                                  \
+    return values[0] + values[7];                                              \
+  }
+
+#define UNUSED_FUNCTIONS_8(N)                                                  \
+  UNUSED_FUNCTION(N##0) UNUSED_FUNCTION(N##1) UNUSED_FUNCTION(N##2)            \
+  UNUSED_FUNCTION(N##3) UNUSED_FUNCTION(N##4) UNUSED_FUNCTION(N##5)            \
+  UNUSED_FUNCTION(N##6) UNUSED_FUNCTION(N##7)
+
+UNUSED_FUNCTIONS_8(1)
+UNUSED_FUNCTIONS_8(2)
+UNUSED_FUNCTIONS_8(3)
+UNUSED_FUNCTIONS_8(4)
+UNUSED_FUNCTIONS_8(5)
+UNUSED_FUNCTIONS_8(6)
+UNUSED_FUNCTIONS_8(7)
+UNUSED_FUNCTIONS_8(8)
+
+#define CALL_8(N)                                                              \
+  unused_##N##0, unused_##N##1, unused_##N##2, unused_##N##3,                  \
+  unused_##N##4, unused_##N##5, unused_##N##6, unused_##N##7
+
+static long (* const functions[])(long) = {
+  CALL_8(1), CALL_8(2), CALL_8(3), CALL_8(4),
+  CALL_8(5), CALL_8(6), CALL_8(7), CALL_8(8)
+};
+
+int main(int argc, char *argv[])
+{
+  /* Optionally call the first "count" functions. */
+  long count = 0;
+  if (argc > 1)
+    count = atol(argv[1]);
+  
+  long const available = sizeof(functions) / sizeof(functions[0]);
+  if (count > available)
+    count = available;
+  
+  long sum = 0;
+  for (long i = 0; i < count; ++i)
+    sum += functions[i](16);
+  
+  printf("%ld\n", sum);
+  return 0;
+}
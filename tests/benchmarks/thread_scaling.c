@@ -0,0 +1,57 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Each thread performs the same number of loads and stores to its own array,
+   so that with ideal scaling the run time does not depend on the number of
+   threads. The arrays are page-sized and page-aligned, so that threads do not
+   share the memory they access. */
+
+#define ITERATIONS 200000
+#define MAX_THREADS 16
+#define SLOTS 1024
+
+struct worker {
+  int values[SLOTS];
+  long sum;
+} __attribute__((aligned(4096)));
+
+static struct worker workers[MAX_THREADS];
+
+static void *work(void *arg)
+{
+  struct worker *w = arg;
+
+  for (long i = 0; i < ITERATIONS; ++i) {
+    int const slot = i % SLOTS;
+    w->values[slot] = w->values[slot] * 3 + (int)i;
+    w->sum += w->values[slot];
+  }
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  int threads = 1;
+  if (argc > 1)
+    threads = atoi(argv[1]);
+  if (threads < 1 || threads > MAX_THREADS)
+    return EXIT_FAILURE;
+
+  pthread_t ids[MAX_THREADS];
+
+  for (int i = 0; i < threads; ++i)
+    if (pthread_create(&ids[i], NULL, work, &workers[i]))
+      return EXIT_FAILURE;
+
+  long sum = 0;
+
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(ids[i], NULL);
+    sum += workers[i].sum;
+  }
+
+  printf("%ld\n", sum);
+  return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# Usage: print_compare_traces.sh <seec-print> <trace> <trace>
+#
+# Prints the recreated states of two traces of the same program, and fails if
+# they differ.
+
+printer=$1
+first=$2
+second=$3
+
+"$printer" -S -comparable -reverse "$first" > "$first.states" || exit 1
+"$printer" -S -comparable -reverse "$second" > "$second.states" || exit 1
+
+if ! cmp -s "$first.states" "$second.states"
+then
+  diff "$first.states" "$second.states"
+  exit 1
+fi
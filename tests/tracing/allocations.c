@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Makes allocations of each kind that the allocation lifetime table records:
+   chains of reallocs (growing in place and moving), frees followed by mallocs
+   that may reuse the same address, allocas in repeated calls and variable
+   length arrays, and structures passed by value. */
+
+struct pair {
+  long values[6];
+  char name[12];
+};
+
+static long by_value(struct pair p, int n)
+{
+  long local[4];
+  for (int i = 0; i < 4; ++i)
+    local[i] = p.values[i] + n;
+  return local[n % 4] + p.name[n % 12];
+}
+
+static long scratch(int n)
+{
+  long total = 0;
+  for (int j = 1; j <= n; ++j) {
+    char vla[j * 3];
+    memset(vla, j, sizeof(vla));
+    total += vla[j];
+  }
+  return total;
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = 3;
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  long total = 0;
+  char *chain = malloc(8);
+  if (!chain)
+    exit(EXIT_FAILURE);
+
+  for (int i = 0; i < iterations; ++i) {
+    for (size_t size = 16; size <= 256; size *= 4) {
+      char *grown = realloc(chain, size + i);
+      if (!grown)
+        exit(EXIT_FAILURE);
+      chain = grown;
+      chain[size - 1] = (char)i;
+    }
+
+    char *shrunk = realloc(chain, 8);
+    if (shrunk)
+      chain = shrunk;
+
+    char *first = malloc(40);
+    if (!first)
+      exit(EXIT_FAILURE);
+    memset(first, 'f', 40);
+    free(first);
+
+    char *second = malloc(40);
+    if (!second)
+      exit(EXIT_FAILURE);
+    memset(second, 's', 20);
+    total += second[10];
+    free(second);
+
+    struct pair p = { { i, i + 1, i + 2, i + 3, i + 4, i + 5 }, "allocation" };
+    total += by_value(p, i) + scratch(i + 2);
+  }
+
+  free(chain);
+  printf("%ld\n", total);
+  return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Copies and clears areas that span several memory pages, starting and ending
+   part way through a page, so that stepping backward must restore the
+   previous contents of whole and partial pages. */
+
+enum { PAGE = 4096, SIZE = 3 * PAGE + 123 };
+
+static char stack_copy(char const *source)
+{
+  char local[2 * PAGE + 7];
+  memcpy(local, source + 5, sizeof(local));
+  memset(local + 100, 'z', PAGE + 1);
+  return local[PAGE + 50];
+}
+
+int main(int argc, char *argv[])
+{
+  long iterations = 3;
+  if (argc > 1)
+    iterations = atol(argv[1]);
+
+  char *a = malloc(SIZE);
+  char *b = malloc(SIZE);
+  if (!a || !b)
+    exit(EXIT_FAILURE);
+
+  memset(a, 'a', SIZE);
+  long total = 0;
+
+  for (long i = 0; i < iterations; ++i) {
+    memset(b + 17, (int)('b' + i), SIZE - 17);
+    memcpy(b, a + 1, PAGE + 300);
+    memmove(a + 9, a, 2 * PAGE);
+    memcpy(a, b, SIZE);
+    total += stack_copy(b) + a[PAGE * 3];
+  }
+
+  printf("%ld\n", total);
+  free(b);
+  free(a);
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Generates enough events to fill several thread event blocks. Functions are
+   entered in one block and left in a later one, and dynamic memory and
+   streams are used throughout. */
+
+struct node {
+  struct node *next;
+  long value;
+};
+
+static struct node *push(struct node *list, long value)
+{
+  struct node *n = malloc(sizeof(*n));
+  if (!n)
+    exit(EXIT_FAILURE);
+  n->next = list;
+  n->value = value;
+  return n;
+}
+
+static long sum_and_free(struct node *list)
+{
+  long sum = 0;
+  while (list) {
+    struct node *next = list->next;
+    sum += list->value;
+    free(list);
+    list = next;
+  }
+  return sum;
+}
+
+int main(int argc, char *argv[])
+{
+  long iterations = 1000;
+  if (argc > 1)
+    iterations = atol(argv[1]);
+
+  char buffer[32];
+  struct node *list = NULL;
+  long total = 0;
+
+  for (long i = 0; i < iterations; ++i) {
+    list = push(list, i * 3 + 1);
+
+    if (i % 100 == 99) {
+      total += sum_and_free(list);
+      list = NULL;
+      snprintf(buffer, sizeof(buffer), "%ld", total);
+      printf("%s\n", buffer);
+    }
+  }
+
+  total += sum_and_free(list);
+  printf("%ld\n", total);
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Changes memory through stores, frees, reallocs (which may move or resize an
+   allocation in place) and variable length arrays (whose stack space is
+   released by stack restores), so that the memory change index is checked
+   against each kind of change. */
+
+static int fill(int n, int seed)
+{
+  int vla[n];
+  for (int i = 0; i < n; ++i)
+    vla[i] = seed + i;
+  return vla[n / 2];
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = 4;
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  int total = 0;
+  int *values = malloc(4 * sizeof(int));
+  if (!values)
+    exit(EXIT_FAILURE);
+  memset(values, 0, 4 * sizeof(int));
+
+  for (int i = 0; i < iterations; ++i) {
+    int n = 4 * (i + 2);
+
+    int *grown = realloc(values, n * sizeof(int));
+    if (!grown)
+      exit(EXIT_FAILURE);
+    values = grown;
+    values[n - 1] = i;
+
+    char *scratch = malloc(32);
+    if (!scratch)
+      exit(EXIT_FAILURE);
+    scratch[i] = 'a' + i;
+    total += scratch[i];
+    free(scratch);
+
+    for (int j = 1; j <= 3; ++j) {
+      int vla[j + i];
+      vla[0] = j;
+      total += vla[0] + fill(j + 2, i);
+    }
+  }
+
+  values = realloc(values, 2 * sizeof(int));
+  if (!values)
+    exit(EXIT_FAILURE);
+  values[1] = total;
+
+  printf("%d\n", values[1]);
+  free(values);
+  return 0;
+}
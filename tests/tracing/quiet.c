@@ -0,0 +1,85 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The main thread sets up some state and then waits for a busy worker, which
+   generates enough events to drop segments from a small flight-recorder ring.
+   Only the worker's ring wraps, so the main thread's events are all retained,
+   including those made before the worker's oldest retained checkpoint. They
+   must recreate the main thread's stack without replaying their effects on
+   memory, which are already part of the checkpoint. */
+
+struct node {
+  struct node *next;
+  char payload[4096 + 128];
+};
+
+static long shared_total;
+
+static void *work(void *arg)
+{
+  long const iterations = *(long const *)arg;
+  struct node *list = NULL;
+
+  for (long i = 0; i < iterations; ++i) {
+    struct node *n = malloc(sizeof(*n));
+    if (!n)
+      exit(EXIT_FAILURE);
+    n->next = list;
+    memset(n->payload, (int)(i & 0x7F), sizeof(n->payload));
+    list = n;
+
+    if (i % 8 == 7) {
+      while (list) {
+        struct node *next = list->next;
+        shared_total += next ? next->payload[i % 4096] : 0;
+        free(list);
+        list = next;
+      }
+    }
+  }
+
+  while (list) {
+    struct node *next = list->next;
+    free(list);
+    list = next;
+  }
+
+  return NULL;
+}
+
+static long wait_for_worker(long iterations, char *buffer)
+{
+  long local = iterations * 2;
+  pthread_t worker;
+
+  memset(buffer, 'q', 64);
+  shared_total = local;
+
+  if (pthread_create(&worker, NULL, work, &iterations))
+    exit(EXIT_FAILURE);
+
+  pthread_join(worker, NULL);
+
+  local += buffer[10];
+  buffer[20] = 'r';
+  return local + shared_total;
+}
+
+int main(int argc, char *argv[])
+{
+  long iterations = 1000;
+  if (argc > 1)
+    iterations = atol(argv[1]);
+
+  char *buffer = malloc(64);
+  if (!buffer)
+    exit(EXIT_FAILURE);
+
+  long const total = wait_for_worker(iterations, buffer);
+  printf("%ld %c\n", total, buffer[20]);
+
+  free(buffer);
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Computes values that minimal recording recomputes during replay: chains of
+   arithmetic ending at a store or branch, floating point comparisons with
+   every ordering (including unordered NaN operands), and conversions from
+   floating point to signed and unsigned integers. */
+
+static int compare(double a, double b)
+{
+  int result = 0;
+  result = result * 2 + (a == b);
+  result = result * 2 + (a != b);
+  result = result * 2 + (a < b);
+  result = result * 2 + (a <= b);
+  result = result * 2 + (a > b);
+  result = result * 2 + (a >= b);
+  result = result * 2 + !(a < b);
+  result = result * 2 + !(a >= b);
+  result = result * 2 + __builtin_isunordered(a, b);
+  result = result * 2 + __builtin_islessgreater(a, b);
+  return result;
+}
+
+static long convert(double d, float f)
+{
+  long total = (long)d + 1;
+  total += (int)f * 3;
+  total += (long)((unsigned)(d * d) % 1000u);
+  total += (long)((unsigned char)f + 1u);
+  return total;
+}
+
+int main(int argc, char *argv[])
+{
+  long count = 20;
+  if (argc > 1)
+    count = atol(argv[1]);
+
+  double const values[] = { -2.75, -0.5, 0.0, 0.5, 1.0, 3.25, NAN };
+  int const n = sizeof(values) / sizeof(values[0]);
+  long total = 0;
+
+  for (long i = 0; i < count; ++i) {
+    double a = values[i % n];
+    double b = values[(i * 3 + 1) % n];
+    total += compare(a, b);
+
+    if (!isnan(a))
+      total += convert(a * 7.5 - 1.0, (float)(i % 16) * 0.75f + 2.0f);
+
+    int x = (int)(i % 10) * 5 - 13;
+    int y = x * x + 3;
+    if (y - (y >> 2) > 20)
+      total ^= x & 0xff;
+  }
+
+  printf("%ld\n", total);
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Generates enough events to drop segments from a small flight-recorder ring,
+   then terminates itself. The trace must still be readable, and its retained
+   checkpoint must recreate the dynamic memory (including its allocators) and
+   the large initialized ranges. */
+
+struct node {
+  struct node *next;
+  char payload[4096 + 128];
+};
+
+static struct node *push(struct node *list, int value)
+{
+  struct node *n = malloc(sizeof(*n));
+  if (!n)
+    exit(EXIT_FAILURE);
+  n->next = list;
+  memset(n->payload, value, sizeof(n->payload));
+  return n;
+}
+
+static void free_all(struct node *list)
+{
+  while (list) {
+    struct node *next = list->next;
+    free(list);
+    list = next;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  long iterations = 1000;
+  if (argc > 1)
+    iterations = atol(argv[1]);
+
+  struct node *list = NULL;
+
+  for (long i = 0; ; ++i) {
+    list = push(list, (int)(i & 0x7F));
+
+    if (i % 8 == 7) {
+      free_all(list);
+      list = NULL;
+    }
+
+    /* The signal is noticed when the tracer next polls for signals. */
+    if (i == iterations)
+      kill(getpid(), SIGTERM);
+  }
+
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Loads values of each recorded type and uses them in arithmetic, in
+   short-circuit conditions and conditional expressions (which produce PHI
+   nodes), and around intercepted calls. Enough values are updated to fill
+   the inline record buffer several times. */
+
+static long mix(char const *text, long count)
+{
+  char c = 0;
+  short s = 0;
+  int i = 0;
+  long l = 0;
+  float f = 0;
+  double d = 0;
+
+  for (long n = 0; n < count; ++n) {
+    c = text[n % 7];
+    s = (short)((s + c) % 1000);
+    i = (n & 1) && c > 'b' ? i + s : i - 1;
+    l = (l || n) ? (l * 3 + i) % 100003 : 7;
+    f = f * 0.5f + (float)c;
+    d = (n % 3 == 0 || f > 150.0f) ? d + f : d - 0.25;
+
+    int big = c > 'c' && s > 100;
+    if (strlen(text + n % 7) > 3 || big)
+      ++l;
+  }
+
+  return l + (long)d + (long)f;
+}
+
+int main(int argc, char *argv[])
+{
+  long count = 100;
+  if (argc > 1)
+    count = atol(argv[1]);
+
+  char text[] = "abcdefgh";
+  printf("%ld\n", mix(text, count));
+  return 0;
+}
@@ -13,11 +13,14 @@
 
 #include "seec/Transforms/RecordExternal/RecordExternal.hpp"
 #include "seec/Util/Resources.hpp"
+#include "seec/Util/WorkerPool.hpp"
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/BinaryFormat/Magic.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/CodeGen/LinkAllAsmWriterComponents.h"
 #include "llvm/CodeGen/LinkAllCodegenComponents.h"
 #include "llvm/IR/DataLayout.h"
@@ -41,8 +44,13 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 
+#include <functional>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <cstdlib>
 #include <unistd.h>
@@ -111,8 +119,15 @@ static bool Instrument(char const *ProgramName, llvm::Module &Module)
   auto const Path = llvm::sys::fs::getMainExecutable(ProgramName, P);
   auto const ResourcePath = seec::getResourceDirectory(Path);
 
-  // Add SeeC's recording instrumentation pass
-  auto const Pass = new llvm::InsertExternalRecording(ResourcePath);
+  // Add SeeC's recording instrumentation pass. Value updates are recorded
+  // inline if SEEC_INLINE_RECORDING is set, and values that can be recomputed
+  // during replay are not recorded if SEEC_MINIMAL_RECORDING is set.
+  auto const InlineRecording = std::getenv("SEEC_INLINE_RECORDING") != nullptr;
+  auto const MinimalRecording =
+    std::getenv("SEEC_MINIMAL_RECORDING") != nullptr;
+  auto const Pass = new llvm::InsertExternalRecording(ResourcePath,
+                                                      InlineRecording,
+                                                      MinimalRecording);
   Passes.add(Pass);
 
   // Verify the final module
@@ -166,22 +181,32 @@ GetTemporaryObjectStream(char const *ProgramName, llvm::SmallString<256> &Path)
   return Out;
 }
 
-static std::unique_ptr<llvm::ToolOutputFile>
-Compile(char const *ProgramName,
-        llvm::Module &Module,
-        llvm::SmallString<256> &TempObjPath)
+static llvm::Triple GetTriple(llvm::Module const &Module)
 {
   auto Triple = llvm::Triple(Module.getTargetTriple());
   if (Triple.getTriple().empty())
     Triple.setTriple(llvm::sys::getDefaultTargetTriple());
+  return Triple;
+}
+
+/// \brief Generate object code for a Module.
+///
+/// This may be called concurrently for Modules in different LLVMContexts, so
+/// it reports errors rather than exiting.
+///
+/// \return true if the object code was generated, otherwise false with a
+///         description of the error in ErrorMessage.
+///
+static bool Compile(llvm::Module &Module,
+                    llvm::raw_pwrite_stream &Out,
+                    std::string &ErrorMessage)
+{
+  auto const Triple = GetTriple(Module);
   
-  std::string ErrorMessage;
   auto const Target = llvm::TargetRegistry::lookupTarget(Triple.getTriple(),
                                                          ErrorMessage);
-  if (!Target) {
-    llvm::errs() << ProgramName << ": " << ErrorMessage << "\n";
-    exit(EXIT_FAILURE);
-  }
+  if (!Target)
+    return false;
   
   // Target machine options.
   llvm::TargetOptions Options;
@@ -198,27 +223,133 @@ Compile(char const *ProgramName,
   
   assert(Machine && "Could not allocate target machine!");
   
-  // Get an output file for the object.
-  auto Out = GetTemporaryObjectStream(ProgramName, TempObjPath);
-  
   // Setup all of the passes for the codegen.
   llvm::legacy::PassManager Passes;
   
   llvm::TargetLibraryInfoImpl TLII(Triple);
   Passes.add(new llvm::TargetLibraryInfoWrapperPass(TLII));
   
-  llvm::raw_pwrite_stream *FOS(&Out->os());
-  
   if (Machine->addPassesToEmitFile(Passes,
-                                   *FOS,
+                                   Out,
                                    llvm::TargetMachine::CGFT_ObjectFile)) {
-    llvm::errs() << ProgramName << ": can't generate object file!\n";
-    exit(EXIT_FAILURE);
+    ErrorMessage = "can't generate object file!";
+    return false;
   }
   
   Passes.run(Module);
+  return true;
+}
+
+/// \brief Get the number of threads to use for code generation.
+///
+/// This is SEEC_LD_THREADS if it is set, or the number of cores otherwise.
+///
+static unsigned GetCodegenThreads()
+{
+  if (auto const Threads = std::getenv("SEEC_LD_THREADS")) {
+    auto const Value = std::atoi(Threads);
+    if (Value > 0)
+      return static_cast<unsigned>(Value);
+  }
   
-  return Out;
+  auto const Cores = std::thread::hardware_concurrency();
+  return Cores ? Cores : 1;
+}
+
+/// \brief Generate object code for the instrumented Module.
+///
+/// The Module is split into one partition per codegen thread, and the
+/// partitions are compiled concurrently.
+///
+/// \param TempObjs receives the temporary files, which must be kept until
+///        linking is complete.
+/// \return the paths of all object files.
+///
+static std::vector<std::string>
+CompileAll(char const *ProgramName,
+           std::unique_ptr<llvm::Module> Module,
+           std::vector<std::unique_ptr<llvm::ToolOutputFile>> &TempObjs)
+{
+  auto const Threads = GetCodegenThreads();
+  
+  std::vector<std::string> ObjectPaths;
+  
+  // There is nothing to gain from splitting for one thread.
+  if (Threads == 1) {
+    llvm::SmallString<256> Path;
+    TempObjs.emplace_back(GetTemporaryObjectStream(ProgramName, Path));
+    
+    std::string ErrorMessage;
+    if (!Compile(*Module, TempObjs.back()->os(), ErrorMessage)) {
+      llvm::errs() << ProgramName << ": " << ErrorMessage << "\n";
+      exit(EXIT_FAILURE);
+    }
+    
+    TempObjs.back()->os().close();
+    ObjectPaths.emplace_back(Path.str());
+    return ObjectPaths;
+  }
+  
+  // Each partition is compiled in its own LLVMContext, so the partitions are
+  // passed to the codegen threads as bitcode.
+  std::vector<llvm::SmallString<0>> Partitions;
+  
+  llvm::SplitModule(std::move(Module), Threads,
+                    [&] (std::unique_ptr<llvm::Module> Part) {
+                      Partitions.emplace_back();
+                      llvm::raw_svector_ostream BCOS(Partitions.back());
+                      llvm::WriteBitcodeToFile(Part.get(), BCOS);
+                    });
+  
+  // Create an output for each partition. The tasks can't exit while other
+  // threads are running, so each records its error message instead.
+  std::vector<std::function<void ()>> Tasks;
+  std::vector<std::string> Errors(Partitions.size());
+  
+  for (std::size_t i = 0; i < Partitions.size(); ++i) {
+    llvm::SmallString<256> Path;
+    TempObjs.emplace_back(GetTemporaryObjectStream(ProgramName, Path));
+    ObjectPaths.emplace_back(Path.str());
+    
+    auto &Bitcode = Partitions[i];
+    auto &Out = TempObjs.back()->os();
+    auto &Error = Errors[i];
+    
+    Tasks.emplace_back([&Bitcode, &Out, &Error] () {
+      llvm::LLVMContext PartContext;
+      
+      auto MaybePart =
+        llvm::parseBitcodeFile(llvm::MemoryBufferRef(Bitcode.str(),
+                                                     "seec-ld-partition"),
+                               PartContext);
+      if (!MaybePart) {
+        Error = "couldn't read partition: "
+                + llvm::toString(MaybePart.takeError());
+        return;
+      }
+      
+      if (Compile(**MaybePart, Out, Error))
+        Out.close();
+    });
+  }
+  
+  seec::WorkerPool Pool;
+  Pool.run(std::move(Tasks));
+  
+  // Report errors now that all of the codegen threads have finished.
+  bool Failed = false;
+  
+  for (auto const &Error : Errors) {
+    if (!Error.empty()) {
+      llvm::errs() << ProgramName << ": " << Error << "\n";
+      Failed = true;
+    }
+  }
+  
+  if (Failed)
+    exit(EXIT_FAILURE);
+  
+  return ObjectPaths;
 }
 
 static bool MaybeModule(char const *File)
@@ -310,20 +441,25 @@ int main(int argc, char **argv)
     ForwardArgs.push_back(argv[i]);
   }
   
-  llvm::SmallString<256> TempObjPath;
-  std::unique_ptr<llvm::ToolOutputFile> TempObj;
+  std::vector<std::unique_ptr<llvm::ToolOutputFile>> TempObjs;
+  std::vector<std::string> ObjectPaths;
   
   if (Composite) {
     // Instrument the linked Module, if it exists.
     Instrument(argv[0], *Composite);
     
-    // Codegen this Module to an object format and write it to a temporary file.
-    TempObj = Compile(argv[0], *Composite, TempObjPath);
-    TempObj->os().close();
+    // Codegen this Module to object files. The Linker refers to the Module,
+    // so release it first.
+    Linker.reset();
+    ObjectPaths = CompileAll(argv[0], std::move(Composite), TempObjs);
+    
+    // Insert the object files' paths into the forwarding arguments.
+    std::vector<char const *> ObjectArgs;
+    for (auto const &Path : ObjectPaths)
+      ObjectArgs.push_back(Path.c_str());
     
-    // Insert the temporary file's path into the forwarding arguments.
     ForwardArgs.insert(ForwardArgs.begin() + InsertCompositePathAt,
-                       TempObjPath.c_str());
+                       ObjectArgs.begin(), ObjectArgs.end());
   }
   else {
     llvm::errs() << argv[0] << ": didn't find any llvm modules.\n";
@@ -84,6 +84,8 @@ namespace seec {
     extern cl::opt<bool> OnlinePythonTutor;
 
     extern cl::opt<bool> ReverseStates;
+
+    extern cl::opt<bool> TestCache;
   }
 }
 
@@ -193,6 +195,64 @@ void PrintClangMappedStates(seec::cm::ProcessTrace const &Trace,
   }
 }
 
+/// \brief Check that updating the cached information of a mapped state after
+///        each movement gives the same printed state as clearing it.
+///
+/// Both states are moved in the same way, forward through the whole trace and
+/// then backward to the start. Only the first state keeps its cache between
+/// movements, so its Values must be invalidated correctly.
+///
+void
+TestClangMappedCacheUpdate(seec::cm::ProcessTrace const &Trace,
+                           seec::AugmentationCollection const &Augmentations)
+{
+  seec::cm::ProcessState Updated(Trace);
+  seec::cm::ProcessState Cleared(Trace);
+
+  seec::util::IndentationGuide Indent("  ");
+  auto Augmenter = Augmentations.getCallbackFn();
+  std::size_t Steps = 0;
+
+  auto const Describe = [&] (seec::cm::ProcessState const &State) {
+    std::string Description;
+    llvm::raw_string_ostream Stream {Description};
+    State.print(Stream, Indent, Augmenter);
+    Stream.flush();
+    return Description;
+  };
+
+  auto const Check = [&] (char const *Direction) {
+    Cleared.cacheClear();
+
+    auto const UpdatedDescription = Describe(Updated);
+    auto const ClearedDescription = Describe(Cleared);
+
+    if (UpdatedDescription != ClearedDescription) {
+      llvm::errs() << "after " << Steps << " steps (moving " << Direction
+                   << ") the updated state:\n" << UpdatedDescription
+                   << "\ndiffers from the cleared state:\n"
+                   << ClearedDescription << "\n";
+      exit(EXIT_FAILURE);
+    }
+  };
+
+  Check("forward");
+
+  while (moveForwardOneStep(Updated) != seec::cm::MovementResult::Unmoved) {
+    moveForwardOneStep(Cleared);
+    ++Steps;
+    Check("forward");
+  }
+
+  while (moveBackwardOneStep(Updated) != seec::cm::MovementResult::Unmoved) {
+    moveBackwardOneStep(Cleared);
+    ++Steps;
+    Check("backward");
+  }
+
+  llvm::outs() << "cache updates: " << Steps << "\n";
+}
+
 void PrintClangMapped(seec::AugmentationCollection const &Augmentations,
                       llvm::StringRef OPTVariableName)
 {
@@ -220,7 +280,10 @@ void PrintClangMapped(seec::AugmentationCollection const &Augmentations,
 
   auto CMProcessTrace = CMProcessTraceLoad.move<0>();
 
-  if (ShowStates) {
+  if (TestCache) {
+    TestClangMappedCacheUpdate(*CMProcessTrace, Augmentations);
+  }
+  else if (ShowStates) {
     PrintClangMappedStates(*CMProcessTrace, Augmentations);
   }
   else if (OnlinePythonTutor) {
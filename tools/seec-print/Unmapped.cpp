@@ -20,6 +20,7 @@
 #include "seec/ICU/Resources.hpp"
 #include "seec/RuntimeErrors/RuntimeErrors.hpp"
 #include "seec/RuntimeErrors/UnicodeFormatter.hpp"
+#include "seec/Trace/AllocationLifetimeTable.hpp"
 #include "seec/Trace/ProcessState.hpp"
 #include "seec/Trace/StateMovement.hpp"
 #include "seec/Trace/TraceFormat.hpp"
@@ -42,6 +43,7 @@
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
@@ -53,7 +55,10 @@
 
 #include "Unmapped.hpp"
 
+#include <algorithm>
 #include <array>
+#include <functional>
+#include <map>
 #include <memory>
 #include <system_error>
 #include <type_traits>
@@ -86,6 +91,14 @@ namespace seec {
     extern cl::opt<bool> Quiet;
 
     extern cl::opt<bool> TestMovement;
+
+    extern cl::opt<bool> TestSeek;
+
+    extern cl::opt<bool> TestReverse;
+
+    extern cl::opt<bool> TestMemoryChanges;
+
+    extern cl::opt<bool> TestAllocations;
   }
 }
 
@@ -105,6 +118,457 @@ void PrintUnmappedState(seec::trace::ProcessState const &State)
   }
 }
 
+/// \brief Describe the contents of State's memory (the value of each
+///        initialized byte in each allocation).
+///
+static void DescribeMemoryContents(llvm::raw_ostream &Out,
+                                   seec::trace::ProcessState const &State)
+{
+  for (auto const &Pair : State.getMemory().getAllocations()) {
+    auto const &Allocation = Pair.second;
+    auto const Area = seec::MemoryArea(Allocation.getAddress(),
+                                       Allocation.getSize());
+    auto const Data = Allocation.getAreaData(Area);
+    auto const Init = Allocation.getAreaInitialization(Area);
+
+    Out << " Allocation @" << Allocation.getAddress() << ":";
+    for (std::size_t i = 0; i < Data.size(); ++i) {
+      if (Init[i])
+        Out << llvm::format(" %02x", static_cast<unsigned char>(Data[i]));
+      else
+        Out << " --";
+    }
+    Out << "\n";
+  }
+}
+
+/// \brief Get a hash of the complete description of State, including the
+///        contents of its memory.
+///
+static std::size_t HashCompleteState(seec::trace::ProcessState const &State)
+{
+  std::string Description;
+
+  {
+    llvm::raw_string_ostream Out(Description);
+    Out << State;
+    DescribeMemoryContents(Out, State);
+  }
+
+  return std::hash<std::string>()(Description);
+}
+
+static std::size_t GreatestCommonDivisor(std::size_t A, std::size_t B)
+{
+  while (B) {
+    auto const Remainder = A % B;
+    A = B;
+    B = Remainder;
+  }
+  return A;
+}
+
+/// \brief Check that moving to process times (through snapshots) recreates
+///        the same states as stepping to them.
+///
+static void TestSeekingToProcessTimes(
+  std::shared_ptr<seec::trace::ProcessTrace> const &Trace,
+  std::shared_ptr<seec::ModuleIndex> const &ModIndexPtr)
+{
+  // Stepping forward reaches the first state at each process time, and
+  // stepping backward reaches the last state at each process time. Seeking
+  // must reach one of them, depending on the direction of its final
+  // movement.
+  std::map<uint64_t, std::pair<std::size_t, std::size_t>> Expected;
+
+  {
+    trace::ProcessState ProcState{Trace, ModIndexPtr};
+    Expected[ProcState.getProcessTime()].first = HashCompleteState(ProcState);
+
+    while (ProcState.getProcessTime() != Trace->getFinalProcessTime()) {
+      moveForward(ProcState);
+      Expected[ProcState.getProcessTime()].first = HashCompleteState(ProcState);
+    }
+
+    Expected[ProcState.getProcessTime()].second = HashCompleteState(ProcState);
+
+    while (ProcState.getProcessTime() != ProcState.getStartProcessTime()) {
+      moveBackward(ProcState);
+      Expected[ProcState.getProcessTime()].second =
+        HashCompleteState(ProcState);
+    }
+  }
+
+  std::vector<uint64_t> Times;
+  for (auto const &Pair : Expected)
+    Times.push_back(Pair.first);
+
+  // Use a small interval, so that most seeks restore a snapshot.
+  trace::ProcessState ProcState{Trace, ModIndexPtr};
+  ProcState.getSnapshots().setInterval(3);
+
+  auto const Check = [&] (uint64_t const Time) {
+    moveToProcessTime(ProcState, Time);
+
+    auto const &Hashes = Expected[Time];
+    auto const Hash = HashCompleteState(ProcState);
+
+    if (ProcState.getProcessTime() != Time
+        || (Hash != Hashes.first && Hash != Hashes.second))
+    {
+      llvm::errs() << "seeking to process time " << Time
+                   << " recreated a different state:\n" << ProcState << "\n";
+      exit(EXIT_FAILURE);
+    }
+  };
+
+  // Visit the process times in a jumbled order, moving both forward and
+  // backward, with and without snapshots.
+  auto const Count = Times.size();
+  std::size_t Stride = Count / 3 + 1;
+  while (Count > 1 && GreatestCommonDivisor(Stride, Count) != 1)
+    ++Stride;
+
+  for (std::size_t i = 0; i < Count; ++i)
+    Check(Times[(i * Stride) % Count]);
+
+  for (auto It = Times.rbegin(); It != Times.rend(); ++It)
+    Check(*It);
+
+  outs() << "seeks: " << (Count * 2) << "\n";
+}
+
+/// \brief Check that stepping each thread backward recreates the same states
+///        as stepping it forward.
+///
+static void TestReverseStepping(
+  std::shared_ptr<seec::trace::ProcessTrace> const &Trace,
+  std::shared_ptr<seec::ModuleIndex> const &ModIndexPtr)
+{
+  trace::ProcessState ProcState{Trace, ModIndexPtr};
+  std::size_t Steps = 0;
+
+  for (uint32_t ID = 1; ID <= ProcState.getThreadStateCount(); ++ID) {
+    auto &Thread = ProcState.getThreadState(ID);
+
+    std::vector<std::size_t> Hashes{HashCompleteState(ProcState)};
+    while (moveForward(Thread) == trace::MovementResult::PredicateSatisfied)
+      Hashes.push_back(HashCompleteState(ProcState));
+
+    while (Hashes.size() > 1) {
+      Hashes.pop_back();
+      ++Steps;
+
+      if (moveBackward(Thread) != trace::MovementResult::PredicateSatisfied
+          || HashCompleteState(ProcState) != Hashes.back())
+      {
+        llvm::errs() << "stepping thread " << ID
+                     << " backward recreated a different state:\n"
+                     << ProcState << "\n";
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  outs() << "reverse steps: " << Steps << "\n";
+}
+
+/// \brief Describe the memory state of Area in State (the initialization and
+///        value of each byte), or that Area is not allocated.
+///
+static std::string DescribeArea(seec::trace::ProcessState const &State,
+                                seec::MemoryArea const &Area)
+{
+  auto const Region = State.getMemory().getRegion(Area);
+  if (!Region.isAllocated())
+    return "unallocated";
+
+  std::string Description;
+
+  {
+    llvm::raw_string_ostream Out(Description);
+    auto const Init = Region.getByteInitialization();
+    auto const Data = Region.getByteValues();
+    for (std::size_t i = 0; i < Init.size(); ++i)
+      Out << llvm::format(" %02x:%02x",
+                          static_cast<unsigned char>(Init[i]),
+                          static_cast<unsigned char>(Init[i] & Data[i]));
+  }
+
+  return Description;
+}
+
+/// \brief Get every process time reached by stepping forward through Trace.
+///
+static std::vector<uint64_t> GetProcessTimes(
+  std::shared_ptr<seec::trace::ProcessTrace> const &Trace,
+  std::shared_ptr<seec::ModuleIndex> const &ModIndexPtr)
+{
+  std::vector<uint64_t> Times;
+
+  trace::ProcessState ProcState{Trace, ModIndexPtr};
+  Times.push_back(ProcState.getProcessTime());
+
+  while (ProcState.getProcessTime() != Trace->getFinalProcessTime()) {
+    moveForward(ProcState);
+    Times.push_back(ProcState.getProcessTime());
+  }
+
+  return Times;
+}
+
+/// \brief Recreate the first state at Time (or, if Last is true, the last
+///        state at Time) by stepping, without using snapshots or indexes.
+///
+/// States recreated in this way are identical, so they can be used as the
+/// starting points of movements that should be compared.
+///
+static std::unique_ptr<seec::trace::ProcessState> RecreateStateAt(
+  std::shared_ptr<seec::trace::ProcessTrace> const &Trace,
+  std::shared_ptr<seec::ModuleIndex> const &ModIndexPtr,
+  uint64_t const Time,
+  bool const Last = false)
+{
+  auto State = llvm::make_unique<trace::ProcessState>(Trace, ModIndexPtr);
+  auto const Target = Last && Time < Trace->getFinalProcessTime() ? Time + 1
+                                                                   : Time;
+
+  moveForwardUntil(*State, [=] (trace::ProcessState &P) {
+                             return P.getProcessTime() >= Target;
+                           });
+
+  if (State->getProcessTime() > Time)
+    moveBackwardUntil(*State, [=] (trace::ProcessState &P) {
+                                return P.getProcessTime() <= Time;
+                              });
+
+  return State;
+}
+
+/// \brief Check that moving until the memory in an area changes (using the
+///        MemoryChangeIndex) reaches the same process times as searching for
+///        the change by stepping.
+///
+static void TestMemoryChangeMovement(
+  std::shared_ptr<seec::trace::ProcessTrace> const &Trace,
+  std::shared_ptr<seec::ModuleIndex> const &ModIndexPtr)
+{
+  auto const Times = GetProcessTimes(Trace, ModIndexPtr);
+
+  auto const StateAt = [&] (uint64_t const Time) {
+    return RecreateStateAt(Trace, ModIndexPtr, Time);
+  };
+
+  std::size_t Checks = 0;
+
+  auto const Check = [&] (uint64_t const Time,
+                          seec::MemoryArea const &Area,
+                          bool const Forward)
+  {
+    auto const Indexed = StateAt(Time);
+    auto const Stepped = StateAt(Time);
+
+    auto const Initial = DescribeArea(*Stepped, Area);
+    auto const Changed = [&] (trace::ProcessState &P) {
+                           return DescribeArea(P, Area) != Initial;
+                         };
+
+    if (Forward) {
+      moveForwardUntilMemoryChanges(*Indexed, Area);
+      moveForwardUntil(*Stepped, Changed);
+    }
+    else {
+      moveBackwardUntilMemoryChanges(*Indexed, Area);
+      moveBackwardUntil(*Stepped, Changed);
+    }
+
+    ++Checks;
+
+    if (Indexed->getProcessTime() != Stepped->getProcessTime()
+        || Changed(*Indexed) != Changed(*Stepped))
+    {
+      llvm::errs() << "moving " << (Forward ? "forward" : "backward")
+                   << " from process time " << Time
+                   << " until the memory at " << Area.start()
+                   << " (" << Area.length() << " bytes) changes reached"
+                   << " process time " << Indexed->getProcessTime()
+                   << ", but stepping reached process time "
+                   << Stepped->getProcessTime() << "\n";
+      exit(EXIT_FAILURE);
+    }
+  };
+
+  // Check every allocation (and its first byte) at a limited number of
+  // evenly spaced process times.
+  std::size_t const MaximumSamples = 16;
+  auto const Stride = Times.size() / MaximumSamples + 1;
+
+  for (std::size_t i = 0; i < Times.size(); i += Stride) {
+    auto const Time = Times[i];
+
+    std::vector<seec::MemoryArea> Areas;
+
+    {
+      auto const State = StateAt(Time);
+      for (auto const &Pair : State->getMemory().getAllocations()) {
+        auto const &Allocation = Pair.second;
+        Areas.emplace_back(Allocation.getAddress(), Allocation.getSize());
+        if (Allocation.getSize() > 1)
+          Areas.emplace_back(Allocation.getAddress(), 1);
+      }
+    }
+
+    for (auto const &Area : Areas) {
+      Check(Time, Area, true);
+      Check(Time, Area, false);
+    }
+  }
+
+  outs() << "memory change movements: " << Checks << "\n";
+}
+
+/// \brief Check that the allocations in State are the allocations that the
+///        AllocationLifetimeTable says may exist at State's process time, and
+///        that the allocations that must exist do.
+///
+static void CheckLiveAllocations(seec::trace::ProcessState &State)
+{
+  auto const Time = State.getProcessTime();
+  auto const Live = State.getAllocationLifetimes().getLiveAt(Time);
+
+  auto const Fail = [&] (llvm::StringRef const Message,
+                         seec::MemoryArea const &Area)
+  {
+    llvm::errs() << "at process time " << Time << " the allocation at "
+                 << Area.start() << " (" << Area.length() << " bytes) "
+                 << Message << ":\n" << State << "\n";
+    exit(EXIT_FAILURE);
+  };
+
+  std::vector<seec::MemoryArea> Allocated;
+
+  for (auto const &Pair : State.getMemory().getAllocations()) {
+    auto const &Allocation = Pair.second;
+    if (State.isContainedByGlobalVariable(Allocation.getAddress()))
+      continue;
+
+    auto const Area = seec::MemoryArea(Allocation.getAddress(),
+                                       Allocation.getSize());
+    Allocated.push_back(Area);
+
+    auto const IsArea = [&] (seec::trace::AllocationLifetime const *L) {
+                          return L->getArea().start() == Area.start()
+                                 && L->getArea().length() == Area.length();
+                        };
+
+    if (std::none_of(Live.begin(), Live.end(), IsArea))
+      Fail("is not live in the allocation lifetime table", Area);
+  }
+
+  for (auto const Lifetime : Live) {
+    // Allocations that may be visible in some states at this process time,
+    // but not others, can't be checked.
+    if (Lifetime->getBirth().getLatest() > Time
+        || (Lifetime->hasDeath() && Lifetime->getDeath().getEarliest() <= Time))
+      continue;
+
+    auto const &Area = Lifetime->getArea();
+    auto const IsArea = [&] (seec::MemoryArea const &A) {
+                          return A.start() == Area.start()
+                                 && A.length() == Area.length();
+                        };
+
+    if (std::none_of(Allocated.begin(), Allocated.end(), IsArea))
+      Fail("is live in the allocation lifetime table but not allocated", Area);
+  }
+}
+
+/// \brief Check that moving to the allocation and deallocation of an area
+///        (using the AllocationLifetimeTable) reaches the same process times
+///        as searching for them by stepping, and check the table's live
+///        allocations.
+///
+static void TestAllocationMovement(
+  std::shared_ptr<seec::trace::ProcessTrace> const &Trace,
+  std::shared_ptr<seec::ModuleIndex> const &ModIndexPtr)
+{
+  auto const Times = GetProcessTimes(Trace, ModIndexPtr);
+  std::size_t Checks = 0;
+
+  auto const Check = [&] (uint64_t const Time,
+                          seec::trace::stateptr_ty const Address,
+                          bool const ToAllocation)
+  {
+    auto const Indexed = RecreateStateAt(Trace, ModIndexPtr, Time);
+    auto const Searched = RecreateStateAt(Trace, ModIndexPtr, Time);
+
+    if (ToAllocation) {
+      moveToAllocation(*Indexed, Address);
+      searchForAllocation(*Searched, Address);
+    }
+    else {
+      moveToDeallocation(*Indexed, Address);
+      searchForDeallocation(*Searched, Address);
+    }
+
+    ++Checks;
+
+    auto const IndexedArea = Indexed->getContainingMemoryArea(Address);
+    auto const SearchedArea = Searched->getContainingMemoryArea(Address);
+
+    if (Indexed->getProcessTime() != Searched->getProcessTime()
+        || IndexedArea.assigned() != SearchedArea.assigned()
+        || (IndexedArea.assigned()
+            && IndexedArea.get<seec::MemoryArea>()
+               != SearchedArea.get<seec::MemoryArea>()))
+    {
+      llvm::errs() << "moving from process time " << Time << " to the "
+                   << (ToAllocation ? "allocation" : "deallocation")
+                   << " of " << Address << " reached process time "
+                   << Indexed->getProcessTime()
+                   << ", but searching reached process time "
+                   << Searched->getProcessTime() << "\n";
+      exit(EXIT_FAILURE);
+    }
+  };
+
+  // Check the allocations (and the first and last byte of each) at a limited
+  // number of evenly spaced process times.
+  std::size_t const MaximumSamples = 16;
+  auto const Stride = Times.size() / MaximumSamples + 1;
+
+  for (std::size_t i = 0; i < Times.size(); i += Stride) {
+    auto const Time = Times[i];
+
+    std::vector<seec::trace::stateptr_ty> Addresses;
+
+    {
+      auto const First = RecreateStateAt(Trace, ModIndexPtr, Time);
+      CheckLiveAllocations(*First);
+
+      for (auto const &Pair : First->getMemory().getAllocations()) {
+        auto const &Allocation = Pair.second;
+        if (First->isContainedByGlobalVariable(Allocation.getAddress()))
+          continue;
+
+        Addresses.push_back(Allocation.getAddress());
+        if (Allocation.getSize() > 1)
+          Addresses.push_back(Allocation.getAddress() + Allocation.getSize()
+                              - 1);
+      }
+    }
+
+    CheckLiveAllocations(*RecreateStateAt(Trace, ModIndexPtr, Time, true));
+
+    for (auto const Address : Addresses) {
+      Check(Time, Address, true);
+      Check(Time, Address, false);
+    }
+  }
+
+  outs() << "allocation movements: " << Checks << "\n";
+}
+
 void PrintUnmapped(seec::AugmentationCollection const &Augmentations)
 {
   llvm::LLVMContext Context{};
@@ -213,17 +677,26 @@ void PrintUnmapped(seec::AugmentationCollection const &Augmentations)
     trace::ProcessState ProcState{Trace, ModIndexPtr};
     PrintUnmappedState(ProcState);
 
+    uint64_t Steps = 0;
+
     while (ProcState.getProcessTime() != Trace->getFinalProcessTime()) {
       moveForward(ProcState);
       PrintUnmappedState(ProcState);
+      ++Steps;
     }
 
     if (ReverseStates) {
       while (ProcState.getProcessTime() != 0) {
         moveBackward(ProcState);
         PrintUnmappedState(ProcState);
+        ++Steps;
       }
     }
+
+    // When timing, report the number of steps so that the cost of a single
+    // step can be calculated.
+    if (Quiet)
+      outs() << "steps: " << Steps << "\n";
   }
 
   // Test state movement only.
@@ -236,6 +709,22 @@ void PrintUnmapped(seec::AugmentationCollection const &Augmentations)
                       [] (trace::ProcessState const &) { return false; });
   }
 
+  // Test moving to process times through snapshots.
+  if (TestSeek)
+    TestSeekingToProcessTimes(Trace, ModIndexPtr);
+
+  // Test stepping backward through the states recreated by stepping forward.
+  if (TestReverse)
+    TestReverseStepping(Trace, ModIndexPtr);
+
+  // Test indexed movement to memory changes against searching by stepping.
+  if (TestMemoryChanges)
+    TestMemoryChangeMovement(Trace, ModIndexPtr);
+
+  // Test movement to allocations and deallocations against searching.
+  if (TestAllocations)
+    TestAllocationMovement(Trace, ModIndexPtr);
+
   // Print basic descriptions of all run-time errors.
   if (ShowErrors) {
     // Setup diagnostics printing for Clang diagnostics.
@@ -105,6 +105,21 @@ namespace seec {
 
     cl::opt<bool>
     TestMovement("test-movement", cl::desc("test movement only"));
+
+    cl::opt<bool>
+    TestSeek("test-seek", cl::desc("test that seeking through snapshots matches stepping"));
+
+    cl::opt<bool>
+    TestReverse("test-reverse", cl::desc("test that stepping backward matches stepping forward"));
+
+    cl::opt<bool>
+    TestMemoryChanges("test-memory-changes", cl::desc("test that indexed movement to memory changes matches stepping"));
+
+    cl::opt<bool>
+    TestAllocations("test-allocations", cl::desc("test that indexed movement to allocations matches searching"));
+
+    cl::opt<bool>
+    TestCache("test-cache", cl::desc("test that updating mapped states' cached values matches clearing them"));
   }
 }
 
@@ -157,7 +172,7 @@ int main(int argc, char **argv, char * const *envp) {
   Augmentations.loadFromResources(ResourcePath);
   Augmentations.loadFromUserLocalDataDir();
 
-  if (UseClangMapping || OnlinePythonTutor) {
+  if (UseClangMapping || OnlinePythonTutor || TestCache) {
     PrintClangMapped(Augmentations, OPTVariableName);
   }
   else {